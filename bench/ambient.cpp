@@ -0,0 +1,282 @@
+// Automatic brightness check: reads fake IIO sysfs trees, lux files and
+// recordings, and replays half an hour of noisy ambient light through
+// AutoBrightness into a FakeDisplayBackend with one DDC/CI monitor and one
+// without. Verifies that
+//
+//   - the IIO, file and replay sources read what they should;
+//   - the filter ignores a single-sample spike and settles on a step change;
+//   - the curve interpolates in log lux and is flat beyond its ends;
+//   - sensor noise and spikes cause no updates, updates are never closer
+//     together than the rate limit, and both monitors end where the curve
+//     puts them;
+//   - a per-monitor curve overrides the default;
+//   - monitors skipped while the DDC/CI probe runs are set by the next
+//     sample at the same light level.
+//
+// Also reports how many DDC/CI writes the same recording costs when every
+// sample is mapped straight onto the monitor. Exits non-zero on a failed check.
+//
+// Usage: bench_ambient [minutes]
+
+#include "ambient.h"
+#include "benchcheck.h"
+#include "benchdesk.h"
+#include "brightness.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <system_error>
+#include <vector>
+
+namespace
+{
+  using Clock = std::chrono::steady_clock;
+  using std::chrono::milliseconds;
+  using std::chrono::seconds;
+  using BenchCheck::Check;
+
+  void WriteFile(const std::filesystem::path &path, const char *text)
+  {
+    std::ofstream(path) << text;
+  }
+
+  bool Near(double a, double b, double tolerance)
+  {
+    return std::fabs(a - b) <= tolerance;
+  }
+
+  void SourceChecks(const std::filesystem::path &directory)
+  {
+    std::printf("Sources\n");
+    std::error_code ec;
+    std::filesystem::path iio = directory / "iio";
+    std::filesystem::create_directories(iio / "iio:device1", ec); // An accelerometer
+    std::filesystem::create_directories(iio / "iio:device3", ec);
+    std::filesystem::create_directories(iio / "iio:device7", ec);
+    WriteFile(iio / "iio:device1" / "in_accel_x_raw", "12\n");
+    WriteFile(iio / "iio:device3" / "in_illuminance_raw", "240\n");
+    WriteFile(iio / "iio:device3" / "in_illuminance_scale", "0.500000\n");
+    WriteFile(iio / "iio:device3" / "in_illuminance_offset", "-40\n");
+    WriteFile(iio / "iio:device7" / "in_illuminance_input", "9\n");
+
+    Clock::time_point now = Clock::now();
+    double lux = 0.0;
+    std::unique_ptr<IioAmbientSource> sensor = IioAmbientSource::Find(iio);
+    Check(sensor && sensor->Read(now, lux) && Near(lux, 100.0, 1e-9), "IIO: first light sensor, raw scaled and offset");
+    WriteFile(iio / "iio:device3" / "in_illuminance_input", "123.4\n");
+    Check(sensor && sensor->Read(now, lux) && Near(lux, 123.4, 1e-9), "IIO: processed lux preferred");
+    Check(!IioAmbientSource::Find(directory / "missing"), "IIO: no devices, no source");
+
+    FileAmbientSource file(directory / "lux.txt");
+    Check(!file.Read(now, lux), "file: missing file, no reading");
+    WriteFile(directory / "lux.txt", "  312.5\n");
+    Check(file.Read(now, lux) && Near(lux, 312.5, 1e-9), "file: first number read");
+
+    WriteFile(directory / "replay.txt", "# ms lux\n0 50\n\n1000 60\n2500 700\n");
+    std::vector<ReplayAmbientSource::Reading> readings;
+    bool loaded = ReplayAmbientSource::Load(directory / "replay.txt", readings) && readings.size() == 3;
+    ReplayAmbientSource replay(readings);
+    double a = 0.0, b = 0.0, c = 0.0, d = 0.0;
+    bool played = replay.Read(now, a) && replay.Read(now + milliseconds(1999), b) &&
+                  replay.Read(now + milliseconds(2500), c) && replay.Read(now + seconds(60), d);
+    Check(loaded && played && a == 50 && b == 60 && c == 700 && d == 700 && replay.Finished(now + seconds(60)),
+          "replay: readings follow the clock, the last one held");
+    WriteFile(directory / "bad.txt", "0 50\n1000 sixty\n");
+    Check(!ReplayAmbientSource::Load(directory / "bad.txt", readings), "replay: malformed recording rejected");
+  }
+
+  void FilterChecks()
+  {
+    std::printf("Filter\n");
+    Clock::time_point t = Clock::now();
+    LuxFilter filter;
+    for (int i = 0; i < 10; ++i)
+      filter.Add(i == 6 ? 20000.0 : 100.0, t + seconds(i));
+    Check(Near(filter.Lux(), 100.0, 1e-6), "a single-sample spike is thrown out");
+
+    LuxFilter step;
+    LuxFilter::Options options;
+    step.Add(10.0, t);
+    int settled = -1;
+    for (int i = 1; i <= 60 && settled < 0; ++i)
+      if (Near(step.Add(1000.0, t + seconds(i)), 1000.0, 20.0))
+        settled = i;
+    std::printf("  10 -> 1000 lux settled within 2%% after %d s (time constant %lld ms)\n", settled,
+                static_cast<long long>(options.timeConstant.count()));
+    Check(settled > 0 && settled <= 30, "settles on a step change");
+  }
+
+  void CurveChecks()
+  {
+    std::printf("Curve\n");
+    AmbientCurve curve = AmbientCurve::Default();
+    const auto &points = curve.Points();
+    AmbientCurvePoint dark = curve.Evaluate(0.0);
+    AmbientCurvePoint sun = curve.Evaluate(1e6);
+    Check(dark.hardware == points.front().hardware && sun.hardware == points.back().hardware,
+          "flat beyond the first and last points");
+
+    // Halfway between 100 and 1000 lux in log10(1 + lux)
+    double middle = std::pow(10.0, (std::log10(101.0) + std::log10(1001.0)) / 2.0) - 1.0;
+    Check(curve.Evaluate(middle).hardware == (points[2].hardware + points[3].hardware) / 2,
+          "interpolated in log lux");
+
+    bool monotonic = true;
+    for (double lux = 1.0; lux < 20000.0; lux *= 1.1)
+      monotonic = monotonic && curve.Evaluate(lux * 1.1).hardware >= curve.Evaluate(lux).hardware;
+    Check(monotonic, "default curve never dims as light rises");
+    Check(AmbientUtils::SoftwareOnlyBrightness(dark) < dark.software &&
+              AmbientUtils::SoftwareOnlyBrightness(sun) == sun.software,
+          "software-only monitors take over the backlight's dimming");
+  }
+
+  // Office daylight, clouds, then evening lamp light, one reading a second,
+  // with sensor noise and the odd reflection.
+  std::vector<ReplayAmbientSource::Reading> Recording(int minutes)
+  {
+    std::vector<ReplayAmbientSource::Reading> readings;
+    uint32_t seed = 12345;
+    int total = minutes * 60;
+    for (int s = 0; s < total; ++s)
+    {
+      double base = s < total / 3 ? 300.0 : s < 2 * total / 3 ? 120.0 : 15.0;
+      seed = seed * 1664525u + 1013904223u;
+      double noise = 1.0 + 0.3 * ((seed >> 8) / 16777216.0 - 0.5); // +-15%
+      double lux = base * noise * (s % 97 == 50 ? 20.0 : 1.0);
+      readings.push_back({seconds(s), lux});
+    }
+    return readings;
+  }
+
+  using BenchDesk::Desk;
+
+  // DISPLAY1 has DDC/CI, DISPLAY2 does not
+  Desk MakeDesk()
+  {
+    Desk desk;
+    desk.AddDdc(milliseconds(2));
+    desk.Add();
+    desk.Install();
+    return desk;
+  }
+
+  void ReplayChecks(int minutes)
+  {
+    std::printf("Replay, %d minutes at 1 Hz\n", minutes);
+    std::vector<ReplayAmbientSource::Reading> readings = Recording(minutes);
+
+    // Every sample mapped straight onto the monitor
+    AmbientCurve curve = AmbientCurve::Default();
+    uint64_t naiveWrites = 0;
+    int last = -1;
+    for (const auto &reading : readings)
+    {
+      int hardware = curve.Evaluate(reading.lux).hardware;
+      naiveWrites += hardware != last;
+      last = hardware;
+    }
+
+    Desk desk = MakeDesk();
+    AutoBrightness::Options options;
+    AutoBrightness autoBrightness(std::make_unique<ReplayAmbientSource>(readings), options);
+    Clock::time_point start = Clock::now();
+    std::vector<Clock::time_point> updates;
+    for (size_t s = 0; s < readings.size(); ++s)
+    {
+      Clock::time_point now = start + seconds(s);
+      if (autoBrightness.Step(now))
+        updates.push_back(now);
+    }
+    AutoBrightness::Stats stats = autoBrightness.GetStats();
+    int software = BrightnessController::GetSoftwareBrightness(1);
+    BrightnessController::Cleanup(); // Flushes the worker
+
+    Clock::duration closest = Clock::duration::max();
+    for (size_t i = 1; i < updates.size(); ++i)
+      closest = std::min(closest, updates[i] - updates[i - 1]);
+    std::printf("  %llu samples: %llu updates, %llu DDC/CI writes (%llu landed), %llu gamma writes; "
+                "%llu within hysteresis, %llu rate limited\n",
+                static_cast<unsigned long long>(stats.samples), static_cast<unsigned long long>(stats.updates),
+                static_cast<unsigned long long>(stats.hardwareWrites),
+                static_cast<unsigned long long>(desk.ddc[0]->GetAcceptedWrites()),
+                static_cast<unsigned long long>(stats.softwareWrites),
+                static_cast<unsigned long long>(stats.withinHysteresis),
+                static_cast<unsigned long long>(stats.rateLimited));
+    std::printf("  per-sample mapping: %llu DDC/CI writes\n", static_cast<unsigned long long>(naiveWrites));
+
+    Check(stats.samples == readings.size() && stats.hardwareWrites <= 6 && stats.hardwareWrites * 10 < naiveWrites,
+          "noise and spikes cause no DDC/CI traffic");
+    Check(updates.size() <= 1 || closest >= options.minInterval, "updates no closer than the rate limit");
+
+    // The filter lags the noise a little, hence the extra point of slack
+    AmbientCurvePoint evening = curve.Evaluate(15.0);
+    Check(std::abs(static_cast<int>(desk.ddc[0]->GetCurrent()) - evening.hardware) <= options.minHardwareStep &&
+              std::abs(software - AmbientUtils::SoftwareOnlyBrightness(evening)) <= options.minSoftwareStep + 1,
+          "both monitors end on the curve");
+    SetDisplayBackend(nullptr);
+  }
+
+  void ControllerChecks()
+  {
+    std::printf("Controller\n");
+    Desk desk = MakeDesk();
+    AutoBrightness::Options options;
+    options.curves.emplace(L"\\\\.\\DISPLAY1", AmbientCurve({{0.0, 80, 100}}));
+    std::vector<ReplayAmbientSource::Reading> night = {{milliseconds(0), 2.0}};
+    AutoBrightness autoBrightness(std::make_unique<ReplayAmbientSource>(night), options);
+
+    Check(autoBrightness.Step(), "first reading applied at once");
+    AmbientCurvePoint point = options.curve.Evaluate(2.0);
+    Check(BrightnessController::GetHardwareBrightness(0) == 80 && BrightnessController::GetSoftwareBrightness(0) == 100,
+          "per-monitor curve overrides the default");
+    Check(BrightnessController::GetSoftwareBrightness(1) == AmbientUtils::SoftwareOnlyBrightness(point),
+          "monitor without DDC/CI dimmed through gamma");
+    Check(!autoBrightness.Step() && autoBrightness.GetStats().withinHysteresis == 1, "same light, nothing written");
+
+    autoBrightness.Reset();
+    BrightnessController::SetSoftwareBrightness(1, 100);
+    Check(autoBrightness.Step() && BrightnessController::GetSoftwareBrightness(1) < 100, "reset re-applies at once");
+
+    // Listed without the DDC/CI probe: skipped, then set once it is known
+    BrightnessController::RefreshOutputs();
+    BrightnessController::SetSoftwareBrightness(1, 100);
+    AutoBrightness early(std::make_unique<ReplayAmbientSource>(night), options);
+    bool skipped = BrightnessController::GetHardwareProbeState(0) == HardwareProbeState::Pending && !early.Step() &&
+                   BrightnessController::GetSoftwareBrightness(1) == 100;
+    desk.ddc[0]->SetBrightness(30);
+    BrightnessController::StartHardwareProbe();
+    BrightnessController::WaitForHardwareProbe();
+    Check(skipped && early.Step() && BrightnessController::GetHardwareBrightness(0) == 80 &&
+              BrightnessController::GetSoftwareBrightness(1) < 100,
+          "monitors still being probed are set by the next sample");
+
+    AutoBrightness blind(std::make_unique<FileAmbientSource>("/nonexistent/lux.txt"));
+    Check(!blind.Step() && blind.GetStats().readFailures == 1 && blind.GetLux() < 0, "no reading, no change");
+    BenchDesk::TearDown();
+  }
+}
+
+int main(int argc, char **argv)
+{
+  int minutes = argc > 1 ? std::max(3, std::atoi(argv[1])) : 30;
+
+  std::error_code ec;
+  std::filesystem::path directory = std::filesystem::temp_directory_path(ec) / "candela_bench_ambient";
+  std::filesystem::remove_all(directory, ec);
+  std::filesystem::create_directories(directory, ec);
+
+  SourceChecks(directory);
+  FilterChecks();
+  CurveChecks();
+  ReplayChecks(minutes);
+  ControllerChecks();
+
+  std::filesystem::remove_all(directory, ec);
+
+  return BenchCheck::Finish();
+}
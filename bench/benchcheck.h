@@ -0,0 +1,33 @@
+// Pass/fail reporting shared by the benchmarks that verify behaviour as well
+// as timing it: every Check prints one "ok" or "FAIL" line, and Finish turns
+// the failures into the process exit code.
+
+#pragma once
+#include <cstdio>
+
+namespace BenchCheck
+{
+  inline int &Failures()
+  {
+    static int failures = 0;
+    return failures;
+  }
+
+  inline void Check(bool ok, const char *what)
+  {
+    std::printf("  %-60s %s\n", what, ok ? "ok" : "FAIL");
+    if (!ok)
+      ++Failures();
+  }
+
+  // Returns main's exit code: 1 if any check failed.
+  inline int Finish()
+  {
+    if (Failures())
+    {
+      std::printf("FAIL: %d check(s) failed\n", Failures());
+      return 1;
+    }
+    return 0;
+  }
+}
@@ -0,0 +1,121 @@
+// Simulated desk shared by the benchmarks that drive BrightnessController:
+// a FakeDisplayBackend with DISPLAY1, DISPLAY2, ... and a SimulatedDdcMonitor
+// behind each output that has DDC/CI, plus the EDIDs that tell them apart.
+
+#pragma once
+#include "brightness.h"
+#include "colortemp.h"
+#include "ddcci.h"
+#include "ddcsim.h"
+#include "fakebackend.h"
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace BenchDesk
+{
+  inline std::wstring DisplayName(size_t number)
+  {
+    return L"\\\\.\\DISPLAY" + std::to_wstring(number);
+  }
+
+  // Minimal valid base EDID block: header, identity, one serial-string
+  // descriptor (0xFF) if given, checksum.
+  inline std::vector<uint8_t> MakeEdid(const char *manufacturer, uint16_t product, uint32_t serial,
+                                       const char *serialString = nullptr, uint8_t week = 1)
+  {
+    std::vector<uint8_t> edid(DdcCi::EDID_LENGTH, 0);
+    const uint8_t header[8] = {0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x00};
+    std::memcpy(edid.data(), header, sizeof(header));
+    uint16_t id = static_cast<uint16_t>(((manufacturer[0] - '@') << 10) | ((manufacturer[1] - '@') << 5) |
+                                        (manufacturer[2] - '@'));
+    edid[8] = static_cast<uint8_t>(id >> 8);
+    edid[9] = static_cast<uint8_t>(id & 0xFF);
+    edid[10] = static_cast<uint8_t>(product & 0xFF);
+    edid[11] = static_cast<uint8_t>(product >> 8);
+    for (int i = 0; i < 4; ++i)
+      edid[12 + i] = static_cast<uint8_t>(serial >> (8 * i));
+    edid[16] = week;
+    edid[17] = 30; // Year of manufacture - 1990
+    edid[18] = 1;
+    edid[19] = 4;
+    if (serialString)
+    {
+      uint8_t *descriptor = edid.data() + 54;
+      descriptor[3] = 0xFF;
+      size_t length = std::strlen(serialString);
+      for (size_t i = 0; i < 13; ++i)
+        descriptor[5 + i] = i < length ? static_cast<uint8_t>(serialString[i]) : (i == length ? 0x0A : 0x20);
+    }
+    uint8_t sum = 0;
+    for (size_t i = 0; i < DdcCi::EDID_LENGTH - 1; ++i)
+      sum = static_cast<uint8_t>(sum + edid[i]);
+    edid[DdcCi::EDID_LENGTH - 1] = static_cast<uint8_t>(0x100 - sum);
+    return edid;
+  }
+
+  struct Desk
+  {
+    std::shared_ptr<FakeDisplayBackend> backend = std::make_shared<FakeDisplayBackend>();
+    std::vector<OutputHandle> outputs;                     // In the order they were added
+    std::vector<std::shared_ptr<SimulatedDdcMonitor>> ddc; // Per output; nullptr: no DDC/CI
+
+    // Adds the next DISPLAYn, with @p monitor behind it.
+    OutputHandle Add(std::shared_ptr<SimulatedDdcMonitor> monitor = nullptr,
+                     int gammaSize = ColorTempUtils::GAMMA_RAMP_ENTRIES)
+    {
+      outputs.push_back(backend->AddOutput(DisplayName(outputs.size() + 1), monitor, gammaSize));
+      ddc.push_back(monitor);
+      return outputs.back();
+    }
+
+    // Adds the next DISPLAYn with a DDC/CI monitor that answers after @p latency.
+    std::shared_ptr<SimulatedDdcMonitor> AddDdc(std::chrono::milliseconds latency, uint32_t nativeMax = 100)
+    {
+      auto monitor = std::make_shared<SimulatedDdcMonitor>(0, nativeMax, latency);
+      Add(monitor);
+      return monitor;
+    }
+
+    // Hands the backend to BrightnessController without enumerating it.
+    void Attach() const
+    {
+      SetDisplayBackend(backend);
+    }
+
+    // Attaches the backend and enumerates every monitor, DDC/CI included.
+    void Install() const
+    {
+      Attach();
+      BrightnessController::RefreshMonitors();
+    }
+
+    // The ramp an output shows right now.
+    std::vector<uint16_t> Peek(size_t output) const
+    {
+      std::vector<uint16_t> ramp(static_cast<size_t>(backend->GetGammaSize(outputs[output])) * 3);
+      backend->PeekGammaRamp(outputs[output], ramp.data());
+      return ramp;
+    }
+
+    // Total DDC/CI commands every monitor on the desk has seen.
+    uint64_t DdcCommands() const
+    {
+      uint64_t total = 0;
+      for (const auto &monitor : ddc)
+        if (monitor)
+          total += monitor->GetCommandCount();
+      return total;
+    }
+  };
+
+  // Stops the controller's workers and detaches the backend.
+  inline void TearDown()
+  {
+    BrightnessController::Cleanup();
+    SetDisplayBackend(nullptr);
+  }
+}
@@ -0,0 +1,322 @@
+// One-shot command line check: parses candela --get/--set/--bw options, runs
+// them in-process against a FakeDisplayBackend whose outputs take a few
+// milliseconds to open and whose DDC/CI monitors are slow to answer, and
+// forwards them to a running ControlServer. Verifies that
+//
+//   - options translate into one control request, and bad ones are
+//     refused;
+//   - run in-process, a command opens only the monitors it names, probes
+//     DDC/CI only when it touches hardware brightness, keeps the saved
+//     levels it does not change and delivers hardware writes before
+//     returning; --get writes nothing and probes only for "hw"; B&W is
+//     refused;
+//   - with an instance running, the command is forwarded and opens
+//     nothing, and a --set is saved by the instance.
+//
+// Also times each way from start to values applied against the tray
+// application's path (every monitor opened and restored, then the change),
+// each the median of several runs. Exits non-zero on a failed check.
+//
+// Usage: bench_cli [monitors] [open-latency-ms] [ddc-latency-ms]
+
+#include "benchcheck.h"
+#include "benchdesk.h"
+#include "brightness.h"
+#include "cli.h"
+#include "control.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace
+{
+  using Clock = std::chrono::steady_clock;
+  using std::chrono::milliseconds;
+
+  const int RUNS = 5;
+
+  using BenchCheck::Check;
+
+  struct Levels
+  {
+    int software = 100;
+    int kelvin = 6500;
+    int hardware = -1;
+  };
+
+  // Stands in for the settings store: saved levels by monitor index
+  struct Saved
+  {
+    std::map<int, Levels> levels;
+    std::map<int, Levels> stored;
+
+    std::function<void(int)> Restore()
+    {
+      return [this](int index)
+      {
+        Levels saved = levels[index];
+        BrightnessController::SetSoftwareLevels(index, saved.software, saved.kelvin);
+      };
+    }
+
+    std::function<void(int)> Store()
+    {
+      return [this](int index)
+      {
+        Levels &levels = stored[index];
+        levels.software = BrightnessController::GetSoftwareBrightness(index);
+        levels.kelvin = BrightnessController::GetSoftwareColorTemp(index);
+        if (BrightnessController::GetHardwareProbeState(index) == HardwareProbeState::Available)
+          levels.hardware = BrightnessController::GetHardwareBrightness(index);
+      };
+    }
+  };
+
+  using BenchDesk::Desk;
+
+  // Every other monitor has DDC/CI. Nothing is enumerated: each run opens
+  // what it needs.
+  Desk MakeDesk(int monitors, milliseconds openLatency, milliseconds ddcLatency)
+  {
+    Desk desk;
+    desk.backend->SetOpenLatency(openLatency);
+    for (int i = 0; i < monitors; ++i)
+    {
+      if (i % 2 == 0)
+        desk.AddDdc(ddcLatency);
+      else
+        desk.Add();
+    }
+    desk.Attach();
+    return desk;
+  }
+
+  CliUtils::Command Parsed(const std::vector<std::string> &args)
+  {
+    CliUtils::Command command;
+    std::string error;
+    CliUtils::Parse(args, command, error);
+    return command;
+  }
+
+  void ParseChecks()
+  {
+    std::printf("Options\n");
+    CliUtils::Command command;
+    std::string error;
+    bool parsed = CliUtils::Parse({"--set", "1", "sw=40", "temp=3500", "--get", "1", "--timing"}, command, error);
+    Check(parsed && command.request == "set 1 sw=40 temp=3500; get 1; save" && command.monitors == std::set<int>{1} &&
+              !command.allMonitors && command.set && !command.hardware && command.timing,
+          "options become one request, saved");
+
+    command = Parsed({"--set", "*", "hw=30"});
+    Check(command.allMonitors && command.hardware && !command.filter && command.request == "set * hw=30; save",
+          "every monitor, hardware");
+    command = Parsed({"--set", "0", "sw=50"});
+    Check(!command.hardware && command.monitors == std::set<int>{0}, "software only needs no DDC/CI");
+    command = Parsed({"--get", "0"});
+    Check(!command.set && !command.hardware && command.request == "get 0", "get is read only, no DDC/CI");
+    command = Parsed({"--get", "hw"});
+    bool hardware = command.allMonitors && command.hardware && command.request == "get";
+    command = Parsed({"--get", "0", "hw"});
+    Check(hardware && command.hardware && command.request == "get 0", "get ... hw waits for DDC/CI");
+    command = Parsed({"--bw", "on"});
+    Check(command.filter && !command.set && command.request == "bw on", "filter");
+
+    const std::vector<std::vector<std::string>> bad = {
+        {"--set", "1"}, {"--set", "x", "sw=5"}, {"--get", "1", "2"}, {"--get", "hw", "1"}, {"--bw"}, {"--fly"}, {"--timing"}, {"--get", "a"}};
+    bool refused = true;
+    for (const std::vector<std::string> &args : bad)
+      refused = refused && !CliUtils::Parse(args, command, error) && !error.empty();
+    Check(refused, "bad options refused");
+    Check(!CliUtils::IsCommand({}) && CliUtils::IsCommand({"--get"}), "no options starts the tray application");
+    Check(CliUtils::ExitCode("monitor 0 sw=5\nok\n") == 0 && CliUtils::ExitCode("err no monitor 9\n") == 1 &&
+              CliUtils::ExitCode("") == 1,
+          "exit code from the status line");
+  }
+
+  void LocalChecks(int monitors, milliseconds openLatency, milliseconds ddcLatency)
+  {
+    std::printf("In-process, %d monitors\n", monitors);
+    Desk desk = MakeDesk(monitors, openLatency, ddcLatency);
+    Saved saved;
+    saved.levels[1] = {70, 4000, -1};
+
+    FakeDisplayBackend::Counters before = desk.backend->GetCounters();
+    std::string reply = CliUtils::Apply(Parsed({"--set", "1", "sw=40"}), saved.Restore(), saved.Store());
+    FakeDisplayBackend::Counters after = desk.backend->GetCounters();
+    Check(reply == "ok\n" && after.outputOpens - before.outputOpens == 1 && after.ddcOpens == before.ddcOpens &&
+              after.gammaFlushes - before.gammaFlushes == 1 && after.gammaWrites - before.gammaWrites <= 2,
+          "software set opens one monitor, no DDC/CI, one flush");
+    Check(saved.stored.size() == 1 && saved.stored[1].software == 40 && saved.stored[1].kelvin == 4000,
+          "levels not named keep their saved value");
+
+    before = after;
+    saved.stored.clear();
+    reply = CliUtils::Apply(Parsed({"--set", "2", "hw=30"}), saved.Restore(), saved.Store());
+    after = desk.backend->GetCounters();
+    Check(reply == "ok\n" && after.outputOpens - before.outputOpens == 1 && after.ddcOpens - before.ddcOpens == 1 &&
+              desk.ddc[2]->GetCurrent() == 30 && saved.stored[2].hardware == 30,
+          "hardware set probes one monitor, write delivered");
+
+    reply = CliUtils::Apply(Parsed({"--set", "1", "hw=30"}), saved.Restore(), saved.Store());
+    Check(CliUtils::ExitCode(reply) == 1, "hardware set without DDC/CI refused");
+
+    before = desk.backend->GetCounters();
+    reply = CliUtils::Apply(Parsed({"--bw", "on"}), saved.Restore(), saved.Store());
+    after = desk.backend->GetCounters();
+    Check(CliUtils::ExitCode(reply) == 1 && after.enumerations == before.enumerations, "B&W refused without an instance");
+
+    // Monitor 1 still shows the saved levels the last run put back
+    PhaseLog log;
+    saved.stored.clear();
+    before = desk.backend->GetCounters();
+    reply = CliUtils::Apply(Parsed({"--get"}), saved.Restore(), saved.Store(), &log);
+    after = desk.backend->GetCounters();
+    size_t lines = static_cast<size_t>(std::count(reply.begin(), reply.end(), '\n'));
+    Check(CliUtils::ExitCode(reply) == 0 && lines == static_cast<size_t>(monitors) + 2 &&
+              reply.find("monitor 1 sw=70 temp=4000 hw=pending") != std::string::npos && log.GetPhases().size() >= 3,
+          "get reports the levels the monitors show");
+    Check(after.gammaWrites == before.gammaWrites && after.gammaFlushes == before.gammaFlushes &&
+              after.ddcOpens == before.ddcOpens && saved.stored.empty(),
+          "get writes no gamma, probes no DDC/CI and saves nothing");
+
+    before = desk.backend->GetCounters();
+    reply = CliUtils::Apply(Parsed({"--get", "2", "hw"}), saved.Restore(), saved.Store());
+    after = desk.backend->GetCounters();
+    Check(CliUtils::ExitCode(reply) == 0 && reply.find("monitor 2 sw=") != std::string::npos &&
+              reply.find(" hw=30 ") != std::string::npos && after.ddcOpens - before.ddcOpens == 1,
+          "get ... hw probes the monitor it names");
+    SetDisplayBackend(nullptr);
+  }
+
+  double Median(std::vector<double> values)
+  {
+    std::sort(values.begin(), values.end());
+    return values[values.size() / 2];
+  }
+
+  // The tray application: every monitor opened and given its saved levels,
+  // then the change applied. A hardware change must wait for every monitor's
+  // probe.
+  double TrayPath(const CliUtils::Command &command, Saved &saved)
+  {
+    Clock::time_point start = Clock::now();
+    BrightnessController::RefreshOutputs();
+    size_t count = BrightnessController::GetMonitorCount();
+    BrightnessController::BeginUpdate();
+    for (size_t i = 0; i < count; ++i)
+      saved.Restore()(static_cast<int>(i));
+    BrightnessController::EndUpdate();
+    if (command.hardware)
+    {
+      BrightnessController::StartHardwareProbe();
+      BrightnessController::WaitForHardwareProbe();
+    }
+    ControlServer().Execute(command.request);
+    double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    BrightnessController::Cleanup();
+    return ms;
+  }
+
+  // Start to applied, so not counting Cleanup's wait for DDC/CI writes
+  double OneShotPath(const CliUtils::Command &command, Saved &saved)
+  {
+    PhaseLog log;
+    CliUtils::Apply(command, saved.Restore(), nullptr, &log);
+    double ms = 0;
+    for (const PhaseRecord &phase : log.GetPhases())
+      if (phase.name != "release")
+        ms = std::max(ms, phase.startMs + phase.durationMs);
+    return ms;
+  }
+
+  void TimingChecks(int monitors, milliseconds openLatency, milliseconds ddcLatency,
+                    const std::filesystem::path &endpoint)
+  {
+    std::printf("Start to applied, %d monitors, %lld ms to open, %lld ms per DDC/CI command\n", monitors,
+                static_cast<long long>(openLatency.count()), static_cast<long long>(ddcLatency.count()));
+    Desk desk = MakeDesk(monitors, openLatency, ddcLatency);
+    Saved saved;
+    const std::vector<std::string> cases[] = {{"--set", "0", "sw=40", "temp=3500"}, {"--set", "0", "hw=30"}};
+    for (const std::vector<std::string> &args : cases)
+    {
+      CliUtils::Command command = Parsed(args);
+      std::vector<double> tray, oneShot;
+      FakeDisplayBackend::Counters before = desk.backend->GetCounters();
+      for (int run = 0; run < RUNS; ++run)
+        tray.push_back(TrayPath(command, saved));
+      FakeDisplayBackend::Counters middle = desk.backend->GetCounters();
+      for (int run = 0; run < RUNS; ++run)
+        oneShot.push_back(OneShotPath(command, saved));
+      FakeDisplayBackend::Counters after = desk.backend->GetCounters();
+      uint64_t trayOpens = (middle.outputOpens - before.outputOpens + middle.ddcOpens - before.ddcOpens) / RUNS;
+      uint64_t oneShotOpens = (after.outputOpens - middle.outputOpens + after.ddcOpens - middle.ddcOpens) / RUNS;
+      std::printf("  %-28s tray %8.2f ms, %2llu opens; one-shot %8.2f ms, %2llu opens\n", command.request.c_str(),
+                  Median(tray), static_cast<unsigned long long>(trayOpens), Median(oneShot),
+                  static_cast<unsigned long long>(oneShotOpens));
+      // Probes run in parallel, so the time saved is mostly the tray's own
+      // setup, which this does not model; the work saved is the other monitors
+      Check(oneShotOpens < trayOpens && Median(oneShot) <= Median(tray) * 1.1 + 1.0,
+            command.hardware ? "one-shot hardware change: less work, no slower"
+                             : "one-shot software change: less work, no slower");
+    }
+
+    // Forwarded to a running instance, which has everything open already
+    BrightnessController::RefreshMonitors();
+    ControlServer::Options options;
+    options.endpoint = endpoint.string();
+    ControlServer server(options);
+    server.SetStoreHandler(saved.Store());
+    saved.stored.clear();
+    std::string reply;
+    Check(!CliUtils::Forward(Parsed({"--get"}), options.endpoint, reply) && reply.empty(),
+          "nothing to forward to without an instance");
+    server.Start();
+    FakeDisplayBackend::Counters before = desk.backend->GetCounters();
+    std::vector<double> forwarded;
+    bool ok = true;
+    for (int run = 0; run < RUNS; ++run)
+    {
+      Clock::time_point start = Clock::now();
+      ok = CliUtils::Forward(Parsed({"--set", "0", "sw=" + std::to_string(40 + run)}), options.endpoint, reply) &&
+           reply == "ok\n" && ok;
+      forwarded.push_back(std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+    }
+    FakeDisplayBackend::Counters after = desk.backend->GetCounters();
+    std::printf("  %-28s forwarded %.3f ms\n", "set 0 sw=N", Median(forwarded));
+    Check(ok && BrightnessController::GetSoftwareBrightness(0) == 40 + RUNS - 1 &&
+              after.outputOpens == before.outputOpens && after.ddcOpens == before.ddcOpens &&
+              after.enumerations == before.enumerations,
+          "forwarded: applied by the instance, nothing opened");
+    Check(saved.stored.size() == 1 && saved.stored[0].software == 40 + RUNS - 1,
+          "forwarded: saved by the instance, as in-process");
+    server.Stop();
+    BenchDesk::TearDown();
+  }
+}
+
+int main(int argc, char **argv)
+{
+  int monitors = argc > 1 ? std::max(1, std::atoi(argv[1])) : 4;
+  milliseconds openLatency(argc > 2 ? std::max(0, std::atoi(argv[2])) : 5);
+  milliseconds ddcLatency(argc > 3 ? std::max(0, std::atoi(argv[3])) : 40);
+  monitors = std::max(monitors, 3); // The checks use monitors 0 to 2
+
+  std::error_code ec;
+  std::filesystem::path endpoint = std::filesystem::temp_directory_path(ec) / "candela_bench_cli.sock";
+
+  ParseChecks();
+  LocalChecks(monitors, openLatency, ddcLatency);
+  TimingChecks(monitors, openLatency, ddcLatency, endpoint);
+
+  return BenchCheck::Finish();
+}
@@ -0,0 +1,268 @@
+// Colour effect pipeline check: builds ColorEffectStacks and drives BWFilter
+// against a FakeDisplayBackend, verifying that
+//
+//   - grayscale is exactly the matrix the B&W filter has always pushed, and
+//     the other effects do what they say to reference colours;
+//   - the cached product always equals multiplying every effect out afresh,
+//     and a frame of a fade rebuilds only from the fading effect onwards;
+//   - fades are eased, retarget without a jump, and end on the target;
+//   - BWFilter pushes a matrix only when the product changes, merges effects
+//     into one push, and fades through its frame scheduler.
+//
+// Also reports the cost of a fade frame against rebuilding the product from
+// scratch. Exits non-zero on a failed check.
+//
+// Usage: bench_coloreffects [frames]
+
+#include "benchcheck.h"
+#include "bwfilter.h"
+#include "coloreffects.h"
+#include "fakebackend.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+
+namespace
+{
+  using Clock = std::chrono::steady_clock;
+  using std::chrono::milliseconds;
+  using BenchCheck::Check;
+
+  bool Near(const float a[3], const float b[3], float tolerance)
+  {
+    for (int c = 0; c < 3; ++c)
+      if (std::fabs(a[c] - b[c]) > tolerance)
+        return false;
+    return true;
+  }
+
+  bool Near(const ColorMatrix &a, const ColorMatrix &b, float tolerance)
+  {
+    for (int r = 0; r < 5; ++r)
+      for (int c = 0; c < 5; ++c)
+        if (std::fabs(a.m[r][c] - b.m[r][c]) > tolerance)
+          return false;
+    return true;
+  }
+
+  float Distance(const float a[3], const float b[3])
+  {
+    return std::sqrt((a[0] - b[0]) * (a[0] - b[0]) + (a[1] - b[1]) * (a[1] - b[1]) + (a[2] - b[2]) * (a[2] - b[2]));
+  }
+
+  // Distance between the hues of two colours, brightness divided out
+  float HueDistance(const float a[3], const float b[3])
+  {
+    float sa = a[0] + a[1] + a[2], sb = b[0] + b[1] + b[2];
+    const float na[3] = {a[0] / sa, a[1] / sa, a[2] / sa}, nb[3] = {b[0] / sb, b[1] / sb, b[2] / sb};
+    return Distance(na, nb);
+  }
+
+  // The stack's product computed the slow way
+  ColorMatrix Reference(const ColorEffectStack &stack, double saturation)
+  {
+    ColorMatrix product = ColorMatrixUtils::Identity();
+    for (size_t i = 0; i < ColorEffectStack::EFFECT_COUNT; ++i)
+    {
+      ColorEffect effect = static_cast<ColorEffect>(i);
+      ColorMatrix layer = ColorMatrixUtils::Blend(ColorMatrixUtils::EffectMatrix(effect, saturation),
+                                                  stack.GetStrength(effect));
+      product = ColorMatrixUtils::Multiply(product, layer);
+    }
+    return product;
+  }
+
+  void MatrixChecks()
+  {
+    std::printf("Effects\n");
+    const ColorMatrix legacyGrayscale = {{
+        {0.299f, 0.299f, 0.299f, 0.0f, 0.0f},
+        {0.587f, 0.587f, 0.587f, 0.0f, 0.0f},
+        {0.114f, 0.114f, 0.114f, 0.0f, 0.0f},
+        {0.0f, 0.0f, 0.0f, 1.0f, 0.0f},
+        {0.0f, 0.0f, 0.0f, 0.0f, 1.0f},
+    }};
+    ColorMatrix gray = ColorMatrixUtils::EffectMatrix(ColorEffect::Grayscale);
+    Check(ColorMatrixUtils::Equal(gray, legacyGrayscale), "grayscale is the B&W filter's original matrix");
+
+    const float white[3] = {1, 1, 1}, black[3] = {0, 0, 0}, red[3] = {1, 0, 0}, green[3] = {0, 1, 0};
+    const float midGray[3] = {0.5f, 0.5f, 0.5f};
+    float out[3], out2[3];
+    ColorMatrixUtils::Apply(ColorMatrixUtils::EffectMatrix(ColorEffect::Invert), white, out);
+    ColorMatrixUtils::Apply(ColorMatrixUtils::EffectMatrix(ColorEffect::Invert), black, out2);
+    Check(Near(out, black, 1e-6f) && Near(out2, white, 1e-6f), "invert swaps black and white");
+
+    ColorMatrixUtils::Apply(ColorMatrixUtils::EffectMatrix(ColorEffect::Saturation, 1.0), red, out);
+    ColorMatrixUtils::Apply(ColorMatrixUtils::EffectMatrix(ColorEffect::Saturation, 2.0), red, out2);
+    Check(Near(out, red, 1e-6f) && out2[0] > 1.0f && out2[1] < 0.0f, "saturation 1 is a no-op, 2 pushes colours out");
+
+    ColorMatrixUtils::Apply(ColorMatrixUtils::EffectMatrix(ColorEffect::Sepia), white, out);
+    Check(out[0] > out[1] && out[1] > out[2], "sepia tints white towards brown");
+
+    bool simulated = true;
+    bool neutral = true;
+    for (ColorEffect effect : {ColorEffect::SimulateProtanopia, ColorEffect::SimulateDeuteranopia})
+    {
+      ColorMatrix simulate = ColorMatrixUtils::EffectMatrix(effect);
+      ColorMatrixUtils::Apply(simulate, red, out);
+      ColorMatrixUtils::Apply(simulate, green, out2);
+      simulated = simulated && HueDistance(out, out2) < 0.1f;
+    }
+    for (ColorEffect effect : {ColorEffect::CorrectProtanopia, ColorEffect::CorrectDeuteranopia,
+                               ColorEffect::CorrectTritanopia})
+    {
+      ColorMatrixUtils::Apply(ColorMatrixUtils::EffectMatrix(effect), midGray, out);
+      neutral = neutral && Near(out, midGray, 1e-3f);
+    }
+    Check(simulated, "red-green simulations show red and green as one hue");
+    Check(neutral, "corrections leave grays alone");
+
+    // Correction then simulation: red and green end up further apart than
+    // with the simulation alone
+    ColorMatrix simulate = ColorMatrixUtils::EffectMatrix(ColorEffect::SimulateDeuteranopia);
+    ColorMatrix corrected = ColorMatrixUtils::Multiply(
+        ColorMatrixUtils::EffectMatrix(ColorEffect::CorrectDeuteranopia), simulate);
+    float plainRed[3], plainGreen[3];
+    ColorMatrixUtils::Apply(simulate, red, plainRed);
+    ColorMatrixUtils::Apply(simulate, green, plainGreen);
+    ColorMatrixUtils::Apply(corrected, red, out);
+    ColorMatrixUtils::Apply(corrected, green, out2);
+    Check(Distance(out, out2) > Distance(plainRed, plainGreen), "correction separates what the deficiency merges");
+
+    Check(ColorMatrixUtils::Equal(ColorMatrixUtils::Blend(gray, 0.0), ColorMatrixUtils::Identity()) &&
+              ColorMatrixUtils::Equal(ColorMatrixUtils::Blend(gray, 1.0), gray),
+          "blend runs from identity to the effect");
+  }
+
+  void StackChecks(int frames)
+  {
+    std::printf("Stack\n");
+    Clock::time_point t = Clock::now();
+    ColorEffectStack stack;
+    stack.SetSaturation(1.5);
+    stack.SetStrength(ColorEffect::CorrectDeuteranopia, 0.8, milliseconds(0), t);
+    stack.SetStrength(ColorEffect::Saturation, 1.0, milliseconds(0), t);
+    stack.SetStrength(ColorEffect::Sepia, 0.3, milliseconds(0), t);
+    stack.SetStrength(ColorEffect::Grayscale, 0.5, milliseconds(0), t);
+    stack.Update(t);
+    Check(Near(stack.Matrix(), Reference(stack, 1.5), 1e-5f), "product matches multiplying every effect out");
+    Check(!stack.Update(t) && !stack.IsAnimating(), "nothing changed, nothing rebuilt");
+
+    // Fade the last effect in: one multiply a frame
+    stack.SetStrength(ColorEffect::Invert, 1.0, milliseconds(frames * 16), t);
+    ColorEffectStack::Stats before = stack.GetStats();
+    bool matches = true;
+    bool monotonic = true;
+    double last = 0.0;
+    double halfway = -1.0;
+    for (int f = 1; f <= frames; ++f)
+    {
+      stack.Update(t + milliseconds(f * 16));
+      double strength = stack.GetStrength(ColorEffect::Invert);
+      monotonic = monotonic && strength >= last;
+      last = strength;
+      if (f == frames / 2)
+        halfway = strength;
+      matches = matches && Near(stack.Matrix(), Reference(stack, 1.5), 1e-5f);
+    }
+    ColorEffectStack::Stats after = stack.GetStats();
+    Check(matches, "product stays exact through a fade");
+    Check(after.updates - before.updates == static_cast<uint64_t>(frames) &&
+              after.multiplies - before.multiplies == static_cast<uint64_t>(frames),
+          "fading the last effect costs one multiply a frame");
+    Check(monotonic && std::fabs(halfway - 0.5) < 0.01 && last == 1.0 && !stack.IsAnimating(),
+          "fade eased, ends on the target");
+
+    // Retarget halfway through a fade out
+    stack.SetStrength(ColorEffect::Invert, 0.0, milliseconds(160), t);
+    stack.Update(t + milliseconds(80));
+    double reached = stack.GetStrength(ColorEffect::Invert);
+    stack.SetStrength(ColorEffect::Invert, 1.0, milliseconds(160), t + milliseconds(80));
+    stack.Update(t + milliseconds(81));
+    Check(std::fabs(stack.GetStrength(ColorEffect::Invert) - reached) < 0.01, "retarget starts where the fade was");
+
+    // Time a frame against rebuilding from scratch
+    ColorEffectStack timed = stack;
+    timed.SetStrength(ColorEffect::Invert, 0.0, milliseconds(frames * 16), t);
+    auto start = Clock::now();
+    for (int f = 1; f <= frames; ++f)
+      timed.Update(t + milliseconds(f * 16));
+    double cachedNs = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / frames;
+    start = Clock::now();
+    volatile float sink = 0.0f; // Keeps the rebuild from being optimised away
+    for (int f = 1; f <= frames; ++f)
+      sink = sink + Reference(timed, 1.5).m[0][0];
+    double freshNs = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / frames;
+    std::printf("  fade frame %.0f ns, full rebuild %.0f ns\n", cachedNs, freshNs);
+  }
+
+  void FilterChecks()
+  {
+    std::printf("BWFilter\n");
+    auto backend = std::make_shared<FakeDisplayBackend>();
+    SetDisplayBackend(backend);
+    BWFilter::Initialize();
+
+    Check(BWFilter::SetEnabled(true) && BWFilter::IsEnabled() && backend->GetCounters().colorMatrixWrites == 1 &&
+              ColorMatrixUtils::Equal(backend->GetColorMatrix(), ColorMatrixUtils::EffectMatrix(ColorEffect::Grayscale)),
+          "B&W on: one push, the grayscale matrix");
+    BWFilter::SetEnabled(true);
+    BWFilter::SetEffect(ColorEffect::Sepia, 0.0);
+    Check(backend->GetCounters().colorMatrixWrites == 1 && BWFilter::GetStats().unchanged == 2,
+          "no push when the product is unchanged");
+
+    BWFilter::SetEffect(ColorEffect::Invert, 1.0);
+    ColorMatrix merged = ColorMatrixUtils::Multiply(ColorMatrixUtils::EffectMatrix(ColorEffect::Grayscale),
+                                                    ColorMatrixUtils::EffectMatrix(ColorEffect::Invert));
+    Check(backend->GetCounters().colorMatrixWrites == 2 && Near(backend->GetColorMatrix(), merged, 1e-6f),
+          "effects merged into one matrix");
+    BWFilter::SetEffect(ColorEffect::Invert, 0.0);
+
+    // Fade out through the scheduler, ticked as the UI timer would
+    int scheduled = 0;
+    BWFilter::SetScheduler([&scheduled]
+                           { ++scheduled; });
+    uint64_t writes = backend->GetCounters().colorMatrixWrites;
+    BWFilter::SetEnabled(false, milliseconds(120));
+    bool immediate = backend->GetCounters().colorMatrixWrites == writes;
+    int ticks = 0;
+    while (BWFilter::Tick() && ticks < 1000)
+    {
+      ++ticks;
+      std::this_thread::sleep_for(milliseconds(8));
+    }
+    uint64_t fadeWrites = backend->GetCounters().colorMatrixWrites - writes;
+    std::printf("  120 ms fade: %d ticks, %llu pushes\n", ticks, static_cast<unsigned long long>(fadeWrites));
+    Check(scheduled == 1 && immediate && fadeWrites > 3 && !BWFilter::IsEnabled() &&
+              ColorMatrixUtils::Equal(backend->GetColorMatrix(), ColorMatrixUtils::Identity()),
+          "fade runs on the scheduler and ends on identity");
+    writes = backend->GetCounters().colorMatrixWrites;
+    BWFilter::Tick();
+    Check(backend->GetCounters().colorMatrixWrites == writes, "settled: ticks push nothing");
+
+    BWFilter::SetScheduler(nullptr);
+    BWFilter::SetEnabled(true, milliseconds(500));
+    Check(ColorMatrixUtils::Equal(backend->GetColorMatrix(), ColorMatrixUtils::EffectMatrix(ColorEffect::Grayscale)),
+          "no scheduler: fades apply at once");
+
+    BWFilter::Cleanup();
+    Check(ColorMatrixUtils::Equal(backend->GetColorMatrix(), ColorMatrixUtils::Identity()) && !BWFilter::IsEnabled(),
+          "cleanup restores identity");
+    SetDisplayBackend(nullptr);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  int frames = argc > 1 ? std::max(4, std::atoi(argv[1])) : 60;
+
+  MatrixChecks();
+  StackChecks(frames);
+  FilterChecks();
+
+  return BenchCheck::Finish();
+}
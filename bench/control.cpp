@@ -0,0 +1,336 @@
+// Control endpoint check: serves a FakeDisplayBackend with two DDC/CI
+// monitors, one without and one without a gamma ramp over a socket in the
+// temp directory, and drives it with ControlClients. Verifies that
+//
+//   - a second server cannot take an endpoint that is in use;
+//   - get reports every monitor, set applies with one gamma write and one
+//     flush, and a request of several commands is one transaction: one
+//     flush when it applies, nothing at all when any command is bad, and
+//     the monitors put back when a DDC/CI write fails or the filter cannot
+//     be set;
+//   - bad commands, monitors and levels are refused;
+//   - a subscriber is told about changes made by other clients and by the
+//     controller directly, once per burst, and Stop disconnects it promptly;
+//   - under load from several clients every request is answered and
+//     counted.
+//
+// Also reports commands per second and the request latency under load.
+// Exits non-zero on a failed check.
+//
+// Usage: bench_control [clients] [requests]
+
+#include "benchcheck.h"
+#include "benchdesk.h"
+#include "brightness.h"
+#include "bwfilter.h"
+#include "control.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+namespace
+{
+  using Clock = std::chrono::steady_clock;
+  using std::chrono::milliseconds;
+  using BenchCheck::Check;
+
+  using BenchDesk::Desk;
+
+  // DISPLAY1 and DISPLAY2 have DDC/CI, DISPLAY3 only gamma, DISPLAY4 neither
+  Desk MakeDesk()
+  {
+    Desk desk;
+    desk.AddDdc(milliseconds(1));
+    desk.AddDdc(milliseconds(1));
+    desk.Add();
+    desk.backend->SetGammaUnsupported(desk.Add());
+    desk.Install();
+    BrightnessController::StartHardwareProbe();
+    BrightnessController::WaitForHardwareProbe();
+    BWFilter::Initialize();
+    return desk;
+  }
+
+  // Sends @p request and returns the status line, or "" if the connection failed
+  std::string Send(ControlClient &client, const std::string &request, std::vector<std::string> *lines = nullptr)
+  {
+    std::vector<std::string> data;
+    std::string status;
+    if (!client.Request(request, data, status))
+      return std::string();
+    if (lines)
+      *lines = data;
+    return status;
+  }
+
+  // Reads events until one starts with @p prefix; counts those read
+  bool WaitForEvent(ControlClient &client, const std::string &prefix, int *seen = nullptr)
+  {
+    std::string line;
+    while (client.ReadLine(line, milliseconds(2000)))
+    {
+      if (seen)
+        ++*seen;
+      if (line.compare(0, prefix.size(), prefix) == 0)
+        return true;
+    }
+    return false;
+  }
+
+  bool Levels(int monitor, int brightness, int kelvin)
+  {
+    return BrightnessController::GetSoftwareBrightness(monitor) == brightness &&
+           BrightnessController::GetSoftwareColorTemp(monitor) == kelvin;
+  }
+
+  void ProtocolChecks(Desk &desk, ControlServer &server)
+  {
+    std::printf("Protocol\n");
+    ControlServer::Options options;
+    options.endpoint = server.GetEndpoint();
+    ControlServer second(options);
+    Check(!second.Start(), "endpoint in use is refused");
+
+    ControlClient client;
+    Check(client.Connect(server.GetEndpoint()), "client connects");
+
+    std::vector<std::string> lines;
+    std::string status = Send(client, "get", &lines);
+    Check(status == "ok" && lines.size() == 5 && lines[0].compare(0, 10, "monitor 0 ") == 0 &&
+              lines[2].find(" hw=none ") != std::string::npos && lines[4] == "bw off",
+          "get lists every monitor and the filter");
+
+    FakeDisplayBackend::Counters before = desk.backend->GetCounters();
+    status = Send(client, "set 1 sw=70 temp=4000");
+    FakeDisplayBackend::Counters after = desk.backend->GetCounters();
+    Check(status == "ok" && Levels(1, 70, 4000) && after.gammaWrites - before.gammaWrites == 1 &&
+              after.gammaFlushes - before.gammaFlushes == 1,
+          "set: one gamma write, one flush");
+
+    before = after;
+    status = Send(client, "set 0 sw=50; set 2 temp=3000; set * hw=40; get 2", &lines);
+    after = desk.backend->GetCounters();
+    Check(status == "ok" && Levels(0, 50, 6500) && Levels(2, 100, 3000) &&
+              BrightnessController::GetHardwareBrightness(0) == 40 &&
+              BrightnessController::GetHardwareBrightness(1) == 40 && after.gammaFlushes - before.gammaFlushes == 1 &&
+              lines.size() == 1 && lines[0].find(" temp=3000 ") != std::string::npos,
+          "transaction: one flush for every monitor");
+
+    before = after;
+    status = Send(client, "set 0 sw=20; set 2 hw=10");
+    after = desk.backend->GetCounters();
+    Check(status.compare(0, 4, "err ") == 0 && Levels(0, 50, 6500) && after.gammaWrites == before.gammaWrites,
+          "transaction with a bad command applies nothing");
+
+    status = Send(client, "set 0 sw=40; set 3 sw=40");
+    after = desk.backend->GetCounters();
+    Check(status.compare(0, 4, "err ") == 0 && Levels(0, 50, 6500) && after.gammaWrites == before.gammaWrites,
+          "set on a monitor without gamma applies nothing");
+
+    status = Send(client, "set * temp=5000");
+    Check(status == "ok" && Levels(0, 50, 5000) && Levels(1, 70, 5000) && Levels(2, 100, 5000),
+          "set * skips the monitor without gamma");
+
+    desk.ddc[1]->SetFailEvery(1);
+    status = Send(client, "set 0 sw=30 hw=60; set 1 hw=60");
+    desk.ddc[1]->SetFailEvery(0);
+    // The put-back value is queued behind the write that did land
+    for (int i = 0; i < 200 && desk.ddc[0]->GetCurrent() != 40; ++i)
+      std::this_thread::sleep_for(milliseconds(5));
+    Check(status.compare(0, 4, "err ") == 0 && Levels(0, 50, 5000) &&
+              BrightnessController::GetHardwareBrightness(0) == 40 &&
+              BrightnessController::GetHardwareBrightness(1) == 40 && desk.ddc[0]->GetCurrent() == 40,
+          "failed DDC/CI write puts the monitors back");
+
+
+    const char *bad[] = {"fly", "set 9 sw=50", "set 0 sw=0", "set 0 temp=9000", "set 0 hw=101", "set 0 sw=5x",
+                         "set 0", "get 0 1", "bw maybe", "save 1", "subscribe; get", ""};
+    bool refused = true;
+    for (const char *request : bad)
+      refused = refused && Send(client, request).compare(0, 4, "err ") == 0;
+    Check(refused && client.IsConnected(), "bad requests refused, connection kept");
+
+    status = Send(client, "bw on");
+    bool on = BWFilter::IsEnabled();
+    std::string off = Send(client, "bw off");
+    Check(status == "ok" && on && off == "ok" && !BWFilter::IsEnabled(), "bw on and off");
+
+    ControlServer::Stats stats = server.GetStats();
+    Check(stats.errors == 3 + sizeof(bad) / sizeof(bad[0]) && stats.requests >= 6 + sizeof(bad) / sizeof(bad[0]),
+          "errors counted");
+  }
+
+  void SubscriptionChecks(Desk &desk, ControlServer &server)
+  {
+    std::printf("Subscription\n");
+    (void)desk;
+    ControlClient subscriber;
+    std::vector<std::string> lines;
+    std::string status;
+    bool subscribed = subscriber.Connect(server.GetEndpoint()) && subscriber.Request("subscribe", lines, status) &&
+                      status == "ok";
+    // The snapshot follows "ok" as events
+    int snapshot = 0;
+    Check(subscribed && WaitForEvent(subscriber, "event bw ", &snapshot) && snapshot == 5, "subscribe sends the state");
+
+    ControlClient client;
+    client.Connect(server.GetEndpoint());
+    Send(client, "set 2 sw=35");
+    Check(WaitForEvent(subscriber, "event monitor 2 sw=35 "), "event for another client's change");
+
+    BrightnessController::SetSoftwareLevels(0, 65, -1);
+    Check(WaitForEvent(subscriber, "event monitor 0 sw=65 "), "event for a direct controller change");
+
+    Send(client, "bw on");
+    Check(WaitForEvent(subscriber, "event bw on"), "event for the filter");
+    Send(client, "bw off");
+    WaitForEvent(subscriber, "event bw off");
+
+    // A slider drag: many changes inside one event interval
+    uint64_t eventsBefore = server.GetStats().events;
+    for (int level = 1; level <= 50; ++level)
+      BrightnessController::SetSoftwareLevels(1, level, -1);
+    bool last = WaitForEvent(subscriber, "event monitor 1 sw=50 ");
+    uint64_t burst = server.GetStats().events - eventsBefore;
+    std::printf("  50 changes in a burst published as %llu event(s)\n", static_cast<unsigned long long>(burst));
+    Check(last && burst < 10, "burst coalesced");
+
+    Clock::time_point start = Clock::now();
+    server.Stop();
+    double stopMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    std::string line;
+    std::printf("  stopped in %.2f ms with clients connected\n", stopMs);
+    Check(stopMs < 500 && !subscriber.ReadLine(line, milliseconds(500)) && !subscriber.IsConnected(),
+          "stop disconnects subscribers promptly");
+    Check(Send(client, "get").empty(), "requests fail once stopped");
+  }
+
+  // Its own server, since a second running server would take over the
+  // controller's change listener
+  void FilterFailureChecks(const std::string &endpoint)
+  {
+    std::printf("Filter failure\n");
+    ControlServer::Options options;
+    options.endpoint = endpoint;
+    ControlServer server(options);
+    // A UI thread that never takes the task
+    server.SetUiInvoker([](std::function<void()>)
+                        { return false; });
+    ControlClient client;
+    int software = BrightnessController::GetSoftwareBrightness(0);
+    int kelvin = BrightnessController::GetSoftwareColorTemp(0);
+    int hardware = BrightnessController::GetHardwareBrightness(0);
+    std::string status = server.Start() && client.Connect(server.GetEndpoint())
+                             ? Send(client, "set 0 sw=30 temp=3000 hw=70; bw on")
+                             : std::string();
+    Check(status.compare(0, 4, "err ") == 0 && Levels(0, software, kelvin) &&
+              BrightnessController::GetHardwareBrightness(0) == hardware && !BWFilter::IsEnabled(),
+          "failed filter puts the monitors back");
+  }
+
+  void LoadChecks(ControlServer &server, int clientCount, int requestCount)
+  {
+    std::printf("Load, %d clients x %d requests\n", clientCount, requestCount);
+    ControlServer::Stats before = server.GetStats();
+    std::vector<std::vector<double>> latencies(clientCount);
+    std::atomic<int> failed{0};
+    std::atomic<int> commands{0};
+    std::vector<std::thread> threads;
+    Clock::time_point start = Clock::now();
+    for (int c = 0; c < clientCount; ++c)
+    {
+      threads.emplace_back(
+          [&, c]
+          {
+            ControlClient client;
+            if (!client.Connect(server.GetEndpoint()))
+            {
+              failed += requestCount;
+              return;
+            }
+            latencies[c].reserve(requestCount);
+            for (int i = 0; i < requestCount; ++i)
+            {
+              int monitor = (c + i) % 3;
+              int level = 1 + (c * 7 + i) % 100;
+              std::string request;
+              switch (i % 3)
+              {
+              case 0:
+                request = "get " + std::to_string(monitor);
+                commands += 1;
+                break;
+              case 1:
+                request = "set " + std::to_string(monitor) + " sw=" + std::to_string(level);
+                commands += 1;
+                break;
+              default:
+                request = "set 0 sw=" + std::to_string(level) + "; set 2 temp=" + std::to_string(2000 + level * 10) +
+                          "; get";
+                commands += 3;
+                break;
+              }
+              Clock::time_point sent = Clock::now();
+              if (Send(client, request) != "ok")
+                ++failed;
+              latencies[c].push_back(std::chrono::duration<double, std::micro>(Clock::now() - sent).count());
+            }
+          });
+    }
+    for (std::thread &thread : threads)
+      thread.join();
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::vector<double> all;
+    for (const std::vector<double> &client : latencies)
+      all.insert(all.end(), client.begin(), client.end());
+    std::sort(all.begin(), all.end());
+    double p50 = all.empty() ? 0 : all[all.size() / 2];
+    double p99 = all.empty() ? 0 : all[std::min(all.size() - 1, all.size() * 99 / 100)];
+    ControlServer::Stats stats = server.GetStats();
+    std::printf("  %.0f commands/s, request p50 %.1f us, p99 %.1f us\n", commands / seconds, p50, p99);
+
+    uint64_t total = static_cast<uint64_t>(clientCount) * requestCount;
+    Check(failed == 0 && all.size() == total, "every request answered ok");
+    Check(stats.requests - before.requests == total &&
+              stats.commands - before.commands == static_cast<uint64_t>(commands.load()) &&
+              stats.errors == before.errors,
+          "server counts match");
+  }
+}
+
+int main(int argc, char **argv)
+{
+  int clientCount = argc > 1 ? std::max(1, std::atoi(argv[1])) : 8;
+  int requestCount = argc > 2 ? std::max(1, std::atoi(argv[2])) : 2000;
+
+  std::error_code ec;
+  std::filesystem::path endpoint = std::filesystem::temp_directory_path(ec) / "candela_bench_control.sock";
+  Desk desk = MakeDesk();
+
+  ControlServer::Options options;
+  options.endpoint = endpoint.string();
+  {
+    ControlServer server(options);
+    Check(server.Start(), "server starts");
+    ProtocolChecks(desk, server);
+    LoadChecks(server, clientCount, requestCount);
+    SubscriptionChecks(desk, server);
+  }
+  Check(!std::filesystem::exists(endpoint, ec), "socket removed on stop");
+  FilterFailureChecks(options.endpoint);
+
+  BWFilter::Cleanup();
+  BenchDesk::TearDown();
+
+  return BenchCheck::Finish();
+}
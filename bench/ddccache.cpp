@@ -0,0 +1,304 @@
+// DDC/CI capability cache check: runs BrightnessController against
+// FakeDisplayBackend monitors with EDIDs and verifies that
+//
+//   - the cache survives a save and reload, and rejects a corrupt file;
+//   - monitors with a zero EDID serial are told apart by their serial string;
+//   - a known monitor is usable straight after RefreshOutputs, without a
+//     single DDC/CI command, and a known-bad one is not probed up front;
+//   - the background probe revalidates cached monitors: one that stopped
+//     answering loses hardware brightness, while one whose breaker is open
+//     after failed writes keeps it;
+//   - a changed EDID invalidates the entry and the monitor is probed afresh.
+//
+// Also reports how long hardware brightness takes to become usable with a
+// cold and a warm cache. Exits non-zero on a failed check.
+//
+// Usage: bench_ddccache [latency_ms] [monitors]
+
+#include "benchcheck.h"
+#include "benchdesk.h"
+#include "brightness.h"
+#include "ddccache.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace
+{
+  using Clock = std::chrono::steady_clock;
+  using BenchCheck::Check;
+
+  double Millis(Clock::duration d)
+  {
+    return std::chrono::duration<double, std::milli>(d).count();
+  }
+
+  using BenchDesk::MakeEdid;
+  using BenchDesk::Desk;
+
+  // @p count DDC/CI monitors plus one monitor without DDC/CI at all.
+  Desk MakeDesk(size_t count, std::chrono::milliseconds latency)
+  {
+    Desk desk;
+    for (size_t i = 0; i <= count; ++i)
+    {
+      OutputHandle output = desk.Add(i < count ? std::make_shared<SimulatedDdcMonitor>(0, 100, latency) : nullptr);
+      std::vector<uint8_t> edid = MakeEdid("DEL", static_cast<uint16_t>(0x4000 + i), 1000 + static_cast<uint32_t>(i));
+      desk.backend->SetEdid(output, edid.data());
+    }
+    return desk;
+  }
+
+  size_t CountState(size_t monitors, HardwareProbeState state)
+  {
+    size_t n = 0;
+    for (size_t i = 0; i < monitors; ++i)
+      if (BrightnessController::GetHardwareProbeState(static_cast<int>(i)) == state)
+        ++n;
+    return n;
+  }
+
+  void CacheFileChecks(const std::filesystem::path &directory)
+  {
+    std::printf("Cache file\n");
+    std::filesystem::path path = directory / "ddccaps.bin";
+
+    MonitorIdentity a, b;
+    uint64_t hashA, hashB;
+    std::vector<uint8_t> edidA = MakeEdid("DEL", 0x40B5, 12345);
+    std::vector<uint8_t> edidB = MakeEdid("GSM", 0x5B7F, 0);
+    Check(DdcCapabilityCache::Identify(edidA.data(), a, hashA) &&
+              DdcCapabilityCache::Identify(edidB.data(), b, hashB) && std::strcmp(a.manufacturer, "DEL") == 0 &&
+              a.productCode == 0x40B5 && a.serialNumber == 12345,
+          "identity decoded from EDID");
+
+    DdcCapabilities good;
+    good.edidHash = hashA;
+    good.supported = true;
+    good.nativeMin = 0;
+    good.nativeMax = 75;
+    good.nativeCurrent = 30;
+    good.latencyUs = 41000;
+    DdcCapabilities bad;
+    bad.edidHash = hashB;
+
+    {
+      DdcCapabilityCache cache(path);
+      cache.Store(a, good);
+      cache.Store(b, bad);
+      Check(cache.Save() && std::filesystem::exists(path), "saved");
+    }
+
+    DdcCapabilityCache reloaded(path);
+    DdcCapabilities found;
+    bool loaded = reloaded.Load();
+    bool sameA = reloaded.Lookup(a, hashA, found) && found.supported && found.nativeMax == 75 &&
+                 found.nativeCurrent == 30 && found.latencyUs == 41000;
+    bool sameB = reloaded.Lookup(b, hashB, found) && !found.supported;
+    Check(loaded && sameA && sameB, "reload returns the stored entries");
+
+    Check(!reloaded.Lookup(a, hashA ^ 1, found) && !reloaded.Lookup(a, hashA, found) &&
+              reloaded.GetStats().invalidated == 1,
+          "a different EDID block invalidates the entry");
+
+    // Same model, serial 0, different serial strings: two monitors, two entries.
+    MonitorIdentity left, right;
+    uint64_t hashLeft, hashRight;
+    std::vector<uint8_t> edidLeft = MakeEdid("AUS", 0x27A1, 0, "M1LMQS012345");
+    std::vector<uint8_t> edidRight = MakeEdid("AUS", 0x27A1, 0, "M1LMQS067890");
+    DdcCapabilityCache::Identify(edidLeft.data(), left, hashLeft);
+    DdcCapabilityCache::Identify(edidRight.data(), right, hashRight);
+    Check(!(left == right), "zero serials told apart by the serial string");
+
+    // Flip one byte in the middle of the file.
+    {
+      std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+      file.seekp(24);
+      file.put('\x5A');
+    }
+    DdcCapabilityCache corrupt(path);
+    Check(!corrupt.Load() && corrupt.Size() == 0, "corrupt file rejected");
+  }
+
+  struct StartTiming
+  {
+    double gammaMs = 0.0;
+    double hardwareMs = 0.0; // Until every DDC/CI monitor was usable
+    uint64_t commandsBeforeProbe = 0;
+  };
+
+  // Startup as the app does it: RefreshOutputs, then the background probe.
+  StartTiming Start(const Desk &desk, size_t count)
+  {
+    StartTiming timing;
+    auto start = Clock::now();
+    BrightnessController::RefreshOutputs();
+    timing.gammaMs = Millis(Clock::now() - start);
+    timing.commandsBeforeProbe = desk.DdcCommands();
+
+    bool usable = CountState(count, HardwareProbeState::Available) == count;
+    if (usable)
+      timing.hardwareMs = timing.gammaMs;
+    BrightnessController::StartHardwareProbe();
+    BrightnessController::WaitForHardwareProbe();
+    if (!usable)
+      timing.hardwareMs = Millis(Clock::now() - start);
+    return timing;
+  }
+
+  void StartupChecks(const std::filesystem::path &directory, std::chrono::milliseconds latency, size_t count)
+  {
+    std::printf("Startup with %zu DDC/CI monitors + 1 without (%lld ms per command)\n", count,
+                static_cast<long long>(latency.count()));
+    std::filesystem::path path = directory / "startup.bin";
+    std::filesystem::remove(path);
+
+    // Cold: nothing known, everything probed.
+    auto cache = std::make_shared<DdcCapabilityCache>(path);
+    BrightnessController::SetCapabilityCache(cache);
+    Desk cold = MakeDesk(count, latency);
+    cold.Attach();
+    StartTiming coldTiming = Start(cold, count);
+    Check(CountState(count + 1, HardwareProbeState::Available) == count && cache->Size() == count + 1,
+          "cold start probes and caches every monitor");
+    BrightnessController::Cleanup();
+
+    // Warm: a fresh process (cache reloaded from disk) meets the same desk.
+    cache = std::make_shared<DdcCapabilityCache>(path);
+    Check(cache->Load() && cache->Size() == count + 1, "cache persisted by the probe");
+    BrightnessController::SetCapabilityCache(cache);
+    Desk warm = MakeDesk(count, latency);
+    warm.Attach();
+
+    BrightnessController::RefreshOutputs();
+    Check(CountState(count, HardwareProbeState::Available) == count && warm.DdcCommands() == 0,
+          "known monitors usable at once, without DDC/CI traffic");
+    Check(BrightnessController::GetHardwareProbeState(static_cast<int>(count)) == HardwareProbeState::Unavailable,
+          "known-bad monitor not left pending");
+    Check(BrightnessController::SetHardwareBrightness(0, 80), "cached monitor accepts writes");
+    BrightnessController::StartHardwareProbe();
+    BrightnessController::WaitForHardwareProbe();
+    Check(CountState(count, HardwareProbeState::Available) == count &&
+              BrightnessController::GetHardwareBrightness(0) == 80,
+          "revalidation keeps them, and keeps the posted level");
+    BrightnessController::Cleanup();
+
+    StartTiming warmTiming;
+    {
+      Desk again = MakeDesk(count, latency);
+      again.Attach();
+      warmTiming = Start(again, count);
+      BrightnessController::Cleanup();
+    }
+    std::printf("  cold: gamma %.1f ms, hardware %.1f ms\n", coldTiming.gammaMs, coldTiming.hardwareMs);
+    std::printf("  warm: gamma %.1f ms, hardware %.1f ms\n", warmTiming.gammaMs, warmTiming.hardwareMs);
+    Check(warmTiming.hardwareMs * 4 < coldTiming.hardwareMs, "warm cache makes hardware usable much sooner");
+
+    // A cached monitor that stopped answering is caught by revalidation.
+    Desk silent = MakeDesk(count, latency);
+    silent.ddc[0]->SetFailEvery(1);
+    silent.Attach();
+    BrightnessController::RefreshOutputs();
+    bool usableAtFirst = BrightnessController::GetHardwareProbeState(0) == HardwareProbeState::Available;
+    BrightnessController::StartHardwareProbe();
+    BrightnessController::WaitForHardwareProbe();
+    Check(usableAtFirst && BrightnessController::GetHardwareProbeState(0) == HardwareProbeState::Unavailable,
+          "revalidation drops a monitor that stopped answering");
+    BrightnessController::Cleanup();
+
+    // ...and next time it is known bad.
+    Desk after = MakeDesk(count, latency);
+    after.Attach();
+    BrightnessController::RefreshOutputs();
+    Check(BrightnessController::GetHardwareProbeState(0) == HardwareProbeState::Unavailable,
+          "its entry now says known bad");
+    BrightnessController::StartHardwareProbe();
+    BrightnessController::WaitForHardwareProbe();
+    Check(BrightnessController::GetHardwareProbeState(0) == HardwareProbeState::Available,
+          "revalidation brings it back once it answers again");
+    BrightnessController::Cleanup();
+
+    // Writes that failed just before the probe open the endpoint's breaker,
+    // which refuses the revalidation read. That is not "stopped answering".
+    Desk tripped = MakeDesk(count, latency);
+    tripped.Attach();
+    BrightnessController::RefreshOutputs();
+    tripped.ddc[0]->SetFailEvery(1);
+    for (int i = 0; i < 3; ++i)
+    {
+      std::promise<void> done;
+      BrightnessController::SetHardwareBrightness(0, 40 + i, [&done](const HardwareWriteReport &)
+                                                  { done.set_value(); });
+      done.get_future().wait();
+    }
+    tripped.ddc[0]->SetFailEvery(0);
+    std::vector<DdcHealth::Snapshot> health = BrightnessController::GetDdcHealth(0);
+    bool open = !health.empty() && health[0].circuit == DdcCircuit::Open;
+    BrightnessController::StartHardwareProbe();
+    BrightnessController::WaitForHardwareProbe();
+    Check(open && BrightnessController::GetHardwareProbeState(0) == HardwareProbeState::Available,
+          "revalidation refused by an open breaker keeps the endpoint");
+    BrightnessController::Cleanup();
+    Desk afterTrip = MakeDesk(count, latency);
+    afterTrip.Attach();
+    BrightnessController::RefreshOutputs();
+    Check(BrightnessController::GetHardwareProbeState(0) == HardwareProbeState::Available,
+          "...and its entry still says supported");
+    BrightnessController::Cleanup();
+
+    // An endpoint that is not there yet falls back to the full probe.
+    Desk late = MakeDesk(count, latency);
+    late.backend->SetDdcOpenFailures(1, 1);
+    late.Attach();
+    BrightnessController::RefreshOutputs();
+    bool pending = BrightnessController::GetHardwareProbeState(0) == HardwareProbeState::Pending;
+    BrightnessController::StartHardwareProbe();
+    BrightnessController::WaitForHardwareProbe();
+    Check(pending && BrightnessController::GetHardwareProbeState(0) == HardwareProbeState::Available,
+          "endpoint not ready yet: probed as usual");
+    BrightnessController::Cleanup();
+
+    // A new EDID (firmware update, different mode list) is probed afresh.
+    Desk changed = MakeDesk(count, latency);
+    std::vector<uint8_t> edid = MakeEdid("DEL", 0x4000, 1000, nullptr, 2);
+    changed.backend->SetEdid(1, edid.data());
+    changed.Attach();
+    uint64_t invalidated = cache->GetStats().invalidated;
+    BrightnessController::RefreshOutputs();
+    Check(BrightnessController::GetHardwareProbeState(0) == HardwareProbeState::Pending &&
+              cache->GetStats().invalidated == invalidated + 1,
+          "changed EDID invalidates the entry");
+    BrightnessController::StartHardwareProbe();
+    BrightnessController::WaitForHardwareProbe();
+    Check(BrightnessController::GetHardwareProbeState(0) == HardwareProbeState::Available,
+          "and the monitor is probed afresh");
+    BrightnessController::Cleanup();
+
+    BrightnessController::SetCapabilityCache(nullptr);
+    SetDisplayBackend(nullptr);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  std::chrono::milliseconds latency(argc > 1 ? std::atoi(argv[1]) : 40);
+  size_t count = argc > 2 ? static_cast<size_t>(std::atoi(argv[2])) : 4;
+
+  std::error_code ec;
+  std::filesystem::path directory = std::filesystem::temp_directory_path(ec) / "candela_bench_ddccache";
+  std::filesystem::remove_all(directory, ec);
+  std::filesystem::create_directories(directory, ec);
+
+  CacheFileChecks(directory);
+  StartupChecks(directory, latency, count);
+
+  std::filesystem::remove_all(directory, ec);
+  return BenchCheck::Finish();
+}
@@ -0,0 +1,187 @@
+// DDC/CI protocol benchmark: runs DdcCiEngine and I2cDdcBackend against
+// EmulatedDdcBus, which plays the monitor side byte for byte.
+//
+// Checks framing and checksums in both directions, EDID decoding, rejection
+// of corrupt and null replies, the standard's reply delay and command gap,
+// and that Get/Set VCP never allocate. It then brings a three-monitor desk
+// up through BrightnessController, matching outputs to buses by EDID. Exits
+// non-zero on any failure.
+//
+// Usage: bench_ddcci [iterations]
+
+#include "benchcheck.h"
+#include "brightness.h"
+#include "ddcci.h"
+#include "ddcemu.h"
+#include "fakebackend.h"
+#include "i2cddcbackend.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+// Counts heap allocations so the hot path can be shown to make none.
+static std::atomic<uint64_t> g_allocations(0);
+
+void *operator new(size_t size)
+{
+  g_allocations++;
+  if (void *p = std::malloc(size ? size : 1))
+    return p;
+  throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+  std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+  std::free(p);
+}
+
+namespace
+{
+  using BenchCheck::Check;
+
+  // A bus with nothing on it: every transaction is NAKed.
+  class EmptyBus : public DdcCi::I2cBus
+  {
+  public:
+    bool Write(uint8_t, const uint8_t *, size_t) override { return false; }
+    bool Read(uint8_t, uint8_t *, size_t) override { return false; }
+  };
+
+  void ProtocolChecks()
+  {
+    std::printf("Protocol, standard timing (40 ms reply delay, 50 ms gap):\n");
+    EmulatedDdcBus bus("DEL", 0xA0C5, 123456, "DELL U2720Q");
+    DdcCiEngine engine(bus);
+
+    uint8_t edid[DdcCi::EDID_LENGTH];
+    DdcCi::EdidInfo info;
+    Check(engine.ReadEdid(edid) && DdcCi::ParseEdid(edid, info), "EDID read and validated at 0x50");
+    Check(std::strcmp(info.manufacturer, "DEL") == 0 && info.productCode == 0xA0C5 &&
+              info.serialNumber == 123456 && std::strcmp(info.name, "DELL U2720Q") == 0,
+          "EDID identity decoded");
+
+    auto start = std::chrono::steady_clock::now();
+    uint16_t current = 0, maximum = 0;
+    Check(engine.SetVcp(DdcCi::VCP_BRIGHTNESS, 73) && bus.GetFeature(DdcCi::VCP_BRIGHTNESS) == 73,
+          "Set VCP 0x10 = 73 reaches the display");
+    Check(engine.GetVcp(DdcCi::VCP_BRIGHTNESS, current, maximum) && current == 73 && maximum == 100,
+          "Get VCP 0x10 reads back 73 / 100");
+    double setGetMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    bus.CorruptNextReply();
+    Check(!engine.GetVcp(DdcCi::VCP_BRIGHTNESS, current, maximum) && engine.GetStats().badReplies == 1,
+          "Corrupt reply checksum rejected");
+    bus.NullNextReply();
+    Check(!engine.GetVcp(DdcCi::VCP_BRIGHTNESS, current, maximum) && engine.GetStats().nullReplies == 1,
+          "Null message reported as failure");
+    Check(!engine.GetVcp(0xE9, current, maximum) && engine.GetStats().unsupported == 1,
+          "Unsupported VCP code reported");
+    bus.SetDdcEnabled(false);
+    Check(!engine.SetVcp(DdcCi::VCP_BRIGHTNESS, 10) && engine.GetStats().busErrors == 1,
+          "NAK at 0x37 reported as bus error");
+    bus.SetDdcEnabled(true);
+
+    EmulatedDdcBus::Stats stats = bus.GetStats();
+    Check(stats.badRequests == 0, "Every request frame had a valid checksum");
+    Check(stats.timingViolations == 0, "No reply delay or command gap violated");
+    std::printf("  Set + Get round trip: %.1f ms\n", setGetMs);
+  }
+
+  void HotPathChecks(int iterations)
+  {
+    std::printf("Hot path, zero delays, %d Get+Set pairs:\n", iterations);
+    DdcCi::Timing none;
+    none.replyDelay = std::chrono::milliseconds(0);
+    none.commandGap = std::chrono::milliseconds(0);
+    EmulatedDdcBus bus("GSM", 0x5B7F, 42, "LG HDR 4K", none);
+    DdcCiEngine engine(bus, none);
+
+    uint16_t current = 0, maximum = 0;
+    uint64_t before = g_allocations;
+    auto start = std::chrono::steady_clock::now();
+    bool ok = true;
+    for (int i = 0; i < iterations; ++i)
+    {
+      ok = engine.SetVcp(DdcCi::VCP_BRIGHTNESS, static_cast<uint16_t>(i % 101)) && ok;
+      ok = engine.GetVcp(DdcCi::VCP_BRIGHTNESS, current, maximum) && current == i % 101 && ok;
+    }
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / iterations;
+    uint64_t allocations = g_allocations - before;
+
+    Check(ok, "Every value round-tripped");
+    Check(allocations == 0, "No allocations on Get/Set VCP");
+    std::printf("  Protocol cost per Get+Set pair: %.0f ns (%llu allocations)\n", ns,
+                static_cast<unsigned long long>(allocations));
+  }
+
+  void BackendChecks()
+  {
+    std::printf("I2cDdcBackend, three monitors plus an empty bus:\n");
+    DdcCi::Timing fast;
+    fast.replyDelay = std::chrono::milliseconds(5);
+    fast.commandGap = std::chrono::milliseconds(5);
+
+    auto inner = std::make_shared<FakeDisplayBackend>();
+    std::vector<std::shared_ptr<EmulatedDdcBus>> monitors = {
+        std::make_shared<EmulatedDdcBus>("DEL", 0xA0C5, 1, "DELL U2720Q", fast),
+        std::make_shared<EmulatedDdcBus>("DEL", 0xA0C5, 2, "DELL U2720Q", fast),
+        std::make_shared<EmulatedDdcBus>("BNQ", 0x7F30, 3, "BenQ PD2700U", fast)};
+
+    // Outputs are registered in the opposite order to the buses, so only the
+    // EDID comparison can pair them correctly.
+    std::vector<std::shared_ptr<DdcCi::I2cBus>> buses = {std::make_shared<EmptyBus>()};
+    for (auto &monitor : monitors)
+      buses.push_back(monitor);
+    for (size_t i = monitors.size(); i-- > 0;)
+    {
+      uint8_t edid[DdcCi::EDID_LENGTH];
+      monitors[i]->GetEdid(edid);
+      OutputHandle output = inner->AddOutput(L"DP-" + std::to_wstring(i + 1));
+      inner->SetEdid(output, edid);
+    }
+
+    SetDisplayBackend(std::make_shared<I2cDdcBackend>(inner, buses, fast));
+    BrightnessController::RefreshMonitors();
+
+    const auto &list = BrightnessController::GetMonitors();
+    size_t ready = 0;
+    for (const auto &monitor : list)
+      ready += monitor.supportsHardwareBrightness ? 1 : 0;
+    Check(list.size() == 3 && ready == 3, "Every output paired with its bus");
+
+    // Each output N set to 10 * N; the bus with the matching EDID must see it.
+    for (size_t i = 0; i < list.size(); ++i)
+    {
+      int n = list[i].deviceName.back() - L'0';
+      BrightnessController::SetHardwareBrightness(static_cast<int>(i), 10 * n);
+    }
+    BrightnessController::Cleanup(); // Flushes the DDC workers
+    bool routed = true;
+    for (size_t i = 0; i < monitors.size(); ++i)
+      routed = routed && monitors[i]->GetFeature(DdcCi::VCP_BRIGHTNESS) == 10 * (i + 1);
+    Check(routed, "Brightness writes reached the matching monitors");
+
+    uint64_t violations = 0;
+    for (auto &monitor : monitors)
+      violations += monitor->GetStats().timingViolations;
+    Check(violations == 0, "Timing respected with concurrent probes and workers");
+    SetDisplayBackend(nullptr);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  int iterations = argc > 1 ? std::atoi(argv[1]) : 100000;
+  ProtocolChecks();
+  HotPathChecks(iterations);
+  BackendChecks();
+  return BenchCheck::Finish();
+}
@@ -0,0 +1,346 @@
+// Adaptive DDC/CI retry check: feeds DdcHealth synthetic histories and drives
+// DdcWorker and BrightnessController against SimulatedDdcMonitors, verifying
+// that
+//
+//   - a fast monitor is retried sooner, and a slow one later, than the old
+//     fixed 50 ms, and a flaky one gets more attempts than a reliable one;
+//   - a command slower than the learned timeout counts as failed, for the
+//     worker's retries and the breaker as well as the model, but a monitor
+//     that slows down and keeps answering raises its timeout and is not
+//     cut off;
+//   - the circuit breaker opens after repeated failed requests, refuses
+//     requests without touching the bus, lets one trial through after the
+//     cool-down, backs off when it fails and closes when it succeeds;
+//   - a worker recovers from a rejected write faster than the fixed policy,
+//     and writes the value held back by an open breaker once the monitor
+//     answers again, waiting (not spinning) while another thread holds the
+//     breaker's trial;
+//   - the controller exposes what it learned per endpoint.
+//
+// Exits non-zero on a failed check.
+//
+// Usage: bench_ddchealth [latency_ms]
+
+#include "benchcheck.h"
+#include "brightness.h"
+#include "ddchealth.h"
+#include "ddcsim.h"
+#include "ddcworker.h"
+#include "fakebackend.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace
+{
+  using Clock = std::chrono::steady_clock;
+  using std::chrono::milliseconds;
+  using BenchCheck::Check;
+
+  double Millis(Clock::duration d)
+  {
+    return std::chrono::duration<double, std::milli>(d).count();
+  }
+
+  // Blocks until a posted request's completion callback has run.
+  class ResultWaiter
+  {
+  public:
+    DdcWorker::CompletionFn Callback()
+    {
+      return [this](int, DdcResult result)
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_result = result;
+        m_done = true;
+        m_cv.notify_all();
+      };
+    }
+
+    bool Wait(DdcResult &result)
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      if (!m_cv.wait_for(lock, std::chrono::seconds(10), [this]
+                         { return m_done; }))
+        return false;
+      result = m_result;
+      m_done = false;
+      return true;
+    }
+
+  private:
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    DdcResult m_result = DdcResult::Failed;
+    bool m_done = false;
+  };
+
+  DdcRetryParams Learn(uint32_t latencyMs, size_t ok, size_t failed)
+  {
+    DdcHealth health;
+    for (size_t i = 0; i < ok + failed; ++i)
+      health.RecordCommand(i < ok, milliseconds(latencyMs));
+    return health.Params();
+  }
+
+  void ModelChecks()
+  {
+    std::printf("Learned parameters\n");
+    DdcRetryParams defaults = DdcHealth().Params();
+    Check(defaults.attempts == 5 && defaults.retryDelay == milliseconds(50), "no history: the fixed 5 x 50 ms policy");
+
+    DdcRetryParams fast = Learn(3, 32, 0);
+    DdcRetryParams slow = Learn(120, 32, 0);
+    DdcRetryParams flaky = Learn(10, 40, 24);
+    std::printf("  fast:  %d tries, %lld ms apart, timeout %lld ms\n", fast.attempts,
+                static_cast<long long>(fast.retryDelay.count()), static_cast<long long>(fast.timeout.count()));
+    std::printf("  slow:  %d tries, %lld ms apart, timeout %lld ms\n", slow.attempts,
+                static_cast<long long>(slow.retryDelay.count()), static_cast<long long>(slow.timeout.count()));
+    std::printf("  flaky: %d tries, %lld ms apart, timeout %lld ms\n", flaky.attempts,
+                static_cast<long long>(flaky.retryDelay.count()), static_cast<long long>(flaky.timeout.count()));
+    Check(fast.retryDelay < defaults.retryDelay && fast.attempts < defaults.attempts,
+          "fast, reliable monitor: fewer, quicker retries");
+    Check(slow.retryDelay > defaults.retryDelay && slow.timeout > milliseconds(120), "slow monitor: given more room");
+    Check(flaky.attempts > fast.attempts, "flaky monitor: more attempts");
+    Check(slow.Backoff(2) == slow.retryDelay && slow.Backoff(3) == slow.retryDelay * 2 &&
+              slow.Backoff(9) == slow.retryDelay * 4,
+          "backoff doubles, capped at 4x");
+
+    DdcHealth health;
+    for (int i = 0; i < 16; ++i)
+      health.RecordCommand(true, milliseconds(3));
+    bool stalled = !health.RecordCommand(true, milliseconds(5000));
+    DdcHealth::Snapshot snapshot = health.GetSnapshot();
+    Check(stalled && snapshot.failures[DdcHealth::LATENCY_BUCKETS - 1] == 1, "command past the timeout counts as failed");
+    Check(snapshot.successes[2] == 16 && snapshot.p50Us == 3000 && snapshot.samples == 17,
+          "latency histogram and percentiles");
+  }
+
+  void BreakerChecks()
+  {
+    std::printf("Circuit breaker\n");
+    DdcHealth::Options options;
+    options.coolDown = milliseconds(1000);
+    options.maxCoolDown = milliseconds(1500);
+    DdcHealth health(options);
+    Clock::time_point t = Clock::now();
+
+    health.RecordRequest(false, t);
+    health.RecordRequest(false, t);
+    Check(health.Allow(t), "closed until the third failure in a row");
+    health.RecordRequest(false, t);
+    DdcHealth::Snapshot snapshot = health.GetSnapshot(t);
+    Check(snapshot.circuit == DdcCircuit::Open && snapshot.trips == 1, "opens after three failed requests");
+    Check(!health.Allow(t + milliseconds(500)) && health.GetSnapshot(t).rejected == 1, "refuses during the cool-down");
+
+    t += milliseconds(1000);
+    Check(health.Allow(t) && health.Params().attempts == 1, "one single-attempt trial after the cool-down");
+    Check(!health.Allow(t), "nothing else while the trial runs");
+
+    health.RecordRequest(false, t);
+    Check(!health.Allow(t + milliseconds(1000)) && health.Allow(t + milliseconds(1500)),
+          "failed trial reopens with a longer cool-down");
+    health.RecordRequest(true, t);
+    snapshot = health.GetSnapshot(t);
+    Check(snapshot.circuit == DdcCircuit::Closed && snapshot.consecutiveFailures == 0 && health.Allow(t),
+          "successful trial closes it");
+  }
+
+  // Time from Post to completion of a request whose first write is rejected.
+  double RecoveryMs(DdcWorker &worker, SimulatedDdcMonitor &monitor, int value)
+  {
+    ResultWaiter waiter;
+    DdcResult result = DdcResult::Failed;
+    monitor.FailNext(1);
+    auto start = Clock::now();
+    worker.Post(value, static_cast<uint32_t>(value), waiter.Callback());
+    bool done = waiter.Wait(result);
+    return done && result == DdcResult::Applied ? Millis(Clock::now() - start) : -1.0;
+  }
+
+  void WorkerChecks(milliseconds latency)
+  {
+    std::printf("Worker, %lld ms DDC/CI latency\n", static_cast<long long>(latency.count()));
+    auto fixedMonitor = std::make_shared<SimulatedDdcMonitor>(0, 100, latency);
+    auto learnedMonitor = std::make_shared<SimulatedDdcMonitor>(0, 100, latency);
+    DdcWorker fixed([fixedMonitor](uint32_t v)
+                    { return fixedMonitor->SetBrightness(v); });
+    auto health = std::make_shared<DdcHealth>();
+    DdcWorker learned([learnedMonitor](uint32_t v)
+                      { return learnedMonitor->SetBrightness(v); },
+                      health);
+
+    // Warm the model up with ordinary traffic.
+    for (int i = 0; i < 16; ++i)
+    {
+      learned.Post(i, static_cast<uint32_t>(i));
+      learned.Flush();
+    }
+    double fixedMs = RecoveryMs(fixed, *fixedMonitor, 60);
+    double learnedMs = RecoveryMs(learned, *learnedMonitor, 60);
+    std::printf("  rejected write recovered in %.1f ms (fixed policy %.1f ms); %s\n", learnedMs, fixedMs,
+                DdcHealthUtils::Format(health->GetSnapshot()).c_str());
+    Check(learnedMs > 0 && fixedMs > 0 && learnedMs < fixedMs, "retries sooner than the fixed policy");
+
+    // Writes that land, but only after the timeout.
+    DdcHealth::Options slowOptions;
+    slowOptions.defaults.attempts = 2;
+    slowOptions.defaults.retryDelay = milliseconds(1);
+    slowOptions.defaults.timeout = latency / 2;
+    auto slowMonitor = std::make_shared<SimulatedDdcMonitor>(0, 100, latency);
+    auto slowHealth = std::make_shared<DdcHealth>(slowOptions);
+    DdcWorker slow([slowMonitor](uint32_t v)
+                   { return slowMonitor->SetBrightness(v); },
+                   slowHealth);
+    ResultWaiter slowWaiter;
+    DdcResult slowResult = DdcResult::Applied;
+    slow.Post(30, 30, slowWaiter.Callback());
+    bool timedOut = slowWaiter.Wait(slowResult) && slowResult == DdcResult::Failed;
+    Check(timedOut && slowMonitor->GetAcceptedWrites() == 2 && slow.GetStats().attempts == 2 &&
+              slowHealth->GetSnapshot().consecutiveFailures == 1,
+          "attempts past the timeout retried and the request failed");
+
+    // A monitor that slows down after a long fast history but keeps working.
+    auto slowingMonitor = std::make_shared<SimulatedDdcMonitor>(0, 100, latency);
+    auto slowingHealth = std::make_shared<DdcHealth>();
+    DdcWorker slowing([slowingMonitor](uint32_t v)
+                      { return slowingMonitor->SetBrightness(v); },
+                      slowingHealth);
+    for (size_t i = 0; i < DdcHealth::WINDOW; ++i)
+    {
+      slowing.Post(static_cast<int>(i % 100), static_cast<uint32_t>(i % 100));
+      slowing.Flush();
+    }
+    milliseconds learnedTimeout = slowingHealth->GetSnapshot().params.timeout;
+    const milliseconds slowLatency = learnedTimeout + learnedTimeout / 2;
+    slowingMonitor->SetLatency(slowLatency);
+    int applied = 0;
+    for (int i = 0; i < 6; ++i)
+    {
+      ResultWaiter waiter;
+      DdcResult result = DdcResult::Failed;
+      slowing.Post(40 + i, static_cast<uint32_t>(40 + i), waiter.Callback());
+      applied += waiter.Wait(result) && result == DdcResult::Applied ? 1 : 0;
+    }
+    DdcHealth::Snapshot slowed = slowingHealth->GetSnapshot();
+    std::printf("  slowed from %lld ms to %lld ms: %d of 6 requests applied; %s\n",
+                static_cast<long long>(latency.count()), static_cast<long long>(slowLatency.count()), applied,
+                DdcHealthUtils::Format(slowed).c_str());
+    Check(slowed.trips == 0 && slowed.params.timeout > slowLatency && applied >= 4 &&
+              slowingMonitor->GetCurrent() == 45,
+          "monitor that slows down raises its timeout, breaker stays closed");
+
+    // A monitor that stops answering.
+    DdcHealth::Options options;
+    options.defaults.retryDelay = milliseconds(5);
+    options.coolDown = milliseconds(300);
+    auto deadMonitor = std::make_shared<SimulatedDdcMonitor>(0, 100, latency);
+    auto deadHealth = std::make_shared<DdcHealth>(options);
+    DdcWorker dead([deadMonitor](uint32_t v)
+                   { return deadMonitor->SetBrightness(v); },
+                   deadHealth);
+    deadMonitor->SetFailEvery(1);
+    ResultWaiter waiter;
+    DdcResult result = DdcResult::Applied;
+    bool allFailed = true;
+    for (int i = 0; i < 3; ++i)
+    {
+      dead.Post(10 + i, static_cast<uint32_t>(10 + i), waiter.Callback());
+      allFailed = allFailed && waiter.Wait(result) && result == DdcResult::Failed;
+    }
+    Check(allFailed && deadHealth->GetSnapshot().circuit == DdcCircuit::Open, "breaker opens on a dead monitor");
+
+    uint64_t commands = deadMonitor->GetCommandCount();
+    auto start = Clock::now();
+    dead.Post(42, 42, waiter.Callback());
+    bool refused = waiter.Wait(result) && result == DdcResult::Failed;
+    double refusedMs = Millis(Clock::now() - start);
+    std::printf("  refused in %.2f ms\n", refusedMs);
+    Check(refused && deadMonitor->GetCommandCount() == commands && dead.GetStats().rejected == 1 &&
+              refusedMs < latency.count(),
+          "open breaker fails at once, without bus traffic");
+
+    // The monitor comes back; the held-back value is its trial.
+    deadMonitor->SetFailEvery(0);
+    auto deadline = Clock::now() + std::chrono::seconds(5);
+    while (deadMonitor->GetCurrent() != 42 && Clock::now() < deadline)
+      std::this_thread::sleep_for(milliseconds(10));
+    dead.Flush();
+    Check(deadMonitor->GetCurrent() == 42 && deadHealth->GetSnapshot().circuit == DdcCircuit::Closed,
+          "held-back value written once the monitor answers");
+
+    // The trial is taken by someone else, as a probe's revalidation read
+    // does: the worker waits for its outcome instead of asking again.
+    options.coolDown = milliseconds(20);
+    auto sharedMonitor = std::make_shared<SimulatedDdcMonitor>(0, 100, latency);
+    auto sharedHealth = std::make_shared<DdcHealth>(options);
+    DdcWorker shared([sharedMonitor](uint32_t v)
+                     { return sharedMonitor->SetBrightness(v); },
+                     sharedHealth);
+    for (int i = 0; i < 3; ++i)
+      sharedHealth->RecordRequest(false);
+    std::this_thread::sleep_for(options.coolDown);
+    bool trial = sharedHealth->Allow();
+    shared.Post(77, 77, waiter.Callback());
+    refused = waiter.Wait(result) && result == DdcResult::Failed;
+    std::this_thread::sleep_for(milliseconds(100));
+    uint64_t asked = sharedHealth->GetSnapshot().rejected;
+    std::printf("  trial held elsewhere for 100 ms: %llu refusal(s)\n", static_cast<unsigned long long>(asked));
+    Check(trial && refused && asked == 1 && shared.GetStats().rejected == 1,
+          "trial held elsewhere: the worker waits instead of spinning");
+    sharedHealth->RecordRequest(true);
+    deadline = Clock::now() + std::chrono::seconds(5);
+    while (sharedMonitor->GetCurrent() != 77 && Clock::now() < deadline)
+      std::this_thread::sleep_for(milliseconds(5));
+    Check(sharedMonitor->GetCurrent() == 77, "held-back value written once that trial succeeds");
+  }
+
+  void ControllerChecks(milliseconds latency)
+  {
+    std::printf("Controller\n");
+    auto backend = std::make_shared<FakeDisplayBackend>();
+    auto ddc = std::make_shared<SimulatedDdcMonitor>(0, 100, latency);
+    backend->AddOutput(L"\\\\.\\DISPLAY1", ddc);
+    SetDisplayBackend(backend);
+    BrightnessController::RefreshMonitors();
+
+    std::vector<DdcHealth::Snapshot> health = BrightnessController::GetDdcHealth(0);
+    Check(health.size() == 1 && health[0].samples == 1 && health[0].circuit == DdcCircuit::Closed,
+          "probe read recorded per endpoint");
+    Check(BrightnessController::GetDdcHealth(1).empty(), "invalid index: no endpoints");
+
+    ddc->SetFailEvery(1);
+    ResultWaiter waiter;
+    DdcResult result = DdcResult::Applied;
+    for (int i = 0; i < 3; ++i)
+    {
+      BrightnessController::SetHardwareBrightness(0, 20 + i, [&waiter](const HardwareWriteReport &report)
+                                                  { waiter.Callback()(report.brightness, report.Overall()); });
+      waiter.Wait(result);
+    }
+    health = BrightnessController::GetDdcHealth(0);
+    Check(!health.empty() && health[0].circuit == DdcCircuit::Open && health[0].trips == 1,
+          "failing endpoint's breaker visible");
+    std::printf("  %s\n", health.empty() ? "" : DdcHealthUtils::Format(health[0]).c_str());
+
+    BrightnessController::Cleanup();
+    SetDisplayBackend(nullptr);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  milliseconds latency(argc > 1 ? std::atoi(argv[1]) : 5);
+
+  ModelChecks();
+  BreakerChecks();
+  WorkerChecks(latency);
+  ControllerChecks(latency);
+
+  return BenchCheck::Finish();
+}
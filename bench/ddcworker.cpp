@@ -0,0 +1,167 @@
+// DDC/CI worker check: drives DdcWorker against a slow SimulatedDdcMonitor,
+// as a slider drag does, and verifies that
+//
+//   - a burst of posts reaches the bus as two writes: the value already in
+//     flight and the last one; everything in between completes Superseded;
+//   - a write the monitor keeps rejecting is abandoned, not retried, once a
+//     newer value is posted, and the newer value is applied;
+//   - a value still pending when the worker stops completes Cancelled.
+//
+// Also reports how long the burst took to settle. Exits non-zero on a failed
+// check.
+//
+// Usage: bench_ddcworker [latency_ms] [burst]
+
+#include "benchcheck.h"
+#include "ddcsim.h"
+#include "ddcworker.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace
+{
+  using Clock = std::chrono::steady_clock;
+  using std::chrono::milliseconds;
+  using BenchCheck::Check;
+
+  // What reached the bus and how each post ended, shared with the worker
+  struct Log
+  {
+    std::mutex mutex;
+    std::vector<uint32_t> written;  // Every write attempt, in order
+    std::vector<DdcResult> results; // By posted brightness
+
+    explicit Log(size_t posts) : results(posts, DdcResult::Failed) {}
+
+    size_t Written()
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      return written.size();
+    }
+  };
+
+  DdcWorker::WriteFn Writer(SimulatedDdcMonitor &monitor, Log &log)
+  {
+    return [&monitor, &log](uint32_t nativeValue)
+    {
+      {
+        std::lock_guard<std::mutex> lock(log.mutex);
+        log.written.push_back(nativeValue);
+      }
+      return monitor.SetBrightness(nativeValue);
+    };
+  }
+
+  DdcWorker::CompletionFn Recorder(Log &log)
+  {
+    return [&log](int brightness, DdcResult result)
+    {
+      std::lock_guard<std::mutex> lock(log.mutex);
+      log.results[brightness] = result;
+    };
+  }
+
+  // Returns once the worker has started writing
+  void WaitForWrites(Log &log, size_t count)
+  {
+    while (log.Written() < count)
+      std::this_thread::sleep_for(milliseconds(1));
+  }
+
+  void BurstChecks(milliseconds latency, int burst)
+  {
+    std::printf("Burst of %d posts, %lld ms per write\n", burst, static_cast<long long>(latency.count()));
+    SimulatedDdcMonitor monitor(0, 100, latency);
+    Log log(burst);
+    DdcWorker worker(Writer(monitor, log));
+
+    Clock::time_point start = Clock::now();
+    worker.Post(0, 0, Recorder(log));
+    WaitForWrites(log, 1);
+    for (int i = 1; i < burst; ++i)
+      worker.Post(i, static_cast<uint32_t>(i), Recorder(log));
+    worker.Flush();
+    double settledMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+    std::lock_guard<std::mutex> lock(log.mutex);
+    Check(log.written == std::vector<uint32_t>{0, static_cast<uint32_t>(burst - 1)} &&
+              monitor.GetCurrent() == static_cast<uint32_t>(burst - 1),
+          "only the in-flight and the last value reach the bus");
+    bool superseded = true;
+    for (int i = 1; i < burst - 1; ++i)
+      superseded = superseded && log.results[i] == DdcResult::Superseded;
+    Check(superseded && log.results[0] == DdcResult::Applied && log.results[burst - 1] == DdcResult::Applied,
+          "values in between complete Superseded");
+    DdcWorker::Stats stats = worker.GetStats();
+    Check(stats.posted == static_cast<uint64_t>(burst) && stats.superseded == static_cast<uint64_t>(burst - 2) &&
+              stats.applied == 2 && stats.attempts == 2,
+          "stats count the coalescing");
+    std::printf("  settled after %.1f ms (%d writes would take %lld ms)\n", settledMs, burst,
+                static_cast<long long>(latency.count()) * burst);
+  }
+
+  void AbandonChecks(milliseconds latency)
+  {
+    std::printf("Failing write abandoned for a newer value\n");
+    SimulatedDdcMonitor monitor(0, 100, latency);
+    monitor.SetFailEvery(1);
+    Log log(2);
+    const int attempts = 5;
+    const milliseconds retryDelay(500); // Long enough that only a newer value can end the wait
+    DdcWorker worker(Writer(monitor, log), attempts, retryDelay);
+
+    Clock::time_point start = Clock::now();
+    worker.Post(0, 10, Recorder(log));
+    WaitForWrites(log, 1);
+    monitor.SetFailEvery(0);
+    worker.Post(1, 20, Recorder(log));
+    worker.Flush();
+    milliseconds took = std::chrono::duration_cast<milliseconds>(Clock::now() - start);
+
+    std::lock_guard<std::mutex> lock(log.mutex);
+    Check(log.results[0] == DdcResult::Superseded && log.results[1] == DdcResult::Applied,
+          "rejected value completes Superseded, newer one Applied");
+    Check(std::count(log.written.begin(), log.written.end(), 10u) == 1 && monitor.GetCurrent() == 20,
+          "rejected value not retried after the newer post");
+    Check(took < retryDelay, "newer value written without waiting out the retry delay");
+  }
+
+  void StopChecks(milliseconds latency)
+  {
+    std::printf("Stop with a value pending\n");
+    SimulatedDdcMonitor monitor(0, 100, latency);
+    Log log(2);
+    DdcResult late = DdcResult::Applied;
+    {
+      DdcWorker worker(Writer(monitor, log));
+      worker.Post(0, 30, Recorder(log));
+      WaitForWrites(log, 1);
+      worker.Post(1, 40, Recorder(log));
+      worker.Stop();
+      worker.Post(1, 50, [&late](int, DdcResult result)
+                  { late = result; });
+    }
+    std::lock_guard<std::mutex> lock(log.mutex);
+    Check(log.results[0] == DdcResult::Applied && log.results[1] == DdcResult::Cancelled &&
+              log.written.size() == 1,
+          "pending value completes Cancelled, never written");
+    Check(late == DdcResult::Cancelled, "value posted after Stop completes Cancelled");
+  }
+}
+
+int main(int argc, char **argv)
+{
+  milliseconds latency(argc > 1 ? std::max(1, std::atoi(argv[1])) : 40);
+  int burst = argc > 2 ? std::max(3, std::atoi(argv[2])) : 50;
+
+  BurstChecks(latency, burst);
+  AbandonChecks(latency);
+  StopChecks(latency);
+
+  return BenchCheck::Finish();
+}
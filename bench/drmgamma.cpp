@@ -0,0 +1,29 @@
+// DRM/KMS gamma benchmark: runs the shared gamma check (see gammacheck.h)
+// against a DRM card through atomic GAMMA_LUT commits. Needs DRM master, so
+// stop any compositor on that card first. Runs without a GPU on vkms:
+//
+//   sudo modprobe vkms
+//   make bench DRM=1 CANDELA_DRM_DEVICE=/dev/dri/card1
+//
+// Usage: bench_drmgamma [updates] [device]   (device defaults to
+//        $CANDELA_DRM_DEVICE, then /dev/dri/card0)
+
+#include "drmbackend.h"
+#include "gammacheck.h"
+#include <cstdlib>
+
+int main(int argc, char **argv)
+{
+  int updates = argc > 1 ? std::atoi(argv[1]) : 200;
+  const char *device = argc > 2 ? argv[2] : std::getenv("CANDELA_DRM_DEVICE");
+  std::string path = device ? device : "/dev/dri/card0";
+
+  auto backend = std::make_shared<DrmDisplayBackend>(path);
+  if (!backend->IsConnected())
+  {
+    std::printf("FAIL: cannot open %s with atomic modesetting\n", path.c_str());
+    return 1;
+  }
+  std::printf("DRM device: %s\n", path.c_str());
+  return GammaCheck::Run(backend, updates);
+}
@@ -0,0 +1,157 @@
+// Enumeration benchmark: how long does BrightnessController::RefreshMonitors
+// take for a desk of DDC/CI monitors, and how does that compare with probing
+// the same monitors one after another?
+//
+// Runs the real controller against FakeDisplayBackend. Each simulated
+// monitor needs one retry to hand out its DDC/CI handle and rejects its first
+// brightness read, mirroring what RefreshMonitors sees on real hardware.
+// The sequential column is the single-monitor refresh time multiplied by the
+// monitor count.
+//
+// The fast-start table splits the same refresh the way the app starts up:
+// RefreshOutputs (gamma only) on the calling thread, then StartHardwareProbe
+// in the background. "gamma ms" is how long until gamma can be restored,
+// "hardware ms" until DDC/CI brightness is usable.
+//
+// Usage: bench_enumeration [latency_ms] [max_monitors]
+
+#include "benchdesk.h"
+#include "brightness.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+
+namespace
+{
+  BenchDesk::Desk MakeDesk(size_t count, std::chrono::milliseconds latency)
+  {
+    BenchDesk::Desk desk;
+    for (size_t i = 0; i < count; ++i)
+    {
+      desk.AddDdc(latency)->FailNext(1);
+      desk.backend->SetDdcOpenFailures(desk.outputs.back(), 1);
+    }
+    return desk;
+  }
+
+  double TimeRefresh(size_t count, std::chrono::milliseconds latency, size_t &probed)
+  {
+    MakeDesk(count, latency).Attach();
+    auto start = std::chrono::steady_clock::now();
+    BrightnessController::RefreshMonitors();
+    double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    probed = 0;
+    for (const auto &monitor : BrightnessController::GetMonitors())
+      if (monitor.supportsHardwareBrightness)
+        ++probed;
+
+    BenchDesk::TearDown();
+    return elapsed;
+  }
+
+  struct FastStart
+  {
+    double gammaMs = 0.0;
+    double hardwareMs = 0.0;
+    bool pendingUntilProbed = true; // Every monitor reported Pending before the probe published
+    size_t probed = 0;
+  };
+
+  FastStart TimeFastStart(size_t count, std::chrono::milliseconds latency)
+  {
+    MakeDesk(count, latency).Attach();
+    FastStart result;
+    std::atomic<bool> done(false);
+
+    auto start = std::chrono::steady_clock::now();
+    BrightnessController::RefreshOutputs();
+    result.gammaMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    for (size_t i = 0; i < count; ++i)
+      result.pendingUntilProbed = result.pendingUntilProbed &&
+                                  BrightnessController::GetHardwareProbeState(static_cast<int>(i)) ==
+                                      HardwareProbeState::Pending;
+    BrightnessController::StartHardwareProbe([&done]()
+                                             { done = true; });
+    BrightnessController::WaitForHardwareProbe();
+    result.hardwareMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    for (size_t i = 0; i < count; ++i)
+      if (BrightnessController::GetHardwareProbeState(static_cast<int>(i)) == HardwareProbeState::Available)
+        ++result.probed;
+    if (!done || BrightnessController::IsHardwareProbePending())
+      result.probed = 0;
+
+    BenchDesk::TearDown();
+    return result;
+  }
+
+  // A refresh while the probe is still running must abandon it: no callback,
+  // and the new list is left pending for its own probe.
+  bool AbandonedProbeIsDiscarded(std::chrono::milliseconds latency)
+  {
+    MakeDesk(2, latency).Attach();
+    std::atomic<bool> called(false);
+    BrightnessController::RefreshOutputs();
+    BrightnessController::StartHardwareProbe([&called]()
+                                             { called = true; });
+    std::this_thread::sleep_for(latency / 2);
+    BrightnessController::RefreshOutputs();
+    bool ok = !called && BrightnessController::IsHardwareProbePending();
+
+    BenchDesk::TearDown();
+    return ok;
+  }
+}
+
+int main(int argc, char **argv)
+{
+  std::chrono::milliseconds latency(argc > 1 ? std::atoi(argv[1]) : 40);
+  size_t maxMonitors = argc > 2 ? static_cast<size_t>(std::atoi(argv[2])) : 6;
+
+  size_t probed = 0;
+  double single = TimeRefresh(1, latency, probed);
+
+  std::printf("Simulated DDC latency: %lld ms per command\n", static_cast<long long>(latency.count()));
+  std::printf("%-10s %10s %15s %15s %10s\n", "monitors", "ddc ok", "sequential ms", "refresh ms", "speedup");
+  for (size_t count = 1; count <= maxMonitors; ++count)
+  {
+    double refresh = TimeRefresh(count, latency, probed);
+    double sequential = single * count;
+    std::printf("%-10zu %10zu %15.1f %15.1f %9.2fx\n", count, probed, sequential, refresh, sequential / refresh);
+    if (probed != count)
+    {
+      std::printf("FAIL: only %zu of %zu monitors came up with DDC/CI\n", probed, count);
+      return 1;
+    }
+  }
+
+  std::printf("\nFast start\n");
+  std::printf("%-10s %10s %15s %15s\n", "monitors", "ddc ok", "gamma ms", "hardware ms");
+  for (size_t count = 1; count <= maxMonitors; ++count)
+  {
+    FastStart result = TimeFastStart(count, latency);
+    std::printf("%-10zu %10zu %15.1f %15.1f\n", count, result.probed, result.gammaMs, result.hardwareMs);
+    if (result.probed != count || !result.pendingUntilProbed)
+    {
+      std::printf("FAIL: background probe published %zu of %zu monitors\n", result.probed, count);
+      return 1;
+    }
+    if (result.gammaMs * 4 > result.hardwareMs)
+    {
+      std::printf("FAIL: gamma was not ready well ahead of DDC/CI\n");
+      return 1;
+    }
+  }
+  if (!AbandonedProbeIsDiscarded(latency))
+  {
+    std::printf("FAIL: a refresh did not abandon the running probe\n");
+    return 1;
+  }
+  return 0;
+}
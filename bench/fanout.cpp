@@ -0,0 +1,200 @@
+// Physical-monitor fan-out check: puts several SimulatedDdcMonitors behind
+// one FakeDisplayBackend output (a cloned or daisy-chained display) and
+// verifies that
+//
+//   - every physical monitor becomes its own endpoint, read concurrently
+//     during the probe, and one that does not answer is dropped;
+//   - a hardware brightness change reaches every endpoint in its own native
+//     range, concurrently, and reports each endpoint's result and latency;
+//   - a failing endpoint is reported as such without holding up the others;
+//   - hardware transitions drive every endpoint to the target.
+//
+// Also reports how long one change takes across all endpoints compared with
+// writing them one after another. Exits non-zero on a failed check.
+//
+// Usage: bench_fanout [latency_ms] [endpoints]
+
+#include "benchcheck.h"
+#include "benchdesk.h"
+#include "brightness.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace
+{
+  using Clock = std::chrono::steady_clock;
+  using BenchCheck::Check;
+
+  double Millis(Clock::duration d)
+  {
+    return std::chrono::duration<double, std::milli>(d).count();
+  }
+
+  // Blocks until the completion callback of one SetHardwareBrightness call
+  // has run, and keeps its report.
+  class ReportWaiter
+  {
+  public:
+    BrightnessController::HardwareCompletionFn Callback()
+    {
+      return [this](const HardwareWriteReport &report)
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_report = report;
+        m_done = true;
+        m_cv.notify_all();
+      };
+    }
+
+    bool Wait(HardwareWriteReport &report)
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      if (!m_cv.wait_for(lock, std::chrono::seconds(10), [this]
+                         { return m_done; }))
+        return false;
+      report = m_report;
+      m_done = false;
+      return true;
+    }
+
+  private:
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    HardwareWriteReport m_report;
+    bool m_done = false;
+  };
+
+  struct Desk : BenchDesk::Desk
+  {
+    std::vector<std::shared_ptr<SimulatedDdcMonitor>> chain; // Behind DISPLAY1, in endpoint order
+  };
+
+  // DISPLAY1 carries @p endpoints physical monitors with different native
+  // ranges; DISPLAY2 is an ordinary single monitor.
+  Desk MakeDesk(size_t endpoints, std::chrono::milliseconds latency)
+  {
+    Desk desk;
+    desk.chain.push_back(desk.AddDdc(latency));
+    for (size_t i = 1; i < endpoints; ++i)
+    {
+      desk.chain.push_back(std::make_shared<SimulatedDdcMonitor>(0, static_cast<uint32_t>(100 * (i + 1)), latency));
+      desk.backend->AddDdcEndpoint(desk.outputs[0], desk.chain[i]);
+    }
+    desk.AddDdc(latency);
+    desk.Attach();
+    return desk;
+  }
+
+  void ProbeChecks(std::chrono::milliseconds latency, size_t endpoints)
+  {
+    std::printf("Probe, %zu physical monitors behind one output\n", endpoints);
+    Desk desk = MakeDesk(endpoints, latency);
+    auto start = Clock::now();
+    BrightnessController::RefreshMonitors();
+    double elapsed = Millis(Clock::now() - start);
+
+    const auto &monitors = BrightnessController::GetMonitors();
+    bool ranges = monitors.size() == 2 && monitors[0].ddc.size() == endpoints;
+    for (size_t i = 0; ranges && i < endpoints; ++i)
+      ranges = monitors[0].ddc[i].nativeMax == 100 * (i + 1);
+    Check(ranges, "one endpoint per physical monitor, each with its own range");
+    Check(monitors.size() == 2 && monitors[1].ddc.size() == 1, "single monitor keeps a single endpoint");
+    std::printf("  refresh %.1f ms (%zu reads of %lld ms)\n", elapsed, endpoints,
+                static_cast<long long>(latency.count()));
+    Check(elapsed < latency.count() * static_cast<double>(endpoints), "endpoints read concurrently");
+    BenchDesk::TearDown();
+
+    // A physical monitor that never answers is left out.
+    desk = MakeDesk(endpoints, latency);
+    desk.chain.back()->SetFailEvery(1);
+    BrightnessController::RefreshMonitors();
+    Check(BrightnessController::GetMonitors()[0].ddc.size() == endpoints - 1 &&
+              BrightnessController::GetHardwareProbeState(0) == HardwareProbeState::Available,
+          "silent endpoint dropped, the rest usable");
+    BenchDesk::TearDown();
+  }
+
+  void WriteChecks(std::chrono::milliseconds latency, size_t endpoints)
+  {
+    std::printf("Fan-out writes\n");
+    Desk desk = MakeDesk(endpoints, latency);
+    BrightnessController::RefreshMonitors();
+
+    ReportWaiter waiter;
+    HardwareWriteReport report;
+    auto start = Clock::now();
+    BrightnessController::SetHardwareBrightness(0, 40, waiter.Callback());
+    bool reported = waiter.Wait(report);
+    double elapsed = Millis(Clock::now() - start);
+
+    bool applied = reported && report.brightness == 40 && report.endpoints.size() == endpoints &&
+                   report.Overall() == DdcResult::Applied;
+    for (size_t i = 0; applied && i < endpoints; ++i)
+      applied = report.endpoints[i].result == DdcResult::Applied &&
+                desk.chain[i]->GetCurrent() == 40 * (i + 1);
+    Check(applied, "every endpoint applied, in its native range");
+
+    std::chrono::microseconds slowest{0};
+    for (const auto &endpoint : report.endpoints)
+      slowest = std::max(slowest, endpoint.latency);
+    std::printf("  %zu endpoints in %.1f ms (slowest %.1f ms), sequential would be %lld ms\n", endpoints, elapsed,
+                slowest.count() / 1000.0, static_cast<long long>(latency.count() * endpoints));
+    Check(reported && slowest.count() > 0 && elapsed < latency.count() * static_cast<double>(endpoints),
+          "endpoints written concurrently, latency reported");
+
+    // One physical monitor rejects every write.
+    desk.chain[0]->SetFailEvery(1);
+    BrightnessController::SetHardwareBrightness(0, 70, waiter.Callback());
+    reported = waiter.Wait(report);
+    bool othersApplied = reported && report.endpoints.size() == endpoints;
+    for (size_t i = 1; othersApplied && i < endpoints; ++i)
+      othersApplied = report.endpoints[i].result == DdcResult::Applied && desk.chain[i]->GetCurrent() == 70 * (i + 1);
+    Check(othersApplied && report.endpoints[0].result == DdcResult::Failed && report.Overall() == DdcResult::Failed,
+          "failing endpoint reported, the others applied");
+    Check(othersApplied && report.endpoints[0].latency > report.endpoints[1].latency,
+          "failing endpoint's retries do not delay the others");
+    desk.chain[0]->SetFailEvery(0);
+    BenchDesk::TearDown();
+  }
+
+  void TransitionChecks(std::chrono::milliseconds latency, size_t endpoints)
+  {
+    std::printf("Transition\n");
+    Desk desk = MakeDesk(endpoints, std::chrono::milliseconds(latency.count() / 4));
+    BrightnessController::RefreshMonitors();
+
+    TransitionTarget target;
+    target.hardwareBrightness = 20;
+    BrightnessController::StartTransition(0, target, std::chrono::milliseconds(400));
+    auto deadline = Clock::now() + std::chrono::seconds(5);
+    while (BrightnessController::IsTransitioning(0) && Clock::now() < deadline)
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    BrightnessController::Cleanup(); // Flushes the workers
+
+    bool reached = true;
+    for (size_t i = 0; i < endpoints; ++i)
+      reached = reached && desk.chain[i]->GetCurrent() == 20 * (i + 1);
+    Check(reached, "every endpoint ends on the target");
+    SetDisplayBackend(nullptr);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  std::chrono::milliseconds latency(argc > 1 ? std::atoi(argv[1]) : 40);
+  size_t endpoints = argc > 2 ? static_cast<size_t>(std::atoi(argv[2])) : 4;
+  endpoints = std::max<size_t>(endpoints, 2);
+
+  ProbeChecks(latency, endpoints);
+  WriteChecks(latency, endpoints);
+  TransitionChecks(latency, endpoints);
+
+  return BenchCheck::Finish();
+}
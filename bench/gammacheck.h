@@ -0,0 +1,131 @@
+// Shared body of the real-backend gamma benchmarks (x11gamma, drmgamma):
+// drives BrightnessController against a backend, checks that every output
+// reads back the ramp BuildGammaRamp produced at its own gamma size, then
+// times whole-desk updates flushed per output versus batched.
+
+#pragma once
+#include "brightness.h"
+#include "colortemp.h"
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace GammaCheck
+{
+  inline std::string Narrow(const std::wstring &name)
+  {
+    return std::string(name.begin(), name.end());
+  }
+
+  // Compares every gamma-capable output with the ramp its current settings
+  // should produce.
+  inline bool VerifyReadback(DisplayBackend &backend)
+  {
+    for (const auto &monitor : BrightnessController::GetMonitors())
+    {
+      if (!monitor.hasGamma)
+        continue;
+      ColorTempUtils::GammaRampOptions opts;
+      opts.brightness = monitor.softwareBrightness;
+      opts.kelvin = monitor.softwareColorTemp;
+      opts.entries = monitor.gammaSize;
+
+      std::vector<uint16_t> expected(static_cast<size_t>(monitor.gammaSize) * 3);
+      std::vector<uint16_t> actual(expected.size());
+      ColorTempUtils::BuildGammaRamp(opts, expected.data());
+      if (!backend.GetGammaRamp(monitor.output, actual.data()) || actual != expected)
+      {
+        std::printf("FAIL: %s does not show the ramp for brightness %d, %d K\n",
+                    Narrow(monitor.deviceName).c_str(), opts.brightness, opts.kelvin);
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Applies one setting to every output as a single batched update.
+  inline bool ApplyToAll(int brightness, int kelvin)
+  {
+    BrightnessController::BeginUpdate();
+    for (int i = 0; i < static_cast<int>(BrightnessController::GetMonitors().size()); ++i)
+    {
+      BrightnessController::SetSoftwareBrightness(i, brightness);
+      BrightnessController::SetSoftwareColorTemp(i, kelvin);
+    }
+    return BrightnessController::EndUpdate();
+  }
+
+  // Applies @p updates brightness changes to every output and returns the
+  // average wall time of one whole-desk update in microseconds.
+  inline double TimeUpdates(int updates, bool batched)
+  {
+    const int count = static_cast<int>(BrightnessController::GetMonitors().size());
+    auto start = std::chrono::steady_clock::now();
+    for (int u = 0; u < updates; ++u)
+    {
+      // Alternate so redundant-write suppression never skips a write.
+      int brightness = (u % 2) ? 60 : 80;
+      if (batched)
+        BrightnessController::BeginUpdate();
+      for (int i = 0; i < count; ++i)
+        BrightnessController::SetSoftwareBrightness(i, brightness);
+      if (batched)
+        BrightnessController::EndUpdate();
+    }
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / updates;
+  }
+
+  // Full run against an already connected backend. Returns the exit code.
+  inline int Run(const std::shared_ptr<DisplayBackend> &backend, int updates)
+  {
+    SetDisplayBackend(backend);
+    BrightnessController::RefreshMonitors();
+
+    int gammaOutputs = 0;
+    for (const auto &monitor : BrightnessController::GetMonitors())
+    {
+      std::printf("%-12s gamma %s, %d entries per channel\n", Narrow(monitor.deviceName).c_str(),
+                  monitor.hasGamma ? "yes" : "no", monitor.hasGamma ? monitor.gammaSize : 0);
+      if (monitor.hasGamma)
+        ++gammaOutputs;
+    }
+    if (gammaOutputs == 0)
+    {
+      std::printf("FAIL: no output exposes a gamma table\n");
+      return 1;
+    }
+
+    // Correctness: a few settings, each applied as one batched update.
+    const int samples[][2] = {{100, 6500}, {1, 1200}, {57, 3400}};
+    for (const auto &sample : samples)
+    {
+      if (!ApplyToAll(sample[0], sample[1]))
+      {
+        std::printf("FAIL: the backend rejected a gamma update\n");
+        return 1;
+      }
+      if (!VerifyReadback(*backend))
+        return 1;
+    }
+
+    GammaRampStats before = BrightnessController::GetGammaRampStats();
+    double perOutput = TimeUpdates(updates, false);
+    GammaRampStats middle = BrightnessController::GetGammaRampStats();
+    double batched = TimeUpdates(updates, true);
+    GammaRampStats after = BrightnessController::GetGammaRampStats();
+
+    std::printf("%-22s %12s %16s\n", "mode", "us/update", "flushes/update");
+    std::printf("%-22s %12.1f %16.2f\n", "flush per output", perOutput,
+                static_cast<double>(middle.flushes - before.flushes) / updates);
+    std::printf("%-22s %12.1f %16.2f\n", "batched", batched,
+                static_cast<double>(after.flushes - middle.flushes) / updates);
+
+    // Leave the display at neutral.
+    ApplyToAll(ColorTempUtils::BRIGHTNESS_MAX, ColorTempUtils::KELVIN_DEFAULT);
+    BrightnessController::Cleanup();
+    SetDisplayBackend(nullptr);
+    return 0;
+  }
+}
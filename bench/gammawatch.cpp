@@ -0,0 +1,151 @@
+// Gamma drift watchdog check: runs GammaWatchdog against a FakeDisplayBackend
+// whose ramps are overwritten behind Candela's back, as a game or a driver
+// reset would. Verifies that
+//
+//   - intact ramps cost one read per monitor and no writes, and the
+//     interval backs off to its maximum;
+//   - an overwritten ramp is found, only that monitor is rewritten (one
+//     flush), its drift counter counts it, and checking speeds up again;
+//   - a program overwriting the ramp continuously is answered at a
+//     backed-off rate instead of at every check;
+//   - a driver that rounds the ramp it is given is not mistaken for drift;
+//   - a monitor in a transition is left to the transition.
+//
+// Also reports the cost of a check, and the wake-ups per hour once the
+// ramps are stable. Exits non-zero on a failed check.
+//
+// Usage: bench_gammawatch [monitors] [gamma-size]
+
+#include "benchcheck.h"
+#include "benchdesk.h"
+#include "brightness.h"
+#include "gammawatch.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+namespace
+{
+  using Clock = std::chrono::steady_clock;
+  using std::chrono::milliseconds;
+  using BenchCheck::Check;
+
+  using BenchDesk::Desk;
+
+  // A game's ramp: everything at half
+  void Overwrite(const Desk &desk, int monitor)
+  {
+    std::vector<uint16_t> ramp = desk.Peek(monitor);
+    for (uint16_t &value : ramp)
+      value /= 2;
+    desk.backend->OverwriteGammaRamp(desk.outputs[monitor], ramp.data());
+  }
+
+  Desk MakeDesk(int monitors, int gammaSize)
+  {
+    Desk desk;
+    for (int i = 0; i < monitors; ++i)
+      desk.Add(nullptr, gammaSize);
+    desk.Attach();
+    BrightnessController::RefreshOutputs();
+    BrightnessController::BeginUpdate();
+    for (int i = 0; i < monitors; ++i)
+      BrightnessController::SetSoftwareLevels(i, 60 + i, 4000 + 100 * i);
+    BrightnessController::EndUpdate();
+    return desk;
+  }
+
+  void WatchdogChecks(int monitors, int gammaSize)
+  {
+    std::printf("Watchdog, %d monitors, %d ramp entries\n", monitors, gammaSize);
+    Desk desk = MakeDesk(monitors, gammaSize);
+    GammaWatchdog::Options options;
+    GammaWatchdog watchdog(options);
+
+    // Stable: reads only, backing off
+    FakeDisplayBackend::Counters before = desk.backend->GetCounters();
+    milliseconds interval = watchdog.Reset();
+    std::vector<milliseconds> intervals;
+    for (int i = 0; i < 8; ++i)
+      intervals.push_back(watchdog.Check());
+    FakeDisplayBackend::Counters after = desk.backend->GetCounters();
+    Check(interval == options.minInterval && intervals[0] == options.minInterval * 2 &&
+              intervals.back() == options.maxInterval && std::is_sorted(intervals.begin(), intervals.end()),
+          "stable ramps: interval backs off to the maximum");
+    Check(after.gammaReads - before.gammaReads == 8u * monitors && after.gammaWrites == before.gammaWrites &&
+              after.gammaFlushes == before.gammaFlushes,
+          "stable ramps: one read per monitor, no writes");
+
+    // One monitor overwritten
+    std::vector<uint16_t> ours = desk.Peek(1);
+    Overwrite(desk, 1);
+    before = desk.backend->GetCounters();
+    interval = watchdog.Check();
+    after = desk.backend->GetCounters();
+    Check(desk.Peek(1) == ours && after.gammaWrites - before.gammaWrites == 1 &&
+              after.gammaFlushes - before.gammaFlushes == 1,
+          "overwritten ramp restored, that monitor only, one flush");
+    bool counted = BrightnessController::GetGammaDriftCount(1) == 1;
+    for (int i = 0; i < monitors; ++i)
+      counted = counted && (i == 1 || BrightnessController::GetGammaDriftCount(i) == 0);
+    Check(counted && interval == options.minInterval, "drift counted per monitor, checking speeds up");
+    interval = watchdog.Check();
+    Check(interval == options.minInterval * 2, "quiet again: backing off");
+
+    // Something overwriting the ramp before every check
+    std::vector<milliseconds> contested;
+    for (int i = 0; i < 6; ++i)
+    {
+      Overwrite(desk, 0);
+      contested.push_back(watchdog.Check());
+    }
+    Check(contested[0] == options.minInterval && contested[1] == options.minInterval * 2 &&
+              contested.back() == options.maxInterval && watchdog.GetStats().contested == 5 &&
+              BrightnessController::GetGammaDriftCount(0) == 6,
+          "continuous overwriting: restored at a backed-off rate");
+
+    // A driver that keeps 8 bits of every entry
+    BrightnessController::SetSoftwareLevels(2, 45, 3300);
+    std::vector<uint16_t> rounded = desk.Peek(2);
+    for (uint16_t &value : rounded)
+      value &= 0xFF00;
+    desk.backend->OverwriteGammaRamp(desk.outputs[2], rounded.data());
+    before = desk.backend->GetCounters();
+    for (int i = 0; i < 4; ++i)
+      watchdog.Check();
+    after = desk.backend->GetCounters();
+    Check(after.gammaWrites == before.gammaWrites && BrightnessController::GetGammaDriftCount(2) == 0,
+          "driver rounding is not drift");
+
+    // A transition writes every frame anyway
+    BrightnessController::StartTransition(3 % monitors, TransitionTarget{20, 2500, -1}, milliseconds(2000));
+    GammaVerifyResult result = BrightnessController::VerifyGammaRamps();
+    Check(result.busy == 1 && result.checked == monitors - 1, "monitor in a transition skipped");
+    BrightnessController::CancelTransition(3 % monitors);
+
+    // Cost
+    watchdog.Reset();
+    const int checks = 2000;
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < checks; ++i)
+      BrightnessController::VerifyGammaRamps();
+    double checkUs = std::chrono::duration<double, std::micro>(Clock::now() - start).count() / checks;
+    std::printf("  check of %d ramps: %.2f us; stable: %.0f wake-ups per hour\n", monitors, checkUs,
+                3600000.0 / options.maxInterval.count());
+
+    BenchDesk::TearDown();
+  }
+}
+
+int main(int argc, char **argv)
+{
+  int monitors = argc > 1 ? std::max(4, std::atoi(argv[1])) : 4; // The checks use monitors 0 to 3
+  int gammaSize = argc > 2 ? std::max(256, std::atoi(argv[2])) : 256;
+
+  WatchdogChecks(monitors, gammaSize);
+
+  return BenchCheck::Finish();
+}
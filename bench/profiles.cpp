@@ -0,0 +1,324 @@
+// Per-application profile check: loads profile files, runs the rule index
+// against a linear scan, and switches profiles on a FakeDisplayBackend with
+// one DDC/CI monitor and one without, fed by a SimulatedFocusSource.
+// Verifies that
+//
+//   - profiles.ini parses, and bad lines are reported with their number;
+//   - the indexed matcher picks the same rule as testing every rule in
+//     turn, for every event, and honours rule order and case;
+//   - a switch writes one gamma ramp per monitor in one flush, DDC/CI and
+//     colour effects only where they change, and serves repeat switches
+//     from the ramp cache;
+//   - focus events that keep the profile cost no display traffic, leaving
+//     every profile restores the user's levels, and a monitor that appears
+//     while a profile is active gets it.
+//
+// Also reports the cost of a lookup against the linear scan. Exits non-zero
+// on a failed check.
+//
+// Usage: bench_profiles [rules]
+
+#include "benchcheck.h"
+#include "benchdesk.h"
+#include "brightness.h"
+#include "bwfilter.h"
+#include "profiles.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace
+{
+  using Clock = std::chrono::steady_clock;
+  using std::chrono::milliseconds;
+  using BenchCheck::Check;
+
+  void WriteFile(const std::filesystem::path &path, const char *text)
+  {
+    std::ofstream(path, std::ios::binary) << text;
+  }
+
+  bool LoadError(const std::filesystem::path &path, const char *text, const std::string &expected)
+  {
+    WriteFile(path, text);
+    std::vector<AppProfile> profiles;
+    std::vector<ProfileRule> rules;
+    std::string error;
+    return !ProfileUtils::Load(path, profiles, rules, &error) && error.compare(0, expected.size(), expected) == 0;
+  }
+
+  void LoaderChecks(const std::filesystem::path &directory)
+  {
+    std::printf("Profile file\n");
+    std::filesystem::path path = directory / "profiles.ini";
+    WriteFile(path, "\xEF\xBB\xBF# Evening work\n"
+                    "[Terminal]\n"
+                    "brightness = 60\n"
+                    "temperature = 3400\n"
+                    "match = WindowsTerminal.exe\n"
+                    "match = * | vim\n"
+                    "\n"
+                    "; Reading\n"
+                    "[ Reader ]\n"
+                    "Hardware = 30\n"
+                    "grayscale = 1\n"
+                    "sepia = 0.25\n"
+                    "match = | Caf\xC3\xA9 \xF0\x9F\x93\x96\r\n");
+    std::vector<AppProfile> profiles;
+    std::vector<ProfileRule> rules;
+    bool loaded = ProfileUtils::Load(path, profiles, rules);
+    Check(loaded && profiles.size() == 2 && profiles[0].name == "Terminal" && profiles[0].softwareBrightness == 60 &&
+              profiles[0].softwareColorTemp == 3400 && profiles[0].hardwareBrightness == -1 &&
+              profiles[1].name == "Reader" && profiles[1].hardwareBrightness == 30 && profiles[1].effects.size() == 2 &&
+              profiles[1].effects[0].first == ColorEffect::Grayscale && profiles[1].effects[1].second == 0.25,
+          "profiles and their levels");
+
+    std::wstring cafe = L"Café ";
+    if (sizeof(wchar_t) == 2)
+      cafe += L"\xD83D\xDCD6";
+    else
+      cafe += static_cast<wchar_t>(0x1F4D6);
+    Check(loaded && rules.size() == 3 && rules[0].process == L"WindowsTerminal.exe" && rules[0].title.empty() &&
+              rules[0].profile == 0 && rules[1].process.empty() && rules[1].title == L"vim" &&
+              rules[2].process.empty() && rules[2].title == cafe && rules[2].profile == 1,
+          "rules in file order, UTF-8 titles decoded");
+
+    Check(LoadError(path, "[A]\nbrightness = 0\n", "line 2:") &&
+              LoadError(path, "match = x.exe\n", "line 1:") &&
+              LoadError(path, "[A]\nmatch = * |\n", "line 2:") &&
+              LoadError(path, "[A]\n\n[B]\nsaturation = 1\n", "line 4:") &&
+              LoadError(path, "[A]\ntemperature = 3400K\n", "line 2:") &&
+              LoadError(path, "[]\n", "line 1:") && !ProfileUtils::Load(directory / "missing.ini", profiles, rules),
+          "bad lines reported by number");
+  }
+
+  // Rules over a pool of applications, about a third naming a process only,
+  // a third a title only, and the rest both
+  std::vector<ProfileRule> MakeRules(size_t count, std::mt19937 &random)
+  {
+    static const wchar_t *const WORDS[] = {L"vim", L"ssh", L"build", L"Release", L"player", L"meeting", L"chat",
+                                           L"PDF", L"review", L"draft", L"sheet", L"debug", L"log", L"mail"};
+    std::vector<ProfileRule> rules;
+    for (size_t i = 0; i < count; ++i)
+    {
+      ProfileRule rule;
+      int kind = static_cast<int>(random() % 3);
+      if (kind != 1)
+        rule.process = L"App" + std::to_wstring(random() % 200) + L".exe";
+      if (kind != 0)
+        rule.title = std::wstring(WORDS[random() % 14]) + L" " + std::to_wstring(random() % 40);
+      rule.profile = random() % 8;
+      rules.push_back(rule);
+    }
+    return rules;
+  }
+
+  void MatcherChecks(size_t ruleCount)
+  {
+    std::printf("Matcher, %zu rules\n", ruleCount);
+    std::vector<ProfileRule> small = {
+        {L"", L"Meeting", 0},
+        {L"Code.exe", L"", 1},
+        {L"code.exe", L"meeting", 2},
+        {L"", L"", 3},
+    };
+    ProfileMatcher matcher(small);
+    Check(matcher.Match(L"CODE.EXE", L"main.cpp - Visual Studio Code") == 1 &&
+              matcher.Match(L"code.exe", L"Team MEETING notes") == 0 && matcher.Match(L"other.exe", L"") == 3,
+          "first rule wins, case ignored");
+    Check(ProfileMatcher().Match(L"code.exe", L"anything") == ProfileMatcher::NO_MATCH,
+          "no rules, no match");
+
+    // Overlapping patterns: the automaton must find "she" inside "ushers"
+    // through a failure link, and the earliest rule among several hits
+    std::vector<ProfileRule> overlap = {{L"", L"hers", 0}, {L"", L"xyz", 1}, {L"", L"she", 2}, {L"", L"he", 3}};
+    ProfileMatcher overlapping(overlap);
+    Check(overlapping.Match(L"a.exe", L"ushers") == 0 && overlapping.Match(L"a.exe", L"ushe") == 2 &&
+              overlapping.Match(L"a.exe", L"the") == 3,
+          "overlapping title patterns");
+
+    std::mt19937 random(7);
+    std::vector<ProfileRule> rules = MakeRules(ruleCount, random);
+    ProfileMatcher indexed(rules);
+    std::vector<FocusEvent> events;
+    for (int i = 0; i < 20000; ++i)
+    {
+      FocusEvent event;
+      event.process = L"app" + std::to_wstring(random() % 250) + L".EXE";
+      // Most titles hit a word, some a rule's exact pattern
+      const ProfileRule &near = rules[random() % rules.size()];
+      event.title = L"~/src " + (near.title.empty() ? std::wstring(L"build") : near.title) + L" - " +
+                    std::to_wstring(random() % 1000);
+      events.push_back(event);
+    }
+    size_t mismatches = 0;
+    size_t matched = 0;
+    for (const FocusEvent &event : events)
+    {
+      size_t rule = indexed.Match(event.process, event.title);
+      mismatches += rule != ProfileMatcher::MatchLinear(rules, event.process, event.title);
+      matched += rule != ProfileMatcher::NO_MATCH;
+    }
+    Check(mismatches == 0 && matched > events.size() / 4, "index agrees with the linear scan on every event");
+
+    volatile size_t sink = 0;
+    Clock::time_point start = Clock::now();
+    for (const FocusEvent &event : events)
+      sink = sink + indexed.Match(event.process, event.title);
+    double indexedNs = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / events.size();
+    start = Clock::now();
+    for (const FocusEvent &event : events)
+      sink = sink + ProfileMatcher::MatchLinear(rules, event.process, event.title);
+    double linearNs = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / events.size();
+    std::printf("  lookup %.0f ns indexed, %.0f ns linear\n", indexedNs, linearNs);
+    Check(indexedNs < linearNs, "index faster than the linear scan");
+  }
+
+  using BenchDesk::Desk;
+
+  // DISPLAY1 has DDC/CI, DISPLAY2 does not
+  Desk MakeDesk()
+  {
+    Desk desk;
+    desk.AddDdc(milliseconds(1));
+    desk.Add();
+    desk.Install();
+    BWFilter::Initialize();
+    return desk;
+  }
+
+  bool Levels(int monitor, int brightness, int kelvin)
+  {
+    return BrightnessController::GetSoftwareBrightness(monitor) == brightness &&
+           BrightnessController::GetSoftwareColorTemp(monitor) == kelvin;
+  }
+
+  void EngineChecks()
+  {
+    std::printf("Engine\n");
+    Desk desk = MakeDesk();
+    BrightnessController::SetSoftwareLevels(0, 80, 6500);
+    BrightnessController::SetSoftwareLevels(1, 90, 5000);
+    BrightnessController::SetHardwareBrightness(0, 50);
+
+    std::vector<AppProfile> profiles(3);
+    profiles[0].name = "Terminal";
+    profiles[0].softwareBrightness = 60;
+    profiles[0].softwareColorTemp = 3400;
+    profiles[1].name = "Reader";
+    profiles[1].hardwareBrightness = 30;
+    profiles[1].effects = {{ColorEffect::Grayscale, 1.0}};
+    profiles[2].name = "Video";
+    profiles[2].softwareBrightness = 100;
+    std::vector<ProfileRule> rules = {
+        {L"WindowsTerminal.exe", L"", 0},
+        {L"", L".pdf", 1},
+        {L"vlc.exe", L"", 2},
+    };
+    ProfileEngine engine(profiles, rules);
+    SimulatedFocusSource focus;
+    focus.Start([&](const FocusEvent &event)
+                { engine.OnFocus(event); });
+
+    FakeDisplayBackend::Counters before = desk.backend->GetCounters();
+    focus.Focus(L"explorer.exe", L"Downloads");
+    FakeDisplayBackend::Counters after = desk.backend->GetCounters();
+    Check(engine.GetActiveProfile() == ProfileEngine::NO_PROFILE && after.gammaWrites == before.gammaWrites,
+          "no rule, no profile, no writes");
+
+    before = after;
+    focus.Focus(L"WindowsTerminal.exe", L"PowerShell");
+    after = desk.backend->GetCounters();
+    Check(engine.GetActiveProfile() == 0 && Levels(0, 60, 3400) && Levels(1, 60, 3400) &&
+              after.gammaWrites - before.gammaWrites == 2 && after.gammaFlushes - before.gammaFlushes == 1 &&
+              after.colorMatrixWrites == before.colorMatrixWrites,
+          "switch: one ramp per monitor, one flush");
+
+    // A terminal updates its title constantly
+    before = after;
+    Clock::time_point start = Clock::now();
+    const int titleEvents = 1000;
+    for (int i = 0; i < titleEvents; ++i)
+      focus.Focus(L"WindowsTerminal.exe", L"PowerShell - build " + std::to_wstring(i));
+    double eventUs = std::chrono::duration<double, std::micro>(Clock::now() - start).count() / titleEvents;
+    after = desk.backend->GetCounters();
+    std::printf("  title change handled in %.2f us\n", eventUs);
+    Check(after.gammaWrites == before.gammaWrites && engine.GetStats().switches == 1,
+          "title changes within a profile cost no writes");
+
+    // Reader sets no gamma levels, so the terminal's are undone
+    before = after;
+    focus.Focus(L"AcroRd32.exe", L"manual.PDF - Reader");
+    after = desk.backend->GetCounters();
+    Check(engine.GetActiveProfile() == 1 && Levels(0, 80, 6500) && Levels(1, 90, 5000) &&
+              BrightnessController::GetHardwareBrightness(0) == 30 && BWFilter::GetEffect(ColorEffect::Grayscale) == 1.0 &&
+              after.gammaWrites - before.gammaWrites == 2 && after.colorMatrixWrites - before.colorMatrixWrites == 1,
+          "switch between profiles: each level set once");
+
+    GammaRampStats ramps = BrightnessController::GetGammaRampStats();
+    for (int round = 0; round < 5; ++round)
+    {
+      focus.Focus(L"WindowsTerminal.exe", L"PowerShell");
+      focus.Focus(L"AcroRd32.exe", L"manual.pdf");
+      focus.Focus(L"vlc.exe", L"film.mkv");
+    }
+    GammaRampStats rampsAfter = BrightnessController::GetGammaRampStats();
+    Check(rampsAfter.cacheMisses - ramps.cacheMisses <= 2 && rampsAfter.cacheHits - ramps.cacheHits >= 20,
+          "repeat switches served from the ramp cache");
+
+    // A monitor plugged in while a profile is active gets it too
+    focus.Focus(L"WindowsTerminal.exe", L"PowerShell");
+    desk.Add();
+    TopologyChange change;
+    BrightnessController::UpdateOutputs(change);
+    int added = change.added.empty() ? -1 : change.added[0];
+    int addedBrightness = BrightnessController::GetSoftwareBrightness(added);
+    engine.Refresh();
+    Check(added >= 0 && Levels(added, 60, 3400) && Levels(0, 60, 3400), "new monitor joins the active profile");
+
+    focus.Focus(L"explorer.exe", L"Downloads");
+    Check(engine.GetActiveProfile() == ProfileEngine::NO_PROFILE && Levels(0, 80, 6500) && Levels(1, 90, 5000) &&
+              Levels(added, addedBrightness, 6500) && BrightnessController::GetHardwareBrightness(0) == 50 &&
+              BWFilter::GetEffect(ColorEffect::Grayscale) == 0.0,
+          "leaving the profiles restores the user's levels");
+
+    ProfileEngine::Stats stats = engine.GetStats();
+    std::printf("  %llu events, %llu switches, %llu monitor writes, %llu DDC/CI writes, %llu effect changes\n",
+                static_cast<unsigned long long>(stats.events), static_cast<unsigned long long>(stats.switches),
+                static_cast<unsigned long long>(stats.monitorWrites),
+                static_cast<unsigned long long>(stats.hardwareWrites),
+                static_cast<unsigned long long>(stats.effectChanges));
+
+    focus.Stop();
+    BWFilter::Cleanup();
+    BrightnessController::Cleanup(); // Flushes the worker
+    Check(desk.ddc[0]->GetCurrent() == 50 && !focus.Focus(L"vlc.exe", L""), "DDC/CI back on the user's level");
+    SetDisplayBackend(nullptr);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  size_t ruleCount = argc > 1 ? static_cast<size_t>(std::max(1, std::atoi(argv[1]))) : 500;
+
+  std::error_code ec;
+  std::filesystem::path directory = std::filesystem::temp_directory_path(ec) / "candela_bench_profiles";
+  std::filesystem::remove_all(directory, ec);
+  std::filesystem::create_directories(directory, ec);
+
+  LoaderChecks(directory);
+  MatcherChecks(ruleCount);
+  EngineChecks();
+
+  std::filesystem::remove_all(directory, ec);
+
+  return BenchCheck::Finish();
+}
@@ -0,0 +1,209 @@
+// Settings store benchmark: how long does SettingsStore::Load take with
+// 1,000 stored monitors, from the snapshot alone, with a journal of recent
+// changes on top, and from a journal alone (what the snapshot saves)?
+//
+// Also checks the file format's recovery paths: a torn record at the end of
+// the journal, a journal left over from before a compaction, a corrupted
+// snapshot, and names outside the BMP. Exits non-zero on a failed check.
+//
+// Usage: bench_settingsstore [monitors] [loads]
+
+#include "benchcheck.h"
+#include "settingsstore.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <system_error>
+
+namespace
+{
+  using Clock = std::chrono::steady_clock;
+  namespace fs = std::filesystem;
+  using BenchCheck::Check;
+
+  bool Equal(const MonitorSettings &a, const MonitorSettings &b)
+  {
+    return a.showSoftware == b.showSoftware && a.showHardware == b.showHardware &&
+           a.unifiedBrightness == b.unifiedBrightness && a.lastSoftwareBrightness == b.lastSoftwareBrightness &&
+           a.lastHardwareBrightness == b.lastHardwareBrightness && a.lastStandardColorTemp == b.lastStandardColorTemp;
+  }
+
+  bool Equal(const StoredSettings &a, const StoredSettings &b)
+  {
+    if (a.startOnBoot != b.startOnBoot || a.showBWToggle != b.showBWToggle || a.bwEnabled != b.bwEnabled ||
+        a.autoBrightness != b.autoBrightness || a.monitors.size() != b.monitors.size())
+      return false;
+    for (auto ia = a.monitors.begin(), ib = b.monitors.begin(); ia != a.monitors.end(); ++ia, ++ib)
+      if (ia->first != ib->first || !Equal(ia->second, ib->second))
+        return false;
+    return true;
+  }
+
+  // Every display a long-lived machine has seen: docks, projectors, TVs.
+  StoredSettings MakeSettings(size_t count)
+  {
+    StoredSettings settings;
+    settings.startOnBoot = true;
+    settings.bwEnabled = true;
+    settings.autoBrightness = true;
+    for (size_t i = 0; i < count; ++i)
+    {
+      MonitorSettings &monitor = settings.monitors[L"\\\\.\\DISPLAY" + std::to_wstring(i + 1)];
+      monitor.showHardware = i % 3 != 0;
+      monitor.unifiedBrightness = i % 4 == 1;
+      monitor.lastSoftwareBrightness = static_cast<int>(1 + i % 100);
+      monitor.lastHardwareBrightness = static_cast<int>(i % 101);
+      monitor.lastStandardColorTemp = static_cast<int>(1200 + (i % 54) * 100);
+    }
+    return settings;
+  }
+
+  double TimeLoads(const fs::path &dir, int loads, StoredSettings &loaded)
+  {
+    auto start = Clock::now();
+    for (int i = 0; i < loads; ++i)
+    {
+      SettingsStore store(dir);
+      store.Load(loaded);
+    }
+    return std::chrono::duration<double, std::micro>(Clock::now() - start).count() / loads;
+  }
+
+  uintmax_t FileSize(const fs::path &path)
+  {
+    std::error_code ec;
+    uintmax_t size = fs::file_size(path, ec);
+    return ec ? 0 : size;
+  }
+}
+
+int main(int argc, char **argv)
+{
+  size_t count = argc > 1 ? static_cast<size_t>(std::atoi(argv[1])) : 1000;
+  int loads = argc > 2 ? std::atoi(argv[2]) : 200;
+
+  fs::path dir = fs::temp_directory_path() / ("candela-bench-" + std::to_string(Clock::now().time_since_epoch().count()));
+  StoredSettings expected = MakeSettings(count);
+  StoredSettings loaded;
+
+  std::printf("Load, %zu stored monitors (average of %d)\n", count, loads);
+  {
+    SettingsStore store(dir);
+    store.Load(loaded);
+    store.Compact(expected);
+  }
+  double snapshotOnly = TimeLoads(dir, loads, loaded);
+  Check(Equal(loaded, expected), "snapshot round-trips every monitor");
+
+  // A session's worth of changes on top of the snapshot.
+  {
+    SettingsStore store(dir);
+    store.Load(loaded);
+    for (int i = 0; i < 200; ++i)
+    {
+      MonitorSettings &monitor = expected.monitors[L"\\\\.\\DISPLAY" + std::to_wstring(i % 10 + 1)];
+      monitor.lastStandardColorTemp = 1200 + i * 10;
+      store.AppendMonitor(L"\\\\.\\DISPLAY" + std::to_wstring(i % 10 + 1), monitor);
+    }
+    expected.showBWToggle = true;
+    store.AppendGlobals(expected);
+    store.Sync();
+  }
+  double withJournal = TimeLoads(dir, loads, loaded);
+  Check(Equal(loaded, expected), "journal replays on top of the snapshot");
+
+  // The same data held only as journal records.
+  fs::path journalDir = dir / "journal-only";
+  {
+    SettingsStore store(journalDir);
+    store.Load(loaded);
+    for (const auto &pair : expected.monitors)
+      store.AppendMonitor(pair.first, pair.second);
+    store.AppendGlobals(expected);
+    store.Sync();
+  }
+  double journalOnly = TimeLoads(journalDir, loads, loaded);
+  Check(Equal(loaded, expected), "journal alone reproduces the settings");
+
+  std::printf("  %-34s %10s %12s\n", "layout", "load us", "bytes");
+  std::printf("  %-34s %10.1f %12ju\n", "snapshot", snapshotOnly, FileSize(dir / "settings.bin"));
+  std::printf("  %-34s %10.1f %12ju\n", "snapshot + 201 journal records", withJournal,
+              FileSize(dir / "settings.bin") + FileSize(dir / "settings.journal"));
+  std::printf("  %-34s %10.1f %12ju\n", "journal only", journalOnly, FileSize(journalDir / "settings.journal"));
+
+  std::printf("Recovery\n");
+  {
+    // Torn append: half a record after the last good one.
+    {
+      std::ofstream torn(dir / "settings.journal", std::ios::binary | std::ios::app);
+      const char partial[] = {40, 0, 0, 0, 1, 2, 3, 4, 2, 0};
+      torn.write(partial, sizeof(partial));
+    }
+    uintmax_t tornSize = FileSize(dir / "settings.journal");
+    SettingsStore store(dir);
+    bool ok = store.Load(loaded);
+    Check(ok && Equal(loaded, expected) && FileSize(dir / "settings.journal") == tornSize - 10,
+          "torn journal tail is cut off");
+
+    // Appends after recovery are readable again.
+    expected.monitors[L"\\\\.\\DISPLAY1"].lastSoftwareBrightness = 42;
+    store.AppendMonitor(L"\\\\.\\DISPLAY1", expected.monitors[L"\\\\.\\DISPLAY1"]);
+    store.Sync();
+    SettingsStore reread(dir);
+    reread.Load(loaded);
+    Check(Equal(loaded, expected), "appends after recovery replay");
+
+    // Compaction folds the journal in and bumps the generation. A journal
+    // restored from before it (as if the reset never happened) must be
+    // ignored, or its older value would win over the snapshot's.
+    fs::copy_file(dir / "settings.journal", dir / "old.journal", fs::copy_options::overwrite_existing);
+    expected.monitors[L"\\\\.\\DISPLAY1"].lastSoftwareBrightness = 43;
+    bool compacted = store.Compact(expected);
+    Check(compacted && store.GetStats().journalRecords == 0, "compaction empties the journal");
+    fs::copy_file(dir / "old.journal", dir / "settings.journal", fs::copy_options::overwrite_existing);
+    SettingsStore stale(dir);
+    stale.Load(loaded);
+    Check(Equal(loaded, expected) && stale.GetStats().journalRecords == 0, "journal from before compaction ignored");
+
+    // Corrupt one byte of a record: the checksum must catch it.
+    {
+      std::fstream file(dir / "settings.bin", std::ios::binary | std::ios::in | std::ios::out);
+      file.seekp(40);
+      file.put('\x7f');
+    }
+    SettingsStore corrupt(dir);
+    Check(!corrupt.Load(loaded), "corrupted snapshot rejected");
+  }
+
+  {
+    // Names are stored as UTF-16 regardless of wchar_t's width.
+    StoredSettings unicode;
+    unicode.monitors[L"Bildschirm äöü"].lastSoftwareBrightness = 10;
+    unicode.monitors[std::wstring(L"Emoji ") + static_cast<wchar_t>(0x1F5B5)].lastSoftwareBrightness = 20;
+    fs::path unicodeDir = dir / "unicode";
+    SettingsStore store(unicodeDir);
+    store.Load(loaded);
+    store.Compact(unicode);
+    SettingsStore reread(unicodeDir);
+    bool ok = reread.Load(loaded);
+    Check(ok && Equal(loaded, unicode), "non-ASCII device names round-trip");
+  }
+
+  {
+    SettingsStore store(dir / "threshold");
+    store.Load(loaded);
+    for (uint64_t i = 0; i < SettingsStore::COMPACT_RECORDS - 1; ++i)
+      store.AppendGlobals(loaded);
+    bool before = store.NeedsCompaction();
+    store.AppendGlobals(loaded);
+    Check(!before && store.NeedsCompaction(), "compaction requested at the record threshold");
+  }
+
+  std::error_code ec;
+  fs::remove_all(dir, ec);
+
+  return BenchCheck::Finish();
+}
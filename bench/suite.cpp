@@ -0,0 +1,407 @@
+// Benchmark suite: times the colour, ramp, device-name and enumeration paths
+// and writes the results as JSON. With --baseline it compares each case
+// against a stored run and fails if one got slower than the threshold.
+//
+// Each case is calibrated to run for about BATCH_TARGET per batch and
+// timed over several batches. The fastest batch is what gets compared: on a
+// busy machine the median drifts by a quarter between runs, the minimum by
+// a few percent, and a real slowdown raises both.
+//
+// Usage: bench_suite [--json PATH] [--baseline PATH] [--threshold PERCENT]
+//                    [--latency-ms N] [--monitors N] [--filter TEXT]
+//
+//   make bench-baseline   records a run as the baseline (bench/baseline.json)
+//   make bench-check      compares a fresh run against it
+
+#include "brightness.h"
+#include "colortemp.h"
+#include "ddcsim.h"
+#include "devicename.h"
+#include "fakebackend.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+  using Clock = std::chrono::steady_clock;
+
+  const auto BATCH_TARGET = std::chrono::milliseconds(10);
+  const int BATCHES = 30;
+  const int FIXED_BATCHES = 5; // For the I/O-bound cases, which take far longer
+
+  struct Options
+  {
+    std::string jsonPath;
+    std::string baselinePath;
+    double thresholdPercent = 20.0;
+    int latencyMs = 5;
+    int monitors = 3;
+    std::string filter;
+  };
+
+  struct Case
+  {
+    std::string name;
+    // Runs the path @p iterations times.
+    std::function<void(uint64_t iterations)> run;
+    // Paths dominated by (simulated) I/O run one iteration per batch, and
+    // fewer batches.
+    bool fixedIterations = false;
+  };
+
+  struct Result
+  {
+    std::string name;
+    uint64_t iterations = 0; // Per batch
+    double medianNs = 0.0;   // Per iteration
+    double minNs = 0.0;
+    double maxNs = 0.0;
+  };
+
+  // Keeps the optimiser from discarding a result.
+  volatile uint64_t g_sink = 0;
+
+  double NanosPer(Clock::duration d, uint64_t iterations)
+  {
+    return std::chrono::duration<double, std::nano>(d).count() / static_cast<double>(iterations);
+  }
+
+  // Grows a case's batch until it takes long enough to time reliably.
+  uint64_t Calibrate(const Case &c)
+  {
+    if (c.fixedIterations)
+      return 1;
+    uint64_t iterations = 1;
+    for (;;)
+    {
+      auto start = Clock::now();
+      c.run(iterations);
+      if (Clock::now() - start >= BATCH_TARGET / 4 || iterations >= (1ull << 30))
+        break;
+      iterations *= 2;
+    }
+    return iterations * 4;
+  }
+
+  // Times every case over several rounds, one batch per case per round, so
+  // each case's batches are spread across the whole run rather than packed
+  // into one stretch a frequency change or a noisy neighbour can cover.
+  std::vector<Result> Measure(const std::vector<Case> &cases)
+  {
+    std::vector<uint64_t> iterations;
+    for (const Case &c : cases)
+      iterations.push_back(Calibrate(c));
+
+    std::vector<std::vector<double>> samples(cases.size());
+    for (int round = 0; round < BATCHES; ++round)
+    {
+      for (size_t i = 0; i < cases.size(); ++i)
+      {
+        if (cases[i].fixedIterations && round >= FIXED_BATCHES)
+          continue;
+        auto start = Clock::now();
+        cases[i].run(iterations[i]);
+        samples[i].push_back(NanosPer(Clock::now() - start, iterations[i]));
+      }
+    }
+
+    std::vector<Result> results;
+    for (size_t i = 0; i < cases.size(); ++i)
+    {
+      std::vector<double> &sorted = samples[i];
+      std::sort(sorted.begin(), sorted.end());
+      Result result;
+      result.name = cases[i].name;
+      result.iterations = iterations[i];
+      result.medianNs = sorted[sorted.size() / 2];
+      result.minNs = sorted.front();
+      result.maxNs = sorted.back();
+      results.push_back(result);
+    }
+    return results;
+  }
+
+  std::string FormatTime(double ns)
+  {
+    char buffer[32];
+    if (ns >= 1e6)
+      std::snprintf(buffer, sizeof(buffer), "%.2f ms", ns / 1e6);
+    else if (ns >= 1e3)
+      std::snprintf(buffer, sizeof(buffer), "%.2f us", ns / 1e3);
+    else
+      std::snprintf(buffer, sizeof(buffer), "%.1f ns", ns);
+    return buffer;
+  }
+
+  std::vector<Case> BuildCases(const Options &options)
+  {
+    std::vector<Case> cases;
+
+    cases.push_back({"KelvinToRGB", [](uint64_t n)
+                     {
+                       // Includes off-step temperatures, which interpolate.
+                       double r, g, b, sum = 0.0;
+                       int kelvin = ColorTempUtils::KELVIN_MIN;
+                       for (uint64_t i = 0; i < n; ++i)
+                       {
+                         ColorTempUtils::KelvinToRGB(kelvin, r, g, b);
+                         sum += r + g + b;
+                         kelvin = kelvin >= ColorTempUtils::KELVIN_MAX ? ColorTempUtils::KELVIN_MIN : kelvin + 37;
+                       }
+                       g_sink = g_sink + static_cast<uint64_t>(sum);
+                     }});
+
+    cases.push_back({"MapBrightnessToSafeFactor", [](uint64_t n)
+                     {
+                       double sum = 0.0;
+                       for (uint64_t i = 0; i < n; ++i)
+                         sum += MapBrightnessToSafeFactor(static_cast<int>(i % 100) + 1);
+                       g_sink = g_sink + static_cast<uint64_t>(sum);
+                     }});
+
+    for (int entries : {ColorTempUtils::GAMMA_RAMP_ENTRIES, 1024})
+    {
+      std::string name = "BuildGammaRamp/" + std::to_string(entries);
+      cases.push_back({name, [entries](uint64_t n)
+                       {
+                         std::vector<uint16_t> ramp(static_cast<size_t>(entries) * 3);
+                         ColorTempUtils::GammaRampOptions opts;
+                         opts.entries = entries;
+                         for (uint64_t i = 0; i < n; ++i)
+                         {
+                           opts.brightness = static_cast<int>(i % 100) + 1;
+                           opts.kelvin = ColorTempUtils::KELVIN_MIN + static_cast<int>(i % 54) * 100;
+                           ColorTempUtils::BuildGammaRamp(opts, ramp.data());
+                         }
+                         g_sink = g_sink + ramp[entries - 1];
+                       }});
+    }
+
+    // The whole software path: ramp cache, ramp build on a miss, the
+    // backend write (FakeDisplayBackend stands in for SetDeviceGammaRamp)
+    // and the flush. Alternates between two levels so every call writes.
+    cases.push_back({"ApplyGammaRamp", [](uint64_t n)
+                     {
+                       auto backend = std::make_shared<FakeDisplayBackend>();
+                       backend->AddOutput(L"\\\\.\\DISPLAY1");
+                       SetDisplayBackend(backend);
+                       BrightnessController::RefreshOutputs();
+                       for (uint64_t i = 0; i < n; ++i)
+                         BrightnessController::SetSoftwareBrightness(0, (i & 1) ? 40 : 60);
+                       BrightnessController::Cleanup();
+                       SetDisplayBackend(nullptr);
+                     }});
+
+    static const std::wstring NAMES[] = {L"\\\\.\\DISPLAY1", L"\\\\.\\DISPLAY12",
+                                         L"\\\\?\\DISPLAY#DEL40B5#5&2f1c#0&UID4352"};
+    cases.push_back({"DeviceName/Escape", [](uint64_t n)
+                     {
+                       size_t length = 0;
+                       for (uint64_t i = 0; i < n; ++i)
+                         length += DeviceNameUtils::Escape(NAMES[i % 3]).length();
+                       g_sink = g_sink + length;
+                     }});
+    cases.push_back({"DeviceName/Unescape", [](uint64_t n)
+                     {
+                       const std::wstring escaped[] = {DeviceNameUtils::Escape(NAMES[0]),
+                                                       DeviceNameUtils::Escape(NAMES[1]),
+                                                       DeviceNameUtils::Escape(NAMES[2])};
+                       size_t length = 0;
+                       for (uint64_t i = 0; i < n; ++i)
+                         length += DeviceNameUtils::Unescape(escaped[i % 3]).length();
+                       g_sink = g_sink + length;
+                     }});
+
+    // Enumeration and both probe passes, with every DDC/CI command taking
+    // the configured latency and each endpoint needing one retry to open.
+    int monitors = options.monitors;
+    std::chrono::milliseconds latency(options.latencyMs);
+    std::string name = "RefreshMonitors/" + std::to_string(monitors) + "x" + std::to_string(options.latencyMs) + "ms";
+    cases.push_back({name, [monitors, latency](uint64_t n)
+                     {
+                       auto backend = std::make_shared<FakeDisplayBackend>();
+                       for (int i = 0; i < monitors; ++i)
+                       {
+                         auto ddc = std::make_shared<SimulatedDdcMonitor>(0, 100, latency);
+                         OutputHandle output = backend->AddOutput(L"\\\\.\\DISPLAY" + std::to_wstring(i + 1), ddc);
+                         backend->SetDdcOpenFailures(output, 1);
+                       }
+                       SetDisplayBackend(backend);
+                       for (uint64_t i = 0; i < n; ++i)
+                         BrightnessController::RefreshMonitors();
+                       BrightnessController::Cleanup();
+                       SetDisplayBackend(nullptr);
+                     },
+                     true});
+
+    if (!options.filter.empty())
+      cases.erase(std::remove_if(cases.begin(), cases.end(), [&options](const Case &c)
+                                 { return c.name.find(options.filter) == std::string::npos; }),
+                  cases.end());
+    return cases;
+  }
+
+  std::string ToJson(const std::vector<Result> &results, const Options &options)
+  {
+    std::ostringstream out;
+    out << "{\n  \"suite\": \"candela\",\n  \"version\": 1,\n";
+    out << "  \"config\": {\"monitors\": " << options.monitors << ", \"latencyMs\": " << options.latencyMs << "},\n";
+    out << "  \"cases\": [";
+    char buffer[256];
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+      const Result &r = results[i];
+      std::snprintf(buffer, sizeof(buffer),
+                    "%s\n    {\"name\": \"%s\", \"unit\": \"ns\", \"iterations\": %llu, \"median\": %.3f, "
+                    "\"min\": %.3f, \"max\": %.3f}",
+                    i ? "," : "", r.name.c_str(), static_cast<unsigned long long>(r.iterations), r.medianNs, r.minNs,
+                    r.maxNs);
+      out << buffer;
+    }
+    out << "\n  ]\n}\n";
+    return out.str();
+  }
+
+  // Reads each case's fastest batch back out of a file written by ToJson.
+  // Only this suite's own output needs to be understood, not JSON in general.
+  bool ReadBaseline(const std::string &path, std::map<std::string, double> &best)
+  {
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+      return false;
+    std::stringstream contents;
+    contents << file.rdbuf();
+    const std::string text = contents.str();
+
+    const std::string nameKey = "\"name\": \"";
+    const std::string minKey = "\"min\": ";
+    for (size_t at = text.find(nameKey); at != std::string::npos; at = text.find(nameKey, at))
+    {
+      at += nameKey.size();
+      size_t end = text.find('"', at);
+      size_t min = text.find(minKey, end);
+      if (end == std::string::npos || min == std::string::npos)
+        return false;
+      best[text.substr(at, end - at)] = std::strtod(text.c_str() + min + minKey.size(), nullptr);
+      at = min;
+    }
+    return !best.empty();
+  }
+
+  // The escaping is a straight move out of Settings; make sure it still
+  // round-trips and still reads names written by the old scheme.
+  bool CheckDeviceNames()
+  {
+    bool ok = true;
+    for (const wchar_t *name : {L"\\\\.\\DISPLAY1", L"\\\\?\\DISPLAY#DEL40B5#0", L"#", L"\\"})
+      ok = ok && DeviceNameUtils::Unescape(DeviceNameUtils::Escape(name)) == name;
+    ok = ok && DeviceNameUtils::Escape(L"\\\\.\\A#1") == L"####.##A#01";
+    ok = ok && DeviceNameUtils::Unescape(L"#.#DISPLAY1#") == L"\\.\\DISPLAY1\\";
+    std::printf("  %-60s %s\n", "device names round-trip, legacy names decode", ok ? "ok" : "FAIL");
+    return ok;
+  }
+
+  bool ParseOptions(int argc, char **argv, Options &options)
+  {
+    for (int i = 1; i < argc; ++i)
+    {
+      std::string arg = argv[i];
+      const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+      if (!value)
+        return false;
+      if (arg == "--json")
+        options.jsonPath = value;
+      else if (arg == "--baseline")
+        options.baselinePath = value;
+      else if (arg == "--threshold")
+        options.thresholdPercent = std::atof(value);
+      else if (arg == "--latency-ms")
+        options.latencyMs = std::atoi(value);
+      else if (arg == "--monitors")
+        options.monitors = std::atoi(value);
+      else if (arg == "--filter")
+        options.filter = value;
+      else
+        return false;
+      ++i;
+    }
+    return options.monitors > 0 && options.latencyMs >= 0 && options.thresholdPercent >= 0.0;
+  }
+}
+
+int main(int argc, char **argv)
+{
+  Options options;
+  if (!ParseOptions(argc, argv, options))
+  {
+    std::fprintf(stderr, "usage: %s [--json PATH] [--baseline PATH] [--threshold PERCENT] "
+                         "[--latency-ms N] [--monitors N] [--filter TEXT]\n",
+                 argv[0]);
+    return 2;
+  }
+
+  std::map<std::string, double> baseline;
+  if (!options.baselinePath.empty() && !ReadBaseline(options.baselinePath, baseline))
+  {
+    std::fprintf(stderr, "cannot read baseline %s\n", options.baselinePath.c_str());
+    return 2;
+  }
+
+  if (!CheckDeviceNames())
+    return 1;
+
+  std::vector<Result> results = Measure(BuildCases(options));
+  int regressions = 0;
+  std::printf("%-28s %12s %12s %12s", "case", "median", "min", "max");
+  if (!baseline.empty())
+    std::printf(" %12s %8s", "baseline", "change");
+  std::printf("\n");
+
+  for (const Result &r : results)
+  {
+    std::printf("%-28s %12s %12s %12s", r.name.c_str(), FormatTime(r.medianNs).c_str(), FormatTime(r.minNs).c_str(),
+                FormatTime(r.maxNs).c_str());
+
+    auto it = baseline.find(r.name);
+    if (it != baseline.end() && it->second > 0.0)
+    {
+      double change = (r.minNs / it->second - 1.0) * 100.0;
+      bool regressed = change > options.thresholdPercent;
+      std::printf(" %12s %+7.1f%% %s", FormatTime(it->second).c_str(), change, regressed ? "FAIL" : "ok");
+      if (regressed)
+        ++regressions;
+    }
+    else if (!baseline.empty())
+      std::printf(" %12s %8s", "-", "new");
+    std::printf("\n");
+  }
+
+  if (!options.jsonPath.empty())
+  {
+    std::ofstream file(options.jsonPath, std::ios::binary | std::ios::trunc);
+    file << ToJson(results, options);
+    if (!file)
+    {
+      std::fprintf(stderr, "cannot write %s\n", options.jsonPath.c_str());
+      return 2;
+    }
+  }
+
+  if (regressions)
+  {
+    std::printf("FAIL: %d case(s) slower than the baseline by more than %.0f%%\n", regressions,
+                options.thresholdPercent);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,283 @@
+// Display-change check: runs BrightnessController::UpdateOutputs against
+// FakeDisplayBackend desks and verifies that
+//
+//   - a mode change that leaves every monitor in place costs no DDC/CI
+//     command and rewrites only the ramp the driver reset;
+//   - kept monitors keep their DDC/CI endpoint, worker and running transition;
+//   - an unplugged monitor is released and a new one is the only one probed;
+//   - a different monitor behind the same handle and name is probed afresh;
+//   - a hardware probe cut short by the update is picked up by the next one;
+//   - a display change or refresh on one thread waits for a batch another
+//     thread has open, instead of freeing the monitors it is writing.
+//
+// Also reports how long a full refresh and an incremental update take for
+// the same desk. Exits non-zero on a failed check.
+//
+// Usage: bench_topology [latency_ms] [monitors]
+
+#include "benchcheck.h"
+#include "benchdesk.h"
+#include "brightness.h"
+#include "colortemp.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+  using Clock = std::chrono::steady_clock;
+  using BenchCheck::Check;
+
+  double Millis(Clock::duration d)
+  {
+    return std::chrono::duration<double, std::milli>(d).count();
+  }
+
+  using BenchDesk::Desk;
+  using BenchDesk::MakeEdid;
+
+  // Adds the next DDC/CI monitor, with an EDID of its own.
+  void AddMonitor(Desk &desk, std::chrono::milliseconds latency)
+  {
+    desk.AddDdc(latency);
+    desk.backend->SetEdid(desk.outputs.back(), MakeEdid("CDL", 0x1000, static_cast<uint32_t>(desk.outputs.size())).data());
+  }
+
+  // @p count DDC/CI monitors, enumerated and probed, with a dimmed ramp on
+  // every output so a driver reset is visible.
+  Desk MakeDesk(size_t count, std::chrono::milliseconds latency)
+  {
+    Desk desk;
+    for (size_t i = 0; i < count; ++i)
+      AddMonitor(desk, latency);
+    desk.Install();
+    BrightnessController::BeginUpdate();
+    for (size_t i = 0; i < count; ++i)
+      BrightnessController::SetSoftwareBrightness(static_cast<int>(i), 60);
+    BrightnessController::EndUpdate();
+    return desk;
+  }
+
+  int IndexOf(const std::wstring &deviceName)
+  {
+    const auto &monitors = BrightnessController::GetMonitors();
+    for (size_t i = 0; i < monitors.size(); ++i)
+      if (monitors[i].deviceName == deviceName)
+        return static_cast<int>(i);
+    return -1;
+  }
+
+  void ModeChangeChecks(std::chrono::milliseconds latency, size_t count)
+  {
+    std::printf("Mode change, %zu monitors\n", count);
+    Desk desk = MakeDesk(count, latency);
+    const auto &monitors = BrightnessController::GetMonitors();
+
+    std::vector<DdcHandle> handles;
+    std::vector<DdcWorker *> workers;
+    for (const Monitor &monitor : monitors)
+    {
+      handles.push_back(monitor.ddc[0].handle);
+      workers.push_back(monitor.ddc[0].worker.get());
+    }
+
+    // The driver drops the last monitor's ramp with its new mode.
+    const size_t resetIndex = count - 1;
+    std::vector<uint16_t> dimmed(ColorTempUtils::GAMMA_RAMP_ENTRIES * 3);
+    desk.backend->PeekGammaRamp(desk.outputs[resetIndex], dimmed.data());
+    std::vector<uint16_t> identity(ColorTempUtils::GAMMA_RAMP_ENTRIES * 3);
+    for (int i = 0; i < ColorTempUtils::GAMMA_RAMP_ENTRIES; ++i)
+      for (int c = 0; c < 3; ++c)
+        identity[i + c * ColorTempUtils::GAMMA_RAMP_ENTRIES] =
+            static_cast<uint16_t>(i * 65535 / (ColorTempUtils::GAMMA_RAMP_ENTRIES - 1));
+    desk.backend->OverwriteGammaRamp(desk.outputs[resetIndex], identity.data());
+
+    uint64_t commands = desk.DdcCommands();
+    FakeDisplayBackend::Counters before = desk.backend->GetCounters();
+    TopologyChange change;
+    bool found = BrightnessController::UpdateOutputs(change);
+    FakeDisplayBackend::Counters after = desk.backend->GetCounters();
+
+    Check(found && change.kept == count && change.added.empty() && change.removed.empty(),
+          "every monitor kept");
+    Check(desk.DdcCommands() == commands, "no DDC/CI command sent");
+
+    bool sameHandles = monitors.size() == count;
+    for (size_t i = 0; sameHandles && i < count; ++i)
+      sameHandles = monitors[i].ddc.size() == 1 && monitors[i].ddc[0].handle == handles[i] &&
+                    monitors[i].ddc[0].worker.get() == workers[i] &&
+                    BrightnessController::GetHardwareProbeState(static_cast<int>(i)) == HardwareProbeState::Available;
+    Check(sameHandles, "DDC/CI endpoints and workers carried over");
+    Check(!BrightnessController::StartHardwareProbe(), "nothing left to probe");
+
+    std::vector<uint16_t> shown(dimmed.size());
+    desk.backend->PeekGammaRamp(desk.outputs[resetIndex], shown.data());
+    Check(change.reset.size() == 1 && change.reset[0] == static_cast<int>(resetIndex) &&
+              after.gammaWrites - before.gammaWrites == 1 && shown == dimmed,
+          "only the reset ramp rewritten");
+
+    BrightnessController::StartTransition(0, TransitionTarget{20, -1, -1}, std::chrono::seconds(10));
+    BrightnessController::UpdateOutputs(change);
+    Check(BrightnessController::IsTransitioning(0), "running transition survives");
+    BenchDesk::TearDown();
+  }
+
+  void HotplugChecks(std::chrono::milliseconds latency, size_t count)
+  {
+    std::printf("Hotplug\n");
+    Desk desk = MakeDesk(count, latency);
+
+    // One monitor unplugged, another plugged in.
+    desk.backend->RemoveOutput(desk.outputs[1]);
+    AddMonitor(desk, latency);
+    uint64_t keptCommands = desk.DdcCommands() - desk.ddc[1]->GetCommandCount();
+
+    TopologyChange change;
+    BrightnessController::UpdateOutputs(change);
+    std::wstring pluggedName = BenchDesk::DisplayName(count + 1);
+    int added = IndexOf(pluggedName);
+    Check(change.removed.size() == 1 && change.removed[0] == L"\\\\.\\DISPLAY2" && IndexOf(L"\\\\.\\DISPLAY2") < 0,
+          "unplugged monitor released");
+    Check(change.added.size() == 1 && change.added[0] == added && change.kept == count - 1 &&
+              BrightnessController::GetHardwareProbeState(added) == HardwareProbeState::Pending,
+          "plugged-in monitor opened, hardware pending");
+
+    bool probing = BrightnessController::StartHardwareProbe();
+    BrightnessController::WaitForHardwareProbe();
+    uint64_t pluggedCommands = desk.ddc.back()->GetCommandCount();
+    Check(probing && BrightnessController::GetHardwareProbeState(added) == HardwareProbeState::Available &&
+              pluggedCommands > 0 &&
+              desk.DdcCommands() - desk.ddc[1]->GetCommandCount() - pluggedCommands == keptCommands,
+          "only the new monitor probed");
+
+    // A different monitor behind the same handle and name.
+    int swappedIndex = IndexOf(L"\\\\.\\DISPLAY1");
+    desk.backend->SetEdid(desk.outputs[0], MakeEdid("CDL", 0x2000, 99).data());
+    BrightnessController::UpdateOutputs(change);
+    Check(change.removed.size() == 1 && change.removed[0] == L"\\\\.\\DISPLAY1" && change.added.size() == 1 &&
+              change.added[0] == swappedIndex &&
+              BrightnessController::GetHardwareProbeState(swappedIndex) == HardwareProbeState::Pending,
+          "new EDID behind the same output probed afresh");
+    BenchDesk::TearDown();
+  }
+
+  void AbandonedProbeChecks(std::chrono::milliseconds latency, size_t count)
+  {
+    std::printf("Probe in flight\n");
+    Desk desk;
+    for (size_t i = 0; i < count; ++i)
+      AddMonitor(desk, latency);
+    desk.Attach();
+
+    BrightnessController::RefreshOutputs();
+    BrightnessController::StartHardwareProbe();
+    TopologyChange change;
+    BrightnessController::UpdateOutputs(change);
+    Check(change.kept == count && BrightnessController::IsHardwareProbePending(), "cut-short probe leaves monitors pending");
+
+    bool probing = BrightnessController::StartHardwareProbe();
+    BrightnessController::WaitForHardwareProbe();
+    bool available = true;
+    for (size_t i = 0; i < count; ++i)
+      available = available &&
+                  BrightnessController::GetHardwareProbeState(static_cast<int>(i)) == HardwareProbeState::Available;
+    Check(probing && available, "next probe finishes them");
+    BenchDesk::TearDown();
+  }
+
+  // Opens a batch on another thread (as a control client's transaction
+  // does), writes every monitor in it, and runs @p change on this thread
+  // while it is open. Returns whether @p change finished after the batch.
+  template <typename Change>
+  bool ChangeDuringBatch(size_t count, Change change, bool &flushed)
+  {
+    std::promise<void> opened;
+    Clock::time_point closing;
+    std::thread client([&]
+                       {
+                         BrightnessController::BeginUpdate();
+                         for (size_t i = 0; i < count; ++i)
+                           BrightnessController::SetSoftwareLevels(static_cast<int>(i), 35, 4200);
+                         opened.set_value();
+                         std::this_thread::sleep_for(std::chrono::milliseconds(30));
+                         closing = Clock::now();
+                         flushed = BrightnessController::EndUpdate();
+                       });
+    opened.get_future().wait();
+    change();
+    Clock::time_point changed = Clock::now();
+    client.join();
+    return changed >= closing;
+  }
+
+  void BatchChecks(std::chrono::milliseconds latency, size_t count)
+  {
+    std::printf("Display change during a batch\n");
+    Desk desk = MakeDesk(count, latency);
+
+    // The first monitor goes away, so every index shifts under the batch.
+    desk.backend->RemoveOutput(desk.outputs[0]);
+    bool flushed = false;
+    TopologyChange change;
+    bool waited = ChangeDuringBatch(count, [&change]
+                                    { BrightnessController::UpdateOutputs(change); },
+                                    flushed);
+    ColorTempUtils::GammaRampOptions options;
+    options.brightness = 35;
+    options.kelvin = 4200;
+    std::vector<uint16_t> expected(ColorTempUtils::GAMMA_RAMP_ENTRIES * 3);
+    ColorTempUtils::BuildGammaRamp(options, expected.data());
+    bool shown = change.kept == count - 1;
+    std::vector<uint16_t> ramp(expected.size());
+    for (size_t i = 1; shown && i < count; ++i)
+      shown = desk.backend->PeekGammaRamp(desk.outputs[i], ramp.data()) && ramp == expected;
+    Check(waited && flushed && shown, "display change waits for the batch, which lands");
+
+    waited = ChangeDuringBatch(count - 1, []
+                               { BrightnessController::RefreshOutputs(); },
+                               flushed);
+    Check(waited && flushed && BrightnessController::GetMonitorCount() == count - 1,
+          "full refresh waits for the batch");
+    BenchDesk::TearDown();
+  }
+
+  void Timing(std::chrono::milliseconds latency, size_t count)
+  {
+    std::printf("Timing, %zu monitors, %lld ms DDC/CI latency\n", count, static_cast<long long>(latency.count()));
+    Desk desk = MakeDesk(count, latency);
+
+    auto start = Clock::now();
+    BrightnessController::RefreshMonitors();
+    double full = Millis(Clock::now() - start);
+
+    TopologyChange change;
+    start = Clock::now();
+    BrightnessController::UpdateOutputs(change);
+    double incremental = Millis(Clock::now() - start);
+
+    std::printf("  full refresh %.2f ms, incremental update %.2f ms\n", full, incremental);
+    Check(incremental < full, "incremental update faster than a full refresh");
+    BenchDesk::TearDown();
+  }
+}
+
+int main(int argc, char **argv)
+{
+  std::chrono::milliseconds latency(argc > 1 ? std::atoi(argv[1]) : 40);
+  size_t count = argc > 2 ? static_cast<size_t>(std::atoi(argv[2])) : 6;
+  count = std::max<size_t>(count, 2);
+
+  ModeChangeChecks(latency, count);
+  HotplugChecks(latency, count);
+  AbandonedProbeChecks(latency, count);
+  BatchChecks(latency, count);
+  Timing(latency, count);
+
+  return BenchCheck::Finish();
+}
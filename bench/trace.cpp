@@ -0,0 +1,290 @@
+// Trace check: records spans into the per-thread ring buffers and verifies
+// that
+//
+//   - a span outside a capture records nothing and costs next to nothing;
+//   - spans keep their name, argument, thread and duration;
+//   - a full ring keeps the newest events and counts the overwritten ones;
+//   - Collect while threads are recording never returns a torn event;
+//   - Stop and a restart cut spans off at the capture boundary;
+//   - the Chrome JSON has one complete event per span plus thread names;
+//   - the instrumented BrightnessController paths show up in a capture.
+//
+// Also reports the cost of a span when idle and when capturing. Exits
+// non-zero on a failed check.
+//
+// Usage: bench_trace [spans]
+
+#include "benchcheck.h"
+#include "brightness.h"
+#include "ddcsim.h"
+#include "fakebackend.h"
+#include "trace.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <set>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+namespace
+{
+  using Clock = std::chrono::steady_clock;
+  using BenchCheck::Check;
+
+  double Nanos(Clock::duration d)
+  {
+    return std::chrono::duration<double, std::nano>(d).count();
+  }
+
+  size_t CountNamed(const Trace::Capture &capture, const char *name)
+  {
+    size_t n = 0;
+    for (const Trace::Event &event : capture.events)
+      if (std::strcmp(event.name, name) == 0)
+        ++n;
+    return n;
+  }
+
+  size_t CountSubstring(const std::string &text, const char *needle)
+  {
+    size_t n = 0;
+    for (size_t at = text.find(needle); at != std::string::npos; at = text.find(needle, at + 1))
+      ++n;
+    return n;
+  }
+
+  // Average cost of one Span, measured over @p spans.
+  double SpanCost(size_t spans)
+  {
+    auto start = Clock::now();
+    for (size_t i = 0; i < spans; ++i)
+    {
+      Trace::Span span("cost", "i", static_cast<int64_t>(i));
+    }
+    return Nanos(Clock::now() - start) / spans;
+  }
+
+  void OverheadChecks(size_t spans)
+  {
+    std::printf("Overhead (%zu spans)\n", spans);
+
+    Trace::Stop();
+    double idle = SpanCost(spans);
+    Trace::Start();
+    double capturing = SpanCost(spans);
+    Trace::Stop();
+
+    std::printf("  idle %.1f ns per span, capturing %.1f ns per span\n", idle, capturing);
+    Check(idle < 5.0, "idle span costs under 5 ns");
+    Check(capturing < 500.0, "captured span costs under 500 ns");
+  }
+
+  void RecordingChecks()
+  {
+    std::printf("Recording\n");
+
+    Trace::Start();
+    {
+      Trace::Span outer("outer");
+      std::this_thread::sleep_for(std::chrono::milliseconds(2));
+      Trace::Span inner("inner", "monitor", 3);
+    }
+    Trace::Stop();
+    {
+      Trace::Span late("after stop");
+    }
+
+    Trace::Capture capture = Trace::Collect();
+    bool shape = capture.events.size() == 2 && CountNamed(capture, "outer") == 1 && CountNamed(capture, "inner") == 1;
+    Check(shape, "spans recorded, nothing after Stop");
+    if (shape)
+    {
+      const Trace::Event &outer = capture.events[0];
+      const Trace::Event &inner = capture.events[1];
+      Check(std::strcmp(outer.name, "outer") == 0 && outer.durationNs >= 2000000 && !outer.argName,
+            "outer span lasts the sleep");
+      Check(inner.startNs >= outer.startNs && inner.argName && std::strcmp(inner.argName, "monitor") == 0 &&
+                inner.arg == 3 && inner.threadId == outer.threadId,
+            "inner span nested, with its argument");
+    }
+
+    // A span open across a restart belongs to neither capture.
+    Trace::Start();
+    {
+      Trace::Span straddling("straddling");
+      Trace::Start();
+    }
+    Trace::Stop();
+    capture = Trace::Collect();
+    Check(capture.events.empty(), "restart discards the previous capture and open spans");
+
+    // Overflow: the newest EVENTS_PER_THREAD survive.
+    const size_t extra = 100;
+    Trace::Start();
+    for (size_t i = 0; i < Trace::EVENTS_PER_THREAD + extra; ++i)
+    {
+      Trace::Span span("wrap", "i", static_cast<int64_t>(i));
+    }
+    Trace::Stop();
+    capture = Trace::Collect();
+    Check(capture.events.size() == Trace::EVENTS_PER_THREAD && capture.dropped == extra &&
+              capture.events.front().arg == static_cast<int64_t>(extra),
+          "full ring keeps the newest events, counts the rest");
+  }
+
+  void ThreadChecks()
+  {
+    std::printf("Threads\n");
+
+    const size_t writers = 4;
+    const size_t minimum = Trace::EVENTS_PER_THREAD * 3; // Every ring wraps
+    const size_t collections = 50;
+    static const char *const NAMES[] = {"writer 0", "writer 1", "writer 2", "writer 3"};
+
+    // Writers keep going until the collector is done, so the rings wrap
+    // underneath every Collect.
+    Trace::Start();
+    std::atomic<bool> collected(false);
+    std::vector<size_t> written(writers, 0);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < writers; ++t)
+      threads.emplace_back([t, minimum, &collected, &written]()
+                           {
+                             Trace::SetThreadName(NAMES[t]);
+                             size_t i = 0;
+                             for (; i < minimum || !collected; ++i)
+                             {
+                               Trace::Span span(NAMES[t], "i", static_cast<int64_t>(i));
+                             }
+                             written[t] = i; });
+
+    bool consistent = true;
+    for (size_t c = 0; c < collections; ++c)
+    {
+      Trace::Capture capture = Trace::Collect();
+      std::set<std::pair<uint32_t, int64_t>> seen;
+      for (const Trace::Event &event : capture.events)
+      {
+        bool known = false;
+        for (const char *name : NAMES)
+          known = known || event.name == name;
+        consistent = consistent && known && event.arg >= 0 && seen.insert({event.threadId, event.arg}).second;
+      }
+    }
+    collected = true;
+    for (auto &thread : threads)
+      thread.join();
+    Trace::Stop();
+    Check(consistent, "no torn or duplicated events while recording");
+
+    size_t dropped = 0;
+    for (size_t count : written)
+      dropped += count - Trace::EVENTS_PER_THREAD;
+    Trace::Capture capture = Trace::Collect();
+    bool named = true;
+    for (const char *name : NAMES)
+    {
+      bool found = false;
+      for (const Trace::ThreadInfo &thread : capture.threads)
+        found = found || thread.name == name;
+      named = named && found;
+    }
+    Check(capture.events.size() == writers * Trace::EVENTS_PER_THREAD &&
+              capture.dropped == dropped,
+          "each thread keeps its own ring");
+    Check(named && capture.threads.size() == writers, "threads carry their names");
+
+    // Exited threads' buffers are freed by the next capture.
+    Trace::Start();
+    Trace::Stop();
+    Check(Trace::Collect().threads.empty(), "buffers of exited threads released");
+  }
+
+  void JsonChecks(const std::filesystem::path &directory)
+  {
+    std::printf("Chrome JSON\n");
+
+    Trace::SetThreadName("main");
+    Trace::Start();
+    {
+      Trace::Span plain("SetDeviceGammaRamp");
+      Trace::Span quoted("a \"quoted\" \\ name", "value", -7);
+    }
+    Trace::Stop();
+
+    Trace::Capture capture = Trace::Collect();
+    std::string json = Trace::ToChromeJson(capture);
+    Check(json.find("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[") == 0 &&
+              json.find("\"droppedEvents\":0") != std::string::npos,
+          "document framing");
+    Check(CountSubstring(json, "\"ph\":\"X\"") == capture.events.size() &&
+              CountSubstring(json, "\"ph\":\"M\"") == capture.threads.size(),
+          "one complete event per span, one metadata event per thread");
+    Check(json.find("\"args\":{\"name\":\"main\"}") != std::string::npos, "thread name exported");
+    Check(json.find("a \\\"quoted\\\" \\\\ name") != std::string::npos && json.find("\"value\":-7") != std::string::npos,
+          "names escaped, arguments exported");
+
+    std::filesystem::path path = directory / "trace.json";
+    Check(Trace::WriteChromeJson(path) && std::filesystem::file_size(path) == json.size(), "written to disk");
+  }
+
+  void ControllerChecks()
+  {
+    std::printf("BrightnessController spans\n");
+#if CANDELA_TRACE
+    auto backend = std::make_shared<FakeDisplayBackend>();
+    auto ddc = std::make_shared<SimulatedDdcMonitor>(0, 100, std::chrono::milliseconds(1));
+    backend->AddOutput(L"\\\\.\\DISPLAY1", ddc);
+    backend->AddOutput(L"\\\\.\\DISPLAY2");
+    SetDisplayBackend(backend);
+
+    Trace::Start();
+    BrightnessController::RefreshMonitors();
+    BrightnessController::SetSoftwareBrightness(1, 40);
+    BrightnessController::SetHardwareBrightness(0, 70);
+    BrightnessController::Cleanup(); // Flushes the DDC worker
+    Trace::Stop();
+
+    Trace::Capture capture = Trace::Collect();
+    Check(CountNamed(capture, "RefreshMonitors") == 1 && CountNamed(capture, "ProbeGamma") == 2 &&
+              CountNamed(capture, "ProbeHardware") == 2,
+          "enumeration and probing traced");
+    Check(CountNamed(capture, "OpenDdc") >= 1 && CountNamed(capture, "GetDdcBrightness") >= 1,
+          "DDC/CI retry loops traced per attempt");
+    Check(CountNamed(capture, "ApplyMonitorRamp") >= 1 && CountNamed(capture, "DdcWrite") == 1,
+          "gamma and DDC/CI writes traced");
+
+    bool workerNamed = false;
+    for (const Trace::ThreadInfo &thread : capture.threads)
+      workerNamed = workerNamed || thread.name == "ddc worker";
+    Check(workerNamed, "DDC worker thread named");
+    SetDisplayBackend(nullptr);
+#else
+    std::printf("  compiled out (CANDELA_TRACE=0)\n");
+#endif
+  }
+}
+
+int main(int argc, char **argv)
+{
+  size_t spans = argc > 1 ? static_cast<size_t>(std::atoi(argv[1])) : 1000000;
+
+  std::error_code ec;
+  std::filesystem::path directory = std::filesystem::temp_directory_path(ec) / "candela_bench_trace";
+  std::filesystem::create_directories(directory, ec);
+
+  OverheadChecks(spans);
+  RecordingChecks();
+  ThreadChecks();
+  JsonChecks(directory);
+  ControllerChecks();
+
+  std::filesystem::remove_all(directory, ec);
+  return BenchCheck::Finish();
+}
@@ -0,0 +1,216 @@
+// Transition engine check: drives BrightnessController::StartTransition
+// against FakeDisplayBackend and verifies that
+//
+//   - colour temperature moves linearly in mired, not in kelvin;
+//   - each output gets one keyframe per refresh (60 Hz and 144 Hz outputs);
+//   - hardware brightness moves in throttled native steps and lands exactly;
+//   - a retarget mid-flight continues from the in-flight level (no jump);
+//   - CancelTransition and a manual Set* stop the animation where it is.
+//
+// Also reports how long planning a keyframe table takes. Exits non-zero on
+// a failed check.
+//
+// Usage: bench_transition [duration_ms]
+
+#include "benchcheck.h"
+#include "brightness.h"
+#include "ddcsim.h"
+#include "fakebackend.h"
+#include "transition.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace
+{
+  using Clock = std::chrono::steady_clock;
+  using BenchCheck::Check;
+
+  double Millis(Clock::duration d)
+  {
+    return std::chrono::duration<double, std::milli>(d).count();
+  }
+
+  void WaitIdle(int monitorIndex)
+  {
+    while (BrightnessController::IsTransitioning(monitorIndex))
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  void KeyframeChecks()
+  {
+    std::printf("Keyframe table\n");
+
+    // Halfway through a linear plan the temperature must sit at the mired
+    // midpoint (about 3815 K here), well below the kelvin midpoint (4600 K).
+    SoftwareTransition plan;
+    plan.Plan(100, TransitionUtils::KelvinToMired(6500), 100, 2700, 100, TransitionEasing::Linear);
+    double midMired = (TransitionUtils::KelvinToMired(6500) + TransitionUtils::KelvinToMired(2700)) / 2;
+    int expected = static_cast<int>(std::lround(TransitionUtils::MiredToKelvin(midMired)));
+    Check(std::abs(plan.Frame(49).rampKelvin - expected) <= 1, "midpoint is the mired midpoint");
+    Check(plan.Frame(plan.FrameCount() - 1).rampKelvin == 2700, "last keyframe is exactly the target");
+
+    const int runs = 1000;
+    auto start = Clock::now();
+    for (int i = 0; i < runs; ++i)
+      plan.Plan(100, TransitionUtils::KelvinToMired(6500), 40, 1200 + i % 100, 144, TransitionEasing::InOut);
+    std::printf("  plan 1 s at 144 Hz: %.2f us\n", Millis(Clock::now() - start) * 1000.0 / runs);
+
+    HardwareTransition hw;
+    hw.Plan(50, 90, std::chrono::milliseconds(500), BrightnessController::HARDWARE_STEP_INTERVAL);
+    uint32_t value = 0;
+    size_t steps = 0;
+    for (int ms = 0; ms <= 500; ++ms)
+      if (hw.Due(std::chrono::milliseconds(ms), value))
+        ++steps;
+    Check(steps == 6 && value == 90, "hardware plan: one write per interval, ends on target");
+  }
+
+  void PlaybackChecks(std::chrono::milliseconds duration)
+  {
+    std::printf("Playback (%lld ms)\n", static_cast<long long>(duration.count()));
+
+    auto backend = std::make_shared<FakeDisplayBackend>();
+    auto ddc = std::make_shared<SimulatedDdcMonitor>(0, 100, std::chrono::milliseconds(5));
+    OutputHandle slow = backend->AddOutput(L"\\\\.\\DISPLAY1", ddc);
+    OutputHandle fast = backend->AddOutput(L"\\\\.\\DISPLAY2");
+    backend->SetRefreshRate(slow, 60);
+    backend->SetRefreshRate(fast, 144);
+    SetDisplayBackend(backend);
+    BrightnessController::RefreshMonitors();
+
+    TransitionTarget target;
+    target.softwareBrightness = 40;
+    target.softwareColorTemp = 2700;
+    target.hardwareBrightness = 90;
+
+    auto start = Clock::now();
+    BrightnessController::StartTransition(0, target, duration);
+    BrightnessController::StartTransition(1, target, duration);
+    WaitIdle(0);
+    WaitIdle(1);
+    double elapsed = Millis(Clock::now() - start);
+    BrightnessController::Cleanup(); // Flushes the DDC worker
+
+    TransitionStats stats = BrightnessController::GetTransitionStats();
+    uint64_t frames = stats.framesApplied + stats.framesSkipped;
+    uint64_t expected = TransitionUtils::FramesFor(duration, 60) + TransitionUtils::FramesFor(duration, 144);
+    std::printf("  took %.1f ms, %llu frames applied, %llu skipped, %llu DDC steps, %llu flushes\n", elapsed,
+                static_cast<unsigned long long>(stats.framesApplied),
+                static_cast<unsigned long long>(stats.framesSkipped),
+                static_cast<unsigned long long>(stats.hardwareSteps),
+                static_cast<unsigned long long>(backend->GetCounters().gammaFlushes));
+
+    Check(frames == expected, "one keyframe per refresh on each output");
+    Check(stats.framesApplied * 10 >= expected * 8, "at least 80% of keyframes shown");
+    Check(elapsed < duration.count() * 1.2 + 50, "finishes on time");
+    Check(stats.hardwareSteps <= static_cast<uint64_t>(duration / BrightnessController::HARDWARE_STEP_INTERVAL) + 1,
+          "DDC writes throttled");
+    Check(ddc->GetCurrent() == 90, "hardware brightness lands on the target");
+
+    uint16_t ramp[ColorTempUtils::GAMMA_RAMP_ENTRIES * 3];
+    uint16_t expectedRamp[ColorTempUtils::GAMMA_RAMP_ENTRIES * 3];
+    ColorTempUtils::GammaRampOptions opts;
+    opts.brightness = 40;
+    opts.kelvin = 2700;
+    ColorTempUtils::BuildGammaRamp(opts, expectedRamp);
+    backend->PeekGammaRamp(fast, ramp);
+    Check(std::equal(ramp, ramp + opts.entries * 3, expectedRamp), "final ramp is exactly the target's");
+    SetDisplayBackend(nullptr);
+  }
+
+  void RetargetChecks(std::chrono::milliseconds duration)
+  {
+    std::printf("Retarget and cancel\n");
+
+    auto backend = std::make_shared<FakeDisplayBackend>();
+    OutputHandle output = backend->AddOutput(L"\\\\.\\DISPLAY1");
+    backend->SetRefreshRate(output, 60);
+    SetDisplayBackend(backend);
+    BrightnessController::RefreshMonitors();
+
+    // Sample the temperature as fast as possible while the transition heads
+    // for 1200 K, is turned back towards 6500 K halfway, and finishes.
+    TransitionTarget down;
+    down.softwareColorTemp = 1200;
+    TransitionTarget up;
+    up.softwareColorTemp = 6500;
+
+    struct Sample
+    {
+      Clock::time_point at;
+      int kelvin;
+    };
+    std::vector<Sample> samples;
+    auto start = Clock::now();
+    BrightnessController::StartTransition(0, down, duration);
+    bool retargeted = false;
+    while (BrightnessController::IsTransitioning(0))
+    {
+      auto now = Clock::now();
+      if (!retargeted && now - start >= duration / 2)
+      {
+        BrightnessController::StartTransition(0, up, duration);
+        retargeted = true;
+      }
+      samples.push_back({now, BrightnessController::GetSoftwareColorTemp(0)});
+      std::this_thread::sleep_for(std::chrono::microseconds(500));
+    }
+
+    // No jump: per frame, the level never moves further than the steepest
+    // frame of a fresh ease-in-out over the full range.
+    const double span = TransitionUtils::KelvinToMired(1200) - TransitionUtils::KelvinToMired(6500);
+    const auto frameInterval = std::chrono::duration<double>(1.0 / 60);
+    const double frames = static_cast<double>(TransitionUtils::FramesFor(duration, 60));
+    const double limit = 1.5 * span / frames * 1.1;
+    double worst = 0.0;
+    for (size_t i = 1; i < samples.size(); ++i)
+    {
+      double moved = std::abs(TransitionUtils::KelvinToMired(samples[i].kelvin) -
+                              TransitionUtils::KelvinToMired(samples[i - 1].kelvin));
+      double elapsedFrames = std::ceil((samples[i].at - samples[i - 1].at) / frameInterval);
+      worst = std::max(worst, moved / std::max(1.0, elapsedFrames));
+    }
+    std::printf("  steepest step %.2f mired/frame (limit %.2f)\n", worst, limit);
+    Check(retargeted && worst <= limit, "retarget continues without a jump");
+    Check(BrightnessController::GetSoftwareColorTemp(0) == 6500, "retarget ends on the new target");
+
+    // Cancel: the level stays where it was stopped and nothing is written.
+    BrightnessController::StartTransition(0, down, duration);
+    std::this_thread::sleep_for(duration / 4);
+    BrightnessController::CancelTransition(0);
+    int stoppedAt = BrightnessController::GetSoftwareColorTemp(0);
+    uint64_t writes = backend->GetCounters().gammaWrites;
+    std::this_thread::sleep_for(duration / 4);
+    Check(!BrightnessController::IsTransitioning(0) && backend->GetCounters().gammaWrites == writes &&
+              stoppedAt > 1200 && stoppedAt < 6500,
+          "cancel stops mid-flight");
+
+    // A manual change takes over from a running transition.
+    BrightnessController::StartTransition(0, up, duration);
+    std::this_thread::sleep_for(duration / 4);
+    BrightnessController::SetSoftwareColorTemp(0, 3000);
+    std::this_thread::sleep_for(duration / 4);
+    Check(!BrightnessController::IsTransitioning(0) && BrightnessController::GetSoftwareColorTemp(0) == 3000,
+          "manual change cancels the transition");
+
+    BrightnessController::Cleanup();
+    SetDisplayBackend(nullptr);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  std::chrono::milliseconds duration(argc > 1 ? std::atoi(argv[1]) : 500);
+
+  KeyframeChecks();
+  PlaybackChecks(duration);
+  RetargetChecks(duration);
+
+  return BenchCheck::Finish();
+}
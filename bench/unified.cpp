@@ -0,0 +1,203 @@
+// Unified slider check: drags BrightnessController's unified brightness
+// across a FakeDisplayBackend output backed by a SimulatedDdcMonitor and
+// verifies that
+//
+//   - the drag shows through the gamma ramp at once, with no DDC/CI traffic;
+//   - the end of the drag costs one DDC/CI write, after which the gamma
+//     compensation is dropped and the ramp is the user's own again;
+//   - raising the level previews as far as the software brightness allows;
+//   - a failed write, or a manual hardware change, drops the preview too;
+//   - ending where the drag started writes nothing.
+//
+// Also reports how many DDC/CI writes the same drag costs when every slider
+// tick is sent to the monitor. Exits non-zero on a failed check.
+//
+// Usage: bench_unified [latency_ms] [ticks]
+
+#include "benchcheck.h"
+#include "benchdesk.h"
+#include "brightness.h"
+#include "colortemp.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace
+{
+  using Clock = std::chrono::steady_clock;
+  using BenchCheck::Check;
+
+  // Blocks until the completion callback of one write has run, and keeps
+  // its report.
+  class ReportWaiter
+  {
+  public:
+    BrightnessController::HardwareCompletionFn Callback()
+    {
+      return [this](const HardwareWriteReport &report)
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_report = report;
+        m_done = true;
+        m_cv.notify_all();
+      };
+    }
+
+    bool Wait(HardwareWriteReport &report)
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      if (!m_cv.wait_for(lock, std::chrono::seconds(10), [this]
+                         { return m_done; }))
+        return false;
+      report = m_report;
+      m_done = false;
+      return true;
+    }
+
+  private:
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    HardwareWriteReport m_report;
+    bool m_done = false;
+  };
+
+  using BenchDesk::Desk;
+
+  // One monitor at hardware 50 (the simulator's midpoint) and the given
+  // software brightness.
+  Desk MakeDesk(std::chrono::milliseconds latency, int softwareBrightness)
+  {
+    Desk desk;
+    desk.AddDdc(latency);
+    desk.Install();
+    BrightnessController::SetSoftwareBrightness(0, softwareBrightness);
+    return desk;
+  }
+
+  // Top of the red channel: how bright white is.
+  uint16_t White(const std::vector<uint16_t> &ramp)
+  {
+    return ramp[ColorTempUtils::GAMMA_RAMP_ENTRIES - 1];
+  }
+
+  // The transition thread drops the compensation shortly after the write lands.
+  bool WaitForRamp(const Desk &desk, const std::vector<uint16_t> &expected)
+  {
+    auto deadline = Clock::now() + std::chrono::seconds(2);
+    while (desk.Peek(0) != expected && Clock::now() < deadline)
+      std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    return desk.Peek(0) == expected;
+  }
+
+  void DragChecks(std::chrono::milliseconds latency, int ticks)
+  {
+    std::printf("Drag from 50 to 20 in %d ticks, %lld ms DDC/CI latency\n", ticks,
+                static_cast<long long>(latency.count()));
+    Desk desk = MakeDesk(latency, 100);
+    std::vector<uint16_t> base = desk.Peek(0);
+    uint64_t commands = desk.ddc[0]->GetCommandCount();
+    uint64_t gammaWrites = desk.backend->GetCounters().gammaWrites;
+
+    auto start = Clock::now();
+    for (int i = 1; i <= ticks; ++i)
+      BrightnessController::PreviewUnifiedBrightness(0, 50 - 30 * i / ticks);
+    double perTickUs = std::chrono::duration<double, std::micro>(Clock::now() - start).count() / ticks;
+    std::printf("  %.1f us per preview tick\n", perTickUs);
+    Check(desk.ddc[0]->GetCommandCount() == commands && desk.backend->GetCounters().gammaWrites > gammaWrites,
+          "drag shown through gamma, no DDC/CI traffic");
+    Check(White(desk.Peek(0)) < White(base) && BrightnessController::GetSoftwareBrightness(0) == 100,
+          "ramp dimmed, software brightness untouched");
+
+    ReportWaiter waiter;
+    HardwareWriteReport report;
+    uint64_t writes = desk.ddc[0]->GetAcceptedWrites();
+    BrightnessController::CommitUnifiedBrightness(0, 20, waiter.Callback());
+    bool landed = waiter.Wait(report) && report.Overall() == DdcResult::Applied;
+    Check(landed && desk.ddc[0]->GetAcceptedWrites() - writes == 1 && desk.ddc[0]->GetCurrent() == 20,
+          "one DDC/CI write per gesture");
+    Check(WaitForRamp(desk, base), "compensation dropped once the write landed");
+    BenchDesk::TearDown();
+
+    // The same drag with every tick sent to the monitor, paced like
+    // WM_HSCROLL during a quick drag.
+    desk = MakeDesk(latency, 100);
+    writes = desk.ddc[0]->GetAcceptedWrites();
+    for (int i = 1; i <= ticks; ++i)
+    {
+      BrightnessController::SetHardwareBrightness(0, 50 - 30 * i / ticks);
+      std::this_thread::sleep_for(std::chrono::milliseconds(8));
+    }
+    BrightnessController::Cleanup(); // Flushes the worker
+    std::printf("  per-tick hardware slider: %llu DDC/CI writes, unified: 1\n",
+                static_cast<unsigned long long>(desk.ddc[0]->GetAcceptedWrites() - writes));
+    SetDisplayBackend(nullptr);
+  }
+
+  void HeadroomChecks(std::chrono::milliseconds latency)
+  {
+    std::printf("Raising the level\n");
+    Desk desk = MakeDesk(latency, 60);
+    std::vector<uint16_t> base = desk.Peek(0);
+    BrightnessController::PreviewUnifiedBrightness(0, 70);
+    Check(White(desk.Peek(0)) > White(base), "previews brighter within the software headroom");
+    BenchDesk::TearDown();
+
+    desk = MakeDesk(latency, 100);
+    base = desk.Peek(0);
+    BrightnessController::PreviewUnifiedBrightness(0, 70);
+    Check(desk.Peek(0) == base, "no headroom at full software brightness: ramp unchanged");
+    BenchDesk::TearDown();
+  }
+
+  void EndChecks(std::chrono::milliseconds latency)
+  {
+    std::printf("Ending a gesture\n");
+    Desk desk = MakeDesk(latency, 100);
+    std::vector<uint16_t> base = desk.Peek(0);
+    ReportWaiter waiter;
+    HardwareWriteReport report;
+
+    // The monitor rejects the write.
+    desk.ddc[0]->SetFailEvery(1);
+    BrightnessController::PreviewUnifiedBrightness(0, 30);
+    BrightnessController::CommitUnifiedBrightness(0, 30, waiter.Callback());
+    bool failed = waiter.Wait(report) && report.Overall() == DdcResult::Failed;
+    Check(failed && WaitForRamp(desk, base) && BrightnessController::GetHardwareBrightness(0) == 50,
+          "failed write: preview dropped, level back to the monitor's");
+    desk.ddc[0]->SetFailEvery(0);
+
+    // A manual hardware change takes over.
+    BrightnessController::PreviewUnifiedBrightness(0, 30);
+    BrightnessController::SetHardwareBrightness(0, 70);
+    Check(desk.Peek(0) == base, "manual hardware change drops the preview");
+
+    // Back where it started.
+    BrightnessController::SetHardwareBrightness(0, 50, waiter.Callback());
+    waiter.Wait(report);
+    uint64_t commands = desk.ddc[0]->GetCommandCount();
+    BrightnessController::PreviewUnifiedBrightness(0, 30);
+    BrightnessController::CommitUnifiedBrightness(0, 50, waiter.Callback());
+    bool reported = waiter.Wait(report) && report.endpoints.empty();
+    Check(reported && desk.ddc[0]->GetCommandCount() == commands && desk.Peek(0) == base,
+          "ending at the start level writes nothing");
+    BenchDesk::TearDown();
+  }
+}
+
+int main(int argc, char **argv)
+{
+  std::chrono::milliseconds latency(argc > 1 ? std::atoi(argv[1]) : 40);
+  int ticks = argc > 2 ? std::max(1, std::atoi(argv[2])) : 30;
+
+  DragChecks(latency, ticks);
+  HeadroomChecks(latency);
+  EndChecks(latency);
+
+  return BenchCheck::Finish();
+}
@@ -0,0 +1,99 @@
+// Write-behind check: how many flushes does WriteBehind issue for a slider
+// drag's worth of save requests, and when?
+//
+// Simulates a drag (one request per tick) and verifies that the burst
+// collapses into a single flush that lands one quiet period after the last
+// tick, that separate bursts flush separately, and that Stop() and
+// FlushNow() write pending changes immediately. Exits non-zero on a failed
+// check.
+//
+// Usage: bench_writebehind [ticks] [tick_ms] [quiet_ms]
+
+#include "benchcheck.h"
+#include "writebehind.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+namespace
+{
+  using Clock = std::chrono::steady_clock;
+  using BenchCheck::Check;
+
+  double Millis(Clock::duration d)
+  {
+    return std::chrono::duration<double, std::milli>(d).count();
+  }
+}
+
+int main(int argc, char **argv)
+{
+  int ticks = argc > 1 ? std::atoi(argv[1]) : 100;
+  std::chrono::milliseconds tick(argc > 2 ? std::atoi(argv[2]) : 5);
+  std::chrono::milliseconds quiet(argc > 3 ? std::atoi(argv[3]) : 100);
+
+  std::atomic<int> flushes(0);
+  std::atomic<Clock::rep> lastFlush(0);
+  auto onFlush = [&]()
+  {
+    lastFlush = Clock::now().time_since_epoch().count();
+    flushes++;
+  };
+  auto lastFlushAt = [&]()
+  {
+    return Clock::time_point(Clock::duration(lastFlush.load()));
+  };
+
+  std::printf("Drag of %d ticks every %lld ms, quiet period %lld ms\n", ticks,
+              static_cast<long long>(tick.count()), static_cast<long long>(quiet.count()));
+  {
+    WriteBehind writer(onFlush, quiet);
+    for (int i = 0; i < ticks; ++i)
+    {
+      writer.Request();
+      std::this_thread::sleep_for(tick);
+    }
+    Clock::time_point lastTick = Clock::now() - tick;
+    Check(flushes == 0, "nothing written while the drag continues");
+
+    std::this_thread::sleep_for(quiet * 2);
+    double delay = Millis(lastFlushAt() - lastTick);
+    std::printf("  %d requests -> %d flush, %.1f ms after the last tick\n", ticks, flushes.load(), delay);
+    Check(flushes == 1, "one flush per burst");
+    Check(delay >= quiet.count() * 0.95, "flush waits for the quiet period");
+
+    // A second, separate burst.
+    writer.Request();
+    writer.Request();
+    std::this_thread::sleep_for(quiet * 2);
+    Check(flushes == 2, "a later burst flushes again");
+
+    // FlushNow takes over a pending flush; it is not written twice.
+    writer.Request();
+    writer.FlushNow();
+    Check(flushes == 3, "FlushNow writes immediately");
+    std::this_thread::sleep_for(quiet * 2);
+    Check(flushes == 3, "FlushNow cancels the scheduled flush");
+
+    // Stop (shutdown) writes pending changes without waiting out the period.
+    writer.Request();
+    auto stopStart = Clock::now();
+    writer.Stop();
+    Check(flushes == 4 && Millis(Clock::now() - stopStart) < quiet.count(), "Stop flushes pending changes at once");
+
+    writer.Request();
+    Check(flushes == 5, "requests after Stop flush synchronously");
+
+    WriteBehind::Stats stats = writer.GetStats();
+    Check(stats.requests == static_cast<uint64_t>(ticks) + 5 && stats.flushes == 5, "counters match");
+  }
+
+  {
+    WriteBehind idle(onFlush, quiet);
+  }
+  Check(flushes == 5, "an untouched writer never flushes");
+
+  return BenchCheck::Finish();
+}
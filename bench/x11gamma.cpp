@@ -0,0 +1,24 @@
+// XRandR gamma benchmark: runs the shared gamma check (see gammacheck.h)
+// against the X server named by $DISPLAY. Needs no monitor; run it under
+// Xvfb, e.g.
+//
+//   xvfb-run -a make bench X11=1
+//
+// Usage: bench_x11gamma [updates]
+
+#include "gammacheck.h"
+#include "x11backend.h"
+#include <cstdlib>
+
+int main(int argc, char **argv)
+{
+  int updates = argc > 1 ? std::atoi(argv[1]) : 200;
+
+  auto backend = std::make_shared<X11DisplayBackend>();
+  if (!backend->IsConnected())
+  {
+    std::printf("FAIL: cannot open an X display with RandR 1.2 (is DISPLAY set? try xvfb-run)\n");
+    return 1;
+  }
+  return GammaCheck::Run(backend, updates);
+}
@@ -0,0 +1,399 @@
+#include "ambient.h"
+#include "brightness.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <locale>
+#include <sstream>
+#include <system_error>
+
+namespace
+{
+  // A sensor value file holds one short number; only this much is read.
+  constexpr std::streamsize MAX_VALUE_FILE = 64;
+
+  // Backlight light that remains at hardware brightness 0, as in the unified
+  // slider's compensation.
+  constexpr double BACKLIGHT_FLOOR = 10.0;
+
+  bool ReadNumber(const std::filesystem::path &path, double &value)
+  {
+    std::ifstream file(path);
+    if (!file)
+      return false;
+    char buffer[MAX_VALUE_FILE] = {};
+    file.read(buffer, sizeof(buffer) - 1);
+    std::istringstream text(std::string(buffer, static_cast<size_t>(file.gcount())));
+    text.imbue(std::locale::classic());
+    return static_cast<bool>(text >> value) && std::isfinite(value);
+  }
+
+  double ToLevel(double lux)
+  {
+    return std::log10(1.0 + std::max(0.0, lux));
+  }
+
+  double FromLevel(double level)
+  {
+    return std::pow(10.0, level) - 1.0;
+  }
+
+  bool HasIlluminance(const std::filesystem::path &device)
+  {
+    std::error_code ec;
+    return std::filesystem::exists(device / "in_illuminance_input", ec) ||
+           std::filesystem::exists(device / "in_illuminance_raw", ec);
+  }
+}
+
+// -----------------------------------------------------------------------------------------------
+// Sources
+// -----------------------------------------------------------------------------------------------
+
+IioAmbientSource::IioAmbientSource(std::filesystem::path device)
+    : m_device(std::move(device))
+{
+}
+
+std::unique_ptr<IioAmbientSource> IioAmbientSource::Find(const std::filesystem::path &root)
+{
+  std::error_code ec;
+  std::vector<std::filesystem::path> devices;
+  for (std::filesystem::directory_iterator it(root, ec), end; !ec && it != end; it.increment(ec))
+  {
+    if (it->path().filename().string().rfind("iio:device", 0) == 0 && HasIlluminance(it->path()))
+      devices.push_back(it->path());
+  }
+  if (devices.empty())
+    return nullptr;
+
+  // Directory order is arbitrary; take the lowest-numbered device
+  std::sort(devices.begin(), devices.end());
+  return std::make_unique<IioAmbientSource>(devices.front());
+}
+
+bool IioAmbientSource::Read(Clock::time_point, double &lux)
+{
+  if (ReadNumber(m_device / "in_illuminance_input", lux))
+    return lux >= 0.0;
+
+  double raw = 0.0;
+  if (!ReadNumber(m_device / "in_illuminance_raw", raw))
+    return false;
+  double scale = 1.0;
+  double offset = 0.0;
+  ReadNumber(m_device / "in_illuminance_scale", scale);
+  ReadNumber(m_device / "in_illuminance_offset", offset);
+  lux = (raw + offset) * scale;
+  return lux >= 0.0;
+}
+
+std::string IioAmbientSource::Describe() const
+{
+  return "IIO " + m_device.string();
+}
+
+FileAmbientSource::FileAmbientSource(std::filesystem::path path)
+    : m_path(std::move(path))
+{
+}
+
+bool FileAmbientSource::Read(Clock::time_point, double &lux)
+{
+  return ReadNumber(m_path, lux) && lux >= 0.0;
+}
+
+std::string FileAmbientSource::Describe() const
+{
+  return "file " + m_path.string();
+}
+
+ReplayAmbientSource::ReplayAmbientSource(std::vector<Reading> readings)
+    : m_readings(std::move(readings))
+{
+}
+
+bool ReplayAmbientSource::Load(const std::filesystem::path &path, std::vector<Reading> &readings)
+{
+  std::ifstream file(path);
+  if (!file)
+    return false;
+
+  readings.clear();
+  std::string line;
+  while (std::getline(file, line))
+  {
+    size_t start = line.find_first_not_of(" \t\r");
+    if (start == std::string::npos || line[start] == '#')
+      continue;
+    std::istringstream text(line);
+    text.imbue(std::locale::classic());
+    long long at = 0;
+    double lux = 0.0;
+    if (!(text >> at >> lux) || at < 0 || lux < 0.0 || (!readings.empty() && at < readings.back().at.count()))
+      return false;
+    readings.push_back({std::chrono::milliseconds(at), lux});
+  }
+  return true;
+}
+
+bool ReplayAmbientSource::Read(Clock::time_point now, double &lux)
+{
+  if (m_readings.empty())
+    return false;
+  if (!m_started)
+  {
+    m_start = now;
+    m_started = true;
+  }
+
+  while (m_next < m_readings.size() && now - m_start >= m_readings[m_next].at)
+    ++m_next;
+  if (m_next == 0)
+    return false; // Before the first reading
+  lux = m_readings[m_next - 1].lux;
+  return true;
+}
+
+std::string ReplayAmbientSource::Describe() const
+{
+  return "replay of " + std::to_string(m_readings.size()) + " readings";
+}
+
+bool ReplayAmbientSource::Finished(Clock::time_point now) const
+{
+  return m_started && !m_readings.empty() && now - m_start >= m_readings.back().at;
+}
+
+// -----------------------------------------------------------------------------------------------
+// Filter
+// -----------------------------------------------------------------------------------------------
+
+LuxFilter::LuxFilter()
+    : LuxFilter(Options())
+{
+}
+
+LuxFilter::LuxFilter(const Options &options)
+    : m_options(options)
+{
+  m_options.medianWindow = std::max<size_t>(m_options.medianWindow, 1);
+}
+
+double LuxFilter::Add(double lux, Clock::time_point now)
+{
+  m_window.push_back(ToLevel(lux));
+  if (m_window.size() > m_options.medianWindow)
+    m_window.pop_front();
+
+  // Median of what the window holds so far; the upper one for an even count
+  std::vector<double> sorted(m_window.begin(), m_window.end());
+  std::nth_element(sorted.begin(), sorted.begin() + sorted.size() / 2, sorted.end());
+  double median = sorted[sorted.size() / 2];
+
+  if (!m_hasValue || m_options.timeConstant.count() <= 0)
+  {
+    m_level = median;
+  }
+  else
+  {
+    // Weighted by the time since the last sample, so irregular polling
+    // settles at the same speed
+    double dt = std::chrono::duration<double, std::milli>(now - m_last).count();
+    double alpha = 1.0 - std::exp(-std::max(0.0, dt) / static_cast<double>(m_options.timeConstant.count()));
+    m_level += alpha * (median - m_level);
+  }
+  m_hasValue = true;
+  m_last = now;
+  return Lux();
+}
+
+void LuxFilter::Reset()
+{
+  m_window.clear();
+  m_level = 0.0;
+  m_hasValue = false;
+}
+
+double LuxFilter::Lux() const
+{
+  return FromLevel(m_level);
+}
+
+// -----------------------------------------------------------------------------------------------
+// Curve
+// -----------------------------------------------------------------------------------------------
+
+AmbientCurve::AmbientCurve(std::vector<AmbientCurvePoint> points)
+    : m_points(std::move(points))
+{
+  if (m_points.empty())
+    m_points.push_back({0.0, 50, 100});
+}
+
+AmbientCurve AmbientCurve::Default()
+{
+  return AmbientCurve({{0.0, 0, 70},
+                       {10.0, 10, 100},
+                       {100.0, 35, 100},
+                       {1000.0, 75, 100},
+                       {10000.0, 100, 100}});
+}
+
+AmbientCurvePoint AmbientCurve::Evaluate(double lux) const
+{
+  const AmbientCurvePoint &first = m_points.front();
+  const AmbientCurvePoint &last = m_points.back();
+  if (lux <= first.lux)
+    return {lux, first.hardware, first.software};
+  if (lux >= last.lux)
+    return {lux, last.hardware, last.software};
+
+  size_t upper = 1;
+  while (m_points[upper].lux < lux)
+    ++upper;
+  const AmbientCurvePoint &a = m_points[upper - 1];
+  const AmbientCurvePoint &b = m_points[upper];
+  double span = ToLevel(b.lux) - ToLevel(a.lux);
+  double t = span > 0.0 ? (ToLevel(lux) - ToLevel(a.lux)) / span : 1.0;
+  return {lux, static_cast<int>(std::lround(a.hardware + t * (b.hardware - a.hardware))),
+          static_cast<int>(std::lround(a.software + t * (b.software - a.software)))};
+}
+
+// -----------------------------------------------------------------------------------------------
+// AutoBrightness
+// -----------------------------------------------------------------------------------------------
+
+AutoBrightness::AutoBrightness(std::unique_ptr<AmbientSource> source)
+    : AutoBrightness(std::move(source), Options())
+{
+}
+
+AutoBrightness::AutoBrightness(std::unique_ptr<AmbientSource> source, const Options &options)
+    : m_source(std::move(source)),
+      m_options(options),
+      m_filter(options.filter)
+{
+}
+
+bool AutoBrightness::Step(Clock::time_point now)
+{
+  double lux = 0.0;
+  if (!m_source || !m_source->Read(now, lux))
+  {
+    m_stats.readFailures++;
+    return false;
+  }
+  m_stats.samples++;
+  m_filter.Add(lux, now);
+
+  if (m_anchored)
+  {
+    if (std::fabs(m_filter.Level() - m_anchor) < m_options.hysteresis)
+    {
+      m_stats.withinHysteresis++;
+      return false;
+    }
+    // Left for a later sample, which acts on the light level as it is then
+    if (now - m_lastUpdate < m_options.minInterval)
+    {
+      m_stats.rateLimited++;
+      return false;
+    }
+  }
+
+  m_lastUpdate = now;
+  m_stats.updates++;
+  bool skipped = false;
+  bool changed = Apply(m_filter.Lux(), skipped);
+  // Monitors still being probed were not set, so the old anchor stays and
+  // a later sample at this level reaches them
+  if (!skipped)
+  {
+    m_anchored = true;
+    m_anchor = m_filter.Level();
+  }
+  return changed;
+}
+
+void AutoBrightness::Reset()
+{
+  m_filter.Reset();
+  m_anchored = false;
+}
+
+double AutoBrightness::GetLux() const
+{
+  return m_filter.HasValue() ? m_filter.Lux() : -1.0;
+}
+
+const AmbientCurve &AutoBrightness::CurveFor(const std::wstring &deviceName) const
+{
+  auto it = m_options.curves.find(deviceName);
+  return it != m_options.curves.end() ? it->second : m_options.curve;
+}
+
+bool AutoBrightness::Apply(double lux, bool &skipped)
+{
+  bool changed = false;
+  const auto &monitors = BrightnessController::GetMonitors();
+
+  // One gamma round trip for every monitor's software change
+  BrightnessController::BeginUpdate();
+  for (size_t i = 0; i < monitors.size(); ++i)
+  {
+    int index = static_cast<int>(i);
+    HardwareProbeState probe = BrightnessController::GetHardwareProbeState(index);
+    if (probe == HardwareProbeState::Pending)
+    {
+      skipped = true; // Not known yet whether the backlight can do the dimming
+      continue;
+    }
+
+    AmbientCurvePoint point = CurveFor(monitors[i].deviceName).Evaluate(lux);
+    int software = point.software;
+    if (probe == HardwareProbeState::Available)
+    {
+      int hardware = BrightnessController::GetHardwareBrightness(index);
+      if (hardware >= 0 && std::abs(point.hardware - hardware) >= m_options.minHardwareStep &&
+          BrightnessController::SetHardwareBrightness(index, point.hardware))
+      {
+        m_stats.hardwareWrites++;
+        changed = true;
+      }
+    }
+    else
+    {
+      software = AmbientUtils::SoftwareOnlyBrightness(point);
+    }
+
+    int current = BrightnessController::GetSoftwareBrightness(index);
+    if (current >= 0 && std::abs(software - current) >= m_options.minSoftwareStep &&
+        BrightnessController::SetSoftwareBrightness(index, software))
+    {
+      m_stats.softwareWrites++;
+      changed = true;
+    }
+  }
+  BrightnessController::EndUpdate();
+  return changed;
+}
+
+namespace AmbientUtils
+{
+  int SoftwareOnlyBrightness(const AmbientCurvePoint &point)
+  {
+    double backlight = (std::max(0, point.hardware) + BACKLIGHT_FLOOR) / (100.0 + BACKLIGHT_FLOOR);
+    int software = static_cast<int>(std::lround(point.software * backlight));
+    return std::max(1, std::min(software, 100));
+  }
+
+  std::unique_ptr<AmbientSource> CreateDefaultSource(const std::filesystem::path &dataDirectory)
+  {
+    if (std::unique_ptr<IioAmbientSource> iio = IioAmbientSource::Find())
+      return iio;
+    if (dataDirectory.empty())
+      return nullptr;
+    return std::make_unique<FileAmbientSource>(dataDirectory / "ambient_lux.txt");
+  }
+}
@@ -0,0 +1,298 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Where ambient light readings come from.
+ *
+ * Implementations are polled from the thread that drives AutoBrightness and
+ * need not be thread-safe.
+ */
+class AmbientSource
+{
+public:
+  using Clock = std::chrono::steady_clock;
+
+  virtual ~AmbientSource() = default;
+
+  /**
+   * @brief Takes one reading, in lux.
+   * @return false if no reading is available right now.
+   */
+  virtual bool Read(Clock::time_point now, double &lux) = 0;
+
+  /**
+   * @brief Short description for logs, e.g. "IIO /sys/bus/iio/devices/iio:device0".
+   */
+  virtual std::string Describe() const = 0;
+};
+
+/**
+ * @brief Linux Industrial I/O light sensor, read through sysfs.
+ *
+ * Uses in_illuminance_input (already in lux) where the driver provides it,
+ * otherwise (in_illuminance_raw + in_illuminance_offset) * in_illuminance_scale.
+ * Plain file reads, so it builds anywhere; Find() just finds nothing off Linux.
+ */
+class IioAmbientSource : public AmbientSource
+{
+public:
+  explicit IioAmbientSource(std::filesystem::path device);
+
+  /**
+   * @brief The first device under @p root with an illuminance channel.
+   * @return nullptr if there is none.
+   */
+  static std::unique_ptr<IioAmbientSource> Find(const std::filesystem::path &root = "/sys/bus/iio/devices");
+
+  bool Read(Clock::time_point now, double &lux) override;
+  std::string Describe() const override;
+
+private:
+  std::filesystem::path m_device;
+};
+
+/**
+ * @brief Reads the first number in a text file on every poll, so any other
+ *        tool (a sensor bridge, a script, a test) can feed in lux values.
+ */
+class FileAmbientSource : public AmbientSource
+{
+public:
+  explicit FileAmbientSource(std::filesystem::path path);
+
+  bool Read(Clock::time_point now, double &lux) override;
+  std::string Describe() const override;
+
+private:
+  std::filesystem::path m_path;
+};
+
+/**
+ * @brief Plays back a recorded series of readings against the clock, for
+ *        tests and benchmarks. Time starts at the first Read(); after the
+ *        last reading its value is held.
+ */
+class ReplayAmbientSource : public AmbientSource
+{
+public:
+  struct Reading
+  {
+    std::chrono::milliseconds at; // Offset from the start of the recording
+    double lux;
+  };
+
+  /**
+   * @param readings In ascending order of @c at.
+   */
+  explicit ReplayAmbientSource(std::vector<Reading> readings);
+
+  /**
+   * @brief Parses a recording: one "<milliseconds> <lux>" pair per line;
+   *        blank lines and lines starting with '#' are skipped.
+   * @return false if the file cannot be read or a line does not parse.
+   */
+  static bool Load(const std::filesystem::path &path, std::vector<Reading> &readings);
+
+  bool Read(Clock::time_point now, double &lux) override;
+  std::string Describe() const override;
+
+  /**
+   * @brief True once the clock has passed the last reading.
+   */
+  bool Finished(Clock::time_point now) const;
+
+private:
+  std::vector<Reading> m_readings;
+  size_t m_next = 0; // First reading not yet reached
+  bool m_started = false;
+  Clock::time_point m_start;
+};
+
+/**
+ * @brief Smooths lux readings: a running median over the last few samples
+ *        throws out spikes (a passing shadow, a flickering lamp), then an
+ *        exponential moving average with a time constant settles the rest.
+ *
+ * Works on log10(1 + lux), since perceived brightness follows the ratio of
+ * light levels rather than their difference.
+ */
+class LuxFilter
+{
+public:
+  using Clock = std::chrono::steady_clock;
+
+  struct Options
+  {
+    size_t medianWindow = 5;                      // Samples in the median; 1 disables it
+    std::chrono::milliseconds timeConstant{4000}; // Of the moving average; 0 disables it
+  };
+
+  LuxFilter();
+  explicit LuxFilter(const Options &options);
+
+  /**
+   * @brief Adds a sample.
+   * @return The filtered value, in lux.
+   */
+  double Add(double lux, Clock::time_point now);
+
+  void Reset();
+  bool HasValue() const { return m_hasValue; }
+
+  /**
+   * @brief The filtered value as log10(1 + lux).
+   */
+  double Level() const { return m_level; }
+
+  double Lux() const;
+
+private:
+  Options m_options;
+  std::deque<double> m_window; // Newest last, as levels
+  double m_level = 0.0;
+  bool m_hasValue = false;
+  Clock::time_point m_last;
+};
+
+/**
+ * @brief One point of an ambient brightness curve.
+ */
+struct AmbientCurvePoint
+{
+  double lux;
+  int hardware; // Hardware brightness (0-100) at this light level
+  int software; // Software brightness (1-100) at this light level
+};
+
+/**
+ * @brief Maps a light level to brightness: piecewise linear in log lux
+ *        between the points, and flat beyond the first and last.
+ */
+class AmbientCurve
+{
+public:
+  /**
+   * @param points In ascending order of lux; at least one.
+   */
+  explicit AmbientCurve(std::vector<AmbientCurvePoint> points);
+
+  /**
+   * @brief Dark room to daylight: the backlight does most of the work, and
+   *        gamma only dims further once the backlight is near its floor.
+   */
+  static AmbientCurve Default();
+
+  AmbientCurvePoint Evaluate(double lux) const;
+
+  const std::vector<AmbientCurvePoint> &Points() const { return m_points; }
+
+private:
+  std::vector<AmbientCurvePoint> m_points;
+};
+
+/**
+ * @brief Automatic brightness from an ambient light sensor.
+ *
+ * Step() polls the source, filters the reading and, when the light level has
+ * moved far enough from the one last acted on, sets every monitor to the
+ * level its curve gives through BrightnessController's ordinary setters.
+ * Three things keep DDC/CI traffic down:
+ *   - hysteresis: light within Options::hysteresis decades of the last
+ *     level acted on changes nothing;
+ *   - a rate limit: at most one update per Options::minInterval;
+ *   - a deadband: a monitor already within minHardwareStep (minSoftwareStep)
+ *     of its target is left alone.
+ * Monitors without DDC/CI get the whole curve through software brightness.
+ *
+ * Not thread-safe; call from the thread that drives BrightnessController.
+ */
+class AutoBrightness
+{
+public:
+  using Clock = std::chrono::steady_clock;
+
+  struct Options
+  {
+    LuxFilter::Options filter;
+    double hysteresis = 0.15;                    // In log10(1 + lux); about +-40% in lux
+    std::chrono::milliseconds minInterval{5000}; // Between updates
+    int minHardwareStep = 3;                     // Smallest hardware change worth a DDC/CI write
+    int minSoftwareStep = 2;                     // Smallest software change worth a gamma write
+    AmbientCurve curve = AmbientCurve::Default();
+    std::map<std::wstring, AmbientCurve> curves; // Per monitor device name, overriding curve
+  };
+
+  /**
+   * @brief What the hysteresis, rate limit and deadband absorbed.
+   */
+  struct Stats
+  {
+    uint64_t samples = 0;          // Readings taken
+    uint64_t readFailures = 0;     // Polls the source had nothing for
+    uint64_t withinHysteresis = 0; // Samples too close to the level last acted on
+    uint64_t rateLimited = 0;      // Samples that moved far enough, but too soon after an update
+    uint64_t updates = 0;          // Times the monitors were re-evaluated
+    uint64_t hardwareWrites = 0;   // SetHardwareBrightness calls made
+    uint64_t softwareWrites = 0;   // SetSoftwareBrightness calls made
+  };
+
+  explicit AutoBrightness(std::unique_ptr<AmbientSource> source);
+  AutoBrightness(std::unique_ptr<AmbientSource> source, const Options &options);
+
+  /**
+   * @brief Polls the source once and updates the monitors if warranted.
+   * @return true if any monitor's brightness was changed.
+   */
+  bool Step(Clock::time_point now = Clock::now());
+
+  /**
+   * @brief Forgets the filter and the level last acted on, so the next
+   *        reading is applied at once. Call when the mode is switched on or
+   *        the monitors have changed.
+   */
+  void Reset();
+
+  /**
+   * @brief The filtered light level, or -1 before the first reading.
+   */
+  double GetLux() const;
+
+  Stats GetStats() const { return m_stats; }
+  const AmbientSource &GetSource() const { return *m_source; }
+
+private:
+  const AmbientCurve &CurveFor(const std::wstring &deviceName) const;
+  bool Apply(double lux, bool &skipped); // skipped: set if a Pending monitor was left alone
+
+  std::unique_ptr<AmbientSource> m_source;
+  Options m_options;
+  LuxFilter m_filter;
+  bool m_anchored = false; // Whether m_anchor holds a level acted on
+  double m_anchor = 0.0;   // Filter level at the last update that reached every monitor
+  Clock::time_point m_lastUpdate;
+  Stats m_stats;
+};
+
+namespace AmbientUtils
+{
+  /**
+   * @brief Software brightness for a monitor without DDC/CI at curve point
+   *        @p point: the software level, scaled down by what the backlight
+   *        would have dimmed.
+   */
+  int SoftwareOnlyBrightness(const AmbientCurvePoint &point);
+
+  /**
+   * @brief The platform's sensor if there is one (IIO on Linux), otherwise
+   *        a FileAmbientSource reading ambient_lux.txt in @p dataDirectory.
+   */
+  std::unique_ptr<AmbientSource> CreateDefaultSource(const std::filesystem::path &dataDirectory);
+}
@@ -1,61 +1,357 @@
 #include "brightness.h"
 #include "colortemp.h"
-#include <windows.h>
+#include "ddcci.h"
+#include "parallel.h"
+#include "rampcache.h"
+#include "trace.h"
+#include "transition.h"
 #include <vector>
 #include <string>
-#include <highlevelmonitorconfigurationapi.h>
-#include <physicalmonitorenumerationapi.h>
 #include <cmath>
+#include <cstdlib>
 #include <algorithm>
+#include <utility>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
 
 // Internal constants for brightness mapping
 namespace
 {
   // Software brightness lower bound (0-100 scale) to prevent the screen from going fully black.
-  // Setting this too low can make the screen unreadable.
-  const int MIN_SAFE_SOFTWARE_BRIGHTNESS = 49;
-  const int MAX_BRIGHTNESS = 100;
-  const int MIN_INPUT_BRIGHTNESS = 1;
-}
+  // Defined next to the ramp builder, which maps onto it (see MapBrightnessToSafeFactor).
+  const int MIN_SAFE_SOFTWARE_BRIGHTNESS = ColorTempUtils::SAFE_BRIGHTNESS_FLOOR;
+  const int MAX_BRIGHTNESS = ColorTempUtils::BRIGHTNESS_MAX;
+  const int MIN_INPUT_BRIGHTNESS = ColorTempUtils::BRIGHTNESS_MIN;
 
-double MapBrightnessToSafeFactor(int brightness)
-{
-  // Clamp input
-  brightness = std::max(MIN_INPUT_BRIGHTNESS, std::min(brightness, MAX_BRIGHTNESS));
+  // Upper bound on monitors probed at once. Probing is dominated by DDC/CI
+  // bus latency and retry sleeps, so threads mostly wait; the cap only stops
+  // a wall of displays from spawning a thread each.
+  const size_t MAX_PROBE_THREADS = 8;
+
+  // Frame rate assumed for transitions when the backend cannot report one.
+  const int DEFAULT_REFRESH_RATE = 60;
 
-  // Linear mapping:
-  // Out = MinSafe + (In - MinIn) * (MaxSafe - MinSafe) / (MaxIn - MinIn)
-  return static_cast<double>(MIN_SAFE_SOFTWARE_BRIGHTNESS) +
-         (static_cast<double>(brightness - MIN_INPUT_BRIGHTNESS) *
-          (static_cast<double>(MAX_BRIGHTNESS - MIN_SAFE_SOFTWARE_BRIGHTNESS)) /
-          (static_cast<double>(MAX_BRIGHTNESS - MIN_INPUT_BRIGHTNESS)));
+  // Light a backlight still gives at hardware brightness 0, on the 0-100
+  // scale. Keeps the unified slider's gamma compensation finite near 0.
+  const int BACKLIGHT_FLOOR = 10;
+
+  // How often the transition thread looks for a landed unified commit if
+  // the completion's wake-up came while it was busy.
+  const std::chrono::milliseconds UNIFIED_POLL{50};
+
+  // Largest difference per entry between a ramp written and the one read
+  // back that VerifyGammaRamps puts down to the driver rounding it (to an
+  // 8-bit LUT, at worst) rather than to someone else's ramp.
+  const int GAMMA_ROUNDING_TOLERANCE = 256;
 }
 
-// Global internal state
+// Global internal state. Guarded by g_stateMutex, which is recursive so the
+// public members can call one another while holding it.
+static std::recursive_mutex g_stateMutex;
+using StateLock = std::lock_guard<std::recursive_mutex>;
 static std::vector<Monitor> g_monitors;
 static bool g_initialized = false;
 
-// Forward declaration of the callback
-BOOL CALLBACK MonitorEnumProc(HMONITOR hMonitor, HDC hdcMonitor, LPRECT, LPARAM dwData);
+// Built ramps shared by every monitor, plus the writes they made unnecessary
+static GammaRampCache g_rampCache;
+static std::atomic<uint64_t> g_rampWritesIssued(0);
+static std::atomic<uint64_t> g_rampWritesSkipped(0);
+static std::atomic<uint64_t> g_rampFlushes(0);
+static std::vector<uint16_t> g_shownRamp; // VerifyGammaRamps' read-back buffer; state lock only
+
+// BeginUpdate nesting depth and the monitors written since the outermost one.
+// Per thread; the outermost BeginUpdate holds the state until its EndUpdate,
+// so no other thread can replace g_monitors under these pointers.
+static thread_local int g_updateDepth = 0;
+static thread_local std::vector<Monitor *> g_unflushed;
+
+// Transition tracks, parallel to g_monitors
+struct MonitorTransition
+{
+  SoftwareTransition software;
+  std::chrono::steady_clock::time_point softwareStart;
+  std::chrono::steady_clock::duration frameInterval{};
+  size_t framesPlayed = 0; // Index of the next keyframe due
+  double brightness = 0.0; // Exact level of the last keyframe played,
+  double mired = 0.0;      // so a retarget starts from there
+  int targetBrightness = 0;
+  int targetKelvin = 0;
+
+  HardwareTransition hardware;
+  std::chrono::steady_clock::time_point hardwareStart;
+  int targetHardware = 0;
+
+  // Unified slider gesture: the ramp stands in for the hardware level until
+  // the gesture's single DDC/CI write has landed.
+  bool unified = false;
+  int unifiedShown = 0;  // Hardware level the monitor shows, which the ramp compensates from
+  int unifiedTarget = 0; // Level previewed or committed
+  int unifiedCommitted = 0; // Level the write in flight carries
+  std::shared_ptr<std::atomic<int>> unifiedCommit; // DdcResult of the write in flight, -1 until it lands
+};
+static std::vector<MonitorTransition> g_transitions;
+static TransitionStats g_transitionStats;
+
+// Transition thread, started by the first StartTransition
+static std::thread g_transitionThread;
+static std::condition_variable_any g_transitionWake;
+static bool g_transitionStop = false;
+
+// Background DDC/CI probe started by StartHardwareProbe. The generation
+// changes whenever g_monitors is replaced, so a probe can tell that the list
+// it was started for is gone.
+static std::thread g_probeThread;
+static std::shared_ptr<std::atomic<bool>> g_probeCancel; // Abandons the running probe
+static uint64_t g_monitorGeneration = 0;
+
+// Known monitors' DDC/CI capabilities, installed by SetCapabilityCache
+static std::shared_ptr<DdcCapabilityCache> g_ddcCache;
+
+// How soon OpenDdc hands out every endpoint after a mode change, learned
+// across outputs. Opening is retried on a slower schedule than VCP commands
+// and never refused: there is no monitor yet to give up on.
+static DdcHealth::Options OpenDdcOptions()
+{
+  DdcHealth::Options options;
+  options.defaults.retryDelay = std::chrono::milliseconds(100);
+  options.minDelay = std::chrono::milliseconds(25);
+  options.maxDelay = std::chrono::milliseconds(400);
+  options.tripAfter = 0;
+  return options;
+}
+static DdcHealth g_openHealth(OpenDdcOptions());
+
+// One successful VCP brightness read
+struct DdcReading
+{
+  uint32_t min = 0;
+  uint32_t current = 0;
+  uint32_t max = 0;
+  uint32_t latencyUs = 0;
+};
+
+// How a VCP brightness read ended
+enum class DdcReadResult
+{
+  Answered,
+  Silent, // Every attempt failed
+  Refused // The endpoint's breaker is open; nothing was sent
+};
+
+// One monitor's share of a hardware probe. A full probe works on a private
+// Monitor that owns whatever it opens; a revalidation only reads through the
+// endpoint the published monitor already owns (monitors set up from the
+// cache have exactly one).
+struct HardwareProbeJob
+{
+  size_t index = 0;
+  bool revalidate = false;
+  Monitor probed;                      // Full probe: output in, endpoint and levels out
+  DdcHandle ddc = 0;                   // Revalidation: the endpoint in use
+  std::shared_ptr<std::mutex> busLock; // ...and the lock its worker writes under
+  std::shared_ptr<DdcHealth> health;   // ...and what has been learned about it
+  uint64_t postsAtStart = 0;           // ...and how many values it had been posted
+  DdcReading reading;
+  bool answered = false;
+  bool refused = false; // Revalidation: the breaker was open, so nothing was learned
+};
+
+// Forward declarations of the enumeration stages
+static void ProbeGamma(const std::shared_ptr<DisplayBackend> &backend, Monitor &monitor);
+static void ReadIdentity(const std::shared_ptr<DisplayBackend> &backend, Monitor &monitor);
+static bool ReadBackGamma(const std::shared_ptr<DisplayBackend> &backend, Monitor &monitor);
+static void ApplyCachedCapabilities(const std::shared_ptr<DisplayBackend> &backend, Monitor &monitor,
+                                    const DdcCapabilities &capabilities);
+static std::vector<HardwareProbeJob> CollectProbeJobs();
+static void RunProbeJob(const std::shared_ptr<DisplayBackend> &backend, HardwareProbeJob &job);
+static void PublishProbeJobs(std::vector<HardwareProbeJob> &jobs);
+static void DiscardProbeJobs(std::vector<HardwareProbeJob> &jobs);
+static std::unique_lock<std::recursive_mutex> LockWithoutProbe();
+static void ReleaseHardware(const std::shared_ptr<DisplayBackend> &backend, Monitor &monitor);
+static void ReleaseMonitor(const std::shared_ptr<DisplayBackend> &backend, Monitor &monitor);
+static void ReleaseMonitors(std::vector<Monitor> &monitors);
+
+// Told about level and topology changes (see SetChangeListener)
+static BrightnessController::ChangeFn g_changeListener;
+
+// Tells the change listener about @p m, if it is in the published list
+// rather than one still being probed. Called with the state held.
+static void NotifyChange(const Monitor &m)
+{
+  if (!g_changeListener || g_monitors.empty())
+    return;
+  std::less<const Monitor *> before;
+  if (before(&m, g_monitors.data()) || !before(&m, g_monitors.data() + g_monitors.size()))
+    return;
+  g_changeListener(static_cast<int>(&m - g_monitors.data()));
+}
+
+static void NotifyListChange()
+{
+  if (g_changeListener)
+    g_changeListener(-1);
+}
+
+// Forward declarations of the transition engine
+static void TransitionThread();
+static void WakeTransitionThread();
+static void StopTransitionThread();
+
+// The ramp a monitor's levels call for.
+static ColorTempUtils::GammaRampOptions RampOptions(const Monitor &m)
+{
+  ColorTempUtils::GammaRampOptions opts;
+  opts.brightness = m.softwareBrightness;
+  if (m.softwareGain != 1.0)
+    opts.brightness = MapSafeFactorToBrightness(MapBrightnessToSafeFactor(m.softwareBrightness) * m.softwareGain);
+  opts.kelvin = m.softwareColorTemp;
+  opts.entries = m.gammaSize;
+  return opts;
+}
 
 // Single point of truth for rebuilding a monitor's gamma ramp. Every code
 // path that mutates brightness or colour temp funnels through this helper so
 // the stages are always applied in the same order.
 static bool ApplyMonitorRamp(Monitor &m)
 {
-  if (!m.hdc)
+  TRACE_SCOPE("ApplyMonitorRamp");
+  NotifyChange(m);
+  std::shared_ptr<DisplayBackend> backend = GetDisplayBackend();
+  if (!m.hasGamma || !backend)
     return false;
 
-  ColorTempUtils::GammaRampOptions opts;
-  opts.brightness = m.softwareBrightness;
-  opts.kelvin = m.softwareColorTemp;
-  return ColorTempUtils::ApplyGammaRamp(m.hdc, opts);
+  std::shared_ptr<const CachedGammaRamp> ramp = g_rampCache.Get(RampOptions(m));
+
+  // The device already shows exactly this ramp; rewriting it is pure cost.
+  if (ramp->hash == m.lastRampHash)
+  {
+    g_rampWritesSkipped++;
+    return true;
+  }
+
+  g_rampWritesIssued++;
+  m.shownRampHash = 0;
+  if (!backend->SetGammaRamp(m.output, ramp->values.data()))
+  {
+    m.lastRampHash = 0; // Device state unknown after a failed write
+    return false;
+  }
+  m.lastRampHash = ramp->hash;
+
+  // Inside BeginUpdate/EndUpdate the flush is shared with the other outputs.
+  if (g_updateDepth > 0)
+  {
+    g_unflushed.push_back(&m);
+    return true;
+  }
+  g_rampFlushes++;
+  if (!backend->FlushGamma())
+  {
+    m.lastRampHash = 0;
+    return false;
+  }
+  return true;
 }
 
-// -----------------------------------------------------------------------------------------------
-// Helper Functions
-// (MapBrightnessToSafeFactor defined above, before the anonymous namespace, for external linkage)
-// -----------------------------------------------------------------------------------------------
+// Flushes the ramps written since the outermost BeginUpdate. Called with the
+// state held.
+static bool FlushUnflushed(const std::shared_ptr<DisplayBackend> &backend)
+{
+  TRACE_SCOPE_ARG("FlushGamma", "outputs", g_unflushed.size());
+  g_rampFlushes++;
+  bool ok = backend && backend->FlushGamma();
+  if (!ok)
+  {
+    // The backend cannot say which output failed; trust none of them.
+    for (Monitor *monitor : g_unflushed)
+      monitor->lastRampHash = 0;
+  }
+  g_unflushed.clear();
+  return ok;
+}
+
+// Maps a normalized 0-100 value onto the monitor's native DDC/CI range.
+static uint32_t ToNativeBrightness(const DdcEndpoint &endpoint, int brightness)
+{
+  if (endpoint.nativeMax <= endpoint.nativeMin)
+    return endpoint.nativeMin;
+  return endpoint.nativeMin + static_cast<uint32_t>(std::round(
+                                  static_cast<double>(brightness) * (endpoint.nativeMax - endpoint.nativeMin) / 100.0));
+}
+
+// @p fallback is returned when the endpoint's range is indeterminate.
+static int FromNativeBrightness(const DdcEndpoint &endpoint, uint32_t nativeValue, int fallback)
+{
+  if (endpoint.nativeMax <= endpoint.nativeMin)
+    return fallback;
+  nativeValue = std::max(endpoint.nativeMin, std::min(nativeValue, endpoint.nativeMax));
+  return static_cast<int>(std::round(
+      static_cast<double>(nativeValue - endpoint.nativeMin) / (endpoint.nativeMax - endpoint.nativeMin) * 100.0));
+}
+
+// Gathers what each endpoint did with one hardware brightness change and
+// reports it once the last one is done.
+struct HardwareFanOut
+{
+  std::mutex mutex;
+  HardwareWriteReport report;
+  size_t remaining = 0;
+  std::chrono::steady_clock::time_point start;
+  BrightnessController::HardwareCompletionFn onComplete;
+
+  void Finish(size_t endpoint, DdcResult result)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      report.endpoints[endpoint].result = result;
+      report.endpoints[endpoint].latency =
+          std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+      if (--remaining > 0)
+        return;
+    }
+    onComplete(report);
+  }
+};
+
+// Shared by SetHardwareBrightness and hardware transition steps. The first
+// endpoint is sent @p nativeValue as is (transitions step in its range), the
+// others @p brightness converted to theirs.
+static void PostHardwareBrightness(Monitor &m, int brightness, uint32_t nativeValue,
+                                   BrightnessController::HardwareCompletionFn onComplete)
+{
+  m.hardwareBrightness = brightness;
+  m.hardwarePosts++;
+  NotifyChange(m);
+
+  std::shared_ptr<HardwareFanOut> fanOut;
+  if (onComplete)
+  {
+    fanOut = std::make_shared<HardwareFanOut>();
+    fanOut->report.brightness = brightness;
+    fanOut->report.endpoints.resize(m.ddc.size());
+    fanOut->remaining = m.ddc.size();
+    fanOut->start = std::chrono::steady_clock::now();
+    fanOut->onComplete = std::move(onComplete);
+  }
+
+  // Every endpoint has its own worker, so the physical monitors are written
+  // concurrently. Retries happen on the workers; neither the UI nor the
+  // transition thread ever waits on the bus.
+  for (size_t i = 0; i < m.ddc.size(); ++i)
+  {
+    DdcEndpoint &endpoint = m.ddc[i];
+    DdcWorker::CompletionFn done;
+    if (fanOut)
+      done = [fanOut, i](int, DdcResult result)
+      { fanOut->Finish(i, result); };
+    endpoint.worker->Post(brightness, i == 0 ? nativeValue : ToNativeBrightness(endpoint, brightness),
+                          std::move(done));
+  }
+}
 
 // -----------------------------------------------------------------------------------------------
 // BrightnessController Implementation
@@ -63,6 +359,7 @@ static bool ApplyMonitorRamp(Monitor &m)
 
 bool BrightnessController::Initialize()
 {
+  StateLock lock(g_stateMutex);
   if (g_initialized)
   {
     return true;
@@ -79,44 +376,325 @@ bool BrightnessController::Initialize()
 
 bool BrightnessController::RefreshMonitors()
 {
-  Cleanup(); // Release existing resources first
+  TRACE_SCOPE("RefreshMonitors");
+  std::unique_lock<std::recursive_mutex> lock = LockWithoutProbe();
+  if (!RefreshOutputs())
+    return false;
 
-  g_monitors.clear();
-  // Enumerate display monitors
-  EnumDisplayMonitors(nullptr, nullptr, MonitorEnumProc, reinterpret_cast<LPARAM>(&g_monitors));
+  // Same jobs as the background probe, but run on this thread with the state
+  // held throughout, so the list is complete when this returns.
+  std::shared_ptr<DisplayBackend> backend = GetDisplayBackend();
+  std::vector<HardwareProbeJob> jobs = CollectProbeJobs();
+  ParallelFor(jobs.size(), MAX_PROBE_THREADS, [&backend, &jobs](size_t i)
+              { RunProbeJob(backend, jobs[i]); });
+  PublishProbeJobs(jobs);
+  if (g_ddcCache)
+    g_ddcCache->Save();
+  return true;
+}
+
+bool BrightnessController::RefreshOutputs()
+{
+  return RefreshOutputs(nullptr);
+}
 
-  if (!g_monitors.empty())
+bool BrightnessController::RefreshOutputs(const std::function<bool(int monitorIndex)> &wanted)
+{
+  TRACE_SCOPE("RefreshOutputs");
+  // Let in-flight DDC writes land and release the previous handles before the
+  // new probe reopens the same outputs. Running transitions end where they are.
+  std::unique_lock<std::recursive_mutex> lock = LockWithoutProbe();
+  std::shared_ptr<DisplayBackend> backend = GetDisplayBackend();
+  g_monitorGeneration++;
+  g_unflushed.clear();
+  g_transitions.clear();
+  ReleaseMonitors(g_monitors);
+  g_initialized = false;
+  if (!backend)
   {
-    g_initialized = true;
-    return true;
+    NotifyListChange();
+    return false;
   }
-  return false;
+
+  // Pass 1: collect monitor handles only. This is cheap; everything that
+  // talks to the monitor itself is deferred to the probe passes.
+  std::vector<DisplayOutput> outputs = backend->EnumerateOutputs();
+  std::vector<Monitor> discovered(outputs.size());
+  for (size_t i = 0; i < outputs.size(); ++i)
+  {
+    discovered[i].output = outputs[i].handle;
+    discovered[i].deviceName = outputs[i].deviceName;
+    discovered[i].hardwareProbePending = !wanted || wanted(static_cast<int>(i));
+  }
+
+  // Pass 2: open the outputs for gamma and read their current ramps. No
+  // DDC/CI traffic yet; that is the slow part and has its own pass, which
+  // monitors known to the capability cache skip.
+  std::shared_ptr<DdcCapabilityCache> cache = g_ddcCache;
+  ParallelFor(discovered.size(), MAX_PROBE_THREADS, [&backend, &discovered, &cache](size_t i)
+              {
+                Monitor &monitor = discovered[i];
+                if (!monitor.hardwareProbePending)
+                  return; // Not wanted
+                ProbeGamma(backend, monitor);
+                ReadIdentity(backend, monitor);
+                DdcCapabilities capabilities;
+                if (cache && monitor.hasIdentity && cache->Lookup(monitor.identity, monitor.edidHash, capabilities))
+                  ApplyCachedCapabilities(backend, monitor, capabilities);
+              });
+
+  // Publish the list in one step.
+  g_monitors.swap(discovered);
+  g_transitions.assign(g_monitors.size(), MonitorTransition());
+  NotifyListChange();
+
+  g_initialized = !g_monitors.empty();
+  return g_initialized;
 }
 
-void BrightnessController::Cleanup()
+bool BrightnessController::UpdateOutputs(TopologyChange &change)
 {
-  for (auto &monitor : g_monitors)
+  TRACE_SCOPE("UpdateOutputs");
+  // Indices are about to change: abandon the probe (its monitors stay pending).
+  std::unique_lock<std::recursive_mutex> lock = LockWithoutProbe();
+  change = TopologyChange();
+  std::shared_ptr<DisplayBackend> backend = GetDisplayBackend();
+  if (!backend)
+    return RefreshOutputs();
+
+  // Pass 1: enumerate and read every output's EDID, so a different monitor
+  // showing up under a reused handle and name is not taken for the old one.
+  std::vector<DisplayOutput> outputs = backend->EnumerateOutputs();
+  std::vector<Monitor> next(outputs.size());
+  ParallelFor(next.size(), MAX_PROBE_THREADS, [&backend, &outputs, &next](size_t i)
+              {
+                next[i].output = outputs[i].handle;
+                next[i].deviceName = outputs[i].deviceName;
+                ReadIdentity(backend, next[i]);
+              });
+
+  // Pair the outputs with the current list. An EDID that could not be read
+  // on one side is not held against the match.
+  std::vector<int> previous(next.size(), -1);
+  std::vector<bool> matched(g_monitors.size(), false);
+  for (size_t i = 0; i < next.size(); ++i)
+  {
+    for (size_t j = 0; j < g_monitors.size(); ++j)
+    {
+      const Monitor &old = g_monitors[j];
+      if (matched[j] || old.output != next[i].output || old.deviceName != next[i].deviceName)
+        continue;
+      if (old.hasIdentity && next[i].hasIdentity &&
+          (!(old.identity == next[i].identity) || old.edidHash != next[i].edidHash))
+        continue;
+      previous[i] = static_cast<int>(j);
+      matched[j] = true;
+      break;
+    }
+  }
+
+  // Flush writes batched against the old list. Monitors that went away are
+  // released before anything is opened, since the backend may hand their
+  // handles to the new ones.
+  g_monitorGeneration++;
+  if (!g_unflushed.empty())
+    FlushUnflushed(backend);
+  for (size_t j = 0; j < g_monitors.size(); ++j)
+  {
+    if (matched[j])
+      continue;
+    change.removed.push_back(g_monitors[j].deviceName);
+    ReleaseMonitor(backend, g_monitors[j]);
+  }
+
+  // Kept monitors move over as they are, transition tracks included.
+  std::vector<MonitorTransition> transitions(next.size());
+  for (size_t i = 0; i < next.size(); ++i)
   {
-    // Clean up Device Contexts
-    if (monitor.hdc)
+    if (previous[i] < 0)
     {
-      DeleteDC(monitor.hdc);
-      monitor.hdc = nullptr;
+      next[i].hardwareProbePending = true;
+      continue;
     }
-    // Clean up Physical Monitor handles
-    if (monitor.hPhysicalMonitor)
+    size_t j = static_cast<size_t>(previous[i]);
+    Monitor &kept = next[i];
+    bool hasIdentity = kept.hasIdentity;
+    MonitorIdentity identity = kept.identity;
+    uint64_t edidHash = kept.edidHash;
+    kept = std::move(g_monitors[j]);
+    if (!kept.hasIdentity && hasIdentity)
+    {
+      kept.hasIdentity = true;
+      kept.identity = identity;
+      kept.edidHash = edidHash;
+    }
+    if (j < g_transitions.size())
+      transitions[i] = std::move(g_transitions[j]);
+  }
+
+  // Pass 2: open the new outputs as RefreshOutputs does, and read the kept
+  // ones' ramps back to see whether the mode change reset them.
+  std::shared_ptr<DdcCapabilityCache> cache = g_ddcCache;
+  std::vector<char> reset(next.size(), 0);
+  ParallelFor(next.size(), MAX_PROBE_THREADS, [&backend, &next, &previous, &reset, &cache](size_t i)
+              {
+                Monitor &monitor = next[i];
+                if (previous[i] >= 0)
+                {
+                  reset[i] = ReadBackGamma(backend, monitor);
+                  return;
+                }
+                ProbeGamma(backend, monitor);
+                DdcCapabilities capabilities;
+                if (cache && monitor.hasIdentity && cache->Lookup(monitor.identity, monitor.edidHash, capabilities))
+                  ApplyCachedCapabilities(backend, monitor, capabilities);
+              });
+
+  g_monitors.swap(next);
+  g_transitions.swap(transitions);
+  g_initialized = !g_monitors.empty();
+  NotifyListChange();
+
+  // Put back the ramps the driver dropped, in one flush.
+  BeginUpdate();
+  for (size_t i = 0; i < g_monitors.size(); ++i)
+  {
+    if (previous[i] < 0)
     {
-      DestroyPhysicalMonitor(monitor.hPhysicalMonitor);
-      monitor.hPhysicalMonitor = nullptr;
-      monitor.supportsHardwareBrightness = false;
+      change.added.push_back(static_cast<int>(i));
+      continue;
     }
+    change.kept++;
+    if (!reset[i])
+      continue;
+    change.reset.push_back(static_cast<int>(i));
+    ApplyMonitorRamp(g_monitors[i]);
+  }
+  EndUpdate();
+  return g_initialized;
+}
+
+// Runs @p jobs, collected for g_monitors of @p generation, and publishes the
+// results.
+static void HardwareProbeThread(std::shared_ptr<DisplayBackend> backend, std::shared_ptr<DdcCapabilityCache> cache,
+                                uint64_t generation, std::shared_ptr<std::atomic<bool>> cancel,
+                                std::vector<HardwareProbeJob> jobs, std::function<void()> onComplete)
+{
+  Trace::SetThreadName("hardware probe");
+  TRACE_SCOPE_ARG("HardwareProbe", "jobs", jobs.size());
+  ParallelFor(jobs.size(), MAX_PROBE_THREADS, [&backend, &jobs, &cancel](size_t i)
+              {
+                if (!*cancel)
+                  RunProbeJob(backend, jobs[i]);
+              });
+
+  // Whoever cancels joins this thread with the state released, so it is
+  // safe to wait for the lock; the flag says whether it was cancelled meanwhile.
+  std::unique_lock<std::recursive_mutex> lock(g_stateMutex);
+  if (*cancel || generation != g_monitorGeneration)
+  {
+    lock.unlock();
+    DiscardProbeJobs(jobs);
+    return;
+  }
+
+  PublishProbeJobs(jobs);
+  lock.unlock();
+
+  // File I/O stays off the state lock.
+  if (cache)
+    cache->Save();
+  if (onComplete)
+    onComplete();
+}
+
+bool BrightnessController::StartHardwareProbe(std::function<void()> onComplete)
+{
+  std::unique_lock<std::recursive_mutex> lock = LockWithoutProbe();
+  std::shared_ptr<DisplayBackend> backend = GetDisplayBackend();
+  if (!backend)
+    return false;
+
+  std::vector<HardwareProbeJob> jobs = CollectProbeJobs();
+  if (jobs.empty())
+    return false;
+
+  g_probeCancel = std::make_shared<std::atomic<bool>>(false);
+  g_probeThread = std::thread(HardwareProbeThread, std::move(backend), g_ddcCache, g_monitorGeneration,
+                              g_probeCancel, std::move(jobs), std::move(onComplete));
+  return true;
+}
+
+void BrightnessController::SetCapabilityCache(std::shared_ptr<DdcCapabilityCache> cache)
+{
+  StateLock lock(g_stateMutex);
+  g_ddcCache = std::move(cache);
+}
+
+void BrightnessController::WaitForHardwareProbe()
+{
+  // The probe publishes under the state lock, so join without holding it.
+  // Taking the thread over leaves nothing for LockWithoutProbe to join
+  // meanwhile; a probe that finishes for a newer monitor list discards its
+  // results by generation.
+  std::thread probe;
+  {
+    StateLock lock(g_stateMutex);
+    probe = std::move(g_probeThread);
   }
-  g_monitors.clear();
+  if (probe.joinable())
+    probe.join();
+}
+
+bool BrightnessController::IsHardwareProbePending()
+{
+  StateLock lock(g_stateMutex);
+  return std::any_of(g_monitors.begin(), g_monitors.end(), [](const Monitor &monitor)
+                     { return monitor.hardwareProbePending; });
+}
+
+HardwareProbeState BrightnessController::GetHardwareProbeState(int monitorIndex)
+{
+  StateLock lock(g_stateMutex);
+  if (monitorIndex < 0 || static_cast<size_t>(monitorIndex) >= g_monitors.size())
+    return HardwareProbeState::Unavailable;
+
+  const Monitor &monitor = g_monitors[monitorIndex];
+  if (monitor.hardwareProbePending)
+    return HardwareProbeState::Pending;
+  return monitor.supportsHardwareBrightness ? HardwareProbeState::Available : HardwareProbeState::Unavailable;
+}
+
+std::vector<DdcHealth::Snapshot> BrightnessController::GetDdcHealth(int monitorIndex)
+{
+  StateLock lock(g_stateMutex);
+  std::vector<DdcHealth::Snapshot> snapshots;
+  if (monitorIndex < 0 || static_cast<size_t>(monitorIndex) >= g_monitors.size())
+    return snapshots;
+
+  for (const DdcEndpoint &endpoint : g_monitors[monitorIndex].ddc)
+    if (endpoint.health)
+      snapshots.push_back(endpoint.health->GetSnapshot());
+  return snapshots;
+}
+
+void BrightnessController::Cleanup()
+{
+  // The transition thread takes the state lock, so stop it before holding it.
+  StopTransitionThread();
+
+  std::unique_lock<std::recursive_mutex> lock = LockWithoutProbe();
+  g_monitorGeneration++;
+  g_unflushed.clear();
+  g_transitions.clear();
+  ReleaseMonitors(g_monitors);
   g_initialized = false;
+  NotifyListChange();
 }
 
 const std::vector<Monitor> &BrightnessController::GetMonitors()
 {
+  StateLock lock(g_stateMutex);
   if (!g_initialized)
   {
     Initialize();
@@ -124,15 +702,44 @@ const std::vector<Monitor> &BrightnessController::GetMonitors()
   return g_monitors;
 }
 
+size_t BrightnessController::GetMonitorCount()
+{
+  StateLock lock(g_stateMutex);
+  return g_monitors.size();
+}
+
+std::wstring BrightnessController::GetDeviceName(int monitorIndex)
+{
+  StateLock lock(g_stateMutex);
+  if (monitorIndex < 0 || static_cast<size_t>(monitorIndex) >= g_monitors.size())
+    return std::wstring();
+  return g_monitors[monitorIndex].deviceName;
+}
+
+void BrightnessController::SetChangeListener(ChangeFn listener)
+{
+  StateLock lock(g_stateMutex);
+  g_changeListener = std::move(listener);
+}
+
 bool BrightnessController::SetSoftwareBrightness(int monitorIndex, int brightness)
 {
+  StateLock lock(g_stateMutex);
   if (monitorIndex < 0 || static_cast<size_t>(monitorIndex) >= g_monitors.size())
     return false;
 
   Monitor &monitor = g_monitors[monitorIndex];
-  if (!monitor.hdc)
+  if (!monitor.hasGamma)
     return false;
 
+  // A manual change takes over from any running transition.
+  MonitorTransition &transition = g_transitions[monitorIndex];
+  if (transition.software.IsActive())
+  {
+    transition.software.Clear();
+    g_transitionStats.cancelled++;
+  }
+
   brightness = std::max(MIN_INPUT_BRIGHTNESS, std::min(brightness, MAX_BRIGHTNESS));
   monitor.softwareBrightness = brightness;
   return ApplyMonitorRamp(monitor);
@@ -140,62 +747,225 @@ bool BrightnessController::SetSoftwareBrightness(int monitorIndex, int brightnes
 
 bool BrightnessController::SetSoftwareColorTemp(int monitorIndex, int kelvin)
 {
+  StateLock lock(g_stateMutex);
   if (monitorIndex < 0 || static_cast<size_t>(monitorIndex) >= g_monitors.size())
     return false;
 
   Monitor &monitor = g_monitors[monitorIndex];
-  if (!monitor.hdc)
+  if (!monitor.hasGamma)
     return false;
 
+  MonitorTransition &transition = g_transitions[monitorIndex];
+  if (transition.software.IsActive())
+  {
+    transition.software.Clear();
+    g_transitionStats.cancelled++;
+  }
+
   kelvin = std::max(ColorTempUtils::KELVIN_MIN, std::min(kelvin, ColorTempUtils::KELVIN_MAX));
   monitor.softwareColorTemp = kelvin;
   return ApplyMonitorRamp(monitor);
 }
 
+bool BrightnessController::SetSoftwareLevels(int monitorIndex, int brightness, int kelvin)
+{
+  StateLock lock(g_stateMutex);
+  if (monitorIndex < 0 || static_cast<size_t>(monitorIndex) >= g_monitors.size())
+    return false;
+
+  Monitor &monitor = g_monitors[monitorIndex];
+  if (!monitor.hasGamma)
+    return false;
+
+  MonitorTransition &transition = g_transitions[monitorIndex];
+  if (transition.software.IsActive())
+  {
+    transition.software.Clear();
+    g_transitionStats.cancelled++;
+  }
+
+  if (brightness >= 0)
+    monitor.softwareBrightness = std::max(MIN_INPUT_BRIGHTNESS, std::min(brightness, MAX_BRIGHTNESS));
+  if (kelvin >= 0)
+    monitor.softwareColorTemp = std::max(ColorTempUtils::KELVIN_MIN, std::min(kelvin, ColorTempUtils::KELVIN_MAX));
+  return ApplyMonitorRamp(monitor);
+}
+
+void BrightnessController::BeginUpdate()
+{
+  // Released by the matching EndUpdate
+  g_stateMutex.lock();
+  g_updateDepth++;
+}
+
+bool BrightnessController::EndUpdate()
+{
+  if (g_updateDepth == 0)
+    return true;
+  // Takes over the hold of the matching BeginUpdate, released after the flush
+  StateLock lock(g_stateMutex, std::adopt_lock);
+  if (--g_updateDepth > 0 || g_unflushed.empty())
+    return true;
+
+  return FlushUnflushed(GetDisplayBackend());
+}
+
 int BrightnessController::GetSoftwareColorTemp(int monitorIndex)
 {
+  StateLock lock(g_stateMutex);
   if (monitorIndex < 0 || static_cast<size_t>(monitorIndex) >= g_monitors.size())
     return -1;
   return g_monitors[monitorIndex].softwareColorTemp;
 }
 
-bool BrightnessController::SetHardwareBrightness(int monitorIndex, int brightness)
+// A manual hardware change takes over from a running hardware transition.
+// Called with the state held.
+static void StopHardwareTrack(MonitorTransition &transition)
+{
+  if (transition.hardware.IsActive())
+  {
+    transition.hardware.Clear();
+    g_transitionStats.cancelled++;
+  }
+}
+
+// Scales the ramp so the monitor looks as if it showed the unified target
+// rather than the hardware level it does show. Backlight light is taken to
+// follow the hardware level linearly. Called with the state held.
+static void ApplyUnifiedGain(Monitor &monitor, const MonitorTransition &transition)
 {
+  double gain = 1.0;
+  if (transition.unified && transition.unifiedTarget != transition.unifiedShown)
+    gain = static_cast<double>(transition.unifiedTarget + BACKLIGHT_FLOOR) /
+           (transition.unifiedShown + BACKLIGHT_FLOOR);
+  if (gain == monitor.softwareGain)
+    return;
+  monitor.softwareGain = gain;
+  ApplyMonitorRamp(monitor);
+}
+
+// Starts a unified gesture from the level the monitor shows, unless one is
+// still running. Called with the state held.
+static void BeginUnified(const Monitor &monitor, MonitorTransition &transition)
+{
+  if (transition.unified)
+    return;
+  transition.unified = true;
+  transition.unifiedShown = monitor.hardwareBrightness;
+  transition.unifiedTarget = monitor.hardwareBrightness;
+}
+
+// Ends a unified gesture and drops its compensation. A write still in
+// flight lands unobserved. Called with the state held.
+static void EndUnified(Monitor &monitor, MonitorTransition &transition)
+{
+  transition.unified = false;
+  transition.unifiedCommit.reset();
+  ApplyUnifiedGain(monitor, transition);
+}
+
+bool BrightnessController::SetHardwareBrightness(int monitorIndex, int brightness,
+                                                 HardwareCompletionFn onComplete)
+{
+  StateLock lock(g_stateMutex);
   if (monitorIndex < 0 || static_cast<size_t>(monitorIndex) >= g_monitors.size())
     return false;
 
   Monitor &monitor = g_monitors[monitorIndex];
-  if (!monitor.supportsHardwareBrightness)
+  if (!monitor.supportsHardwareBrightness || monitor.ddc.empty())
     return false;
 
+  MonitorTransition &transition = g_transitions[monitorIndex];
+  StopHardwareTrack(transition);
+  if (transition.unified)
+    EndUnified(monitor, transition);
+
   brightness = std::max(0, std::min(brightness, MAX_BRIGHTNESS));
+  PostHardwareBrightness(monitor, brightness, ToNativeBrightness(monitor.ddc[0], brightness), std::move(onComplete));
+  return true;
+}
+
+bool BrightnessController::PreviewUnifiedBrightness(int monitorIndex, int brightness)
+{
+  TRACE_SCOPE_ARG("PreviewUnifiedBrightness", "brightness", brightness);
+  StateLock lock(g_stateMutex);
+  if (monitorIndex < 0 || static_cast<size_t>(monitorIndex) >= g_monitors.size())
+    return false;
 
-  monitor.hardwareBrightness = brightness;
+  Monitor &monitor = g_monitors[monitorIndex];
+  if (!monitor.supportsHardwareBrightness || monitor.ddc.empty())
+    return false;
 
-  // Map the normalized 0-100 value to the monitor's native brightness range
-  DWORD nativeBrightness = monitor.hwNativeMin;
-  if (monitor.hwNativeMax > monitor.hwNativeMin)
-  {
-    nativeBrightness = monitor.hwNativeMin +
-                       static_cast<DWORD>(std::round(
-                           static_cast<double>(brightness) *
-                           (monitor.hwNativeMax - monitor.hwNativeMin) / 100.0));
-  }
+  MonitorTransition &transition = g_transitions[monitorIndex];
+  StopHardwareTrack(transition);
+  BeginUnified(monitor, transition);
+  transition.unifiedTarget = std::max(0, std::min(brightness, MAX_BRIGHTNESS));
+  ApplyUnifiedGain(monitor, transition);
+  return true;
+}
 
-  for (int attempt = 1; attempt <= 5; ++attempt)
+bool BrightnessController::CommitUnifiedBrightness(int monitorIndex, int brightness,
+                                                   HardwareCompletionFn onComplete)
+{
+  TRACE_SCOPE_ARG("CommitUnifiedBrightness", "brightness", brightness);
+  HardwareWriteReport unchanged;
   {
-    if (SetMonitorBrightness(monitor.hPhysicalMonitor, nativeBrightness))
+    StateLock lock(g_stateMutex);
+    if (monitorIndex < 0 || static_cast<size_t>(monitorIndex) >= g_monitors.size())
+      return false;
+
+    Monitor &monitor = g_monitors[monitorIndex];
+    if (!monitor.supportsHardwareBrightness || monitor.ddc.empty())
+      return false;
+
+    MonitorTransition &transition = g_transitions[monitorIndex];
+    StopHardwareTrack(transition);
+    BeginUnified(monitor, transition);
+    brightness = std::max(0, std::min(brightness, MAX_BRIGHTNESS));
+    transition.unifiedTarget = brightness;
+
+    // Back where it started, with nothing in flight: no write needed.
+    if (brightness != transition.unifiedShown || transition.unifiedCommit)
     {
+      // The completion runs on a DDC worker, which may be flushed with the
+      // state held; it only flags the result and leaves dropping the
+      // compensation to the transition thread.
+      auto commit = std::make_shared<std::atomic<int>>(-1);
+      transition.unifiedCommit = commit;
+      transition.unifiedCommitted = brightness;
+      PostHardwareBrightness(monitor, brightness, ToNativeBrightness(monitor.ddc[0], brightness),
+                             [commit, onComplete](const HardwareWriteReport &report)
+                             {
+                               commit->store(static_cast<int>(report.Overall()));
+                               g_transitionWake.notify_all();
+                               if (onComplete)
+                                 onComplete(report);
+                             });
+      ApplyUnifiedGain(monitor, transition);
+      WakeTransitionThread();
       return true;
     }
-    Sleep(50);
+    EndUnified(monitor, transition);
+    unchanged.brightness = brightness;
   }
+  if (onComplete)
+    onComplete(unchanged);
+  return true;
+}
 
-  return false;
+DdcResult HardwareWriteReport::Overall() const
+{
+  static const DdcResult WORST_FIRST[] = {DdcResult::Failed, DdcResult::Cancelled, DdcResult::Superseded};
+  for (DdcResult result : WORST_FIRST)
+    if (std::any_of(endpoints.begin(), endpoints.end(), [result](const Endpoint &endpoint)
+                    { return endpoint.result == result; }))
+      return result;
+  return DdcResult::Applied;
 }
 
 int BrightnessController::GetSoftwareBrightness(int monitorIndex)
 {
+  StateLock lock(g_stateMutex);
   if (monitorIndex < 0 || static_cast<size_t>(monitorIndex) >= g_monitors.size())
     return -1;
   return g_monitors[monitorIndex].softwareBrightness;
@@ -203,78 +973,358 @@ int BrightnessController::GetSoftwareBrightness(int monitorIndex)
 
 int BrightnessController::GetHardwareBrightness(int monitorIndex)
 {
+  StateLock lock(g_stateMutex);
   if (monitorIndex < 0 || static_cast<size_t>(monitorIndex) >= g_monitors.size())
     return -1;
   return g_monitors[monitorIndex].hardwareBrightness;
 }
 
+GammaRampStats BrightnessController::GetGammaRampStats()
+{
+  GammaRampCache::Stats cache = g_rampCache.GetStats();
+  GammaRampStats stats;
+  stats.cacheHits = cache.hits;
+  stats.cacheMisses = cache.misses;
+  stats.writesIssued = g_rampWritesIssued;
+  stats.writesSkipped = g_rampWritesSkipped;
+  stats.flushes = g_rampFlushes;
+  return stats;
+}
+
+GammaVerifyResult BrightnessController::VerifyGammaRamps()
+{
+  TRACE_SCOPE("VerifyGammaRamps");
+  StateLock lock(g_stateMutex);
+  GammaVerifyResult result;
+  std::shared_ptr<DisplayBackend> backend = GetDisplayBackend();
+  if (!backend)
+    return result;
+
+  std::vector<uint16_t> &shown = g_shownRamp;
+  BeginUpdate();
+  for (size_t i = 0; i < g_monitors.size(); ++i)
+  {
+    Monitor &monitor = g_monitors[i];
+    if (!monitor.hasGamma)
+      continue;
+    if (i < g_transitions.size() && (g_transitions[i].software.IsActive() || g_transitions[i].unified))
+    {
+      result.busy++;
+      continue;
+    }
+
+    shown.resize(static_cast<size_t>(monitor.gammaSize) * 3);
+    if (!backend->GetGammaRamp(monitor.output, shown.data()))
+      continue;
+    result.checked++;
+    uint64_t hash = HashGammaRamp(shown.data(), shown.size());
+    if (hash == monitor.lastRampHash || hash == monitor.shownRampHash)
+      continue;
+
+    // A driver that rounds reads back a near miss of every ramp written to
+    // it. Compared once per ramp written; the hash covers later passes.
+    std::shared_ptr<const CachedGammaRamp> ramp = g_rampCache.Get(RampOptions(monitor));
+    if (ramp->hash == monitor.lastRampHash && ramp->values.size() == shown.size() &&
+        std::equal(shown.begin(), shown.end(), ramp->values.begin(), [](uint16_t a, uint16_t b)
+                   { return std::abs(static_cast<int>(a) - static_cast<int>(b)) <= GAMMA_ROUNDING_TOLERANCE; }))
+    {
+      monitor.shownRampHash = hash;
+      continue;
+    }
+
+    monitor.gammaDrifts++;
+    result.drifted++;
+    monitor.lastRampHash = hash;
+    monitor.shownRampHash = 0;
+    ApplyMonitorRamp(monitor);
+  }
+  EndUpdate();
+  return result;
+}
+
+uint64_t BrightnessController::GetGammaDriftCount(int monitorIndex)
+{
+  StateLock lock(g_stateMutex);
+  if (monitorIndex < 0 || static_cast<size_t>(monitorIndex) >= g_monitors.size())
+    return 0;
+  return g_monitors[monitorIndex].gammaDrifts;
+}
+
 // -----------------------------------------------------------------------------------------------
-// Callbacks
+// Transitions
 // -----------------------------------------------------------------------------------------------
 
-BOOL CALLBACK MonitorEnumProc(HMONITOR hMonitor, HDC hdcMonitor, LPRECT, LPARAM dwData)
+bool BrightnessController::StartTransition(int monitorIndex, const TransitionTarget &target,
+                                           std::chrono::milliseconds duration)
 {
-  (void)hdcMonitor; // Unused
-  auto *monitors = reinterpret_cast<std::vector<Monitor> *>(dwData);
-  Monitor monitor;
-  monitor.hMonitor = hMonitor;
+  StateLock lock(g_stateMutex);
+  if (monitorIndex < 0 || static_cast<size_t>(monitorIndex) >= g_monitors.size())
+    return false;
+
+  Monitor &monitor = g_monitors[monitorIndex];
+  MonitorTransition &transition = g_transitions[monitorIndex];
+  const auto now = std::chrono::steady_clock::now();
+  bool planned = false;
+  bool retargeted = false;
 
-  MONITORINFOEX monitorInfoEx;
-  monitorInfoEx.cbSize = sizeof(MONITORINFOEX);
-  if (GetMonitorInfo(hMonitor, &monitorInfoEx))
+  if (monitor.hasGamma && (target.softwareBrightness >= 0 || target.softwareColorTemp >= 0))
   {
-    monitor.deviceName = monitorInfoEx.szDevice;
-    // Create a dedicated DC for this monitor for software brightness
-    monitor.hdc = CreateDC(nullptr, monitorInfoEx.szDevice, nullptr, nullptr);
+    // Start from the exact in-flight level, not the rounded one last
+    // written, so a retarget continues without a step.
+    bool active = transition.software.IsActive();
+    if (!active)
+    {
+      transition.brightness = monitor.softwareBrightness;
+      transition.mired = TransitionUtils::KelvinToMired(monitor.softwareColorTemp);
+      transition.targetBrightness = monitor.softwareBrightness;
+      transition.targetKelvin = monitor.softwareColorTemp;
+    }
+    if (target.softwareBrightness >= 0)
+      transition.targetBrightness = target.softwareBrightness;
+    if (target.softwareColorTemp >= 0)
+      transition.targetKelvin = target.softwareColorTemp;
+
+    std::shared_ptr<DisplayBackend> backend = GetDisplayBackend();
+    int refreshRate = backend ? backend->GetRefreshRate(monitor.output) : 0;
+    if (refreshRate <= 0)
+      refreshRate = DEFAULT_REFRESH_RATE;
+
+    // A fresh transition eases in and out; a retarget is already moving, so
+    // it only eases out to keep its speed continuous.
+    transition.software.Plan(transition.brightness, transition.mired,
+                             transition.targetBrightness, transition.targetKelvin,
+                             TransitionUtils::FramesFor(duration, refreshRate),
+                             active ? TransitionEasing::Out : TransitionEasing::InOut);
+    transition.softwareStart = now;
+    transition.frameInterval = std::chrono::steady_clock::duration(std::chrono::seconds(1)) / refreshRate;
+    transition.framesPlayed = 0;
+    planned = true;
+    retargeted = retargeted || active;
+  }
+
+  // Steps are planned in the first endpoint's native range; the others
+  // follow in theirs.
+  if (monitor.supportsHardwareBrightness && !monitor.ddc.empty() && target.hardwareBrightness >= 0)
+  {
+    if (transition.unified)
+      EndUnified(monitor, transition);
+    const DdcEndpoint &primary = monitor.ddc[0];
+    bool active = transition.hardware.IsActive();
+    uint32_t from = active ? transition.hardware.Current()
+                           : ToNativeBrightness(primary, monitor.hardwareBrightness);
+    transition.targetHardware = std::max(0, std::min(target.hardwareBrightness, MAX_BRIGHTNESS));
+    transition.hardware.Plan(from, ToNativeBrightness(primary, transition.targetHardware), duration,
+                             HARDWARE_STEP_INTERVAL);
+    transition.hardwareStart = now;
+    planned = true;
+    retargeted = retargeted || active;
   }
 
-  // Attempt to get Physical Monitor for Hardware Brightness (DDC/CI)
-  DWORD monitorCount = 0;
-  if (GetNumberOfPhysicalMonitorsFromHMONITOR(hMonitor, &monitorCount) && monitorCount > 0)
+  if (!planned)
+    return false;
+
+  g_transitionStats.started++;
+  if (retargeted)
+    g_transitionStats.retargeted++;
+
+  WakeTransitionThread();
+  return true;
+}
+
+void BrightnessController::CancelTransition(int monitorIndex)
+{
+  StateLock lock(g_stateMutex);
+  if (monitorIndex < 0 || static_cast<size_t>(monitorIndex) >= g_transitions.size())
+    return;
+
+  MonitorTransition &transition = g_transitions[monitorIndex];
+  if (transition.software.IsActive() || transition.hardware.IsActive())
+    g_transitionStats.cancelled++;
+  transition.software.Clear();
+  transition.hardware.Clear();
+}
+
+bool BrightnessController::IsTransitioning(int monitorIndex)
+{
+  StateLock lock(g_stateMutex);
+  if (monitorIndex < 0 || static_cast<size_t>(monitorIndex) >= g_transitions.size())
+    return false;
+
+  const MonitorTransition &transition = g_transitions[monitorIndex];
+  return transition.software.IsActive() || transition.hardware.IsActive();
+}
+
+TransitionStats BrightnessController::GetTransitionStats()
+{
+  StateLock lock(g_stateMutex);
+  return g_transitionStats;
+}
+
+// Plays whatever is due at @p now on every monitor and lowers @p next to the
+// earliest moment something else falls due. Called with the state held.
+static void TickTransitions(std::chrono::steady_clock::time_point now,
+                            std::chrono::steady_clock::time_point &next)
+{
+  TRACE_SCOPE("TransitionTick");
+  // All outputs that advance on this tick change in one flush.
+  BrightnessController::BeginUpdate();
+  for (size_t i = 0; i < g_transitions.size(); ++i)
   {
-    auto *physicalMonitors = new PHYSICAL_MONITOR[monitorCount];
+    Monitor &monitor = g_monitors[i];
+    MonitorTransition &transition = g_transitions[i];
 
-    for (int attempt = 1; attempt <= 5; ++attempt)
+    if (transition.unifiedCommit)
     {
-      if (GetPhysicalMonitorsFromHMONITOR(hMonitor, monitorCount, physicalMonitors))
+      int result = transition.unifiedCommit->load();
+      if (result < 0)
+      {
+        next = std::min(next, now + UNIFIED_POLL);
+      }
+      else if (static_cast<DdcResult>(result) == DdcResult::Applied)
       {
-        if (physicalMonitors[0].hPhysicalMonitor != nullptr)
-        {
-          monitor.hPhysicalMonitor = physicalMonitors[0].hPhysicalMonitor;
-
-          // Close handles for any additional physical monitors (unsupported in this version)
-          for (DWORD i = 1; i < monitorCount; i++)
-          {
-            DestroyPhysicalMonitor(physicalMonitors[i].hPhysicalMonitor);
-          }
-          break;
-        }
+        // The monitor shows the committed level now; whatever of the ramp's
+        // compensation is left belongs to a newer preview, if any.
+        transition.unifiedCommit.reset();
+        transition.unifiedShown = transition.unifiedCommitted;
+        if (transition.unifiedTarget == transition.unifiedShown)
+          EndUnified(monitor, transition);
         else
-        {
-          // Call succeeded but returned a null handle — release all entries before retrying
-          for (DWORD i = 0; i < monitorCount; i++)
-          {
-            if (physicalMonitors[i].hPhysicalMonitor)
-              DestroyPhysicalMonitor(physicalMonitors[i].hPhysicalMonitor);
-          }
-        }
+          ApplyUnifiedGain(monitor, transition);
+      }
+      else
+      {
+        // The monitor kept its level; stop showing one it does not have.
+        monitor.hardwareBrightness = transition.unifiedShown;
+        EndUnified(monitor, transition);
       }
-      Sleep(100);
     }
 
-    delete[] physicalMonitors;
+    if (transition.software.IsActive())
+    {
+      // The frame is chosen from elapsed time, so a late wake-up skips
+      // ahead rather than stretching the transition.
+      const size_t last = transition.software.FrameCount() - 1;
+      size_t frame = static_cast<size_t>((now - transition.softwareStart) / transition.frameInterval);
+      frame = std::min(frame, last);
+      if (frame >= transition.framesPlayed)
+      {
+        g_transitionStats.framesSkipped += frame - transition.framesPlayed;
+        const TransitionKeyframe &keyframe = transition.software.Frame(frame);
+        monitor.softwareBrightness = keyframe.rampBrightness;
+        monitor.softwareColorTemp = keyframe.rampKelvin;
+        transition.brightness = keyframe.brightness;
+        transition.mired = keyframe.mired;
+        transition.framesPlayed = frame + 1;
+        ApplyMonitorRamp(monitor);
+        g_transitionStats.framesApplied++;
+      }
+
+      if (frame == last)
+        transition.software.Clear();
+      else
+        next = std::min(next, transition.softwareStart +
+                                  transition.frameInterval * static_cast<std::chrono::steady_clock::rep>(frame + 1));
+    }
+
+    if (transition.hardware.IsActive())
+    {
+      uint32_t nativeValue;
+      if (transition.hardware.Due(now - transition.hardwareStart, nativeValue))
+      {
+        // The last step reports the requested value exactly, not a rounding
+        // of its native counterpart.
+        int brightness = transition.hardware.IsActive()
+                             ? FromNativeBrightness(monitor.ddc[0], nativeValue, monitor.hardwareBrightness)
+                             : transition.targetHardware;
+        PostHardwareBrightness(monitor, brightness, nativeValue, nullptr);
+        g_transitionStats.hardwareSteps++;
+      }
+      if (transition.hardware.IsActive())
+        next = std::min(next, transition.hardwareStart + transition.hardware.NextDue());
+    }
+  }
+  BrightnessController::EndUpdate();
+}
+
+// Sleeps until the next keyframe or DDC step falls due (or a transition is
+// started, or a unified commit lands), plays it, and repeats until
+// StopTransitionThread.
+static void TransitionThread()
+{
+  Trace::SetThreadName("transition");
+  std::unique_lock<std::recursive_mutex> lock(g_stateMutex);
+  while (!g_transitionStop)
+  {
+    auto next = std::chrono::steady_clock::time_point::max();
+    TickTransitions(std::chrono::steady_clock::now(), next);
+    if (g_transitionStop)
+      break;
+    if (next == std::chrono::steady_clock::time_point::max())
+      g_transitionWake.wait(lock);
+    else
+      g_transitionWake.wait_until(lock, next);
   }
+}
 
-  // Initialize current values
+// Starts the transition thread if needed and has it look at the tracks.
+// Called with the state held.
+static void WakeTransitionThread()
+{
+  if (!g_transitionThread.joinable())
+  {
+    g_transitionStop = false;
+    g_transitionThread = std::thread(TransitionThread);
+  }
+  g_transitionWake.notify_all();
+}
 
-  // 1. Software Brightness (Reverse calculation from Gamma Ramp)
-  if (monitor.hdc)
+static void StopTransitionThread()
+{
   {
-    WORD currentGammaRamp[256 * 3];
-    if (GetDeviceGammaRamp(monitor.hdc, currentGammaRamp))
+    StateLock lock(g_stateMutex);
+    g_transitionStop = true;
+  }
+  g_transitionWake.notify_all();
+  if (g_transitionThread.joinable())
+    g_transitionThread.join();
+}
+
+// -----------------------------------------------------------------------------------------------
+// Probing & Release
+// -----------------------------------------------------------------------------------------------
+
+// Opens the monitor's output for gamma and reads the ramp it currently shows.
+// Runs on a probe thread; touches nothing but the Monitor it is given.
+static void ProbeGamma(const std::shared_ptr<DisplayBackend> &backend, Monitor &monitor)
+{
+  TRACE_SCOPE("ProbeGamma");
+  // Open the output for software brightness (a dedicated DC on Windows)
+  monitor.hasGamma = backend->OpenOutput(monitor.output);
+  if (monitor.hasGamma)
+  {
+    // Build ramps at the size the hardware reports (256 on GDI, often 1024
+    // or 4096 on XRandR/KMS); an output reporting no usable size gets none.
+    monitor.gammaSize = backend->GetGammaSize(monitor.output);
+    if (monitor.gammaSize < ColorTempUtils::GAMMA_RAMP_ENTRIES_MIN ||
+        monitor.gammaSize > ColorTempUtils::GAMMA_RAMP_ENTRIES_MAX)
     {
+      backend->CloseOutput(monitor.output);
+      monitor.hasGamma = false;
+    }
+  }
+
+  // Software Brightness (Reverse calculation from Gamma Ramp)
+  if (monitor.hasGamma)
+  {
+    std::vector<uint16_t> currentGammaRamp(static_cast<size_t>(monitor.gammaSize) * 3);
+    if (backend->GetGammaRamp(monitor.output, currentGammaRamp.data()))
+    {
+      // Remember what the device shows so an identical restore can be skipped.
+      monitor.lastRampHash = HashGammaRamp(currentGammaRamp.data(), currentGammaRamp.size());
+      monitor.shownRampHash = 0;
+
       // Calculate brightness factor from the top of the ramp (white point)
-      double factor = (double)currentGammaRamp[255] / (255.0 * 257.0);
+      double factor = (double)currentGammaRamp[monitor.gammaSize - 1] / 65535.0;
 
       // Reverse map from Safe Range to 1-100 Range
       // remapped = factor * 100
@@ -290,49 +1340,419 @@ BOOL CALLBACK MonitorEnumProc(HMONITOR hMonitor, HDC hdcMonitor, LPRECT, LPARAM
 
       // Clamp
       monitor.softwareBrightness = std::max(MIN_INPUT_BRIGHTNESS, std::min(monitor.softwareBrightness, MAX_BRIGHTNESS));
+
+      // Colour temperature from the ratios of the channels' white points
+      monitor.softwareColorTemp = ColorTempUtils::RampToKelvin(currentGammaRamp.data(), monitor.gammaSize);
     }
   }
+}
+
+// Reads the EDID that keys the monitor's capability cache entry.
+static void ReadIdentity(const std::shared_ptr<DisplayBackend> &backend, Monitor &monitor)
+{
+  TRACE_SCOPE("ReadIdentity");
+  uint8_t edid[DdcCi::EDID_LENGTH];
+  monitor.hasIdentity = backend->GetEdid(monitor.output, edid) &&
+                        DdcCapabilityCache::Identify(edid, monitor.identity, monitor.edidHash);
+}
+
+// Checks a kept monitor's ramp after a display change. Returns true if the
+// device no longer shows the ramp last written to it (drivers reset gamma on
+// some mode changes), leaving lastRampHash at what it does show so the next
+// ApplyMonitorRamp rewrites it. Touches nothing but the Monitor it is given.
+static bool ReadBackGamma(const std::shared_ptr<DisplayBackend> &backend, Monitor &monitor)
+{
+  TRACE_SCOPE("ReadBackGamma");
+  if (!monitor.hasGamma)
+    return false;
+
+  int gammaSize = backend->GetGammaSize(monitor.output);
+  if (gammaSize < ColorTempUtils::GAMMA_RAMP_ENTRIES_MIN || gammaSize > ColorTempUtils::GAMMA_RAMP_ENTRIES_MAX)
+  {
+    backend->CloseOutput(monitor.output);
+    monitor.hasGamma = false;
+    monitor.lastRampHash = 0;
+    return false;
+  }
+  if (gammaSize != monitor.gammaSize)
+  {
+    // A new mode with a different LUT: the old ramp cannot still be there.
+    monitor.gammaSize = gammaSize;
+    monitor.lastRampHash = 0;
+    return true;
+  }
+
+  std::vector<uint16_t> shown(static_cast<size_t>(gammaSize) * 3);
+  uint64_t hash = backend->GetGammaRamp(monitor.output, shown.data()) ? HashGammaRamp(shown.data(), shown.size()) : 0;
+  if (hash != 0 && (hash == monitor.lastRampHash || hash == monitor.shownRampHash))
+    return false;
+  monitor.lastRampHash = hash;
+  monitor.shownRampHash = 0;
+  return true;
+}
+
+// Starts the background writer for an endpoint. It learns its retry policy
+// into the endpoint's health, which the probe may already have seeded.
+static void StartDdcWorker(const std::shared_ptr<DisplayBackend> &backend, DdcEndpoint &endpoint)
+{
+  // The worker keeps the backend alive for as long as it may still write.
+  DdcHandle ddc = endpoint.handle;
+  std::shared_ptr<std::mutex> busLock = std::make_shared<std::mutex>();
+  endpoint.busLock = busLock;
+  if (!endpoint.health)
+    endpoint.health = std::make_shared<DdcHealth>();
+  endpoint.worker = std::make_shared<DdcWorker>(
+      [backend, ddc, busLock](uint32_t nativeValue)
+      {
+        TRACE_SCOPE_ARG("DdcWrite", "value", nativeValue);
+        std::lock_guard<std::mutex> lock(*busLock);
+        return backend->SetDdcBrightness(ddc, nativeValue);
+      },
+      endpoint.health);
+}
+
+// Reads VCP brightness with the retries @p health has learned for the
+// endpoint, feeding every attempt back into it, and times the read that
+// succeeds. Refused at once while the endpoint's breaker is open. @p busLock,
+// if given, is held around each attempt.
+static DdcReadResult ReadDdcBrightness(const std::shared_ptr<DisplayBackend> &backend, DdcHandle ddc,
+                                       std::mutex *busLock, DdcHealth &health, DdcReading &reading)
+{
+  if (!health.Allow())
+    return DdcReadResult::Refused;
+
+  DdcRetryParams params = health.Params();
+  bool ok = false;
+  for (int attempt = 1; attempt <= params.attempts && !ok; ++attempt)
+  {
+    if (attempt > 1)
+      std::this_thread::sleep_for(params.Backoff(attempt));
+
+    TRACE_SCOPE_ARG("GetDdcBrightness", "attempt", attempt);
+    std::unique_lock<std::mutex> lock;
+    if (busLock)
+      lock = std::unique_lock<std::mutex>(*busLock);
+    auto start = std::chrono::steady_clock::now();
+    ok = backend->GetDdcBrightness(ddc, reading.min, reading.current, reading.max);
+    auto latency = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+    ok = health.RecordCommand(ok, latency); // A read past the learned timeout is retried like a failed one
+    if (ok)
+      reading.latencyUs = static_cast<uint32_t>(latency.count());
+  }
+  health.RecordRequest(ok);
+  return ok ? DdcReadResult::Answered : DdcReadResult::Silent;
+}
+
+// Takes the native range and round trip from a reading.
+static void ApplyReading(DdcEndpoint &endpoint, const DdcReading &reading)
+{
+  endpoint.nativeMin = reading.min;
+  endpoint.nativeMax = reading.max;
+  endpoint.latencyUs = reading.latencyUs;
+}
+
+// The normalised level a reading reports. FromNativeBrightness clamps: some
+// DDC/CI implementations return values slightly outside the reported range.
+static int ReadingLevel(const DdcEndpoint &endpoint, const DdcReading &reading)
+{
+  return FromNativeBrightness(endpoint, reading.current, 50); // Native range indeterminate; use midpoint
+}
 
-  // 2. Hardware Brightness
-  if (monitor.hPhysicalMonitor != nullptr)
+// Opens the monitor's DDC/CI endpoints and reads their hardware brightness.
+// This is where the bus latency and retry sleeps are, so it runs after the
+// gamma pass, possibly in the background. The level and @p reading come from
+// the first endpoint that answers. Touches nothing but the Monitor it is given.
+static bool ProbeHardware(const std::shared_ptr<DisplayBackend> &backend, Monitor &monitor, DdcReading &reading)
+{
+  TRACE_SCOPE("ProbeHardware");
+  // Attempt to get the DDC/CI endpoints for Hardware Brightness. Drivers
+  // sometimes report endpoints but hand out null handles right after a mode
+  // change, so retry a few times before settling for the ones there are.
+  // A complete set is recorded with the time it took to get there, so the
+  // retry delay converges on how long this driver needs.
+  std::vector<DdcHandle> handles;
+  int expected = backend->CountDdcEndpoints(monitor.output);
+  if (expected > 0)
   {
-    DWORD minB, curB, maxB;
-    bool success = false;
-    for (int attempt = 1; attempt <= 5; ++attempt)
+    DdcRetryParams params = g_openHealth.Params();
+    auto first = std::chrono::steady_clock::now();
+    for (int attempt = 1; attempt <= params.attempts; ++attempt)
     {
-      if (GetMonitorBrightness(monitor.hPhysicalMonitor, &minB, &curB, &maxB))
+      auto start = std::chrono::steady_clock::now();
       {
-        monitor.hwNativeMin = minB;
-        monitor.hwNativeMax = maxB;
-        if (maxB > minB)
-        {
-          // Clamp curB to [minB, maxB] before arithmetic: some DDC/CI implementations
-          // return values slightly outside the reported range, and unsigned underflow
-          // on DWORD subtraction would produce UB when cast back to int.
-          curB = std::max(minB, std::min(curB, maxB));
-          double normalized = static_cast<double>(curB - minB) / (maxB - minB) * 100.0;
-          monitor.hardwareBrightness = static_cast<int>(std::round(normalized));
-        }
-        else
-        {
-          monitor.hardwareBrightness = 50; // Native range indeterminate; use midpoint
-        }
-        monitor.supportsHardwareBrightness = true;
-        success = true;
+        TRACE_SCOPE_ARG("OpenDdc", "attempt", attempt);
+        handles = backend->OpenDdc(monitor.output);
+      }
+      bool complete = static_cast<int>(handles.size()) >= expected;
+      g_openHealth.RecordCommand(complete, std::chrono::duration_cast<std::chrono::microseconds>(
+                                               std::chrono::steady_clock::now() - (complete ? first : start)));
+      if (complete || attempt == params.attempts)
         break;
+      for (DdcHandle handle : handles)
+        backend->CloseDdc(handle);
+      handles.clear();
+      std::this_thread::sleep_for(params.Backoff(attempt + 1));
+    }
+  }
+
+  // Physical monitors behind one output sit on separate buses; read them
+  // all at once. The ones that do not answer are closed again.
+  std::vector<DdcReading> readings(handles.size());
+  std::vector<char> answered(handles.size(), 0);
+  std::vector<std::shared_ptr<DdcHealth>> health(handles.size());
+  ParallelFor(handles.size(), MAX_PROBE_THREADS, [&backend, &handles, &readings, &answered, &health](size_t i)
+              {
+                health[i] = std::make_shared<DdcHealth>();
+                answered[i] = ReadDdcBrightness(backend, handles[i], nullptr, *health[i], readings[i]) ==
+                              DdcReadResult::Answered;
+              });
+  for (size_t i = 0; i < handles.size(); ++i)
+  {
+    if (!answered[i])
+    {
+      backend->CloseDdc(handles[i]);
+      continue;
+    }
+    DdcEndpoint endpoint;
+    endpoint.handle = handles[i];
+    endpoint.health = health[i];
+    ApplyReading(endpoint, readings[i]);
+    if (monitor.ddc.empty())
+    {
+      reading = readings[i];
+      monitor.hardwareBrightness = ReadingLevel(endpoint, reading);
+    }
+    StartDdcWorker(backend, endpoint);
+    monitor.ddc.push_back(std::move(endpoint));
+  }
+
+  monitor.supportsHardwareBrightness = !monitor.ddc.empty();
+  return monitor.supportsHardwareBrightness;
+}
+
+// Sets a known monitor up from its cache entry instead of probing it: a
+// single OpenDdc attempt and no brightness reads. The next hardware probe
+// revalidates it. Leaves the monitor pending if the endpoint is not there.
+static void ApplyCachedCapabilities(const std::shared_ptr<DisplayBackend> &backend, Monitor &monitor,
+                                    const DdcCapabilities &capabilities)
+{
+  if (!capabilities.supported)
+  {
+    monitor.hardwareProbePending = false;
+    monitor.ddcFromCache = true;
+    return;
+  }
+
+  // An entry holds a single native range, so displays with several
+  // physical monitors behind them are always probed.
+  if (backend->CountDdcEndpoints(monitor.output) != 1)
+    return;
+  std::vector<DdcHandle> handles;
+  {
+    TRACE_SCOPE_ARG("OpenDdc", "attempt", 1);
+    handles = backend->OpenDdc(monitor.output);
+  }
+  if (handles.size() != 1)
+  {
+    for (DdcHandle handle : handles)
+      backend->CloseDdc(handle);
+    return;
+  }
+
+  DdcEndpoint endpoint;
+  endpoint.handle = handles[0];
+  DdcReading reading;
+  reading.min = capabilities.nativeMin;
+  reading.max = capabilities.nativeMax;
+  reading.current = capabilities.nativeCurrent;
+  reading.latencyUs = capabilities.latencyUs;
+  ApplyReading(endpoint, reading);
+  monitor.hardwareBrightness = ReadingLevel(endpoint, reading);
+  StartDdcWorker(backend, endpoint);
+  monitor.ddc.push_back(std::move(endpoint));
+  monitor.supportsHardwareBrightness = true;
+  monitor.hardwareProbePending = false;
+  monitor.ddcFromCache = true;
+}
+
+// Records what a probe found for the next start. Called with the state held.
+static void StoreCapabilities(const Monitor &monitor, const DdcReading *reading)
+{
+  if (!g_ddcCache || !monitor.hasIdentity)
+    return;
+
+  DdcCapabilities capabilities;
+  capabilities.edidHash = monitor.edidHash;
+  capabilities.supported = reading != nullptr;
+  if (reading)
+  {
+    capabilities.nativeMin = reading->min;
+    capabilities.nativeMax = reading->max;
+    capabilities.nativeCurrent = reading->current;
+    capabilities.latencyUs = reading->latencyUs;
+  }
+  g_ddcCache->Store(monitor.identity, capabilities);
+}
+
+// Lists the monitors a hardware probe has to visit: every pending monitor
+// gets a full probe, every monitor set up from the cache a revalidation (a
+// full probe if the cache said it was bad). Called with the state held.
+static std::vector<HardwareProbeJob> CollectProbeJobs()
+{
+  std::vector<HardwareProbeJob> jobs;
+  for (size_t i = 0; i < g_monitors.size(); ++i)
+  {
+    const Monitor &monitor = g_monitors[i];
+    if (!monitor.hardwareProbePending && !monitor.ddcFromCache)
+      continue;
+
+    HardwareProbeJob job;
+    job.index = i;
+    job.revalidate = monitor.supportsHardwareBrightness;
+    if (job.revalidate)
+    {
+      job.ddc = monitor.ddc[0].handle;
+      job.busLock = monitor.ddc[0].busLock;
+      job.health = monitor.ddc[0].health;
+      job.postsAtStart = monitor.hardwarePosts;
+    }
+    else
+    {
+      job.probed.output = monitor.output;
+    }
+    jobs.push_back(std::move(job));
+  }
+  return jobs;
+}
+
+// Runs one job; touches nothing but the job.
+static void RunProbeJob(const std::shared_ptr<DisplayBackend> &backend, HardwareProbeJob &job)
+{
+  if (job.revalidate)
+  {
+    DdcReadResult result = ReadDdcBrightness(backend, job.ddc, job.busLock.get(), *job.health, job.reading);
+    job.answered = result == DdcReadResult::Answered;
+    job.refused = result == DdcReadResult::Refused;
+  }
+  else
+  {
+    job.answered = ProbeHardware(backend, job.probed, job.reading);
+  }
+}
+
+// Moves finished jobs' results into g_monitors and the cache. Called with
+// the state held, for the generation the jobs were collected for.
+static void PublishProbeJobs(std::vector<HardwareProbeJob> &jobs)
+{
+  std::shared_ptr<DisplayBackend> backend = GetDisplayBackend();
+  for (HardwareProbeJob &job : jobs)
+  {
+    Monitor &monitor = g_monitors[job.index];
+    if (job.refused)
+    {
+      // An open breaker means recent requests failed, not that the monitor
+      // lost DDC/CI: keep the endpoint and its cache entry, and revalidate
+      // on the next probe.
+      continue;
+    }
+    if (job.revalidate)
+    {
+      if (job.answered)
+      {
+        // Keep the level the monitor reported only if nothing has been
+        // posted since; otherwise the posted value is newer.
+        ApplyReading(monitor.ddc[0], job.reading);
+        if (monitor.hardwarePosts == job.postsAtStart)
+          monitor.hardwareBrightness = ReadingLevel(monitor.ddc[0], job.reading);
       }
       else
       {
-        Sleep(50); // Wait 50ms before retrying
+        // Cached as working but no longer answers (DDC/CI switched off in
+        // the OSD, a different input): stop using it.
+        g_transitions[job.index].hardware.Clear();
+        ReleaseHardware(backend, monitor);
       }
+      StoreCapabilities(monitor, job.answered ? &job.reading : nullptr);
+    }
+    else
+    {
+      Monitor &probed = job.probed;
+      monitor.ddc = std::move(probed.ddc);
+      monitor.supportsHardwareBrightness = probed.supportsHardwareBrightness;
+      monitor.hardwareBrightness = probed.hardwareBrightness;
+      probed.ddc.clear();
+      StoreCapabilities(monitor, job.answered ? &job.reading : nullptr);
     }
+    monitor.hardwareProbePending = false;
+    monitor.ddcFromCache = false;
+    NotifyChange(monitor);
+  }
+}
 
-    if (!success)
+// Releases whatever full probes opened, for results that will not be published.
+static void DiscardProbeJobs(std::vector<HardwareProbeJob> &jobs)
+{
+  std::shared_ptr<DisplayBackend> backend = GetDisplayBackend();
+  for (HardwareProbeJob &job : jobs)
+    if (!job.revalidate)
+      ReleaseHardware(backend, job.probed);
+}
+
+// Takes the state with no background probe running: a running probe is
+// abandoned and joined first. The probe waits for the state to publish, so it
+// is joined with the lock released, and the caller must not hold the state
+// already while one may be running (see BeginUpdate).
+static std::unique_lock<std::recursive_mutex> LockWithoutProbe()
+{
+  std::unique_lock<std::recursive_mutex> lock(g_stateMutex);
+  while (g_probeThread.joinable())
+  {
+    std::thread probe = std::move(g_probeThread);
+    *g_probeCancel = true;
+    lock.unlock();
+    probe.join();
+    lock.lock();
+  }
+  return lock;
+}
+
+// Stops the monitor's DDC workers and closes its endpoints.
+static void ReleaseHardware(const std::shared_ptr<DisplayBackend> &backend, Monitor &monitor)
+{
+  // Let each DDC worker deliver the user's last value, then stop it before
+  // its endpoint goes away.
+  for (DdcEndpoint &endpoint : monitor.ddc)
+  {
+    if (endpoint.worker)
     {
-      monitor.supportsHardwareBrightness = false;
+      endpoint.worker->Flush();
+      endpoint.worker->Stop();
+      endpoint.worker.reset();
     }
+    // Release the DDC/CI endpoint (the physical monitor handle on Windows)
+    if (backend && endpoint.handle)
+      backend->CloseDdc(endpoint.handle);
   }
+  monitor.ddc.clear();
+  monitor.supportsHardwareBrightness = false;
+}
 
-  monitors->push_back(monitor);
-  return TRUE;
-}
\ No newline at end of file
+// Releases everything the monitor holds, DDC/CI and gamma.
+static void ReleaseMonitor(const std::shared_ptr<DisplayBackend> &backend, Monitor &monitor)
+{
+  ReleaseHardware(backend, monitor);
+  // Release gamma resources (the Device Context on Windows)
+  if (backend && monitor.hasGamma)
+  {
+    backend->CloseOutput(monitor.output);
+    monitor.hasGamma = false;
+  }
+}
+
+static void ReleaseMonitors(std::vector<Monitor> &monitors)
+{
+  std::shared_ptr<DisplayBackend> backend = GetDisplayBackend();
+  for (auto &monitor : monitors)
+    ReleaseMonitor(backend, monitor);
+  monitors.clear();
+}
@@ -1,44 +1,182 @@
 #pragma once
-#include <windows.h>
 #include <vector>
 #include <string>
+#include <memory>
+#include <cstdint>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include "ddccache.h"
+#include "ddchealth.h"
+#include "ddcworker.h"
+#include "displaybackend.h"
+
+/**
+ * @brief One physical monitor behind a logical display: a DDC/CI endpoint
+ *        with its own native range and background writer.
+ */
+struct DdcEndpoint
+{
+  DdcHandle handle = 0;
+  uint32_t nativeMin = 0;   // Native DDC/CI brightness minimum
+  uint32_t nativeMax = 100; // Native DDC/CI brightness maximum
+  uint32_t latencyUs = 0;   // Measured round trip of a brightness read, 0 = unknown
+  std::shared_ptr<DdcWorker> worker;   // Background writer for handle
+  std::shared_ptr<std::mutex> busLock; // Serialises worker's writes with revalidation reads
+  std::shared_ptr<DdcHealth> health;   // Retry policy learned from this endpoint, and its circuit breaker
+};
 
 /**
  * @brief Represents a physical or logical display monitor.
  *
- * Contains handles and state information for controlling both
- * software (gamma-based) and hardware (DDC/CI) brightness.
+ * Contains backend handles and state information for controlling both
+ * software (gamma-based) and hardware (DDC/CI) brightness. The handles are
+ * only meaningful to the installed DisplayBackend.
  */
 struct Monitor
 {
-  HMONITOR hMonitor;
-  HDC hdc; // Device Context for software brightness (Gamma)
+  OutputHandle output; // Backend handle for the display (HMONITOR on Windows)
+  bool hasGamma;       // Backend opened the output for software brightness (Gamma)
+  int gammaSize;       // Ramp entries per channel the output reports
   std::wstring deviceName;
-  int softwareBrightness;  // Current software brightness level (1-100)
-  int softwareColorTemp;   // Current software color temperature in Kelvin (1200-6500)
-  int hardwareBrightness;  // Current hardware brightness level (0-100)
-  HANDLE hPhysicalMonitor; // Handle for hardware brightness (DDC/CI)
+  int softwareBrightness; // Current software brightness level (1-100)
+  int softwareColorTemp;  // Current software color temperature in Kelvin (1200-6500)
+  double softwareGain;    // Scales the software brightness factor while a unified slider previews (1 = none)
+  int hardwareBrightness; // Current hardware brightness level (0-100)
+  std::vector<DdcEndpoint> ddc; // DDC/CI endpoints that answered, one per physical monitor
   bool supportsHardwareBrightness;
-  DWORD hwNativeMin; // Monitor's native DDC/CI brightness minimum
-  DWORD hwNativeMax; // Monitor's native DDC/CI brightness maximum
+  uint64_t lastRampHash; // HashGammaRamp of the ramp the device shows, 0 = unknown
+  uint64_t shownRampHash; // What the device reads back for lastRampHash if its driver rounds the ramp, 0 = not seen
+  uint64_t gammaDrifts;   // Times VerifyGammaRamps found the ramp overwritten
+  bool hardwareProbePending; // DDC/CI not probed yet (see BrightnessController::StartHardwareProbe)
+  bool hasIdentity;          // EDID was read; identity and edidHash are valid
+  MonitorIdentity identity;  // Key into the DDC/CI capability cache
+  uint64_t edidHash;
+  bool ddcFromCache;         // DDC/CI state came from the cache and awaits revalidation
+  uint64_t hardwarePosts;    // Values handed to the ddc workers so far
 
   Monitor()
-      : hMonitor(nullptr),
-        hdc(nullptr),
+      : output(0),
+        hasGamma(false),
+        gammaSize(256),
         softwareBrightness(100),
         softwareColorTemp(6500),
+        softwareGain(1.0),
         hardwareBrightness(50),
-        hPhysicalMonitor(nullptr),
         supportsHardwareBrightness(false),
-        hwNativeMin(0),
-        hwNativeMax(100) {}
+        lastRampHash(0),
+        shownRampHash(0),
+        gammaDrifts(0),
+        hardwareProbePending(false),
+        hasIdentity(false),
+        edidHash(0),
+        ddcFromCache(false),
+        hardwarePosts(0) {}
+};
+
+/**
+ * @brief Where a monitor's hardware brightness stands after enumeration.
+ */
+enum class HardwareProbeState
+{
+  Pending,    // The background DDC/CI probe has not reached this monitor yet
+  Available,  // DDC/CI brightness works
+  Unavailable // No DDC/CI endpoint, or the monitor did not answer
+};
+
+/**
+ * @brief How UpdateOutputs changed the monitor list. Indices refer to the
+ *        new GetMonitors list.
+ */
+struct TopologyChange
+{
+  std::vector<int> added;            // Opened and read as RefreshOutputs would; hardware pending unless cached
+  std::vector<int> reset;            // Kept monitors whose ramp the driver had replaced; reapplied
+  std::vector<std::wstring> removed; // Device names of the monitors that went away
+  size_t kept = 0;                   // Carried over with their handles, levels and DDC/CI state
+};
+
+/**
+ * @brief What a hardware brightness change did on each physical monitor of
+ *        a display.
+ */
+struct HardwareWriteReport
+{
+  struct Endpoint
+  {
+    DdcResult result = DdcResult::Cancelled;
+    std::chrono::microseconds latency{0}; // From the call until this endpoint finished with the value
+  };
+
+  int brightness = 0;              // Normalised value that was requested
+  std::vector<Endpoint> endpoints; // In Monitor::ddc order
+
+  /**
+   * @brief The worst outcome across endpoints: Failed, then Cancelled, then
+   *        Superseded, then Applied.
+   */
+  DdcResult Overall() const;
+};
+
+/**
+ * @brief Counters for the software gamma path, used to measure how much work
+ *        the shared ramp cache and redundant-write suppression save.
+ */
+struct GammaRampStats
+{
+  uint64_t cacheHits = 0;     // Ramp served from the cache
+  uint64_t cacheMisses = 0;   // Ramp had to be built
+  uint64_t writesIssued = 0;  // Ramp writes handed to the backend
+  uint64_t flushes = 0;       // Backend flushes; one per update, however many outputs it touched
+  uint64_t writesSkipped = 0; // Calls avoided because the device already had the ramp
+};
+
+/**
+ * @brief Outcome of one BrightnessController::VerifyGammaRamps pass.
+ */
+struct GammaVerifyResult
+{
+  int checked = 0; // Ramps read back
+  int drifted = 0; // Found overwritten and written again
+  int busy = 0;    // Skipped because a transition or slider preview is writing the ramp anyway
+};
+
+/**
+ * @brief Levels a transition should end on. Fields left at -1 keep their
+ *        current value (or the target of a transition already in flight).
+ */
+struct TransitionTarget
+{
+  int softwareBrightness = -1; // 1-100
+  int softwareColorTemp = -1;  // Kelvin, 1200-6500
+  int hardwareBrightness = -1; // 0-100
+};
+
+/**
+ * @brief Counters for the transition engine.
+ */
+struct TransitionStats
+{
+  uint64_t started = 0;       // StartTransition calls that planned at least one track
+  uint64_t retargeted = 0;    // ...of which replaced a track still in flight
+  uint64_t cancelled = 0;     // Tracks stopped by CancelTransition or a manual Set*
+  uint64_t framesApplied = 0; // Gamma keyframes written
+  uint64_t framesSkipped = 0; // Keyframes passed over because the thread woke late
+  uint64_t hardwareSteps = 0; // DDC/CI steps posted to the monitors' workers
 };
 
 /**
  * @brief Static controller for managing monitor brightness operations.
  *
  * Handles enumeration of monitors and application of brightness changes
- * via both software (gamma ramp) and hardware (DDC/CI) methods.
+ * via both software (gamma ramp) and hardware (DDC/CI) methods. All display
+ * access goes through the DisplayBackend installed with SetDisplayBackend;
+ * without one, Initialize fails and no monitors are reported.
+ *
+ * Transitions run on a controller-owned thread, so every member locks the
+ * controller's state. The level fields of the Monitor objects returned by
+ * GetMonitors may change under a running transition; read them through the
+ * Get* accessors instead.
  */
 class BrightnessController
 {
@@ -54,10 +192,112 @@ public:
 
   /**
    * @brief Refreshes the list of connected monitors.
+   *
+   * Monitor handles are collected first, then every monitor is probed
+   * (DC, DDC/CI handle, current levels) concurrently. The new list replaces
+   * the old one only once probing has finished. Equivalent to RefreshOutputs
+   * followed by a hardware probe that runs on the calling thread.
+   *
    * @return true if monitors were found.
    */
   static bool RefreshMonitors();
 
+  /**
+   * @brief Fast first half of RefreshMonitors: enumerates the monitors and
+   *        opens them for software brightness only.
+   *
+   * No DDC/CI traffic happens here, so gamma can be restored straight away.
+   * Monitors found in the capability cache (see SetCapabilityCache) get
+   * their endpoint and cached range immediately, or are marked unsupported
+   * if they are known bad. Every other monitor comes back with
+   * hardwareProbePending set and no hardware brightness; StartHardwareProbe
+   * fills that in off the calling thread. Stops a hardware probe still
+   * running for the previous list.
+   *
+   * @return true if monitors were found.
+   */
+  static bool RefreshOutputs();
+
+  /**
+   * @brief RefreshOutputs for a one-shot command that names its monitors.
+   *
+   * Every output is listed, so indices match a full refresh, but only the
+   * ones @p wanted accepts are opened and left pending for
+   * StartHardwareProbe. The rest have neither gamma nor hardware
+   * brightness. nullptr opens every output.
+   *
+   * @return true if monitors were found.
+   */
+  static bool RefreshOutputs(const std::function<bool(int monitorIndex)> &wanted);
+
+  /**
+   * @brief Incremental RefreshOutputs for a display change: the new topology
+   *        is diffed against the current list instead of replacing it.
+   *
+   * A monitor is kept if it is enumerated again with the same handle and
+   * device name and, where an EDID was read before, the same EDID. Kept
+   * monitors keep their gamma and DDC/CI handles, levels, workers and
+   * running transitions; the only traffic to them is one ramp read, and
+   * their ramp is rewritten only if it no longer matches what was last
+   * written (the driver reset it after a mode change). Monitors that went
+   * away are released; new ones are opened and looked up in the capability
+   * cache like RefreshOutputs does, and left for StartHardwareProbe. A
+   * hardware probe still running is abandoned; its monitors stay pending.
+   *
+   * @param change Receives what was added, removed and reapplied.
+   * @return true if monitors were found.
+   */
+  static bool UpdateOutputs(TopologyChange &change);
+
+  /**
+   * @brief Probes DDC/CI for every monitor still pending, and revalidates the
+   *        ones set up from the capability cache, on a background thread.
+   *
+   * Once every monitor has been probed, the endpoints, native ranges and
+   * current hardware levels are published together and the monitors'
+   * hardwareProbePending flags are cleared. A cached monitor that no longer
+   * answers loses hardware brightness; a known-bad one that now answers
+   * gains it. The cache is updated and saved with the results. If the list is refreshed or
+   * cleaned up first, the probe is abandoned (after the monitor it is
+   * currently talking to) and its results are released.
+   *
+   * @param onComplete Optional; invoked on the probe thread after the results
+   *        are published. Not invoked for an abandoned probe.
+   * @return false if no monitor was waiting for a probe or revalidation.
+   */
+  static bool StartHardwareProbe(std::function<void()> onComplete = nullptr);
+
+  /**
+   * @brief Installs the DDC/CI capability cache consulted by RefreshOutputs
+   *        and updated by every hardware probe. nullptr (the default)
+   *        probes every monitor every time.
+   */
+  static void SetCapabilityCache(std::shared_ptr<DdcCapabilityCache> cache);
+
+  /**
+   * @brief Blocks until a probe started by StartHardwareProbe has finished.
+   */
+  static void WaitForHardwareProbe();
+
+  /**
+   * @brief Returns true while any monitor is waiting for its DDC/CI probe.
+   */
+  static bool IsHardwareProbePending();
+
+  /**
+   * @brief Hardware brightness availability for a specific monitor.
+   * @return Unavailable if the index is invalid.
+   */
+  static HardwareProbeState GetHardwareProbeState(int monitorIndex);
+
+  /**
+   * @brief What has been learned about each of a monitor's DDC/CI endpoints:
+   *        retry policy, latency and failure histograms, circuit breaker.
+   * @return One snapshot per endpoint; empty if the index is invalid or the
+   *         monitor has no DDC/CI.
+   */
+  static std::vector<DdcHealth::Snapshot> GetDdcHealth(int monitorIndex);
+
   /**
    * @brief Cleans up resources (device contexts, physical monitor handles).
    */
@@ -69,13 +309,88 @@ public:
    */
   static const std::vector<Monitor> &GetMonitors();
 
+  /**
+   * @brief Number of monitors, safe to call from any thread.
+   */
+  static size_t GetMonitorCount();
+
+  /**
+   * @brief Device name of a monitor, safe to call from any thread.
+   * @return Empty if the index is invalid.
+   */
+  static std::wstring GetDeviceName(int monitorIndex);
+
+  /**
+   * @brief Told the index of a monitor whose levels or hardware availability
+   *        changed, or -1 when the monitor list itself changed.
+   *
+   * Runs on whichever thread made the change, transitions included, with
+   * the controller's state locked: it must return quickly and must not call
+   * back into the controller.
+   */
+  using ChangeFn = std::function<void(int monitorIndex)>;
+
+  /**
+   * @brief Installs the change listener; nullptr removes it. Once this
+   *        returns, the previous listener is no longer running.
+   */
+  static void SetChangeListener(ChangeFn listener);
+
+  /**
+   * @brief Reports a hardware brightness change once every endpoint has
+   *        finished with it. Runs on the worker thread of the endpoint that
+   *        finished last.
+   */
+  using HardwareCompletionFn = std::function<void(const HardwareWriteReport &report)>;
+
   /**
    * @brief Sets the hardware brightness for a specific monitor.
+   *
+   * The value is converted to each physical monitor's native range and
+   * queued on every endpoint's DDC worker at once, so the endpoints are
+   * written concurrently and this call returns immediately. If an earlier
+   * value has not reached an endpoint yet it is dropped in favour of this one.
+   *
    * @param monitorIndex Index of the monitor in the list.
    * @param brightness Desired brightness level (0-100).
-   * @return true if the operation succeeded.
+   * @param onComplete Optional callback, invoked once every endpoint has
+   *        applied the value, failed, or had it superseded.
+   * @return true if the request was queued.
    */
-  static bool SetHardwareBrightness(int monitorIndex, int brightness);
+  static bool SetHardwareBrightness(int monitorIndex, int brightness,
+                                    HardwareCompletionFn onComplete = nullptr);
+
+  /**
+   * @brief Shows a unified brightness level through the gamma ramp only.
+   *
+   * For dragging a unified slider: the ramp is scaled so the monitor looks
+   * as if its hardware brightness were @p brightness, at gamma speed and
+   * without DDC/CI traffic. The user's software brightness is left as it
+   * is. Gamma cannot go brighter than the identity ramp, so raising the
+   * level only previews as far as the software brightness leaves room.
+   *
+   * @param monitorIndex Index of the monitor in the list.
+   * @param brightness Hardware-scale level to preview (0-100).
+   * @return false if the index is invalid or the monitor has no DDC/CI.
+   */
+  static bool PreviewUnifiedBrightness(int monitorIndex, int brightness);
+
+  /**
+   * @brief Ends a unified slider gesture: writes @p brightness to every
+   *        DDC/CI endpoint once, and drops the gamma compensation as soon
+   *        as the write has landed. If it fails, the compensation is
+   *        dropped too and the hardware level goes back to what the
+   *        monitor shows.
+   *
+   * A manual SetHardwareBrightness or hardware transition also ends the
+   * gesture.
+   *
+   * @param onComplete As for SetHardwareBrightness. Runs at once, with no
+   *        endpoints, if the monitor already shows @p brightness.
+   * @return false if the index is invalid or the monitor has no DDC/CI.
+   */
+  static bool CommitUnifiedBrightness(int monitorIndex, int brightness,
+                                      HardwareCompletionFn onComplete = nullptr);
 
   /**
    * @brief Sets the software brightness for a specific monitor.
@@ -99,6 +414,28 @@ public:
    */
   static int GetSoftwareBrightness(int monitorIndex);
 
+  /**
+   * @brief Starts a multi-monitor update.
+   *
+   * Until the matching EndUpdate, software brightness and colour temperature
+   * changes are queued in the backend instead of being flushed one by one,
+   * so all outputs change in a single round trip. Calls nest, and must be
+   * paired on the same thread.
+   *
+   * The batch holds the controller's state until EndUpdate: other threads'
+   * calls, display changes included, wait for it. Keep batches short, and
+   * never wait inside one for another thread that uses the controller. That
+   * includes the refresh, update, probe and cleanup calls, which wait for a
+   * running hardware probe.
+   */
+  static void BeginUpdate();
+
+  /**
+   * @brief Flushes the gamma writes queued since BeginUpdate.
+   * @return false if the backend reported a failed write.
+   */
+  static bool EndUpdate();
+
   /**
    * @brief Sets the software color temperature for a specific monitor via gamma ramp.
    * @param monitorIndex Index of the monitor in the list.
@@ -113,15 +450,72 @@ public:
    * @return Current temperature in Kelvin, or -1 if the index is invalid.
    */
   static int GetSoftwareColorTemp(int monitorIndex);
-};
 
-/**
- * @brief Maps a linear brightness value (1-100) to a safe gamma factor (49-100).
- *
- * Exposed for use by ColorTempUtils::ApplyGammaRamp so brightness and color
- * temperature are always written together in a single gamma ramp.
- *
- * @param brightness Input brightness 1-100
- * @return Remapped value in [49, 100]; caller divides by 100 to get factor
- */
-double MapBrightnessToSafeFactor(int brightness);
\ No newline at end of file
+  /**
+   * @brief Sets software brightness and colour temperature together, with a
+   *        single gamma ramp write (served from the ramp cache) instead of
+   *        one per setter.
+   * @param brightness Desired brightness level (1-100), or -1 to keep it.
+   * @param kelvin Desired temperature (1200-6500), or -1 to keep it.
+   * @return true if the operation succeeded.
+   */
+  static bool SetSoftwareLevels(int monitorIndex, int brightness, int kelvin);
+
+  /**
+   * @brief Returns the gamma ramp cache and write-suppression counters.
+   */
+  static GammaRampStats GetGammaRampStats();
+
+  /**
+   * @brief Reads back every monitor's ramp and rewrites the ones something
+   *        else has overwritten (a game, a screen recorder, a driver reset).
+   *
+   * A read-back ramp is compared by hash with the one last written, so an
+   * intact ramp costs one read and one hash. If a driver rounds what it is
+   * given, the ramp it reads back is compared entry by entry once; if it is
+   * within rounding, its hash is remembered and counts as intact from then
+   * on. The rewrites share one flush.
+   */
+  static GammaVerifyResult VerifyGammaRamps();
+
+  /**
+   * @brief Times VerifyGammaRamps has found a monitor's ramp overwritten.
+   * @return 0 if the index is invalid.
+   */
+  static uint64_t GetGammaDriftCount(int monitorIndex);
+
+  /**
+   * @brief Animates a monitor towards @p target over @p duration.
+   *
+   * Software brightness and colour temperature (in mired) are played back
+   * from a precomputed keyframe table, one frame per refresh of the output.
+   * Hardware brightness moves in native DDC/CI steps, at most one write per
+   * HARDWARE_STEP_INTERVAL. Calling this while a transition is running
+   * retargets it from wherever it currently is, without a jump.
+   *
+   * @return false if the index is invalid or nothing in @p target applies
+   *         to this monitor.
+   */
+  static bool StartTransition(int monitorIndex, const TransitionTarget &target, std::chrono::milliseconds duration);
+
+  /**
+   * @brief Stops a monitor's transition where it is. The levels reached so
+   *        far stay applied.
+   */
+  static void CancelTransition(int monitorIndex);
+
+  /**
+   * @brief Returns true while any track of the monitor's transition is running.
+   */
+  static bool IsTransitioning(int monitorIndex);
+
+  /**
+   * @brief Returns the transition engine's counters.
+   */
+  static TransitionStats GetTransitionStats();
+
+  // Minimum spacing of DDC/CI writes during a transition. Well above the
+  // 50 ms the DDC/CI spec asks between commands, since the worker may still
+  // be retrying the previous step.
+  static constexpr std::chrono::milliseconds HARDWARE_STEP_INTERVAL{100};
+};
@@ -1,70 +1,47 @@
 #include "bwfilter.h"
-#include <windows.h>
-#include <magnification.h>
+#include "displaybackend.h"
 
-// MinGW ships neither prototypes nor an import library for Magnification.dll,
-// so we resolve the three entry points dynamically. The DLL is present on
-// Windows 7 SP1 and later.
+// The colour matrix facility itself (Magnification.dll on Windows) lives in
+// the DisplayBackend; this module only decides which matrix to show.
 namespace
 {
-  using MagInitializeFn = BOOL(WINAPI *)();
-  using MagUninitializeFn = BOOL(WINAPI *)();
-  using MagSetFullscreenColorEffectFn = BOOL(WINAPI *)(PMAGCOLOREFFECT);
-
-  HMODULE g_module = nullptr;
-  MagInitializeFn g_init = nullptr;
-  MagUninitializeFn g_uninit = nullptr;
-  MagSetFullscreenColorEffectFn g_setEffect = nullptr;
-
   bool g_initialized = false;
-  bool g_enabled = false;
-
-  // Column 0..2 of each row holds the BT.601 luminance coefficient for that
-  // row's input channel; alpha and constant columns are identity so the rest
-  // of the pixel passes through unchanged.
-  MAGCOLOREFFECT kGrayscale = {{
-      {0.299f, 0.299f, 0.299f, 0.0f, 0.0f},
-      {0.587f, 0.587f, 0.587f, 0.0f, 0.0f},
-      {0.114f, 0.114f, 0.114f, 0.0f, 0.0f},
-      {0.0f, 0.0f, 0.0f, 1.0f, 0.0f},
-      {0.0f, 0.0f, 0.0f, 0.0f, 1.0f},
-  }};
+  ColorEffectStack g_stack;
+  BWFilter::ScheduleFn g_schedule;
+  BWFilter::ChangeFn g_changeListener;
+  BWFilter::Stats g_stats;
 
-  MAGCOLOREFFECT kIdentity = {{
-      {1.0f, 0.0f, 0.0f, 0.0f, 0.0f},
-      {0.0f, 1.0f, 0.0f, 0.0f, 0.0f},
-      {0.0f, 0.0f, 1.0f, 0.0f, 0.0f},
-      {0.0f, 0.0f, 0.0f, 1.0f, 0.0f},
-      {0.0f, 0.0f, 0.0f, 0.0f, 1.0f},
-  }};
+  // What the backend is showing; identity until something is pushed
+  ColorMatrix g_pushed = ColorMatrixUtils::Identity();
 
-  bool LoadEntryPoints()
+  // Sends the stack's product to the backend unless it is already showing it
+  bool Push()
   {
-    if (g_module)
+    const ColorMatrix &matrix = g_stack.Matrix();
+    if (ColorMatrixUtils::Equal(matrix, g_pushed))
+    {
+      g_stats.unchanged++;
       return true;
-    g_module = LoadLibraryW(L"Magnification.dll");
-    if (!g_module)
+    }
+    std::shared_ptr<DisplayBackend> backend = GetDisplayBackend();
+    if (!backend || !backend->SetColorMatrix(matrix))
       return false;
+    g_pushed = matrix;
+    g_stats.pushes++;
+    return true;
+  }
 
-    // Double-cast through void* keeps -Wcast-function-type quiet without
-    // hiding genuine type mismatches at the call sites below.
-    g_init = reinterpret_cast<MagInitializeFn>(
-        reinterpret_cast<void *>(GetProcAddress(g_module, "MagInitialize")));
-    g_uninit = reinterpret_cast<MagUninitializeFn>(
-        reinterpret_cast<void *>(GetProcAddress(g_module, "MagUninitialize")));
-    g_setEffect = reinterpret_cast<MagSetFullscreenColorEffectFn>(
-        reinterpret_cast<void *>(GetProcAddress(g_module, "MagSetFullscreenColorEffect")));
-
-    if (!g_init || !g_uninit || !g_setEffect)
+  // Applies a change to the stack: at once, or by starting the frame
+  // scheduler. Fades already running carry on where they are.
+  bool Commit(bool fading)
+  {
+    if (fading)
     {
-      FreeLibrary(g_module);
-      g_module = nullptr;
-      g_init = nullptr;
-      g_uninit = nullptr;
-      g_setEffect = nullptr;
-      return false;
+      g_schedule();
+      return true;
     }
-    return true;
+    g_stack.Update();
+    return Push();
   }
 }
 
@@ -74,9 +51,8 @@ namespace BWFilter
   {
     if (g_initialized)
       return true;
-    if (!LoadEntryPoints())
-      return false;
-    if (!g_init())
+    std::shared_ptr<DisplayBackend> backend = GetDisplayBackend();
+    if (!backend || !backend->InitColorEffects())
       return false;
     g_initialized = true;
     return true;
@@ -86,35 +62,73 @@ namespace BWFilter
   {
     if (!g_initialized)
       return;
-    if (g_setEffect)
-      g_setEffect(&kIdentity);
-    if (g_uninit)
-      g_uninit();
-    g_initialized = false;
-    g_enabled = false;
-
-    if (g_module)
+    std::shared_ptr<DisplayBackend> backend = GetDisplayBackend();
+    if (backend)
     {
-      FreeLibrary(g_module);
-      g_module = nullptr;
-      g_init = nullptr;
-      g_uninit = nullptr;
-      g_setEffect = nullptr;
+      backend->SetColorMatrix(ColorMatrixUtils::Identity());
+      backend->ShutdownColorEffects();
     }
+    g_initialized = false;
+    g_stack = ColorEffectStack();
+    g_pushed = ColorMatrixUtils::Identity();
   }
 
-  bool SetEnabled(bool enabled)
+  void SetScheduler(ScheduleFn schedule)
+  {
+    g_schedule = std::move(schedule);
+  }
+
+  void SetChangeListener(ChangeFn listener)
+  {
+    g_changeListener = std::move(listener);
+  }
+
+  bool SetEnabled(bool enabled, std::chrono::milliseconds fade)
+  {
+    return SetEffect(ColorEffect::Grayscale, enabled ? 1.0 : 0.0, fade);
+  }
+
+  bool IsEnabled()
+  {
+    return g_stack.GetTarget(ColorEffect::Grayscale) > 0.0;
+  }
+
+  bool SetEffect(ColorEffect effect, double strength, std::chrono::milliseconds fade)
   {
     if (!g_initialized && !Initialize())
       return false;
-    if (!g_setEffect(enabled ? &kGrayscale : &kIdentity))
+    // Without a scheduler nothing would advance the fade
+    if (!g_schedule)
+      fade = std::chrono::milliseconds(0);
+    bool wasEnabled = IsEnabled();
+    g_stack.SetStrength(effect, strength, fade);
+    if (g_changeListener && IsEnabled() != wasEnabled)
+      g_changeListener(!wasEnabled);
+    return Commit(fade.count() > 0);
+  }
+
+  double GetEffect(ColorEffect effect)
+  {
+    return g_stack.GetTarget(effect);
+  }
+
+  bool SetSaturation(double amount)
+  {
+    if (!g_initialized && !Initialize())
       return false;
-    g_enabled = enabled;
-    return true;
+    g_stack.SetSaturation(amount);
+    return Commit(false);
   }
 
-  bool IsEnabled()
+  bool Tick()
+  {
+    if (g_stack.Update())
+      Push();
+    return g_stack.IsAnimating();
+  }
+
+  Stats GetStats()
   {
-    return g_enabled;
+    return g_stats;
   }
 }
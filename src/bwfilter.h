@@ -1,41 +1,108 @@
 #pragma once
+#include "coloreffects.h"
+#include <chrono>
+#include <functional>
 
 /**
- * @brief System-wide black & white (grayscale) screen filter.
+ * @brief System-wide colour effect pipeline: black & white (grayscale) and
+ *        the other ColorEffects, merged into one colour matrix.
  *
  * Uses the Windows Magnification API (MagSetFullscreenColorEffect) to apply a
- * grayscale colour matrix to the entire desktop. This is the same mechanism
- * Windows' built-in Colour Filters accessibility feature uses, and is the only
+ * colour matrix to the entire desktop. This is the same mechanism Windows'
+ * built-in Colour Filters accessibility feature uses, and is the only
  * supported way to get *real* per-pixel grayscale on Windows — gamma ramps
  * cannot do it because each channel's LUT only sees its own channel.
  *
+ * Every effect lives in one ColorEffectStack; its product is pushed to the
+ * backend only when it differs from the matrix last pushed, so toggling an
+ * effect that is already in place, or animating one that has settled, costs
+ * no Magnification call.
+ *
  * The effect is necessarily global (all monitors); there is no per-monitor
- * equivalent in this API.
+ * equivalent in this API. The matrix is applied through the installed
+ * DisplayBackend (see displaybackend.h). Call from the UI thread.
  */
 namespace BWFilter
 {
   /**
-   * @brief Initialises the Magnification runtime. Must succeed before
+   * @brief Asks the platform layer to call Tick() every frame until it
+   *        returns false. Invoked when an animated change starts.
+   */
+  using ScheduleFn = std::function<void()>;
+
+  /**
+   * @brief Initialises the backend's colour matrix facility (the
+   *        Magnification runtime on Windows). Must succeed before
    *        SetEnabled has any effect. Safe to call multiple times.
    * @return true on success.
    */
   bool Initialize();
 
   /**
-   * @brief Releases Magnification resources. Disables the filter first so
+   * @brief Releases Magnification resources. Clears every effect first so
    *        the desktop returns to normal colour on shutdown.
    */
   void Cleanup();
 
+  /**
+   * @brief Installs the frame scheduler for animated changes. Without one,
+   *        changes apply at once.
+   */
+  void SetScheduler(ScheduleFn schedule);
+
+  /**
+   * @brief Told the new grayscale state whenever it changes. nullptr
+   *        removes it.
+   */
+  using ChangeFn = std::function<void(bool enabled)>;
+
+  void SetChangeListener(ChangeFn listener);
+
   /**
    * @brief Applies or clears the grayscale colour effect.
-   * @param enabled true to set the grayscale matrix; false to restore identity.
-   * @return true if the effect was applied successfully.
+   * @param enabled true to fade grayscale in; false to fade it out.
+   * @param fade How long the change takes; 0 applies it at once.
+   * @return true if the effect was applied successfully (or, when fading,
+   *         the fade has started).
    */
-  bool SetEnabled(bool enabled);
+  bool SetEnabled(bool enabled, std::chrono::milliseconds fade = std::chrono::milliseconds(0));
 
   /**
-   * @brief Returns the most recently applied state.
+   * @brief Returns the most recently requested grayscale state.
    */
   bool IsEnabled();
+
+  /**
+   * @brief Moves any effect to @p strength (0-1) over @p fade.
+   * @return As for SetEnabled.
+   */
+  bool SetEffect(ColorEffect effect, double strength, std::chrono::milliseconds fade = std::chrono::milliseconds(0));
+
+  /**
+   * @brief Strength @p effect is set to (its target while fading).
+   */
+  double GetEffect(ColorEffect effect);
+
+  /**
+   * @brief Sets the amount ColorEffect::Saturation scales saturation by.
+   */
+  bool SetSaturation(double amount);
+
+  /**
+   * @brief Advances fades and pushes the matrix if it changed.
+   * @return true while a fade is still running.
+   */
+  bool Tick();
+
+  /**
+   * @brief Matrix pushes made, and pushes skipped because the product
+   *        matched the matrix already shown.
+   */
+  struct Stats
+  {
+    uint64_t pushes = 0;
+    uint64_t unchanged = 0;
+  };
+
+  Stats GetStats();
 }
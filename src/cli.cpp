@@ -0,0 +1,214 @@
+#include "cli.h"
+#include "brightness.h"
+#include "control.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+
+namespace
+{
+  bool IsOption(const std::string &arg)
+  {
+    return arg.compare(0, 2, "--") == 0;
+  }
+
+  bool ParseMonitor(const std::string &text, int &monitor)
+  {
+    if (text.empty() || text.size() > 4 ||
+        !std::all_of(text.begin(), text.end(), [](unsigned char c)
+                     { return std::isdigit(c) != 0; }))
+      return false;
+    monitor = std::atoi(text.c_str());
+    return true;
+  }
+
+  void Append(std::string &request, const std::string &command)
+  {
+    if (!request.empty())
+      request += "; ";
+    request += command;
+  }
+}
+
+namespace CliUtils
+{
+  bool IsCommand(const std::vector<std::string> &args)
+  {
+    return std::any_of(args.begin(), args.end(), IsOption);
+  }
+
+  bool Parse(const std::vector<std::string> &args, Command &command, std::string &error)
+  {
+    command = Command();
+    for (size_t i = 0; i < args.size(); ++i)
+    {
+      const std::string &option = args[i];
+      // The values following an option, up to the next one
+      std::vector<std::string> values;
+      while (i + 1 < args.size() && !IsOption(args[i + 1]))
+        values.push_back(args[++i]);
+
+      int monitor = -1;
+      if (option == "--timing" && values.empty())
+      {
+        command.timing = true;
+      }
+      else if (option == "--get" && values.size() <= 2 && (values.size() < 2 || values[1] == "hw"))
+      {
+        // "hw" only matters in-process, where it waits for the DDC/CI probe
+        if (!values.empty() && values.back() == "hw")
+        {
+          command.hardware = true;
+          values.pop_back();
+        }
+        if (values.empty())
+        {
+          command.allMonitors = true;
+          Append(command.request, "get");
+          continue;
+        }
+        if (!ParseMonitor(values[0], monitor))
+        {
+          error = "bad monitor '" + values[0] + "'";
+          return false;
+        }
+        command.monitors.insert(monitor);
+        Append(command.request, "get " + values[0]);
+      }
+      else if (option == "--set" && values.size() >= 2)
+      {
+        if (values[0] == "*")
+          command.allMonitors = true;
+        else if (ParseMonitor(values[0], monitor))
+          command.monitors.insert(monitor);
+        else
+        {
+          error = "bad monitor '" + values[0] + "'";
+          return false;
+        }
+        command.set = true;
+        std::string set = "set";
+        for (const std::string &value : values)
+        {
+          command.hardware = command.hardware || value.compare(0, 3, "hw=") == 0;
+          set += " " + value;
+        }
+        Append(command.request, set);
+      }
+      else if (option == "--bw" && values.size() == 1)
+      {
+        command.filter = true;
+        Append(command.request, "bw " + values[0]);
+      }
+      else
+      {
+        error = option == "--get" || option == "--set" || option == "--bw" || option == "--timing"
+                    ? "wrong arguments for " + option
+                    : "unknown option '" + option + "'";
+        return false;
+      }
+    }
+    if (command.request.empty())
+    {
+      error = "nothing to do";
+      return false;
+    }
+    // A running instance saves the changes, as Apply does in-process
+    if (command.set)
+      Append(command.request, "save");
+    return true;
+  }
+
+  const char *Usage()
+  {
+    return "usage: candela [--get [<monitor>] [hw]] [--set <monitor|*> [sw=1-100] [temp=1200-6500] [hw=0-100]]\n"
+           "               [--bw on|off] [--timing]\n";
+  }
+
+  bool Forward(const Command &command, const std::string &endpoint, std::string &reply)
+  {
+    reply.clear();
+    ControlClient client;
+    if (!client.Connect(endpoint))
+      return false;
+    std::vector<std::string> lines;
+    std::string status;
+    if (!client.Request(command.request, lines, status))
+    {
+      reply = "err lost the connection to Candela\n";
+      return true;
+    }
+    for (const std::string &line : lines)
+      reply += line + "\n";
+    reply += status + "\n";
+    return true;
+  }
+
+  std::string Apply(const Command &command, const std::function<void(int monitorIndex)> &restore,
+                    const std::function<void(int monitorIndex)> &store, PhaseLog *log)
+  {
+    if (command.filter)
+      return "err bw needs Candela running: the filter ends with the process that applies it\n";
+
+    auto wanted = [&command](int index)
+    {
+      return command.allMonitors || command.monitors.count(index) != 0;
+    };
+    PhaseLog::Clock::time_point phase = PhaseLog::Clock::now();
+    BrightnessController::RefreshOutputs(wanted);
+    size_t count = BrightnessController::GetMonitorCount();
+    if (log)
+      log->End("enumerate outputs", phase);
+
+    if (command.hardware)
+    {
+      bool pending = false;
+      for (size_t i = 0; i < count; ++i)
+        pending = pending || BrightnessController::GetHardwareProbeState(static_cast<int>(i)) ==
+                                 HardwareProbeState::Pending;
+      if (pending)
+      {
+        phase = PhaseLog::Clock::now();
+        BrightnessController::StartHardwareProbe();
+        BrightnessController::WaitForHardwareProbe();
+        if (log)
+          log->End("probe hardware", phase);
+      }
+    }
+
+    // The saved levels and the request's changes to them go out in one flush
+    phase = PhaseLog::Clock::now();
+    BrightnessController::BeginUpdate();
+    for (size_t i = 0; i < count; ++i)
+      if (command.set && wanted(static_cast<int>(i)) && restore)
+        restore(static_cast<int>(i));
+    std::string reply = ControlServer().Execute(command.request);
+    bool flushed = BrightnessController::EndUpdate();
+    if (!flushed && ExitCode(reply) == 0)
+      reply = "err gamma write failed\n";
+    if (command.set && ExitCode(reply) == 0 && store)
+      for (size_t i = 0; i < count; ++i)
+        if (wanted(static_cast<int>(i)))
+          store(static_cast<int>(i));
+    if (log)
+      log->End("apply", phase);
+
+    // Waits for the DDC/CI writes to land
+    phase = PhaseLog::Clock::now();
+    BrightnessController::Cleanup();
+    if (log)
+      log->End("release", phase);
+    return reply;
+  }
+
+  int ExitCode(const std::string &reply)
+  {
+    // The status is the last line
+    size_t end = reply.size();
+    if (end > 0 && reply[end - 1] == '\n')
+      --end;
+    size_t start = reply.rfind('\n', end == 0 ? 0 : end - 1);
+    start = start == std::string::npos ? 0 : start + 1;
+    return reply.compare(start, end - start, "ok") == 0 ? 0 : 1;
+  }
+}
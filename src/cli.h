@@ -0,0 +1,84 @@
+#pragma once
+#include "phaselog.h"
+#include <functional>
+#include <set>
+#include <string>
+#include <vector>
+
+/**
+ * @brief One-shot command line: apply or report levels, then exit.
+ *
+ *     candela --get [<monitor>] [hw]
+ *     candela --set <monitor|*> [sw=N] [temp=K] [hw=N]
+ *     candela --bw on|off
+ *
+ * Options may be repeated and combined, and run as one control request (see
+ * control.h), so they apply together or not at all. --timing adds the phase
+ * timings to the output. A running instance is sent the request over its
+ * control endpoint; otherwise it is applied in this process, opening only
+ * the monitors it names. Either way the levels a --set leaves are saved.
+ * In-process, --get reports hw=pending for a monitor the capability cache
+ * does not know unless "hw" asks it to wait for the DDC/CI probe.
+ */
+namespace CliUtils
+{
+  struct Command
+  {
+    std::string request;    // The options as one control request, e.g. "set 0 sw=50; get 0"
+    std::set<int> monitors; // Monitors the request names
+    bool allMonitors = false;
+    bool set = false;      // Changes levels; a request without is read only
+    bool hardware = false; // Writes hardware brightness, or reads it with --get ... hw
+    bool filter = false;   // Uses the B&W filter
+    bool timing = false;
+  };
+
+  /**
+   * @brief Returns true if @p args (without the program name) ask for a
+   *        one-shot command rather than the tray application.
+   */
+  bool IsCommand(const std::vector<std::string> &args);
+
+  /**
+   * @brief Translates the options into one control request.
+   * @return false, with @p error set, on an unknown or incomplete option.
+   *         Levels are checked when the request runs.
+   */
+  bool Parse(const std::vector<std::string> &args, Command &command, std::string &error);
+
+  const char *Usage();
+
+  /**
+   * @brief Sends @p command to the instance listening at @p endpoint.
+   * @param reply Receives the reply: data lines, then "ok" or "err ...".
+   * @return false if no instance is listening; @p reply is then empty.
+   */
+  bool Forward(const Command &command, const std::string &endpoint, std::string &reply);
+
+  /**
+   * @brief Runs @p command in this process, for when no instance is running.
+   *
+   * Only the monitors it names are opened, and DDC/CI is probed only if it
+   * reads or writes hardware brightness and the capability cache does not
+   * already know the monitor. The display backend (and capability cache)
+   * must be set. Leaves the controller cleaned up, with hardware writes
+   * delivered.
+   *
+   * @param restore Called for each opened monitor before a request that
+   *        changes levels runs, to put back its saved levels, which the
+   *        request then changes. A read-only request reports the levels the
+   *        monitors show and writes nothing.
+   * @param store Called for each opened monitor once a request that changes
+   *        levels has applied, to save its new levels.
+   * @param log Optional; receives the phase timings.
+   * @return The reply, as Forward would have received it. B&W commands are
+   *         refused: the filter ends with the process that applies it.
+   */
+  std::string Apply(const Command &command, const std::function<void(int monitorIndex)> &restore,
+                    const std::function<void(int monitorIndex)> &store, PhaseLog *log = nullptr);
+
+  /**
+   * @brief Process exit code for a reply: 0 for "ok", 1 otherwise.
+   */
+  int ExitCode(const std::string &reply);
+}
@@ -0,0 +1,284 @@
+#include "coloreffects.h"
+#include "transition.h"
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+  // Rec. 601 luma weights, as in the original B&W filter matrix
+  constexpr double LUMA[3] = {0.299, 0.587, 0.114};
+
+  constexpr double MAX_SATURATION = 4.0;
+
+  // 3x3 colour transforms are written the usual way round (output channel
+  // per row, acting on a column vector) and transposed into the row-vector
+  // layout of ColorMatrix, with @p offset added to each output channel.
+  ColorMatrix FromRgb(const double t[3][3], const double offset[3] = nullptr)
+  {
+    ColorMatrix matrix = ColorMatrixUtils::Identity();
+    for (int out = 0; out < 3; ++out)
+    {
+      for (int in = 0; in < 3; ++in)
+        matrix.m[in][out] = static_cast<float>(t[out][in]);
+      if (offset)
+        matrix.m[4][out] = static_cast<float>(offset[out]);
+    }
+    return matrix;
+  }
+
+  // Machado, Oliveira and Fernandes (2009), severity 1
+  constexpr double PROTANOPIA[3][3] = {{0.152286, 1.052583, -0.204868},
+                                       {0.114503, 0.786281, 0.099216},
+                                       {-0.003882, -0.048116, 1.051998}};
+  constexpr double DEUTERANOPIA[3][3] = {{0.367322, 0.860646, -0.227968},
+                                         {0.280085, 0.672501, 0.047413},
+                                         {-0.011820, 0.042940, 0.968881}};
+  constexpr double TRITANOPIA[3][3] = {{1.255528, -0.076749, -0.178779},
+                                       {-0.078411, 0.930809, 0.147602},
+                                       {0.004733, 0.691367, 0.303900}};
+
+  // Where the colour a deficient eye loses is moved to (Fidaner et al.):
+  // red-green losses into green and blue, blue-yellow losses into red and green
+  constexpr double SHIFT_RED_GREEN[3][3] = {{0.0, 0.0, 0.0}, {0.7, 1.0, 0.0}, {0.7, 0.0, 1.0}};
+  constexpr double SHIFT_BLUE[3][3] = {{1.0, 0.0, 0.7}, {0.0, 1.0, 0.7}, {0.0, 0.0, 0.0}};
+
+  // Daltonisation: c + shift * (c - simulate(c))
+  ColorMatrix Correction(const double simulate[3][3], const double shift[3][3])
+  {
+    double t[3][3];
+    for (int r = 0; r < 3; ++r)
+    {
+      for (int c = 0; c < 3; ++c)
+      {
+        double sum = 0.0;
+        for (int k = 0; k < 3; ++k)
+          sum += shift[r][k] * ((k == c ? 1.0 : 0.0) - simulate[k][c]);
+        t[r][c] = (r == c ? 1.0 : 0.0) + sum;
+      }
+    }
+    return FromRgb(t);
+  }
+
+  ColorMatrix SaturationMatrix(double amount)
+  {
+    double t[3][3];
+    for (int r = 0; r < 3; ++r)
+      for (int c = 0; c < 3; ++c)
+        t[r][c] = (1.0 - amount) * LUMA[c] + (r == c ? amount : 0.0);
+    return FromRgb(t);
+  }
+}
+
+namespace ColorMatrixUtils
+{
+  ColorMatrix Identity()
+  {
+    ColorMatrix matrix{};
+    for (int i = 0; i < 5; ++i)
+      matrix.m[i][i] = 1.0f;
+    return matrix;
+  }
+
+  ColorMatrix Multiply(const ColorMatrix &a, const ColorMatrix &b)
+  {
+    ColorMatrix product{};
+    for (int r = 0; r < 5; ++r)
+    {
+      for (int c = 0; c < 5; ++c)
+      {
+        float sum = 0.0f;
+        for (int k = 0; k < 5; ++k)
+          sum += a.m[r][k] * b.m[k][c];
+        product.m[r][c] = sum;
+      }
+    }
+    return product;
+  }
+
+  ColorMatrix Blend(const ColorMatrix &effect, double strength)
+  {
+    // Exact at the ends, where float rounding would otherwise leave a matrix
+    // that differs from both in the last bit
+    if (strength <= 0.0)
+      return Identity();
+    if (strength >= 1.0)
+      return effect;
+    ColorMatrix blended{};
+    float s = static_cast<float>(strength);
+    for (int r = 0; r < 5; ++r)
+    {
+      for (int c = 0; c < 5; ++c)
+      {
+        float identity = r == c ? 1.0f : 0.0f;
+        blended.m[r][c] = identity + s * (effect.m[r][c] - identity);
+      }
+    }
+    return blended;
+  }
+
+  bool Equal(const ColorMatrix &a, const ColorMatrix &b)
+  {
+    for (int r = 0; r < 5; ++r)
+      for (int c = 0; c < 5; ++c)
+        if (a.m[r][c] != b.m[r][c])
+          return false;
+    return true;
+  }
+
+  void Apply(const ColorMatrix &matrix, const float in[3], float out[3])
+  {
+    for (int c = 0; c < 3; ++c)
+    {
+      // Alpha and the constant input are both 1
+      out[c] = in[0] * matrix.m[0][c] + in[1] * matrix.m[1][c] + in[2] * matrix.m[2][c] + matrix.m[3][c] +
+               matrix.m[4][c];
+    }
+  }
+
+  ColorMatrix EffectMatrix(ColorEffect effect, double saturation)
+  {
+    switch (effect)
+    {
+    case ColorEffect::CorrectProtanopia:
+      return Correction(PROTANOPIA, SHIFT_RED_GREEN);
+    case ColorEffect::CorrectDeuteranopia:
+      return Correction(DEUTERANOPIA, SHIFT_RED_GREEN);
+    case ColorEffect::CorrectTritanopia:
+      return Correction(TRITANOPIA, SHIFT_BLUE);
+    case ColorEffect::Saturation:
+      return SaturationMatrix(saturation);
+    case ColorEffect::Sepia:
+    {
+      constexpr double SEPIA[3][3] = {{0.393, 0.769, 0.189}, {0.349, 0.686, 0.168}, {0.272, 0.534, 0.131}};
+      return FromRgb(SEPIA);
+    }
+    case ColorEffect::Grayscale:
+      return SaturationMatrix(0.0);
+    case ColorEffect::SimulateProtanopia:
+      return FromRgb(PROTANOPIA);
+    case ColorEffect::SimulateDeuteranopia:
+      return FromRgb(DEUTERANOPIA);
+    case ColorEffect::SimulateTritanopia:
+      return FromRgb(TRITANOPIA);
+    case ColorEffect::Invert:
+    {
+      constexpr double NEGATE[3][3] = {{-1.0, 0.0, 0.0}, {0.0, -1.0, 0.0}, {0.0, 0.0, -1.0}};
+      constexpr double ONE[3] = {1.0, 1.0, 1.0};
+      return FromRgb(NEGATE, ONE);
+    }
+    default:
+      return Identity();
+    }
+  }
+}
+
+// -----------------------------------------------------------------------------------------------
+// ColorEffectStack
+// -----------------------------------------------------------------------------------------------
+
+ColorEffectStack::ColorEffectStack()
+{
+  for (size_t i = 0; i < EFFECT_COUNT; ++i)
+    m_layers[i].full = ColorMatrixUtils::EffectMatrix(static_cast<ColorEffect>(i), m_saturation);
+  for (ColorMatrix &prefix : m_prefix)
+    prefix = ColorMatrixUtils::Identity();
+}
+
+void ColorEffectStack::SetStrength(ColorEffect effect, double strength, std::chrono::milliseconds duration,
+                                   Clock::time_point now)
+{
+  Layer &layer = m_layers[static_cast<size_t>(effect)];
+  layer.from = layer.strength;
+  layer.target = std::max(0.0, std::min(strength, 1.0));
+  layer.start = now;
+  layer.duration = std::max(duration, std::chrono::milliseconds(0));
+  layer.dirty = true;
+}
+
+void ColorEffectStack::SetSaturation(double amount)
+{
+  amount = std::max(0.0, std::min(amount, MAX_SATURATION));
+  if (amount == m_saturation)
+    return;
+  m_saturation = amount;
+  Layer &layer = m_layers[static_cast<size_t>(ColorEffect::Saturation)];
+  layer.full = ColorMatrixUtils::EffectMatrix(ColorEffect::Saturation, amount);
+  layer.dirty = true;
+}
+
+double ColorEffectStack::GetStrength(ColorEffect effect) const
+{
+  return m_layers[static_cast<size_t>(effect)].strength;
+}
+
+double ColorEffectStack::GetTarget(ColorEffect effect) const
+{
+  return m_layers[static_cast<size_t>(effect)].target;
+}
+
+bool ColorEffectStack::Update(Clock::time_point now)
+{
+  size_t first = EFFECT_COUNT;
+  for (size_t i = 0; i < EFFECT_COUNT; ++i)
+  {
+    Layer &layer = m_layers[i];
+    double strength = layer.target;
+    if (layer.duration.count() > 0 && now - layer.start < layer.duration)
+    {
+      double t = std::chrono::duration<double>(now - layer.start) / layer.duration;
+      strength = layer.from + (layer.target - layer.from) *
+                                  TransitionUtils::Ease(std::max(0.0, t), TransitionEasing::InOut);
+    }
+    if (strength != layer.strength || layer.dirty)
+    {
+      // A saturation amount change dirties the layer without moving its strength
+      bool changed = strength != layer.strength || layer.strength > 0.0;
+      layer.strength = strength;
+      layer.dirty = false;
+      if (changed)
+        first = std::min(first, i);
+    }
+  }
+  if (first == EFFECT_COUNT)
+    return false;
+
+  m_stats.updates++;
+  Rebuild(first);
+  return true;
+}
+
+bool ColorEffectStack::IsAnimating() const
+{
+  for (const Layer &layer : m_layers)
+    if (layer.strength != layer.target)
+      return true;
+  return false;
+}
+
+void ColorEffectStack::Rebuild(size_t first)
+{
+  // Until the first active layer the product is identity, and the first
+  // active layer is the product as it stands: no multiply needed for either
+  bool active = false;
+  for (size_t i = 0; i < first && !active; ++i)
+    active = m_layers[i].strength > 0.0;
+
+  for (size_t i = first; i < EFFECT_COUNT; ++i)
+  {
+    const Layer &layer = m_layers[i];
+    if (layer.strength <= 0.0)
+    {
+      m_prefix[i + 1] = m_prefix[i];
+      continue;
+    }
+    ColorMatrix blended = ColorMatrixUtils::Blend(layer.full, layer.strength);
+    if (!active)
+    {
+      m_prefix[i + 1] = blended;
+      active = true;
+      continue;
+    }
+    m_prefix[i + 1] = ColorMatrixUtils::Multiply(m_prefix[i], blended);
+    m_stats.multiplies++;
+  }
+}
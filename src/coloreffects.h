@@ -0,0 +1,148 @@
+#pragma once
+#include "displaybackend.h"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Full-screen colour effects, in the order ColorEffectStack applies
+ *        them: corrections see the original colours, simulations see the
+ *        result of everything before them, and inversion comes last.
+ */
+enum class ColorEffect
+{
+  CorrectProtanopia,    // Daltonise: shift what a red-blind eye misses into green and blue
+  CorrectDeuteranopia,  // ...what a green-blind eye misses
+  CorrectTritanopia,    // ...what a blue-blind eye misses, into red and green
+  Saturation,           // Scale saturation by ColorEffectStack::SetSaturation's amount
+  Sepia,
+  Grayscale,            // BT.601 luminance, as the B&W filter has always used
+  SimulateProtanopia,   // Show the screen as a red-blind eye sees it (Machado et al. 2009)
+  SimulateDeuteranopia,
+  SimulateTritanopia,
+  Invert,
+  Count
+};
+
+namespace ColorMatrixUtils
+{
+  ColorMatrix Identity();
+
+  /**
+   * @brief @p a applied first, then @p b. Matrices act on row vectors, so
+   *        this is the plain product a * b.
+   */
+  ColorMatrix Multiply(const ColorMatrix &a, const ColorMatrix &b);
+
+  /**
+   * @brief identity + strength * (effect - identity): @p effect at partial
+   *        strength, 0 being no effect.
+   */
+  ColorMatrix Blend(const ColorMatrix &effect, double strength);
+
+  bool Equal(const ColorMatrix &a, const ColorMatrix &b);
+
+  /**
+   * @brief Transforms an RGB colour (components 0-1) by @p matrix.
+   */
+  void Apply(const ColorMatrix &matrix, const float in[3], float out[3]);
+
+  /**
+   * @brief @p effect at full strength. @p saturation is only used by
+   *        ColorEffect::Saturation: 0 is gray, 1 unchanged, 2 doubled.
+   */
+  ColorMatrix EffectMatrix(ColorEffect effect, double saturation = 1.0);
+}
+
+/**
+ * @brief Ordered stack of colour effects, multiplied into one matrix.
+ *
+ * Each effect has a strength from 0 to 1, which can be animated. The full
+ * strength matrix of every effect is built once; a strength change only
+ * blends that matrix with identity, and the product is rebuilt from the
+ * changed effect onwards using cached prefix products, so animating the last
+ * effect of the stack costs one 5x5 multiply per frame. Effects at strength
+ * 0 are skipped entirely.
+ *
+ * Pure logic, no OS dependencies; not thread-safe.
+ */
+class ColorEffectStack
+{
+public:
+  using Clock = std::chrono::steady_clock;
+
+  static constexpr size_t EFFECT_COUNT = static_cast<size_t>(ColorEffect::Count);
+
+  /**
+   * @brief How much work the cache saved.
+   */
+  struct Stats
+  {
+    uint64_t updates = 0;    // Update calls that changed a strength
+    uint64_t multiplies = 0; // 5x5 products computed
+  };
+
+  ColorEffectStack();
+
+  /**
+   * @brief Moves @p effect to @p strength (clamped to 0-1), over @p duration
+   *        with ease-in-out, starting from wherever it currently is. Takes
+   *        effect at the next Update.
+   */
+  void SetStrength(ColorEffect effect, double strength, std::chrono::milliseconds duration = std::chrono::milliseconds(0),
+                   Clock::time_point now = Clock::now());
+
+  /**
+   * @brief Sets the amount ColorEffect::Saturation scales saturation by
+   *        (0-4) at full strength.
+   */
+  void SetSaturation(double amount);
+
+  /**
+   * @brief The strength @p effect has reached as of the last Update.
+   */
+  double GetStrength(ColorEffect effect) const;
+
+  /**
+   * @brief The strength @p effect is heading for.
+   */
+  double GetTarget(ColorEffect effect) const;
+
+  /**
+   * @brief Advances animations to @p now and rebuilds the product from the
+   *        first effect that changed.
+   * @return true if any strength changed.
+   */
+  bool Update(Clock::time_point now = Clock::now());
+
+  /**
+   * @brief True while an effect has not reached its target.
+   */
+  bool IsAnimating() const;
+
+  /**
+   * @brief The product of every effect at its current strength.
+   */
+  const ColorMatrix &Matrix() const { return m_prefix[EFFECT_COUNT]; }
+
+  Stats GetStats() const { return m_stats; }
+
+private:
+  struct Layer
+  {
+    ColorMatrix full;      // At strength 1
+    double strength = 0.0; // As of the last Update
+    double from = 0.0;     // Strength when the animation started
+    double target = 0.0;
+    Clock::time_point start;
+    std::chrono::milliseconds duration{0};
+    bool dirty = false; // Changed since the last Update
+  };
+
+  void Rebuild(size_t first);
+
+  Layer m_layers[EFFECT_COUNT];
+  ColorMatrix m_prefix[EFFECT_COUNT + 1]; // m_prefix[i]: product of layers 0 .. i-1
+  double m_saturation = 1.0;
+  Stats m_stats;
+};
@@ -1,69 +1,202 @@
 #include "colortemp.h"
-#include "brightness.h"
-#include <cmath>
 #include <algorithm>
+#include <array>
+#include <cmath>
 
-namespace ColorTempUtils
+namespace
 {
+  using namespace ColorTempUtils;
 
-  void KelvinToRGB(int kelvin, double &r, double &g, double &b)
+  constexpr double LN2 = 0.69314718055994530942;
+
+  // Natural logarithm usable in constant expressions (std::log is not
+  // constexpr in C++17). Reduces x to [1, 2) and sums the atanh series,
+  // which reaches full double precision well within 40 terms there.
+  constexpr double ConstLog(double x)
   {
-    kelvin = std::max(KELVIN_MIN, std::min(kelvin, KELVIN_MAX));
-    double temp = kelvin / 100.0;
+    int exponent = 0;
+    while (x >= 2.0)
+    {
+      x /= 2.0;
+      ++exponent;
+    }
+    while (x < 1.0)
+    {
+      x *= 2.0;
+      --exponent;
+    }
 
-    // Red
-    if (temp <= 66.0)
-      r = 1.0;
-    else
-      r = 329.698727446 * std::pow(temp - 60.0, -0.1332047592) / 255.0;
+    double z = (x - 1.0) / (x + 1.0);
+    double z2 = z * z;
+    double term = z;
+    double sum = 0.0;
+    for (int k = 0; k < 40; ++k)
+    {
+      sum += term / (2 * k + 1);
+      term *= z2;
+    }
+    return 2.0 * sum + exponent * LN2;
+  }
+
+  constexpr double Clamp01(double v)
+  {
+    return v < 0.0 ? 0.0 : (v > 1.0 ? 1.0 : v);
+  }
+
+  struct RGBMultipliers
+  {
+    double r, g, b;
+  };
+
+  // Above 6600 K the red and green curves switch to pow() branches. The
+  // supported range stops below that, so only the logarithmic branches are
+  // needed to build the table.
+  static_assert(KELVIN_MAX < 6600, "Kelvin table only implements the <= 6600 K branches");
+
+  constexpr RGBMultipliers KelvinToRGBExact(int kelvin)
+  {
+    double temp = kelvin / 100.0;
+    RGBMultipliers m{1.0, 0.0, 0.0};
 
     // Green
-    if (temp <= 66.0)
-      g = (99.4708025861 * std::log(temp) - 161.1195681661) / 255.0;
-    else
-      g = 288.1221695283 * std::pow(temp - 60.0, -0.0755148492) / 255.0;
+    m.g = Clamp01((99.4708025861 * ConstLog(temp) - 161.1195681661) / 255.0);
 
     // Blue
     if (temp >= 66.0)
-      b = 1.0;
+      m.b = 1.0;
     else if (temp <= 19.0)
-      b = 0.0;
+      m.b = 0.0;
     else
-      b = (138.5177312231 * std::log(temp - 10.0) - 305.0447927307) / 255.0;
+      m.b = Clamp01((138.5177312231 * ConstLog(temp - 10.0) - 305.0447927307) / 255.0);
 
-    // Clamp all channels to [0.0, 1.0]
-    r = std::max(0.0, std::min(r, 1.0));
-    g = std::max(0.0, std::min(g, 1.0));
-    b = std::max(0.0, std::min(b, 1.0));
+    return m;
   }
 
-  bool ApplyGammaRamp(HDC hdc, const GammaRampOptions &opts)
+  constexpr int KELVIN_TABLE_SIZE = (KELVIN_MAX - KELVIN_MIN) / KELVIN_STEP + 1;
+
+  constexpr std::array<RGBMultipliers, KELVIN_TABLE_SIZE> MakeKelvinTable()
   {
-    if (!hdc)
-      return false;
+    std::array<RGBMultipliers, KELVIN_TABLE_SIZE> table{};
+    for (int i = 0; i < KELVIN_TABLE_SIZE; ++i)
+      table[i] = KelvinToRGBExact(KELVIN_MIN + i * KELVIN_STEP);
+    return table;
+  }
 
+  constexpr std::array<RGBMultipliers, KELVIN_TABLE_SIZE> KELVIN_TABLE = MakeKelvinTable();
+
+  static_assert((KELVIN_MAX - KELVIN_MIN) % KELVIN_STEP == 0, "Kelvin range must be a whole number of steps");
+  static_assert(KELVIN_TABLE[0].b == 0.0, "1200 K has no blue component");
+  static_assert(KELVIN_TABLE[KELVIN_TABLE_SIZE - 1].g > 0.99, "6500 K is close to neutral");
+}
+
+double MapBrightnessToSafeFactor(int brightness)
+{
+  // Clamp input
+  brightness = std::max(BRIGHTNESS_MIN, std::min(brightness, BRIGHTNESS_MAX));
+
+  // Linear mapping:
+  // Out = MinSafe + (In - MinIn) * (MaxSafe - MinSafe) / (MaxIn - MinIn)
+  return static_cast<double>(SAFE_BRIGHTNESS_FLOOR) +
+         (static_cast<double>(brightness - BRIGHTNESS_MIN) *
+          (static_cast<double>(BRIGHTNESS_MAX - SAFE_BRIGHTNESS_FLOOR)) /
+          (static_cast<double>(BRIGHTNESS_MAX - BRIGHTNESS_MIN)));
+}
+
+int MapSafeFactorToBrightness(double safeFactor)
+{
+  safeFactor = std::max(static_cast<double>(SAFE_BRIGHTNESS_FLOOR),
+                        std::min(safeFactor, static_cast<double>(BRIGHTNESS_MAX)));
+  return BRIGHTNESS_MIN + static_cast<int>(std::lround((safeFactor - SAFE_BRIGHTNESS_FLOOR) *
+                                                       (BRIGHTNESS_MAX - BRIGHTNESS_MIN) /
+                                                       (BRIGHTNESS_MAX - SAFE_BRIGHTNESS_FLOOR)));
+}
+
+namespace ColorTempUtils
+{
+
+  void KelvinToRGB(int kelvin, double &r, double &g, double &b)
+  {
+    kelvin = std::max(KELVIN_MIN, std::min(kelvin, KELVIN_MAX));
+    int offset = kelvin - KELVIN_MIN;
+    const RGBMultipliers &lo = KELVIN_TABLE[offset / KELVIN_STEP];
+
+    int remainder = offset % KELVIN_STEP;
+    if (remainder == 0)
+    {
+      r = lo.r;
+      g = lo.g;
+      b = lo.b;
+      return;
+    }
+
+    // Off-step values (e.g. mid-transition) blend the two neighbouring entries.
+    const RGBMultipliers &hi = KELVIN_TABLE[offset / KELVIN_STEP + 1];
+    double t = static_cast<double>(remainder) / KELVIN_STEP;
+    r = lo.r + (hi.r - lo.r) * t;
+    g = lo.g + (hi.g - lo.g) * t;
+    b = lo.b + (hi.b - lo.b) * t;
+  }
+
+  void BuildGammaRamp(const GammaRampOptions &opts, uint16_t *ramp)
+  {
     double rMul, gMul, bMul;
     KelvinToRGB(opts.kelvin, rMul, gMul, bMul);
 
     double brightnessFactor = MapBrightnessToSafeFactor(opts.brightness) / 100.0;
+    const uint32_t entries = static_cast<uint32_t>(
+        std::max(GAMMA_RAMP_ENTRIES_MIN, std::min(opts.entries, GAMMA_RAMP_ENTRIES_MAX)));
 
-    WORD ramp[256 * 3];
-    for (int i = 0; i < 256; i++)
+    // Stages 2 and 3 collapse into one Q16 slope per channel: entry i is
+    // (i * slope) >> 16. With 256 entries the full-scale step is exactly 257.
+    // Both factors are at most 1, so (entries - 1) * slope stays within
+    // 65535 << 16 plus rounding and never overflows 32 bits.
+    const double step = 65535.0 / (entries - 1);
+    auto toSlope = [brightnessFactor, step](double channelMul)
     {
-      // Stage 2: software brightness
-      double base = i * brightnessFactor * 257.0;
+      return static_cast<uint32_t>(brightnessFactor * channelMul * step * 65536.0 + 0.5);
+    };
+    const uint32_t rSlope = toSlope(rMul);
+    const uint32_t gSlope = toSlope(gMul);
+    const uint32_t bSlope = toSlope(bMul);
 
-      // Stage 3: colour temperature (per-channel tint)
-      double R = base * rMul;
-      double G = base * gMul;
-      double B = base * bMul;
+    uint16_t *R = ramp;
+    uint16_t *G = ramp + entries;
+    uint16_t *B = ramp + entries * 2;
 
-      ramp[i] = (WORD)std::max(0.0, std::min(R, 65535.0));
-      ramp[i + 256] = (WORD)std::max(0.0, std::min(G, 65535.0));
-      ramp[i + 512] = (WORD)std::max(0.0, std::min(B, 65535.0));
+    // Branch-free and independent per entry, so the compiler can vectorise it.
+    for (uint32_t i = 0; i < entries; i++)
+    {
+      R[i] = static_cast<uint16_t>((i * rSlope) >> 16);
+      G[i] = static_cast<uint16_t>((i * gSlope) >> 16);
+      B[i] = static_cast<uint16_t>((i * bSlope) >> 16);
     }
+  }
+
+  int RampToKelvin(const uint16_t *ramp, int entries)
+  {
+    if (entries < GAMMA_RAMP_ENTRIES_MIN)
+      return KELVIN_DEFAULT;
+    double red = ramp[entries - 1];
+    if (red <= 0.0)
+      return KELVIN_DEFAULT;
+    double green = ramp[entries * 2 - 1] / red;
+    double blue = ramp[entries * 3 - 1] / red;
 
-    return SetDeviceGammaRamp(hdc, ramp) != FALSE;
+    // Red is 1 at every temperature in range, so the table's g and b are
+    // already the ratios to compare with.
+    int best = KELVIN_DEFAULT;
+    double bestError = 0.0;
+    for (int i = 0; i < KELVIN_TABLE_SIZE; ++i)
+    {
+      const RGBMultipliers &m = KELVIN_TABLE[i];
+      double error = (m.g / m.r - green) * (m.g / m.r - green) + (m.b / m.r - blue) * (m.b / m.r - blue);
+      if (i == 0 || error < bestError)
+      {
+        best = KELVIN_MIN + i * KELVIN_STEP;
+        bestError = error;
+      }
+    }
+    return best;
   }
 
 } // namespace ColorTempUtils
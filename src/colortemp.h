@@ -1,5 +1,5 @@
 #pragma once
-#include <windows.h>
+#include <cstdint>
 
 namespace ColorTempUtils
 {
@@ -7,10 +7,29 @@ namespace ColorTempUtils
   constexpr int KELVIN_MAX = 6500;
   constexpr int KELVIN_DEFAULT = 6500;
 
+  // Granularity of the precomputed Kelvin table; matches the 100 K snapping
+  // the Settings window applies, so slider values never need interpolation.
+  constexpr int KELVIN_STEP = 100;
+
+  // Software brightness input range (1-100) and the gamma floor it is
+  // remapped onto. The floor keeps the screen from going fully black;
+  // setting it too low can make the screen unreadable.
+  constexpr int BRIGHTNESS_MIN = 1;
+  constexpr int BRIGHTNESS_MAX = 100;
+  constexpr int SAFE_BRIGHTNESS_FLOOR = 49;
+
+  // Entries per channel in a GDI gamma ramp (R, G and B are stored back to back)
+  constexpr int GAMMA_RAMP_ENTRIES = 256;
+
+  // Bounds on the per-channel ramp size a backend may report. XRandR and KMS
+  // CRTCs commonly advertise 1024 or 4096 entries rather than GDI's 256.
+  constexpr int GAMMA_RAMP_ENTRIES_MIN = 2;
+  constexpr int GAMMA_RAMP_ENTRIES_MAX = 65536;
+
   /**
    * @brief Options controlling how the gamma ramp is built.
    *
-   * Stages inside ApplyGammaRamp are applied in a strict order:
+   * Stages inside BuildGammaRamp are applied in a strict order:
    *   1. Hardware brightness  (applied outside this ramp, via DDC/CI)
    *   2. Software brightness  (multiplicative on each ramp entry)
    *   3. Colour temperature   (per-channel R/G/B multipliers)
@@ -22,10 +41,59 @@ namespace ColorTempUtils
    */
   struct GammaRampOptions
   {
-    int brightness = 100; // Software brightness, 1..100
-    int kelvin = 6500;    // Colour temperature, 1200..6500
+    int brightness = 100;              // Software brightness, 1..100
+    int kelvin = 6500;                 // Colour temperature, 1200..6500
+    int entries = GAMMA_RAMP_ENTRIES;  // Ramp size per channel, as the output reports it
   };
 
+  /**
+   * @brief Per-channel multipliers (0..1) for a colour temperature.
+   *
+   * Reads a table generated at compile time at KELVIN_STEP granularity and
+   * interpolates linearly between neighbouring entries; no transcendental
+   * maths runs at call time.
+   */
   void KelvinToRGB(int kelvin, double &r, double &g, double &b);
-  bool ApplyGammaRamp(HDC hdc, const GammaRampOptions &opts);
+
+  /**
+   * @brief Computes the ramp for @p opts without touching the display.
+   *
+   * Integer (Q16 fixed-point) builder that fills R, G and B in a single pass.
+   * Matches the double-precision reference within one LSB.
+   *
+   * @param ramp Output, opts.entries * 3 words (R, then G, then B). Entry i of
+   *             each channel spans i / (entries - 1) of the full 16-bit range.
+   */
+  void BuildGammaRamp(const GammaRampOptions &opts, uint16_t *ramp);
+
+  /**
+   * @brief The colour temperature a ramp shows, to the nearest KELVIN_STEP.
+   *
+   * Compares the green and blue ends of the ramp with its red end, so the
+   * software brightness it was built with does not matter. A ramp with a
+   * dark red channel was not built by BuildGammaRamp; KELVIN_DEFAULT.
+   *
+   * @param ramp @p entries words per channel, R, then G, then B.
+   */
+  int RampToKelvin(const uint16_t *ramp, int entries);
 }
+
+/**
+ * @brief Maps a linear brightness value (1-100) to a safe gamma factor (49-100).
+ *
+ * Used by ColorTempUtils::BuildGammaRamp so brightness and color temperature
+ * are always written together in a single gamma ramp.
+ *
+ * @param brightness Input brightness 1-100
+ * @return Remapped value in [49, 100]; caller divides by 100 to get factor
+ */
+double MapBrightnessToSafeFactor(int brightness);
+
+/**
+ * @brief Inverse of MapBrightnessToSafeFactor: the brightness whose safe
+ *        factor is closest to @p safeFactor.
+ *
+ * @param safeFactor Value on the [49, 100] scale; clamped to it
+ * @return Brightness 1-100
+ */
+int MapSafeFactorToBrightness(double safeFactor);
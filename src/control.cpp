@@ -0,0 +1,1230 @@
+#include "control.h"
+#include "brightness.h"
+#include "bwfilter.h"
+#include "colortemp.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <future>
+#include <sstream>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+  using Clock = std::chrono::steady_clock;
+
+  constexpr size_t MAX_LINE = 4096;  // Longer requests are refused
+  constexpr size_t MAX_EVENTS = 256; // A subscriber further behind than this skips ahead
+  constexpr int MAX_MONITOR = 9999;
+  constexpr std::chrono::milliseconds REPLY_TIMEOUT{10000};
+  constexpr std::chrono::milliseconds FOREVER{-1};
+
+  std::string ToUtf8(const std::wstring &text)
+  {
+    std::string utf8;
+    for (size_t i = 0; i < text.size(); ++i)
+    {
+      uint32_t code = static_cast<uint32_t>(text[i]);
+      // UTF-16 surrogate pair, where wchar_t is 16 bits
+      if (code >= 0xD800 && code < 0xDC00 && i + 1 < text.size())
+      {
+        uint32_t low = static_cast<uint32_t>(text[i + 1]);
+        if (low >= 0xDC00 && low < 0xE000)
+        {
+          code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+          ++i;
+        }
+      }
+      if (code < 0x80)
+      {
+        utf8.push_back(static_cast<char>(code));
+      }
+      else if (code < 0x800)
+      {
+        utf8.push_back(static_cast<char>(0xC0 | (code >> 6)));
+        utf8.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+      }
+      else if (code < 0x10000)
+      {
+        utf8.push_back(static_cast<char>(0xE0 | (code >> 12)));
+        utf8.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+        utf8.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+      }
+      else
+      {
+        utf8.push_back(static_cast<char>(0xF0 | (code >> 18)));
+        utf8.push_back(static_cast<char>(0x80 | ((code >> 12) & 0x3F)));
+        utf8.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+        utf8.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+      }
+    }
+    return utf8;
+  }
+
+  std::string Trim(const std::string &text)
+  {
+    size_t start = text.find_first_not_of(" \t\r");
+    if (start == std::string::npos)
+      return std::string();
+    size_t end = text.find_last_not_of(" \t\r");
+    return text.substr(start, end - start + 1);
+  }
+
+  // Plain decimal digits only: "+5", "5.0" and "0x5" are not levels
+  bool ParseLevel(const std::string &text, int minValue, int maxValue, int &value)
+  {
+    if (text.empty() || text.size() > 6 ||
+        !std::all_of(text.begin(), text.end(), [](unsigned char c)
+                     { return std::isdigit(c) != 0; }))
+      return false;
+    value = std::atoi(text.c_str());
+    return value >= minValue && value <= maxValue;
+  }
+
+  struct Command
+  {
+    enum class Kind
+    {
+      Get,
+      Set,
+      Filter,
+      Save
+    };
+    Kind kind = Kind::Get;
+    int monitor = -1; // -1: every monitor
+    int software = -1;
+    int kelvin = -1;
+    int hardware = -1;
+    bool enabled = false;
+  };
+
+  bool ParseCommand(const std::string &text, Command &command, std::string &error)
+  {
+    std::istringstream words(text);
+    std::string verb;
+    words >> verb;
+    std::vector<std::string> args;
+    for (std::string word; words >> word;)
+      args.push_back(word);
+
+    if (verb == "get")
+    {
+      command.kind = Command::Kind::Get;
+      if (args.size() > 1 || (args.size() == 1 && !ParseLevel(args[0], 0, MAX_MONITOR, command.monitor)))
+      {
+        error = "usage: get [<monitor>]";
+        return false;
+      }
+      return true;
+    }
+    if (verb == "set")
+    {
+      command.kind = Command::Kind::Set;
+      if (args.size() < 2 || (args[0] != "*" && !ParseLevel(args[0], 0, MAX_MONITOR, command.monitor)))
+      {
+        error = "usage: set <monitor|*> [sw=N] [temp=K] [hw=N]";
+        return false;
+      }
+      for (size_t i = 1; i < args.size(); ++i)
+      {
+        size_t equals = args[i].find('=');
+        std::string key = args[i].substr(0, equals);
+        std::string value = equals == std::string::npos ? std::string() : args[i].substr(equals + 1);
+        bool valid = key == "sw"     ? ParseLevel(value, 1, 100, command.software)
+                     : key == "temp" ? ParseLevel(value, ColorTempUtils::KELVIN_MIN, ColorTempUtils::KELVIN_MAX,
+                                                  command.kelvin)
+                     : key == "hw"   ? ParseLevel(value, 0, 100, command.hardware)
+                                     : false;
+        if (!valid)
+        {
+          error = "bad setting '" + args[i] + "'";
+          return false;
+        }
+      }
+      return true;
+    }
+    if (verb == "bw")
+    {
+      command.kind = Command::Kind::Filter;
+      command.enabled = args.size() == 1 && args[0] == "on";
+      if (args.size() != 1 || (args[0] != "on" && args[0] != "off"))
+      {
+        error = "usage: bw on|off";
+        return false;
+      }
+      return true;
+    }
+    if (verb == "save")
+    {
+      command.kind = Command::Kind::Save;
+      if (!args.empty())
+      {
+        error = "usage: save";
+        return false;
+      }
+      return true;
+    }
+    if (verb == "subscribe")
+      error = "subscribe must be a request of its own";
+    else
+      error = verb.empty() ? "empty command" : "unknown command '" + verb + "'";
+    return false;
+  }
+
+  bool Targets(const Command &command, size_t index)
+  {
+    return command.monitor < 0 || static_cast<size_t>(command.monitor) == index;
+  }
+
+  // Why a command cannot apply, or empty. Called inside the batch that
+  // applies it, so the monitors cannot change in between.
+  std::string CheckCommand(const Command &command)
+  {
+    const std::vector<Monitor> &monitors = BrightnessController::GetMonitors();
+    if (command.monitor >= 0 && static_cast<size_t>(command.monitor) >= monitors.size())
+      return "no monitor " + std::to_string(command.monitor);
+    if (command.kind != Command::Kind::Set)
+      return std::string();
+
+    bool software = command.software < 0 && command.kelvin < 0;
+    bool hardware = command.hardware < 0;
+    for (size_t i = 0; i < monitors.size(); ++i)
+    {
+      if (!Targets(command, i))
+        continue;
+      software = software || monitors[i].hasGamma;
+      hardware = hardware || BrightnessController::GetHardwareProbeState(static_cast<int>(i)) ==
+                                 HardwareProbeState::Available;
+    }
+    std::string monitor = "monitor " + std::to_string(command.monitor);
+    if (!software)
+      return command.monitor < 0 ? "no monitor has a gamma ramp" : monitor + " has no gamma ramp";
+    if (!hardware)
+      return command.monitor < 0 ? "no monitor has hardware brightness" : monitor + " has no hardware brightness";
+    return std::string();
+  }
+
+  // A monitor's levels before a request, to put back if it fails part way
+  struct Levels
+  {
+    std::wstring device;
+    int software = 0;
+    int kelvin = 0;
+    int hardware = 0;
+    bool softwareSet = false;
+    bool hardwareSet = false;
+  };
+
+  std::vector<Levels> SaveLevels()
+  {
+    std::vector<Levels> levels(BrightnessController::GetMonitorCount());
+    for (size_t i = 0; i < levels.size(); ++i)
+    {
+      int index = static_cast<int>(i);
+      levels[i].device = BrightnessController::GetDeviceName(index);
+      levels[i].software = BrightnessController::GetSoftwareBrightness(index);
+      levels[i].kelvin = BrightnessController::GetSoftwareColorTemp(index);
+      levels[i].hardware = BrightnessController::GetHardwareBrightness(index);
+    }
+    return levels;
+  }
+
+  // Monitors replaced since SaveLevels are left alone
+  void RestoreLevels(const std::vector<Levels> &levels)
+  {
+    BrightnessController::BeginUpdate();
+    size_t count = BrightnessController::GetMonitorCount();
+    for (size_t i = 0; i < levels.size() && i < count; ++i)
+    {
+      int index = static_cast<int>(i);
+      if (BrightnessController::GetDeviceName(index) != levels[i].device)
+        continue;
+      if (levels[i].softwareSet)
+        BrightnessController::SetSoftwareLevels(index, levels[i].software, levels[i].kelvin);
+      if (levels[i].hardwareSet)
+        BrightnessController::SetHardwareBrightness(index, levels[i].hardware);
+    }
+    BrightnessController::EndUpdate();
+  }
+
+  // The hardware writes of one request, which finish on the DDC workers.
+  // Shared with their completions, which may outlive a request that gave up.
+  struct HardwareWait
+  {
+    std::mutex mutex;
+    std::condition_variable finished;
+    size_t pending = 0;
+    int failed = -1; // A monitor whose write failed or was cancelled
+  };
+
+  BrightnessController::HardwareCompletionFn Track(const std::shared_ptr<HardwareWait> &wait, int monitor)
+  {
+    std::lock_guard<std::mutex> lock(wait->mutex);
+    wait->pending++;
+    return [wait, monitor](const HardwareWriteReport &report)
+    {
+      // Superseded is fine: a later change took the value's place
+      DdcResult result = report.Overall();
+      std::lock_guard<std::mutex> lock(wait->mutex);
+      if ((result == DdcResult::Failed || result == DdcResult::Cancelled) && wait->failed < 0)
+        wait->failed = monitor;
+      if (--wait->pending == 0)
+        wait->finished.notify_all();
+    };
+  }
+
+  // Why the writes did not all land, or empty
+  std::string WaitForHardware(HardwareWait &wait, std::chrono::milliseconds timeout)
+  {
+    std::unique_lock<std::mutex> lock(wait.mutex);
+    if (!wait.finished.wait_for(lock, timeout, [&wait]
+                                { return wait.pending == 0 || wait.failed >= 0; }))
+      return "hardware brightness timed out";
+    if (wait.failed >= 0)
+      return "monitor " + std::to_string(wait.failed) + " did not take the hardware brightness";
+    return std::string();
+  }
+
+  // Saves the monitors a request set; those replaced since SaveLevels are
+  // left alone
+  void StoreLevels(const std::vector<Levels> &levels, const std::function<void(int)> &store)
+  {
+    BrightnessController::BeginUpdate();
+    size_t count = BrightnessController::GetMonitorCount();
+    for (size_t i = 0; i < levels.size() && i < count; ++i)
+    {
+      int index = static_cast<int>(i);
+      if ((levels[i].softwareSet || levels[i].hardwareSet) &&
+          BrightnessController::GetDeviceName(index) == levels[i].device)
+        store(index);
+    }
+    BrightnessController::EndUpdate();
+  }
+
+  std::string DescribeMonitor(int index)
+  {
+    HardwareProbeState probe = BrightnessController::GetHardwareProbeState(index);
+    std::string hardware = probe == HardwareProbeState::Available
+                               ? std::to_string(BrightnessController::GetHardwareBrightness(index))
+                           : probe == HardwareProbeState::Pending ? "pending"
+                                                                  : "none";
+    return "monitor " + std::to_string(index) +
+           " sw=" + std::to_string(BrightnessController::GetSoftwareBrightness(index)) +
+           " temp=" + std::to_string(BrightnessController::GetSoftwareColorTemp(index)) + " hw=" + hardware +
+           " name=" + ToUtf8(BrightnessController::GetDeviceName(index));
+  }
+
+  const char *FilterWord(bool enabled)
+  {
+    return enabled ? "on" : "off";
+  }
+
+#ifdef _WIN32
+  std::wstring Widen(const std::string &text)
+  {
+    int length = MultiByteToWideChar(CP_UTF8, 0, text.c_str(), static_cast<int>(text.size()), nullptr, 0);
+    std::wstring wide(length > 0 ? length : 0, L'\0');
+    if (length > 0)
+      MultiByteToWideChar(CP_UTF8, 0, text.c_str(), static_cast<int>(text.size()), &wide[0], length);
+    return wide;
+  }
+
+  DWORD ToTimeout(std::chrono::milliseconds timeout)
+  {
+    return timeout.count() < 0 ? INFINITE : static_cast<DWORD>(timeout.count());
+  }
+#else
+  int ToTimeout(std::chrono::milliseconds timeout)
+  {
+    return timeout.count() < 0 ? -1 : static_cast<int>(timeout.count());
+  }
+
+  void SetCloseOnExec(int fd)
+  {
+    fcntl(fd, F_SETFD, fcntl(fd, F_GETFD) | FD_CLOEXEC);
+  }
+#endif
+}
+
+// -----------------------------------------------------------------------------------------------
+// ControlLink
+// -----------------------------------------------------------------------------------------------
+
+// One connected pipe or socket. Blocking calls also return when the owning
+// server is stopped (the stop event, or the wake pipe becoming readable).
+class ControlLink
+{
+public:
+#ifdef _WIN32
+  // Takes ownership of @p pipe, opened for overlapped I/O
+  ControlLink(HANDLE pipe, HANDLE stop)
+      : m_pipe(pipe),
+        m_stop(stop),
+        m_readEvent(CreateEventW(nullptr, TRUE, FALSE, nullptr)),
+        m_writeEvent(CreateEventW(nullptr, TRUE, FALSE, nullptr))
+  {
+  }
+
+  ~ControlLink()
+  {
+    CloseHandle(m_pipe);
+    if (m_readEvent)
+      CloseHandle(m_readEvent);
+    if (m_writeEvent)
+      CloseHandle(m_writeEvent);
+  }
+#else
+  // Takes ownership of @p fd
+  ControlLink(int fd, int wake) : m_fd(fd), m_wake(wake) {}
+
+  ~ControlLink()
+  {
+    close(m_fd);
+  }
+#endif
+
+  ControlLink(const ControlLink &) = delete;
+  ControlLink &operator=(const ControlLink &) = delete;
+
+  /**
+   * @brief Reads whatever has arrived, waiting up to @p timeout for some
+   *        (a negative timeout waits for ever).
+   * @return Bytes read; 0 if the timeout passed first; -1 once the
+   *         connection is closed or the server stops.
+   */
+  long Read(char *buffer, size_t size, std::chrono::milliseconds timeout)
+  {
+#ifdef _WIN32
+    OVERLAPPED overlapped = {};
+    overlapped.hEvent = m_readEvent;
+    BOOL started = ReadFile(m_pipe, buffer, static_cast<DWORD>(size), nullptr, &overlapped);
+    DWORD bytes = 0;
+    int finished = Finish(overlapped, started, bytes, ToTimeout(timeout));
+    if (finished <= 0)
+      return finished;
+    return bytes > 0 ? static_cast<long>(bytes) : -1;
+#else
+    for (;;)
+    {
+      int ready = Wait(POLLIN, timeout);
+      if (ready <= 0)
+        return ready;
+      ssize_t got = recv(m_fd, buffer, size, 0);
+      if (got < 0 && errno == EINTR)
+        continue;
+      return got > 0 ? static_cast<long>(got) : -1;
+    }
+#endif
+  }
+
+  bool Write(const std::string &data)
+  {
+    size_t sent = 0;
+    while (sent < data.size())
+    {
+#ifdef _WIN32
+      OVERLAPPED overlapped = {};
+      overlapped.hEvent = m_writeEvent;
+      BOOL started = WriteFile(m_pipe, data.data() + sent, static_cast<DWORD>(data.size() - sent), nullptr, &overlapped);
+      DWORD bytes = 0;
+      if (Finish(overlapped, started, bytes, INFINITE) <= 0 || bytes == 0)
+        return false;
+      sent += bytes;
+#else
+      if (Wait(POLLOUT, FOREVER) <= 0)
+        return false;
+      ssize_t put = send(m_fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+      if (put < 0 && errno == EINTR)
+        continue;
+      if (put <= 0)
+        return false;
+      sent += static_cast<size_t>(put);
+#endif
+    }
+    return true;
+  }
+
+private:
+#ifdef _WIN32
+  // Completes an overlapped call: 1 done, 0 timed out, -1 failed or stopped
+  int Finish(OVERLAPPED &overlapped, BOOL started, DWORD &bytes, DWORD timeout)
+  {
+    if (!started && GetLastError() != ERROR_IO_PENDING)
+      return -1;
+    HANDLE handles[2] = {overlapped.hEvent, m_stop};
+    DWORD waited = WaitForMultipleObjects(m_stop ? 2 : 1, handles, FALSE, timeout);
+    if (waited != WAIT_OBJECT_0)
+    {
+      CancelIoEx(m_pipe, &overlapped);
+      GetOverlappedResult(m_pipe, &overlapped, &bytes, TRUE);
+      return waited == WAIT_TIMEOUT ? 0 : -1;
+    }
+    return GetOverlappedResult(m_pipe, &overlapped, &bytes, FALSE) ? 1 : -1;
+  }
+
+  HANDLE m_pipe;
+  HANDLE m_stop; // Not owned; nullptr on the client side
+  HANDLE m_readEvent;
+  HANDLE m_writeEvent;
+#else
+  // Waits for @p events: 1 ready, 0 timed out, -1 hung up or stopped
+  int Wait(short events, std::chrono::milliseconds timeout)
+  {
+    pollfd fds[2] = {{m_fd, events, 0}, {m_wake, POLLIN, 0}};
+    for (;;)
+    {
+      int ready = poll(fds, m_wake >= 0 ? 2 : 1, ToTimeout(timeout));
+      if (ready < 0 && errno == EINTR)
+        continue;
+      if (ready < 0 || (m_wake >= 0 && fds[1].revents))
+        return -1;
+      if (ready == 0)
+        return 0;
+      // POLLHUP with data still buffered is left to recv to sort out
+      return (fds[0].revents & (events | POLLHUP)) ? 1 : -1;
+    }
+  }
+
+  int m_fd;
+  int m_wake; // Not owned; -1 on the client side
+#endif
+};
+
+// -----------------------------------------------------------------------------------------------
+// ControlServer::Platform
+// -----------------------------------------------------------------------------------------------
+
+// The listening end of the endpoint
+struct ControlServer::Platform
+{
+#ifdef _WIN32
+  std::wstring name;
+  HANDLE stop = nullptr;         // Manual-reset; set by Interrupt
+  HANDLE connectEvent = nullptr;
+  HANDLE pending = INVALID_HANDLE_VALUE; // Instance waiting for the next client
+
+  HANDLE CreateInstance(bool first)
+  {
+    // Local clients only. The first instance fails if another process
+    // already serves the name.
+    return CreateNamedPipeW(name.c_str(), PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED | (first ? FILE_FLAG_FIRST_PIPE_INSTANCE : 0),
+                            PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS,
+                            PIPE_UNLIMITED_INSTANCES, static_cast<DWORD>(MAX_LINE), static_cast<DWORD>(MAX_LINE), 0,
+                            nullptr);
+  }
+
+  bool Open(const std::string &endpoint)
+  {
+    name = Widen(endpoint);
+    stop = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+    connectEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+    pending = CreateInstance(true);
+    return stop && connectEvent && pending != INVALID_HANDLE_VALUE;
+  }
+
+  // Waits for the next client; nullptr once interrupted
+  std::unique_ptr<ControlLink> Accept()
+  {
+    for (;;)
+    {
+      if (pending == INVALID_HANDLE_VALUE)
+        pending = CreateInstance(false);
+      if (pending == INVALID_HANDLE_VALUE)
+        return nullptr;
+
+      OVERLAPPED overlapped = {};
+      overlapped.hEvent = connectEvent;
+      BOOL connected = ConnectNamedPipe(pending, &overlapped);
+      DWORD error = connected ? 0 : GetLastError();
+      if (error == ERROR_PIPE_CONNECTED)
+      {
+        connected = TRUE;
+      }
+      else if (error == ERROR_IO_PENDING)
+      {
+        HANDLE handles[2] = {connectEvent, stop};
+        DWORD bytes = 0;
+        if (WaitForMultipleObjects(2, handles, FALSE, INFINITE) != WAIT_OBJECT_0)
+        {
+          CancelIoEx(pending, &overlapped);
+          GetOverlappedResult(pending, &overlapped, &bytes, TRUE);
+          return nullptr;
+        }
+        connected = GetOverlappedResult(pending, &overlapped, &bytes, FALSE);
+      }
+
+      HANDLE pipe = pending;
+      pending = INVALID_HANDLE_VALUE;
+      if (connected)
+        return std::make_unique<ControlLink>(pipe, stop);
+      CloseHandle(pipe);
+      if (WaitForSingleObject(stop, 0) == WAIT_OBJECT_0)
+        return nullptr;
+    }
+  }
+
+  void Interrupt()
+  {
+    SetEvent(stop);
+  }
+
+  void Close()
+  {
+    if (pending != INVALID_HANDLE_VALUE)
+      CloseHandle(pending);
+    if (connectEvent)
+      CloseHandle(connectEvent);
+    if (stop)
+      CloseHandle(stop);
+    pending = INVALID_HANDLE_VALUE;
+    connectEvent = stop = nullptr;
+  }
+#else
+  std::string path;
+  int listener = -1;
+  int wake[2] = {-1, -1}; // Written by Interrupt; never read, so stays readable
+
+  bool Open(const std::string &endpoint)
+  {
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (endpoint.empty() || endpoint.size() >= sizeof(address.sun_path))
+      return false;
+    std::memcpy(address.sun_path, endpoint.c_str(), endpoint.size() + 1);
+
+    // A socket left behind by an instance that crashed is replaced; one
+    // that still answers is not
+    int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (probe >= 0)
+    {
+      bool live = connect(probe, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0;
+      close(probe);
+      if (live)
+        return false;
+    }
+    unlink(endpoint.c_str());
+
+    listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0)
+      return false;
+    SetCloseOnExec(listener);
+    if (bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0)
+      return false;
+    path = endpoint;
+    // Owner only. The default endpoint is in the private runtime directory
+    // anyway; this covers the /tmp fallback.
+    chmod(path.c_str(), S_IRUSR | S_IWUSR);
+    if (listen(listener, 16) != 0 || pipe(wake) != 0)
+      return false;
+    SetCloseOnExec(wake[0]);
+    SetCloseOnExec(wake[1]);
+    return true;
+  }
+
+  std::unique_ptr<ControlLink> Accept()
+  {
+    for (;;)
+    {
+      pollfd fds[2] = {{listener, POLLIN, 0}, {wake[0], POLLIN, 0}};
+      if (poll(fds, 2, -1) < 0)
+      {
+        if (errno == EINTR)
+          continue;
+        return nullptr;
+      }
+      if (fds[1].revents)
+        return nullptr;
+      int fd = accept(listener, nullptr, nullptr);
+      if (fd < 0)
+      {
+        if (errno == EINTR || errno == ECONNABORTED)
+          continue;
+        return nullptr;
+      }
+      SetCloseOnExec(fd);
+      return std::make_unique<ControlLink>(fd, wake[0]);
+    }
+  }
+
+  void Interrupt()
+  {
+    if (wake[1] >= 0 && write(wake[1], "x", 1) < 0)
+      return;
+  }
+
+  void Close()
+  {
+    for (int *fd : {&listener, &wake[0], &wake[1]})
+    {
+      if (*fd >= 0)
+        close(*fd);
+      *fd = -1;
+    }
+    if (!path.empty())
+      unlink(path.c_str());
+    path.clear();
+  }
+#endif
+};
+
+// -----------------------------------------------------------------------------------------------
+// ControlUtils
+// -----------------------------------------------------------------------------------------------
+
+namespace ControlUtils
+{
+  std::string DefaultEndpoint()
+  {
+#ifdef _WIN32
+    // One per logon session, so fast user switching gets an instance each
+    DWORD session = 0;
+    ProcessIdToSessionId(GetCurrentProcessId(), &session);
+    return "\\\\.\\pipe\\candela-control-" + std::to_string(session);
+#else
+    const char *runtime = std::getenv("XDG_RUNTIME_DIR");
+    if (runtime && *runtime)
+      return std::string(runtime) + "/candela.sock";
+    return "/tmp/candela-" + std::to_string(getuid()) + ".sock";
+#endif
+  }
+}
+
+// -----------------------------------------------------------------------------------------------
+// ControlClient
+// -----------------------------------------------------------------------------------------------
+
+ControlClient::ControlClient() = default;
+
+ControlClient::~ControlClient() = default;
+
+bool ControlClient::Connect(const std::string &endpoint, std::chrono::milliseconds timeout)
+{
+  Close();
+#ifdef _WIN32
+  std::wstring name = Widen(endpoint);
+  Clock::time_point deadline = Clock::now() + timeout;
+  for (;;)
+  {
+    HANDLE pipe = CreateFileW(name.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_EXISTING,
+                              FILE_FLAG_OVERLAPPED, nullptr);
+    if (pipe != INVALID_HANDLE_VALUE)
+    {
+      m_link = std::make_unique<ControlLink>(pipe, nullptr);
+      return true;
+    }
+    // Every instance is taken until the server creates the next one
+    long long remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count();
+    if (GetLastError() != ERROR_PIPE_BUSY || remaining <= 0 ||
+        !WaitNamedPipeW(name.c_str(), static_cast<DWORD>(remaining)))
+      return false;
+  }
+#else
+  (void)timeout; // A listening socket queues connections instead of refusing them
+  sockaddr_un address = {};
+  address.sun_family = AF_UNIX;
+  if (endpoint.empty() || endpoint.size() >= sizeof(address.sun_path))
+    return false;
+  std::memcpy(address.sun_path, endpoint.c_str(), endpoint.size() + 1);
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0)
+    return false;
+  SetCloseOnExec(fd);
+  if (connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0)
+  {
+    close(fd);
+    return false;
+  }
+  m_link = std::make_unique<ControlLink>(fd, -1);
+  return true;
+#endif
+}
+
+void ControlClient::Close()
+{
+  m_link.reset();
+  m_buffer.clear();
+}
+
+bool ControlClient::Request(const std::string &request, std::vector<std::string> &lines, std::string &status)
+{
+  lines.clear();
+  status.clear();
+  if (!m_link || !m_link->Write(request + "\n"))
+  {
+    Close();
+    return false;
+  }
+  std::string line;
+  while (ReadLine(line, REPLY_TIMEOUT))
+  {
+    if (line == "ok" || line.compare(0, 4, "err ") == 0)
+    {
+      status = line;
+      return true;
+    }
+    lines.push_back(line);
+  }
+  Close();
+  return false;
+}
+
+bool ControlClient::ReadLine(std::string &line, std::chrono::milliseconds timeout)
+{
+  Clock::time_point deadline = Clock::now() + timeout;
+  for (;;)
+  {
+    size_t end = m_buffer.find('\n');
+    if (end != std::string::npos)
+    {
+      line.assign(m_buffer, 0, end);
+      if (!line.empty() && line.back() == '\r')
+        line.pop_back();
+      m_buffer.erase(0, end + 1);
+      return true;
+    }
+    if (!m_link)
+      return false;
+    std::chrono::milliseconds remaining =
+        std::max(std::chrono::milliseconds(0), std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()));
+    char chunk[MAX_LINE];
+    long got = m_link->Read(chunk, sizeof(chunk), remaining);
+    if (got == 0)
+      return false;
+    if (got < 0)
+    {
+      m_link.reset(); // Whatever is still buffered can be read
+      continue;
+    }
+    m_buffer.append(chunk, static_cast<size_t>(got));
+  }
+}
+
+// -----------------------------------------------------------------------------------------------
+// ControlServer
+// -----------------------------------------------------------------------------------------------
+
+ControlServer::ControlServer() : ControlServer(Options()) {}
+
+ControlServer::ControlServer(const Options &options) : m_options(options) {}
+
+ControlServer::~ControlServer()
+{
+  Stop();
+}
+
+void ControlServer::SetUiInvoker(UiInvokeFn invoke)
+{
+  m_invoke = std::move(invoke);
+}
+
+void ControlServer::SetStoreHandler(StoreFn store)
+{
+  m_store = std::move(store);
+}
+
+bool ControlServer::Start()
+{
+  if (m_running)
+    return true;
+  auto platform = std::make_unique<Platform>();
+  if (!platform->Open(m_options.endpoint))
+  {
+    platform->Close();
+    return false;
+  }
+  m_platform = std::move(platform);
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stopping = false;
+    m_dirty.clear();
+    m_listDirty = false;
+    m_filterEnabled = BWFilter::IsEnabled();
+    m_publishedFilter = m_filterEnabled;
+    m_events.clear();
+    m_published.clear();
+  }
+
+  // Listeners only mark what changed; the publisher does the reading
+  BrightnessController::SetChangeListener(
+      [this](int index)
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (index < 0)
+          m_listDirty = true;
+        else
+          m_dirty.insert(index);
+        m_changed.notify_all();
+      });
+  BWFilter::SetChangeListener(
+      [this](bool enabled)
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_filterEnabled = enabled;
+        m_changed.notify_all();
+      });
+
+  m_running = true;
+  m_publisher = std::thread(&ControlServer::Publish, this);
+  m_listener = std::thread(&ControlServer::Listen, this);
+  return true;
+}
+
+void ControlServer::Stop()
+{
+  if (!m_running)
+    return;
+  BWFilter::SetChangeListener(nullptr);
+  BrightnessController::SetChangeListener(nullptr);
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stopping = true;
+  }
+  m_changed.notify_all();
+  m_platform->Interrupt();
+
+  m_listener.join();
+  m_publisher.join();
+  Reap(true);
+  m_platform->Close();
+  m_platform.reset();
+  m_running = false;
+}
+
+ControlServer::Stats ControlServer::GetStats() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_stats;
+}
+
+void ControlServer::Listen()
+{
+  while (std::unique_ptr<ControlLink> link = m_platform->Accept())
+  {
+    Reap(false);
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_stopping)
+      break;
+    m_stats.connections++;
+    if (m_peers.size() >= m_options.maxClients)
+    {
+      m_stats.rejected++;
+      lock.unlock();
+      link->Write("err busy\n");
+      continue;
+    }
+    m_peers.push_back(std::make_unique<Peer>());
+    Peer *peer = m_peers.back().get();
+    peer->link = std::move(link);
+    peer->thread = std::thread([this, peer]
+                               { Serve(*peer); });
+  }
+}
+
+// Joins the threads of clients that have gone, or of every client
+void ControlServer::Reap(bool all)
+{
+  std::list<std::unique_ptr<Peer>> finished;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto it = m_peers.begin(); it != m_peers.end();)
+    {
+      auto next = std::next(it);
+      if (all || (*it)->done)
+        finished.splice(finished.end(), m_peers, it);
+      it = next;
+    }
+  }
+  for (std::unique_ptr<Peer> &peer : finished)
+    if (peer->thread.joinable())
+      peer->thread.join();
+}
+
+void ControlServer::Serve(Peer &peer)
+{
+  ControlLink &link = *peer.link;
+  std::string buffer;
+  char chunk[1024];
+  for (;;)
+  {
+    size_t end = buffer.find('\n');
+    if (end == std::string::npos)
+    {
+      if (buffer.size() > MAX_LINE)
+      {
+        link.Write("err request too long\n");
+        break;
+      }
+      long got = link.Read(chunk, sizeof(chunk), FOREVER);
+      if (got <= 0)
+        break;
+      buffer.append(chunk, static_cast<size_t>(got));
+      continue;
+    }
+    std::string request = buffer.substr(0, end);
+    buffer.erase(0, end + 1);
+    if (Trim(request) == "subscribe")
+    {
+      Stream(link);
+      break;
+    }
+    if (!link.Write(Execute(request)))
+      break;
+  }
+  peer.done = true;
+}
+
+// Sends the current state, then every event, until the client goes away or
+// the server stops
+void ControlServer::Stream(ControlLink &link)
+{
+  uint64_t seen;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    seen = m_eventCount;
+  }
+  std::string text = "ok\n";
+  for (const std::string &line : Snapshot())
+    text += "event " + line + "\n";
+  if (!link.Write(text))
+    return;
+
+  std::unique_lock<std::mutex> lock(m_mutex);
+  for (;;)
+  {
+    m_changed.wait(lock, [&]
+                   { return m_stopping || m_eventCount > seen; });
+    if (m_stopping)
+      return;
+    uint64_t first = m_eventCount - m_events.size(); // Events before m_events.front()
+    text.clear();
+    for (size_t i = seen > first ? static_cast<size_t>(seen - first) : 0; i < m_events.size(); ++i)
+      text += m_events[i] + "\n";
+    seen = m_eventCount;
+    lock.unlock();
+    bool sent = link.Write(text);
+    lock.lock();
+    if (!sent)
+      return;
+  }
+}
+
+void ControlServer::Publish()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  for (;;)
+  {
+    m_changed.wait(lock, [&]
+                   { return m_stopping || !m_dirty.empty() || m_listDirty || m_filterEnabled != m_publishedFilter; });
+    // Let a burst (a transition, a transaction) settle into one event per monitor
+    if (m_stopping || m_changed.wait_for(lock, m_options.eventInterval, [&]
+                                         { return m_stopping; }))
+      return;
+    std::set<int> dirty;
+    dirty.swap(m_dirty);
+    bool listChanged = m_listDirty;
+    m_listDirty = false;
+    bool filter = m_filterEnabled;
+    lock.unlock();
+
+    std::vector<std::string> lines;
+    size_t count = BrightnessController::GetMonitorCount();
+    if (listChanged)
+    {
+      lines.push_back("event monitors " + std::to_string(count));
+      m_published.assign(count, std::string());
+      for (size_t i = 0; i < count; ++i)
+        dirty.insert(static_cast<int>(i));
+    }
+    m_published.resize(count);
+    for (int index : dirty)
+    {
+      if (index < 0 || static_cast<size_t>(index) >= count)
+        continue;
+      std::string line = "event " + DescribeMonitor(index);
+      if (line == m_published[index])
+        continue;
+      m_published[index] = line;
+      lines.push_back(line);
+    }
+    if (filter != m_publishedFilter)
+    {
+      m_publishedFilter = filter;
+      lines.push_back(std::string("event bw ") + FilterWord(filter));
+    }
+
+    lock.lock();
+    for (std::string &line : lines)
+    {
+      m_events.push_back(std::move(line));
+      if (m_events.size() > MAX_EVENTS)
+        m_events.pop_front();
+    }
+    m_eventCount += lines.size();
+    m_stats.events += lines.size();
+    if (!lines.empty())
+      m_changed.notify_all();
+  }
+}
+
+// Every monitor as get reports it, then the filter
+std::vector<std::string> ControlServer::Snapshot()
+{
+  std::vector<std::string> lines;
+  size_t count = BrightnessController::GetMonitorCount();
+  for (size_t i = 0; i < count; ++i)
+    lines.push_back(DescribeMonitor(static_cast<int>(i)));
+  std::lock_guard<std::mutex> lock(m_mutex);
+  lines.push_back(std::string("bw ") + FilterWord(m_filterEnabled));
+  return lines;
+}
+
+// BWFilter belongs to the UI thread. The task only holds shared state, so
+// it is harmless if it runs after this has given up waiting.
+bool ControlServer::SetFilter(bool enabled, std::string &error)
+{
+  auto done = std::make_shared<std::promise<bool>>();
+  std::future<bool> result = done->get_future();
+  std::function<void()> task = [done, enabled]
+  { done->set_value(BWFilter::SetEnabled(enabled)); };
+  if (!m_invoke)
+    task();
+  else if (!m_invoke(task))
+  {
+    error = "UI thread unavailable";
+    return false;
+  }
+  if (result.wait_for(m_options.uiTimeout) != std::future_status::ready)
+  {
+    error = "UI thread busy";
+    return false;
+  }
+  if (!result.get())
+  {
+    error = "colour filter unavailable";
+    return false;
+  }
+  return true;
+}
+
+std::string ControlServer::Execute(const std::string &request)
+{
+  // Parse everything first: a request applies whole or not at all
+  std::vector<Command> commands;
+  std::string error;
+  std::stringstream parts(request);
+  for (std::string part; std::getline(parts, part, ';');)
+  {
+    commands.emplace_back();
+    if (!ParseCommand(Trim(part), commands.back(), error))
+      break;
+  }
+  if (error.empty() && commands.empty())
+    error = "empty request";
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stats.requests++;
+    m_stats.commands += commands.size();
+  }
+
+  std::string reply;
+  if (error.empty())
+  {
+    std::lock_guard<std::mutex> apply(m_applyMutex);
+
+    // The filter is applied last, so a get reports the state it will leave
+    bool filter;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      filter = m_filterEnabled;
+    }
+    bool filterSet = false;
+    bool save = false;
+    for (const Command &command : commands)
+    {
+      if (command.kind == Command::Kind::Filter)
+      {
+        filter = command.enabled;
+        filterSet = true;
+      }
+      save = save || command.kind == Command::Kind::Save;
+    }
+
+    // Checked and applied in one batch, which holds the monitors still
+    auto hardware = std::make_shared<HardwareWait>();
+    BrightnessController::BeginUpdate();
+    for (const Command &command : commands)
+      if (error.empty())
+        error = CheckCommand(command);
+    std::vector<Levels> levels = error.empty() ? SaveLevels() : std::vector<Levels>();
+    const std::vector<Monitor> &monitors = BrightnessController::GetMonitors();
+    for (const Command &command : commands)
+    {
+      if (!error.empty())
+        break;
+      size_t first = command.monitor < 0 ? 0 : static_cast<size_t>(command.monitor);
+      size_t last = command.monitor < 0 ? monitors.size() : first + 1;
+      if (command.kind == Command::Kind::Get)
+      {
+        for (size_t i = first; i < last; ++i)
+          reply += DescribeMonitor(static_cast<int>(i)) + "\n";
+        if (command.monitor < 0)
+          reply += std::string("bw ") + FilterWord(filter) + "\n";
+        continue;
+      }
+      if (command.kind != Command::Kind::Set)
+        continue;
+      // With '*', each monitor takes the settings it supports
+      for (size_t i = first; i < last; ++i)
+      {
+        int index = static_cast<int>(i);
+        if ((command.software >= 0 || command.kelvin >= 0) && monitors[i].hasGamma)
+        {
+          levels[i].softwareSet = true;
+          if (!BrightnessController::SetSoftwareLevels(index, command.software, command.kelvin))
+            error = "monitor " + std::to_string(i) + " rejected the change";
+        }
+        if (command.hardware >= 0 &&
+            BrightnessController::GetHardwareProbeState(index) == HardwareProbeState::Available)
+        {
+          levels[i].hardwareSet = true;
+          BrightnessController::SetHardwareBrightness(index, command.hardware, Track(hardware, index));
+        }
+      }
+    }
+    if (!BrightnessController::EndUpdate() && error.empty())
+      error = "gamma write failed";
+
+    // Waiting on the DDC workers and the UI thread are the steps that can
+    // still fail. Neither may happen inside the batch, which the UI thread
+    // may be waiting for.
+    if (error.empty())
+      error = WaitForHardware(*hardware, m_options.hardwareTimeout);
+    if (error.empty() && filterSet)
+      SetFilter(filter, error);
+    if (!error.empty() && !levels.empty())
+      RestoreLevels(levels);
+    else if (error.empty() && save && m_store)
+      StoreLevels(levels, m_store);
+  }
+
+  if (!error.empty())
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stats.errors++;
+    return "err " + error + "\n";
+  }
+  return reply + "ok\n";
+}
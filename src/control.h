@@ -0,0 +1,227 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Local control endpoint: a named pipe on Windows, a Unix domain
+ *        socket elsewhere. The protocol is line based, UTF-8.
+ *
+ * A request is one line of commands separated by ';'. Every command of a
+ * request is checked before any is applied, so a request is a transaction:
+ * it applies as a whole or not at all, and the gamma writes of all its
+ * monitors go out in one flush. A request with hw= waits until every
+ * monitor has taken the value. The B&W filter is set last; if that, a
+ * hardware write or the flush fails, the monitors are put back as they
+ * were. "set *" changes each monitor in the ways it supports. The reply is
+ * zero or more data lines, then "ok" or "err <reason>".
+ *
+ *     get [<monitor>]                      -> monitor <i> sw=<1-100> temp=<K> hw=<0-100|pending|none> name=<device>
+ *                                             ...and "bw on|off" when no monitor is given
+ *     set <monitor|*> [sw=N] [temp=K] [hw=N]
+ *     bw on|off                            -> the B&W filter, which is global
+ *     save                                 -> once the request has applied, saves the levels of
+ *                                             the monitors it set, as the tray's own controls do
+ *     subscribe                            -> "ok", the current state as events, then one
+ *                                             "event ..." line per change until disconnect
+ *
+ * Monitors are numbered as in BrightnessController::GetMonitors. Events are
+ * "event monitor ..." (as for get), "event monitors <count>" when the list
+ * changes, and "event bw on|off".
+ */
+namespace ControlUtils
+{
+  /**
+   * @brief The endpoint the running instance listens on: a per-session pipe
+   *        name on Windows, a socket in $XDG_RUNTIME_DIR (or /tmp) elsewhere.
+   */
+  std::string DefaultEndpoint();
+}
+
+class ControlLink; // One connection, platform specific
+
+/**
+ * @brief Client end of the control protocol, for scripts, the command line
+ *        and tests. Blocking; one request at a time.
+ */
+class ControlClient
+{
+public:
+  ControlClient();
+  ~ControlClient();
+
+  ControlClient(const ControlClient &) = delete;
+  ControlClient &operator=(const ControlClient &) = delete;
+
+  /**
+   * @brief Connects to the server at @p endpoint, waiting up to @p timeout
+   *        for a busy pipe.
+   * @return false if no server is listening there.
+   */
+  bool Connect(const std::string &endpoint, std::chrono::milliseconds timeout = std::chrono::milliseconds(1000));
+
+  bool IsConnected() const { return m_link != nullptr; }
+  void Close();
+
+  /**
+   * @brief Sends @p request and reads the reply.
+   * @param lines Receives the data lines.
+   * @param status Receives the final "ok" or "err <reason>" line.
+   * @return false if the connection failed; the client is then closed.
+   */
+  bool Request(const std::string &request, std::vector<std::string> &lines, std::string &status);
+
+  /**
+   * @brief Reads the next line the server sends, e.g. an event after
+   *        subscribe.
+   * @return false on timeout or when the server closed the connection.
+   */
+  bool ReadLine(std::string &line, std::chrono::milliseconds timeout);
+
+private:
+  std::unique_ptr<ControlLink> m_link;
+  std::string m_buffer; // Received, not yet returned
+};
+
+/**
+ * @brief Serves the control protocol to local clients.
+ *
+ * Each client gets its own thread, and commands act on BrightnessController
+ * directly from it, never through the UI thread. The exception is the B&W
+ * filter, which the platform only lets the UI thread drive: those commands
+ * are handed to the UI invoker and waited for.
+ *
+ * Subscriptions are fed by a publisher thread. BrightnessController's and
+ * BWFilter's change listeners only mark monitors dirty; the publisher waits
+ * Options::eventInterval for a burst (a transition, a transaction) to settle,
+ * then reads each dirty monitor once and queues an event if it differs from
+ * the last one sent. Start, Stop and the filter listener run on the UI
+ * thread.
+ */
+class ControlServer
+{
+public:
+  /**
+   * @brief Queues @p task to run on the UI thread.
+   * @return false if it could not be queued.
+   */
+  using UiInvokeFn = std::function<bool(std::function<void()> task)>;
+
+  /**
+   * @brief Saves one monitor's current levels to the settings.
+   */
+  using StoreFn = std::function<void(int monitorIndex)>;
+
+  struct Options
+  {
+    std::string endpoint = ControlUtils::DefaultEndpoint();
+    size_t maxClients = 32;                          // Connections beyond this are told "err busy" and closed
+    std::chrono::milliseconds eventInterval{20};     // Changes closer together than this make one event
+    std::chrono::milliseconds uiTimeout{2000};       // Longest a command waits for the UI thread
+    std::chrono::milliseconds hardwareTimeout{5000}; // Longest a request waits for its DDC/CI writes
+  };
+
+  struct Stats
+  {
+    uint64_t connections = 0;
+    uint64_t rejected = 0; // Connections turned away at maxClients
+    uint64_t requests = 0;
+    uint64_t commands = 0;
+    uint64_t errors = 0; // Requests answered with "err"
+    uint64_t events = 0; // Event lines published
+  };
+
+  ControlServer();
+  explicit ControlServer(const Options &options);
+  ~ControlServer();
+
+  ControlServer(const ControlServer &) = delete;
+  ControlServer &operator=(const ControlServer &) = delete;
+
+  /**
+   * @brief Without an invoker, filter commands run on the client's thread;
+   *        only right where nothing else drives BWFilter. Set before Start.
+   */
+  void SetUiInvoker(UiInvokeFn invoke);
+
+  /**
+   * @brief Called on the client's thread for each monitor a request with
+   *        "save" set, once it has applied. Without one, "save" does
+   *        nothing. Set before Start.
+   */
+  void SetStoreHandler(StoreFn store);
+
+  /**
+   * @brief Opens the endpoint and starts serving.
+   * @return false if it cannot be opened, e.g. another instance has it.
+   */
+  bool Start();
+
+  /**
+   * @brief Disconnects every client and closes the endpoint. Waits for the
+   *        client threads, so at most Options::uiTimeout.
+   */
+  void Stop();
+
+  bool IsRunning() const { return m_running; }
+  const std::string &GetEndpoint() const { return m_options.endpoint; }
+
+  /**
+   * @brief Runs one request as a client's would be run.
+   * @return The reply lines, each ending in '\n'. subscribe is refused.
+   */
+  std::string Execute(const std::string &request);
+
+  Stats GetStats() const;
+
+private:
+  struct Platform;
+
+  struct Peer
+  {
+    std::unique_ptr<ControlLink> link;
+    std::thread thread;
+    std::atomic<bool> done{false};
+  };
+
+  void Listen();
+  void Serve(Peer &peer);
+  void Stream(ControlLink &link);
+  void Publish();
+  void Reap(bool all);
+  std::vector<std::string> Snapshot();
+  bool SetFilter(bool enabled, std::string &error);
+
+  Options m_options;
+  UiInvokeFn m_invoke;
+  StoreFn m_store;
+  std::unique_ptr<Platform> m_platform;
+  std::atomic<bool> m_running{false};
+  std::thread m_listener;
+  std::thread m_publisher;
+  std::mutex m_applyMutex; // One transaction at a time
+
+  mutable std::mutex m_mutex; // Guards everything below
+  std::condition_variable m_changed; // Dirty monitors, new events or stopping
+  bool m_stopping = false;
+  std::list<std::unique_ptr<Peer>> m_peers;
+  std::set<int> m_dirty;              // Monitors changed since the last publish
+  bool m_listDirty = false;           // The monitor list changed
+  bool m_filterEnabled = false;       // Grayscale as last reported by BWFilter
+  std::deque<std::string> m_events;   // The most recent event lines
+  uint64_t m_eventCount = 0;          // Events ever published; m_events.back() is the last
+  std::vector<std::string> m_published; // Last event sent per monitor (publisher only)
+  bool m_publishedFilter = false;       // (publisher only)
+  Stats m_stats;
+};
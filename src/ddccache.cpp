@@ -0,0 +1,314 @@
+#include "ddccache.h"
+#include "ddcci.h"
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <system_error>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+namespace
+{
+  // ---- File layout ------------------------------------------------------------------
+
+  const char CACHE_MAGIC[4] = {'C', 'D', 'D', 'C'};
+  const uint16_t FORMAT_VERSION = 1;
+
+  // ddccaps.bin: header, then count records.
+  struct CacheHeader
+  {
+    char magic[4];
+    uint16_t version;
+    uint16_t recordSize;
+    uint32_t count;
+    uint32_t checksum; // FNV-1a over the records
+  };
+
+  struct CacheRecord
+  {
+    uint64_t edidHash;
+    char manufacturer[4];
+    uint16_t productCode;
+    uint16_t flags; // RECORD_*
+    uint32_t serialNumber;
+    uint32_t nativeMin;
+    uint32_t nativeMax;
+    uint32_t nativeCurrent;
+    uint32_t latencyUs;
+    uint32_t lastUsed;
+  };
+
+  static_assert(sizeof(CacheHeader) == 16, "cache header layout");
+  static_assert(sizeof(CacheRecord) == 40, "cache record layout");
+
+  const uint16_t RECORD_SUPPORTED = 1 << 0;
+
+  uint32_t Fnv1a(const uint8_t *data, size_t size)
+  {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; ++i)
+    {
+      hash ^= data[i];
+      hash *= 16777619u;
+    }
+    return hash;
+  }
+
+  uint64_t Fnv1a64(const uint8_t *data, size_t size)
+  {
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < size; ++i)
+    {
+      hash ^= data[i];
+      hash *= 1099511628211ull;
+    }
+    return hash;
+  }
+
+  bool SameCapabilities(const DdcCapabilities &a, const DdcCapabilities &b)
+  {
+    return a.edidHash == b.edidHash && a.supported == b.supported && a.nativeMin == b.nativeMin &&
+           a.nativeMax == b.nativeMax && a.nativeCurrent == b.nativeCurrent && a.latencyUs == b.latencyUs;
+  }
+
+  bool ReplaceWith(const std::filesystem::path &from, const std::filesystem::path &to)
+  {
+#ifdef _WIN32
+    // std::filesystem::rename is not guaranteed to replace on every MinGW runtime.
+    return MoveFileExW(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    std::error_code ec;
+    std::filesystem::rename(from, to, ec);
+    return !ec;
+#endif
+  }
+}
+
+bool MonitorIdentity::operator<(const MonitorIdentity &other) const
+{
+  int name = std::memcmp(manufacturer, other.manufacturer, sizeof(manufacturer));
+  if (name != 0)
+    return name < 0;
+  return std::tie(productCode, serialNumber) < std::tie(other.productCode, other.serialNumber);
+}
+
+bool MonitorIdentity::operator==(const MonitorIdentity &other) const
+{
+  return std::memcmp(manufacturer, other.manufacturer, sizeof(manufacturer)) == 0 &&
+         productCode == other.productCode && serialNumber == other.serialNumber;
+}
+
+DdcCapabilityCache::DdcCapabilityCache(std::filesystem::path path)
+    : m_path(std::move(path))
+{
+}
+
+bool DdcCapabilityCache::Identify(const uint8_t *edid, MonitorIdentity &identity, uint64_t &edidHash)
+{
+  DdcCi::EdidInfo info;
+  if (!DdcCi::ParseEdid(edid, info))
+    return false;
+
+  std::memcpy(identity.manufacturer, info.manufacturer, sizeof(identity.manufacturer));
+  identity.productCode = info.productCode;
+  identity.serialNumber = info.serialNumber;
+  edidHash = Fnv1a64(edid, DdcCi::EDID_LENGTH);
+
+  // Many monitors leave the numeric serial at 0 and put the real one in a
+  // serial-string descriptor (0xFF); without it, two identical monitors
+  // would share an entry.
+  if (identity.serialNumber == 0)
+  {
+    for (size_t offset = 54; offset <= 108; offset += 18)
+    {
+      const uint8_t *descriptor = edid + offset;
+      if (descriptor[0] || descriptor[1] || descriptor[2] || descriptor[3] != 0xFF)
+        continue;
+      identity.serialNumber = Fnv1a(descriptor + 5, 13);
+      break;
+    }
+  }
+  return true;
+}
+
+// -----------------------------------------------------------------------------------------------
+// Persistence
+// -----------------------------------------------------------------------------------------------
+
+bool DdcCapabilityCache::Load()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_entries.clear();
+  m_clock = 0;
+  m_dirty = false;
+  if (m_path.empty())
+    return false;
+
+  std::vector<uint8_t> bytes;
+  {
+    std::ifstream in(m_path, std::ios::binary);
+    if (!in)
+      return false;
+    bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  }
+
+  CacheHeader header;
+  if (bytes.size() < sizeof(header))
+    return false;
+  std::memcpy(&header, bytes.data(), sizeof(header));
+  const uint8_t *records = bytes.data() + sizeof(header);
+  size_t recordBytes = bytes.size() - sizeof(header);
+  if (std::memcmp(header.magic, CACHE_MAGIC, 4) != 0 || header.version != FORMAT_VERSION ||
+      header.recordSize != sizeof(CacheRecord) || recordBytes != size_t(header.count) * sizeof(CacheRecord) ||
+      Fnv1a(records, recordBytes) != header.checksum)
+    return false;
+
+  for (uint32_t i = 0; i < header.count; ++i)
+  {
+    CacheRecord record;
+    std::memcpy(&record, records + size_t(i) * sizeof(CacheRecord), sizeof(record));
+
+    MonitorIdentity identity;
+    std::memcpy(identity.manufacturer, record.manufacturer, sizeof(identity.manufacturer));
+    identity.manufacturer[3] = '\0';
+    identity.productCode = record.productCode;
+    identity.serialNumber = record.serialNumber;
+
+    Entry &entry = m_entries[identity];
+    entry.capabilities.edidHash = record.edidHash;
+    entry.capabilities.supported = (record.flags & RECORD_SUPPORTED) != 0;
+    entry.capabilities.nativeMin = record.nativeMin;
+    entry.capabilities.nativeMax = record.nativeMax;
+    entry.capabilities.nativeCurrent = record.nativeCurrent;
+    entry.capabilities.latencyUs = record.latencyUs;
+    entry.lastUsed = record.lastUsed;
+    if (record.lastUsed > m_clock)
+      m_clock = record.lastUsed;
+  }
+  return true;
+}
+
+bool DdcCapabilityCache::Save()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (!m_dirty || m_path.empty())
+    return true;
+
+  std::vector<uint8_t> body;
+  body.reserve(m_entries.size() * sizeof(CacheRecord));
+  for (const auto &pair : m_entries)
+  {
+    const DdcCapabilities &caps = pair.second.capabilities;
+    CacheRecord record = {};
+    record.edidHash = caps.edidHash;
+    std::memcpy(record.manufacturer, pair.first.manufacturer, sizeof(record.manufacturer));
+    record.productCode = pair.first.productCode;
+    record.flags = caps.supported ? RECORD_SUPPORTED : 0;
+    record.serialNumber = pair.first.serialNumber;
+    record.nativeMin = caps.nativeMin;
+    record.nativeMax = caps.nativeMax;
+    record.nativeCurrent = caps.nativeCurrent;
+    record.latencyUs = caps.latencyUs;
+    record.lastUsed = pair.second.lastUsed;
+    const uint8_t *raw = reinterpret_cast<const uint8_t *>(&record);
+    body.insert(body.end(), raw, raw + sizeof(record));
+  }
+
+  CacheHeader header = {};
+  std::memcpy(header.magic, CACHE_MAGIC, 4);
+  header.version = FORMAT_VERSION;
+  header.recordSize = sizeof(CacheRecord);
+  header.count = static_cast<uint32_t>(m_entries.size());
+  header.checksum = Fnv1a(body.data(), body.size());
+
+  // Same swap-in as the settings snapshot: a crash leaves the old file or
+  // the new one, and a torn file fails its checksum and is ignored anyway.
+  std::error_code ec;
+  std::filesystem::create_directories(m_path.parent_path(), ec);
+  std::filesystem::path temp = m_path;
+  temp += ".tmp";
+  {
+    std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char *>(body.data()), static_cast<std::streamsize>(body.size()));
+    if (!out)
+      return false;
+  }
+  if (!ReplaceWith(temp, m_path))
+    return false;
+
+  m_dirty = false;
+  m_stats.saves++;
+  return true;
+}
+
+// -----------------------------------------------------------------------------------------------
+// Entries
+// -----------------------------------------------------------------------------------------------
+
+bool DdcCapabilityCache::Lookup(const MonitorIdentity &identity, uint64_t edidHash, DdcCapabilities &capabilities)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto it = m_entries.find(identity);
+  if (it == m_entries.end())
+  {
+    m_stats.misses++;
+    return false;
+  }
+  if (it->second.capabilities.edidHash != edidHash)
+  {
+    m_entries.erase(it);
+    m_dirty = true;
+    m_stats.invalidated++;
+    m_stats.misses++;
+    return false;
+  }
+  // Recency only decides eviction; it reaches the file with the next change.
+  it->second.lastUsed = ++m_clock;
+  capabilities = it->second.capabilities;
+  m_stats.hits++;
+  return true;
+}
+
+void DdcCapabilityCache::Store(const MonitorIdentity &identity, const DdcCapabilities &capabilities)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  Entry &entry = m_entries[identity];
+  if (entry.lastUsed != 0 && SameCapabilities(entry.capabilities, capabilities))
+    return;
+
+  entry.capabilities = capabilities;
+  entry.lastUsed = ++m_clock;
+  m_dirty = true;
+  m_stats.stored++;
+  EvictLocked();
+}
+
+void DdcCapabilityCache::EvictLocked()
+{
+  while (m_entries.size() > MAX_ENTRIES)
+  {
+    auto oldest = m_entries.begin();
+    for (auto it = m_entries.begin(); it != m_entries.end(); ++it)
+      if (it->second.lastUsed < oldest->second.lastUsed)
+        oldest = it;
+    m_entries.erase(oldest);
+  }
+}
+
+size_t DdcCapabilityCache::Size() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_entries.size();
+}
+
+DdcCapabilityCache::Stats DdcCapabilityCache::GetStats() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_stats;
+}
@@ -0,0 +1,118 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <mutex>
+
+/**
+ * @brief Identifies a monitor by its EDID, independently of the port or
+ *        output it is attached to.
+ */
+struct MonitorIdentity
+{
+  char manufacturer[4] = {}; // Three-letter PNP id, e.g. "DEL"
+  uint16_t productCode = 0;
+  uint32_t serialNumber = 0; // EDID serial, or a hash of the block when the monitor leaves it 0
+
+  bool operator<(const MonitorIdentity &other) const;
+  bool operator==(const MonitorIdentity &other) const;
+};
+
+/**
+ * @brief What a probe found out about a monitor's DDC/CI brightness control.
+ */
+struct DdcCapabilities
+{
+  uint64_t edidHash = 0;  // Hash of the EDID block the monitor was probed with
+  bool supported = false; // false = known bad: no endpoint, or no answer to VCP 0x10
+  uint32_t nativeMin = 0;
+  uint32_t nativeMax = 100;
+  uint32_t nativeCurrent = 0; // Level read by the probe
+  uint32_t latencyUs = 0;     // Round trip of the successful brightness read
+};
+
+/**
+ * @brief Persistent per-monitor DDC/CI capabilities, keyed by EDID identity.
+ *
+ * Lets a monitor that has been probed before skip the slow probe (endpoint
+ * retries, brightness reads with retries) on the next start, display change
+ * or resume. Each entry remembers a hash of the whole EDID block it was
+ * probed with; a lookup with a different block drops the entry, so a
+ * firmware update or a different monitor with the same identity is probed
+ * afresh.
+ *
+ * Saved as one small binary file, rewritten whole via a temporary file and
+ * a rename. Thread-safe.
+ */
+class DdcCapabilityCache
+{
+public:
+  struct Stats
+  {
+    uint64_t hits = 0;        // Lookups answered from the cache
+    uint64_t misses = 0;      // Lookups for a monitor not in the cache
+    uint64_t invalidated = 0; // Entries dropped because the EDID changed
+    uint64_t stored = 0;      // Entries added or changed
+    uint64_t saves = 0;       // Times the file was rewritten
+  };
+
+  /**
+   * @param path File the cache is loaded from and saved to. Empty keeps the
+   *        cache in memory only.
+   */
+  explicit DdcCapabilityCache(std::filesystem::path path = std::filesystem::path());
+
+  /**
+   * @brief Derives a monitor's identity and EDID hash from its base EDID block.
+   * @return false if the block is not a valid EDID.
+   */
+  static bool Identify(const uint8_t *edid, MonitorIdentity &identity, uint64_t &edidHash);
+
+  /**
+   * @brief Replaces the in-memory entries with the file's.
+   * @return false if the file is missing, foreign or corrupt (the cache is
+   *         then empty).
+   */
+  bool Load();
+
+  /**
+   * @brief Writes the entries out if anything changed since the last Load or Save.
+   */
+  bool Save();
+
+  /**
+   * @brief Looks a monitor up. An entry probed with a different EDID block
+   *        is dropped and reported as a miss.
+   */
+  bool Lookup(const MonitorIdentity &identity, uint64_t edidHash, DdcCapabilities &capabilities);
+
+  /**
+   * @brief Adds or replaces a monitor's entry. Storing what is already
+   *        there does not mark the cache as changed.
+   */
+  void Store(const MonitorIdentity &identity, const DdcCapabilities &capabilities);
+
+  size_t Size() const;
+  Stats GetStats() const;
+  const std::filesystem::path &GetPath() const { return m_path; }
+
+  // Entries beyond this are evicted, least recently used first, so a
+  // laptop that meets many projectors does not grow the file forever.
+  static constexpr size_t MAX_ENTRIES = 64;
+
+private:
+  struct Entry
+  {
+    DdcCapabilities capabilities;
+    uint32_t lastUsed = 0; // m_clock when last looked up or stored
+  };
+
+  void EvictLocked();
+
+  std::filesystem::path m_path;
+  mutable std::mutex m_mutex;
+  std::map<MonitorIdentity, Entry> m_entries;
+  uint32_t m_clock = 0;
+  bool m_dirty = false;
+  Stats m_stats;
+};
@@ -0,0 +1,210 @@
+#include "ddcci.h"
+#include <thread>
+
+namespace DdcCi
+{
+  size_t EncodeRequest(const uint8_t *payload, size_t payloadLength, uint8_t *frame)
+  {
+    if (payloadLength > MAX_PAYLOAD)
+      return 0;
+
+    frame[0] = HOST_ADDRESS;
+    frame[1] = static_cast<uint8_t>(0x80 | payloadLength);
+    uint8_t checksum = DISPLAY_WRITE_ADDRESS ^ frame[0] ^ frame[1];
+    for (size_t i = 0; i < payloadLength; ++i)
+    {
+      frame[2 + i] = payload[i];
+      checksum ^= payload[i];
+    }
+    frame[2 + payloadLength] = checksum;
+    return payloadLength + 3;
+  }
+
+  bool DecodeReply(const uint8_t *frame, size_t frameLength, const uint8_t *&payload, size_t &payloadLength)
+  {
+    if (frameLength < 3 || frame[0] != DISPLAY_WRITE_ADDRESS || !(frame[1] & 0x80))
+      return false;
+
+    size_t length = frame[1] & 0x7F;
+    if (length > MAX_PAYLOAD || length + 3 > frameLength)
+      return false;
+
+    uint8_t checksum = REPLY_CHECKSUM_SEED;
+    for (size_t i = 0; i < length + 2; ++i)
+      checksum ^= frame[i];
+    if (checksum != frame[length + 2])
+      return false;
+
+    payload = frame + 2;
+    payloadLength = length;
+    return true;
+  }
+
+  bool IsValidEdid(const uint8_t *edid)
+  {
+    static const uint8_t header[8] = {0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x00};
+    for (size_t i = 0; i < 8; ++i)
+    {
+      if (edid[i] != header[i])
+        return false;
+    }
+    uint8_t sum = 0;
+    for (size_t i = 0; i < EDID_LENGTH; ++i)
+      sum = static_cast<uint8_t>(sum + edid[i]);
+    return sum == 0;
+  }
+
+  bool ParseEdid(const uint8_t *edid, EdidInfo &info)
+  {
+    if (!IsValidEdid(edid))
+      return false;
+
+    // Manufacturer: three 5-bit letters, big-endian, 'A' = 1
+    uint16_t id = static_cast<uint16_t>((edid[8] << 8) | edid[9]);
+    info.manufacturer[0] = static_cast<char>('@' + ((id >> 10) & 0x1F));
+    info.manufacturer[1] = static_cast<char>('@' + ((id >> 5) & 0x1F));
+    info.manufacturer[2] = static_cast<char>('@' + (id & 0x1F));
+    info.manufacturer[3] = '\0';
+
+    info.productCode = static_cast<uint16_t>(edid[10] | (edid[11] << 8));
+    info.serialNumber = static_cast<uint32_t>(edid[12]) | (static_cast<uint32_t>(edid[13]) << 8) |
+                        (static_cast<uint32_t>(edid[14]) << 16) | (static_cast<uint32_t>(edid[15]) << 24);
+
+    // Four 18-byte descriptors; display descriptors start with three zero bytes.
+    info.name[0] = '\0';
+    for (size_t offset = 54; offset <= 108; offset += 18)
+    {
+      const uint8_t *descriptor = edid + offset;
+      if (descriptor[0] || descriptor[1] || descriptor[2] || descriptor[3] != 0xFC)
+        continue;
+      size_t length = 0;
+      while (length < 13 && descriptor[5 + length] != 0x0A)
+      {
+        info.name[length] = static_cast<char>(descriptor[5 + length]);
+        ++length;
+      }
+      // Names shorter than 13 characters are padded with spaces after the newline.
+      while (length > 0 && info.name[length - 1] == ' ')
+        --length;
+      info.name[length] = '\0';
+      break;
+    }
+    return true;
+  }
+}
+
+// -----------------------------------------------------------------------------------------------
+// DdcCiEngine
+// -----------------------------------------------------------------------------------------------
+
+DdcCiEngine::DdcCiEngine(DdcCi::I2cBus &bus, DdcCi::Timing timing)
+    : m_bus(bus), m_timing(timing), m_readyAt(std::chrono::steady_clock::now())
+{
+}
+
+void DdcCiEngine::WaitForBus()
+{
+  auto now = std::chrono::steady_clock::now();
+  if (now < m_readyAt)
+    std::this_thread::sleep_for(m_readyAt - now);
+}
+
+void DdcCiEngine::CommandDone()
+{
+  m_readyAt = std::chrono::steady_clock::now() + m_timing.commandGap;
+}
+
+bool DdcCiEngine::GetVcp(uint8_t code, uint16_t &current, uint16_t &maximum)
+{
+  using namespace DdcCi;
+  std::lock_guard<std::mutex> lock(m_mutex);
+  WaitForBus();
+
+  const uint8_t request[2] = {OP_GET_VCP, code};
+  uint8_t frame[MAX_FRAME];
+  size_t frameLength = EncodeRequest(request, sizeof(request), frame);
+  m_stats.commands++;
+  if (!m_bus.Write(DDC_ADDRESS, frame, frameLength))
+  {
+    m_stats.busErrors++;
+    CommandDone();
+    return false;
+  }
+
+  // The display needs replyDelay to prepare its answer.
+  std::this_thread::sleep_for(m_timing.replyDelay);
+
+  uint8_t reply[GET_VCP_REPLY_LENGTH];
+  bool read = m_bus.Read(DDC_ADDRESS, reply, sizeof(reply));
+  CommandDone();
+  if (!read)
+  {
+    m_stats.busErrors++;
+    return false;
+  }
+
+  const uint8_t *payload = nullptr;
+  size_t payloadLength = 0;
+  if (!DecodeReply(reply, sizeof(reply), payload, payloadLength))
+  {
+    m_stats.badReplies++;
+    return false;
+  }
+  if (payloadLength == 0)
+  {
+    m_stats.nullReplies++;
+    return false;
+  }
+  // Reply payload: opcode, result, VCP code, type, max (hi, lo), current (hi, lo)
+  if (payloadLength != 8 || payload[0] != OP_GET_VCP_REPLY || payload[2] != code)
+  {
+    m_stats.badReplies++;
+    return false;
+  }
+  if (payload[1] != 0)
+  {
+    m_stats.unsupported++;
+    return false;
+  }
+  maximum = static_cast<uint16_t>((payload[4] << 8) | payload[5]);
+  current = static_cast<uint16_t>((payload[6] << 8) | payload[7]);
+  return true;
+}
+
+bool DdcCiEngine::SetVcp(uint8_t code, uint16_t value)
+{
+  using namespace DdcCi;
+  std::lock_guard<std::mutex> lock(m_mutex);
+  WaitForBus();
+
+  const uint8_t request[4] = {OP_SET_VCP, code, static_cast<uint8_t>(value >> 8), static_cast<uint8_t>(value & 0xFF)};
+  uint8_t frame[MAX_FRAME];
+  size_t frameLength = EncodeRequest(request, sizeof(request), frame);
+  m_stats.commands++;
+  bool written = m_bus.Write(DDC_ADDRESS, frame, frameLength);
+  CommandDone();
+  if (!written)
+    m_stats.busErrors++;
+  return written;
+}
+
+bool DdcCiEngine::ReadEdid(uint8_t *edid)
+{
+  using namespace DdcCi;
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  // EDID lives in a plain EEPROM at 0x50; set the offset, then read the block.
+  const uint8_t offset = 0;
+  if (!m_bus.Write(EDID_ADDRESS, &offset, 1) || !m_bus.Read(EDID_ADDRESS, edid, EDID_LENGTH))
+  {
+    m_stats.busErrors++;
+    return false;
+  }
+  return IsValidEdid(edid);
+}
+
+DdcCiEngine::Stats DdcCiEngine::GetStats() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_stats;
+}
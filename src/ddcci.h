@@ -0,0 +1,146 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+/**
+ * @brief DDC/CI and EDID protocol pieces that do not depend on how the I2C
+ *        bus is reached (/dev/i2c-N, an emulated bus, ...).
+ */
+namespace DdcCi
+{
+  constexpr uint8_t DDC_ADDRESS = 0x37;  // 7-bit DDC/CI address (0x6E / 0x6F on the wire)
+  constexpr uint8_t EDID_ADDRESS = 0x50; // 7-bit address of the EDID EEPROM
+  constexpr size_t EDID_LENGTH = 128;    // Base EDID block
+
+  constexpr uint8_t VCP_BRIGHTNESS = 0x10;
+
+  // Opcodes and framing constants from the DDC/CI standard
+  constexpr uint8_t HOST_ADDRESS = 0x51;        // Source address byte of host requests
+  constexpr uint8_t DISPLAY_WRITE_ADDRESS = 0x6E; // 0x37 << 1
+  constexpr uint8_t REPLY_CHECKSUM_SEED = 0x50; // Virtual host address replies are checksummed against
+  constexpr uint8_t OP_GET_VCP = 0x01;
+  constexpr uint8_t OP_GET_VCP_REPLY = 0x02;
+  constexpr uint8_t OP_SET_VCP = 0x03;
+
+  // Longest frame either side sends: address/length, 32 payload bytes, checksum
+  constexpr size_t MAX_PAYLOAD = 32;
+  constexpr size_t MAX_FRAME = MAX_PAYLOAD + 3;
+
+  // A Get VCP reply is source, length, 8 payload bytes and a checksum.
+  constexpr size_t GET_VCP_REPLY_LENGTH = 11;
+
+  /**
+   * @brief Minimum delays the standard requires of the host.
+   */
+  struct Timing
+  {
+    std::chrono::milliseconds replyDelay{40}; // Between a request and reading its reply
+    std::chrono::milliseconds commandGap{50}; // Between the end of one command and the next
+  };
+
+  /**
+   * @brief Raw I2C transport. Each call is one complete transaction at a
+   *        7-bit address. Implementations must not allocate.
+   */
+  class I2cBus
+  {
+  public:
+    virtual ~I2cBus() = default;
+    virtual bool Write(uint8_t address, const uint8_t *data, size_t length) = 0;
+    virtual bool Read(uint8_t address, uint8_t *data, size_t length) = 0;
+  };
+
+  /**
+   * @brief Frames a host request: source address, 0x80 | length, payload,
+   *        checksum over the destination address and every byte before it.
+   * @param frame Output, at least payloadLength + 3 bytes.
+   * @return The frame length, or 0 if the payload is too long.
+   */
+  size_t EncodeRequest(const uint8_t *payload, size_t payloadLength, uint8_t *frame);
+
+  /**
+   * @brief Validates a display reply and locates its payload.
+   * @return false on a bad source byte, length or checksum. A valid null
+   *         message (the display's "busy / cannot answer") decodes with
+   *         payloadLength 0.
+   */
+  bool DecodeReply(const uint8_t *frame, size_t frameLength, const uint8_t *&payload, size_t &payloadLength);
+
+  /**
+   * @brief Device identity decoded from a base EDID block.
+   */
+  struct EdidInfo
+  {
+    char manufacturer[4] = {}; // Three-letter PNP id, e.g. "DEL"
+    uint16_t productCode = 0;
+    uint32_t serialNumber = 0;
+    char name[14] = {}; // Monitor name descriptor (0xFC), if present
+  };
+
+  /**
+   * @brief Checks the fixed header and the block checksum.
+   */
+  bool IsValidEdid(const uint8_t *edid);
+
+  /**
+   * @brief Decodes the identity fields of a valid EDID block.
+   */
+  bool ParseEdid(const uint8_t *edid, EdidInfo &info);
+}
+
+/**
+ * @brief DDC/CI host for one I2C bus.
+ *
+ * Implements Get/Set VCP Feature and the EDID read, and enforces the
+ * standard's delays: a reply is only read replyDelay after its request, and
+ * no command starts sooner than commandGap after the previous one ended.
+ * Each call is a single attempt; retry policy belongs to the caller.
+ *
+ * Get and Set use fixed-size buffers only, so the brightness hot path never
+ * allocates. Calls on one engine are serialised; distinct engines (buses)
+ * run in parallel.
+ */
+class DdcCiEngine
+{
+public:
+  struct Stats
+  {
+    uint64_t commands = 0;       // Requests written to the display
+    uint64_t badReplies = 0;     // Replies that failed framing or checksum
+    uint64_t nullReplies = 0;    // Display answered with the null message
+    uint64_t unsupported = 0;    // Display reported the VCP code as unsupported
+    uint64_t busErrors = 0;      // I2C transactions that were not acknowledged
+  };
+
+  explicit DdcCiEngine(DdcCi::I2cBus &bus, DdcCi::Timing timing = DdcCi::Timing());
+
+  /**
+   * @brief Reads a continuous VCP feature.
+   */
+  bool GetVcp(uint8_t code, uint16_t &current, uint16_t &maximum);
+
+  /**
+   * @brief Writes a continuous VCP feature. DDC/CI has no acknowledgement,
+   *        so true only means the bus accepted the request.
+   */
+  bool SetVcp(uint8_t code, uint16_t value);
+
+  /**
+   * @brief Reads and validates the base EDID block (DdcCi::EDID_LENGTH bytes).
+   */
+  bool ReadEdid(uint8_t *edid);
+
+  Stats GetStats() const;
+
+private:
+  void WaitForBus();  // Called with m_mutex held; sleeps out the command gap
+  void CommandDone(); // Called with m_mutex held
+
+  DdcCi::I2cBus &m_bus;
+  DdcCi::Timing m_timing;
+  mutable std::mutex m_mutex;
+  std::chrono::steady_clock::time_point m_readyAt;
+  Stats m_stats;
+};
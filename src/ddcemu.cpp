@@ -0,0 +1,233 @@
+#include "ddcemu.h"
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+  using namespace DdcCi;
+
+  // Builds a minimal but valid EDID 1.3 base block carrying the identity
+  // fields the backend keys on, plus a monitor name descriptor.
+  void BuildEdid(uint8_t *edid, const char *manufacturer, uint16_t productCode, uint32_t serialNumber,
+                 const char *name)
+  {
+    std::memset(edid, 0, EDID_LENGTH);
+    const uint8_t header[8] = {0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x00};
+    std::memcpy(edid, header, sizeof(header));
+
+    uint16_t id = static_cast<uint16_t>(((manufacturer[0] - '@') & 0x1F) << 10 |
+                                        ((manufacturer[1] - '@') & 0x1F) << 5 |
+                                        ((manufacturer[2] - '@') & 0x1F));
+    edid[8] = static_cast<uint8_t>(id >> 8);
+    edid[9] = static_cast<uint8_t>(id & 0xFF);
+    edid[10] = static_cast<uint8_t>(productCode & 0xFF);
+    edid[11] = static_cast<uint8_t>(productCode >> 8);
+    for (int i = 0; i < 4; ++i)
+      edid[12 + i] = static_cast<uint8_t>(serialNumber >> (8 * i));
+    edid[16] = 1;  // Week of manufacture
+    edid[17] = 34; // Year - 1990
+    edid[18] = 1;  // EDID 1.3
+    edid[19] = 3;
+
+    // First descriptor slot: monitor name, newline-terminated, space-padded
+    uint8_t *descriptor = edid + 54;
+    descriptor[3] = 0xFC;
+    size_t length = std::min<size_t>(std::strlen(name), 13);
+    std::memcpy(descriptor + 5, name, length);
+    if (length < 13)
+    {
+      descriptor[5 + length] = 0x0A;
+      std::memset(descriptor + 6 + length, ' ', 13 - length - 1);
+    }
+
+    uint8_t sum = 0;
+    for (size_t i = 0; i < EDID_LENGTH - 1; ++i)
+      sum = static_cast<uint8_t>(sum + edid[i]);
+    edid[EDID_LENGTH - 1] = static_cast<uint8_t>(0x100 - sum);
+  }
+}
+
+EmulatedDdcBus::EmulatedDdcBus(const char *manufacturer, uint16_t productCode, uint32_t serialNumber,
+                               const char *name, DdcCi::Timing timing)
+    : m_timing(timing)
+{
+  BuildEdid(m_edid.data(), manufacturer, productCode, serialNumber, name);
+  SetFeature(VCP_BRIGHTNESS, 50, 100);
+}
+
+void EmulatedDdcBus::SetFeature(uint8_t code, uint16_t current, uint16_t maximum)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  Feature &feature = m_features[code];
+  feature.defined = true;
+  feature.current = current;
+  feature.maximum = maximum;
+}
+
+uint16_t EmulatedDdcBus::GetFeature(uint8_t code) const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_features[code].current;
+}
+
+void EmulatedDdcBus::CorruptNextReply()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_corruptNext = true;
+}
+
+void EmulatedDdcBus::NullNextReply()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_nullNext = true;
+}
+
+void EmulatedDdcBus::SetDdcEnabled(bool enabled)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_ddcEnabled = enabled;
+}
+
+void EmulatedDdcBus::GetEdid(uint8_t *edid) const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  std::copy(m_edid.begin(), m_edid.end(), edid);
+}
+
+EmulatedDdcBus::Stats EmulatedDdcBus::GetStats() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_stats;
+}
+
+// -----------------------------------------------------------------------------------------------
+// Bus Transactions
+// -----------------------------------------------------------------------------------------------
+
+bool EmulatedDdcBus::Write(uint8_t address, const uint8_t *data, size_t length)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto now = std::chrono::steady_clock::now();
+
+  if (address == EDID_ADDRESS)
+  {
+    if (length < 1)
+      return false;
+    m_edidOffset = data[0];
+    return true;
+  }
+  if (address != DDC_ADDRESS || !m_ddcEnabled)
+    return false; // NAK
+
+  CheckGap(now);
+
+  // Host frames carry source, length, payload and a checksum seeded with
+  // our own write address.
+  size_t payloadLength = length >= 2 ? (data[1] & 0x7F) : 0;
+  uint8_t checksum = DISPLAY_WRITE_ADDRESS;
+  for (size_t i = 0; i + 1 < length; ++i)
+    checksum ^= data[i];
+  if (length < 3 || data[0] != HOST_ADDRESS || !(data[1] & 0x80) || payloadLength + 3 != length ||
+      checksum != data[length - 1])
+  {
+    m_stats.badRequests++;
+    m_lastCommandEnd = now;
+    return true; // The display acknowledges bytes but ignores a bad frame
+  }
+
+  m_stats.requests++;
+  HandleRequest(data + 2, payloadLength, now);
+  return true;
+}
+
+bool EmulatedDdcBus::Read(uint8_t address, uint8_t *data, size_t length)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto now = std::chrono::steady_clock::now();
+
+  if (address == EDID_ADDRESS)
+  {
+    for (size_t i = 0; i < length; ++i)
+      data[i] = m_edid[(m_edidOffset + i) % EDID_LENGTH];
+    m_edidOffset = static_cast<uint8_t>(m_edidOffset + length);
+    m_stats.edidReads++;
+    return true;
+  }
+  if (address != DDC_ADDRESS || !m_ddcEnabled)
+    return false;
+
+  if (m_replyLength && now - m_requestAt < m_timing.replyDelay)
+    m_stats.timingViolations++;
+
+  // Reading with nothing queued returns the null message, as real displays do.
+  if (!m_replyLength)
+    QueueReply(nullptr, 0);
+
+  for (size_t i = 0; i < length; ++i)
+    data[i] = i < m_replyLength ? m_reply[i] : 0;
+  m_replyLength = 0;
+  m_lastCommandEnd = now;
+  m_haveLastCommand = true;
+  return true;
+}
+
+void EmulatedDdcBus::CheckGap(std::chrono::steady_clock::time_point now)
+{
+  if (m_haveLastCommand && now - m_lastCommandEnd < m_timing.commandGap)
+    m_stats.timingViolations++;
+}
+
+void EmulatedDdcBus::HandleRequest(const uint8_t *payload, size_t length, std::chrono::steady_clock::time_point now)
+{
+  m_replyLength = 0;
+  if (length == 2 && payload[0] == OP_GET_VCP)
+  {
+    m_requestAt = now;
+    if (m_nullNext)
+    {
+      m_nullNext = false;
+      QueueReply(nullptr, 0);
+      return;
+    }
+    const Feature &feature = m_features[payload[1]];
+    const uint8_t reply[8] = {OP_GET_VCP_REPLY,
+                              static_cast<uint8_t>(feature.defined ? 0x00 : 0x01),
+                              payload[1],
+                              0x00, // Set parameter type
+                              static_cast<uint8_t>(feature.maximum >> 8),
+                              static_cast<uint8_t>(feature.maximum & 0xFF),
+                              static_cast<uint8_t>(feature.current >> 8),
+                              static_cast<uint8_t>(feature.current & 0xFF)};
+    QueueReply(reply, sizeof(reply));
+    return;
+  }
+
+  if (length == 4 && payload[0] == OP_SET_VCP)
+  {
+    Feature &feature = m_features[payload[1]];
+    if (feature.defined)
+      feature.current = std::min<uint16_t>(static_cast<uint16_t>((payload[2] << 8) | payload[3]), feature.maximum);
+  }
+  // Set VCP has no reply; the command ends with the write.
+  m_lastCommandEnd = now;
+  m_haveLastCommand = true;
+}
+
+void EmulatedDdcBus::QueueReply(const uint8_t *payload, size_t length)
+{
+  m_reply[0] = DISPLAY_WRITE_ADDRESS;
+  m_reply[1] = static_cast<uint8_t>(0x80 | length);
+  uint8_t checksum = REPLY_CHECKSUM_SEED ^ m_reply[0] ^ m_reply[1];
+  for (size_t i = 0; i < length; ++i)
+  {
+    m_reply[2 + i] = payload[i];
+    checksum ^= payload[i];
+  }
+  if (m_corruptNext)
+  {
+    m_corruptNext = false;
+    checksum ^= 0x01;
+  }
+  m_reply[2 + length] = checksum;
+  m_replyLength = length + 3;
+}
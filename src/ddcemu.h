@@ -0,0 +1,104 @@
+#pragma once
+#include "ddcci.h"
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+/**
+ * @brief In-process I2C bus with a DDC/CI monitor on it.
+ *
+ * Plays the display side of the protocol byte for byte: an EDID EEPROM at
+ * 0x50 and a DDC/CI responder at 0x37 that checks request checksums,
+ * answers Get VCP Feature and applies Set VCP Feature. It also watches the
+ * host's timing, so delay violations can be counted. Replies can be
+ * corrupted or swapped for the null message on demand.
+ *
+ * Lets DdcCiEngine and the i2c backend run anywhere, without /dev/i2c-*.
+ * No method allocates. All methods are thread-safe.
+ */
+class EmulatedDdcBus : public DdcCi::I2cBus
+{
+public:
+  struct Stats
+  {
+    uint64_t requests = 0;         // Well-formed DDC/CI requests received
+    uint64_t badRequests = 0;      // Requests with bad framing or checksum
+    uint64_t edidReads = 0;        // EDID block reads
+    uint64_t timingViolations = 0; // Host broke replyDelay or commandGap
+  };
+
+  /**
+   * @param manufacturer Three-letter PNP id written into the EDID.
+   * @param productCode EDID product code.
+   * @param serialNumber EDID serial number.
+   * @param name Monitor name descriptor, up to 13 characters.
+   * @param timing Delays the host is expected to respect.
+   */
+  EmulatedDdcBus(const char *manufacturer, uint16_t productCode, uint32_t serialNumber, const char *name,
+                 DdcCi::Timing timing = DdcCi::Timing());
+
+  /**
+   * @brief Defines (or redefines) a continuous VCP feature.
+   */
+  void SetFeature(uint8_t code, uint16_t current, uint16_t maximum);
+
+  /**
+   * @brief Current value of a VCP feature (0 if undefined).
+   */
+  uint16_t GetFeature(uint8_t code) const;
+
+  /**
+   * @brief Flips a bit in the next reply's checksum.
+   */
+  void CorruptNextReply();
+
+  /**
+   * @brief Answers the next Get VCP request with the null message.
+   */
+  void NullNextReply();
+
+  /**
+   * @brief Makes the DDC/CI address stop (or resume) acknowledging, as on a
+   *        monitor with DDC/CI switched off in its OSD. EDID stays readable.
+   */
+  void SetDdcEnabled(bool enabled);
+
+  /**
+   * @brief Copies the EDID block the bus serves.
+   */
+  void GetEdid(uint8_t *edid) const;
+
+  Stats GetStats() const;
+
+  bool Write(uint8_t address, const uint8_t *data, size_t length) override;
+  bool Read(uint8_t address, uint8_t *data, size_t length) override;
+
+private:
+  struct Feature
+  {
+    bool defined = false;
+    uint16_t current = 0;
+    uint16_t maximum = 0;
+  };
+
+  // Called with m_mutex held
+  void CheckGap(std::chrono::steady_clock::time_point now);
+  void HandleRequest(const uint8_t *payload, size_t length, std::chrono::steady_clock::time_point now);
+  void QueueReply(const uint8_t *payload, size_t length);
+
+  mutable std::mutex m_mutex;
+  DdcCi::Timing m_timing;
+  std::array<uint8_t, DdcCi::EDID_LENGTH> m_edid;
+  uint8_t m_edidOffset = 0;
+  std::array<Feature, 256> m_features;
+  uint8_t m_reply[DdcCi::MAX_FRAME];
+  size_t m_replyLength = 0;
+  bool m_ddcEnabled = true;
+  bool m_corruptNext = false;
+  bool m_nullNext = false;
+  bool m_haveLastCommand = false;
+  std::chrono::steady_clock::time_point m_requestAt;      // Last Get VCP request
+  std::chrono::steady_clock::time_point m_lastCommandEnd; // End of the last transaction at 0x37
+  Stats m_stats;
+};
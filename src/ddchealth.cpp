@@ -0,0 +1,248 @@
+#include "ddchealth.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+namespace
+{
+  // A request may fail for good at most this often at the learned failure rate.
+  constexpr double RESIDUAL_FAILURE = 0.01;
+  constexpr int MIN_ATTEMPTS = 2;
+  constexpr int MAX_ATTEMPTS = 5;
+
+  size_t LatencyBucket(uint32_t latencyUs)
+  {
+    uint32_t ms = latencyUs / 1000;
+    size_t bucket = 0;
+    while (ms > 0 && bucket + 1 < DdcHealth::LATENCY_BUCKETS)
+    {
+      ms >>= 1;
+      ++bucket;
+    }
+    return bucket;
+  }
+
+  // Nearest-rank percentile of an ascending list.
+  uint32_t Percentile(const std::vector<uint32_t> &sorted, double fraction)
+  {
+    if (sorted.empty())
+      return 0;
+    size_t rank = static_cast<size_t>(std::ceil(fraction * sorted.size()));
+    return sorted[std::min(sorted.size(), std::max<size_t>(rank, 1)) - 1];
+  }
+
+  std::chrono::milliseconds Clamp(std::chrono::milliseconds value, std::chrono::milliseconds low,
+                                  std::chrono::milliseconds high)
+  {
+    return std::max(low, std::min(value, high));
+  }
+
+  std::chrono::milliseconds CeilMillis(uint32_t us)
+  {
+    return std::chrono::milliseconds((us + 999) / 1000);
+  }
+}
+
+std::chrono::milliseconds DdcRetryParams::Backoff(int attempt) const
+{
+  int doublings = std::max(0, std::min(attempt - 2, 2));
+  return retryDelay * (1 << doublings);
+}
+
+DdcHealth::DdcHealth()
+    : DdcHealth(Options())
+{
+}
+
+DdcHealth::DdcHealth(const Options &options)
+    : m_options(options),
+      m_coolDown(options.coolDown)
+{
+}
+
+// -----------------------------------------------------------------------------------------------
+// Learning
+// -----------------------------------------------------------------------------------------------
+
+bool DdcHealth::RecordCommand(bool ok, std::chrono::microseconds latency)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  uint32_t latencyUs = static_cast<uint32_t>(std::max<int64_t>(0, std::min<int64_t>(latency.count(), UINT32_MAX)));
+  bool answered = ok;
+  if (ok && latency > ParamsLocked().timeout)
+    ok = false;
+
+  m_window[m_next].latencyUs = latencyUs;
+  m_window[m_next].ok = ok;
+  m_window[m_next].answered = answered;
+  m_next = (m_next + 1) % WINDOW;
+  m_samples = std::min(m_samples + 1, WINDOW);
+  return ok;
+}
+
+DdcRetryParams DdcHealth::ParamsLocked() const
+{
+  if (m_samples < MIN_SAMPLES)
+    return m_options.defaults;
+
+  std::vector<uint32_t> latencies;
+  size_t failures = 0;
+  for (size_t i = 0; i < m_samples; ++i)
+  {
+    // A command that landed late still says how long this monitor takes,
+    // so a monitor that slows down raises its own timeout.
+    if (m_window[i].answered)
+      latencies.push_back(m_window[i].latencyUs);
+    if (!m_window[i].ok)
+      failures++;
+  }
+
+  // Laplace-smoothed, so a clean window still allows one retry and a window
+  // of failures never asks for more than MAX_ATTEMPTS.
+  DdcRetryParams params = m_options.defaults;
+  double failureRate = (failures + 1.0) / (m_samples + 2.0);
+  int attempts = static_cast<int>(std::ceil(std::log(RESIDUAL_FAILURE) / std::log(failureRate)));
+  params.attempts = std::max(MIN_ATTEMPTS, std::min(attempts, MAX_ATTEMPTS));
+
+  // Without a single answer there is no latency to learn from.
+  if (!latencies.empty())
+  {
+    std::sort(latencies.begin(), latencies.end());
+    params.retryDelay = Clamp(CeilMillis(Percentile(latencies, 0.90)), m_options.minDelay, m_options.maxDelay);
+    params.timeout = Clamp(CeilMillis(Percentile(latencies, 0.95)) * 4, m_options.minTimeout, m_options.maxTimeout);
+  }
+  return params;
+}
+
+DdcRetryParams DdcHealth::Params() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  DdcRetryParams params = ParamsLocked();
+  if (m_circuit == DdcCircuit::HalfOpen)
+    params.attempts = 1;
+  return params;
+}
+
+// -----------------------------------------------------------------------------------------------
+// Circuit Breaker
+// -----------------------------------------------------------------------------------------------
+
+void DdcHealth::RecordRequest(bool ok, Clock::time_point now)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (ok)
+  {
+    m_circuit = DdcCircuit::Closed;
+    m_trialOutstanding = false;
+    m_consecutiveFailures = 0;
+    m_coolDown = m_options.coolDown;
+    return;
+  }
+
+  m_consecutiveFailures++;
+  if (m_circuit == DdcCircuit::HalfOpen)
+  {
+    // The trial failed: wait longer before the next one.
+    m_trialOutstanding = false;
+    m_coolDown = std::min(m_coolDown * 2, m_options.maxCoolDown);
+  }
+  else if (m_circuit != DdcCircuit::Closed || m_options.tripAfter <= 0 ||
+           m_consecutiveFailures < m_options.tripAfter)
+  {
+    return;
+  }
+  m_circuit = DdcCircuit::Open;
+  m_retryAt = now + m_coolDown;
+  m_trips++;
+}
+
+bool DdcHealth::Allow(Clock::time_point now)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (m_circuit == DdcCircuit::Open && now >= m_retryAt)
+    m_circuit = DdcCircuit::HalfOpen;
+
+  if (m_circuit == DdcCircuit::Closed)
+    return true;
+  if (m_circuit == DdcCircuit::HalfOpen && !m_trialOutstanding)
+  {
+    m_trialOutstanding = true;
+    return true;
+  }
+  m_rejected++;
+  return false;
+}
+
+DdcHealth::Clock::time_point DdcHealth::RetryAt(Clock::time_point now) const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  // Nobody says when a trial held elsewhere ends; its outcome decides.
+  if (m_circuit == DdcCircuit::HalfOpen && m_trialOutstanding)
+    return now + ParamsLocked().retryDelay;
+  return m_retryAt;
+}
+
+DdcHealth::Snapshot DdcHealth::GetSnapshot(Clock::time_point now) const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  Snapshot snapshot;
+  snapshot.params = ParamsLocked();
+  snapshot.circuit = m_circuit;
+  if (m_circuit == DdcCircuit::Open && now >= m_retryAt)
+    snapshot.circuit = DdcCircuit::HalfOpen;
+  if (snapshot.circuit == DdcCircuit::HalfOpen)
+    snapshot.params.attempts = 1;
+
+  std::vector<uint32_t> latencies;
+  uint32_t failed = 0;
+  for (size_t i = 0; i < m_samples; ++i)
+  {
+    const Sample &sample = m_window[i];
+    size_t bucket = LatencyBucket(sample.latencyUs);
+    if (sample.answered)
+      latencies.push_back(sample.latencyUs);
+    if (sample.ok)
+    {
+      snapshot.successes[bucket]++;
+    }
+    else
+    {
+      snapshot.failures[bucket]++;
+      failed++;
+    }
+  }
+  std::sort(latencies.begin(), latencies.end());
+  snapshot.samples = static_cast<uint32_t>(m_samples);
+  snapshot.failureRate = m_samples ? static_cast<double>(failed) / m_samples : 0.0;
+  snapshot.p50Us = Percentile(latencies, 0.50);
+  snapshot.p90Us = Percentile(latencies, 0.90);
+  snapshot.p95Us = Percentile(latencies, 0.95);
+  snapshot.consecutiveFailures = m_consecutiveFailures;
+  snapshot.trips = m_trips;
+  snapshot.rejected = m_rejected;
+  if (snapshot.circuit == DdcCircuit::Open)
+    snapshot.coolDown = std::chrono::duration_cast<std::chrono::milliseconds>(m_retryAt - now);
+  return snapshot;
+}
+
+namespace DdcHealthUtils
+{
+  std::string Format(const DdcHealth::Snapshot &snapshot)
+  {
+    static const char *const CIRCUITS[] = {"closed", "open", "half-open"};
+    char buffer[192];
+    std::snprintf(buffer, sizeof(buffer),
+                  "%d tries, %lld ms apart, timeout %lld ms; p50 %.1f ms, %.0f%% of %u failed; %s",
+                  snapshot.params.attempts, static_cast<long long>(snapshot.params.retryDelay.count()),
+                  static_cast<long long>(snapshot.params.timeout.count()), snapshot.p50Us / 1000.0,
+                  snapshot.failureRate * 100.0, snapshot.samples, CIRCUITS[static_cast<int>(snapshot.circuit)]);
+    std::string text = buffer;
+    if (snapshot.circuit == DdcCircuit::Open)
+    {
+      std::snprintf(buffer, sizeof(buffer), " for %lld ms", static_cast<long long>(snapshot.coolDown.count()));
+      text += buffer;
+    }
+    return text;
+  }
+}
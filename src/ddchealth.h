@@ -0,0 +1,172 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+/**
+ * @brief How often and how patiently to retry a DDC/CI request.
+ */
+struct DdcRetryParams
+{
+  int attempts = 5;                         // Tries per request, the first included
+  std::chrono::milliseconds retryDelay{50}; // Pause before the second try; doubles for each later one, up to 4x
+  std::chrono::milliseconds timeout{1000};  // A command slower than this counts as failed
+
+  /**
+   * @brief Pause before try number @p attempt (2 or more).
+   */
+  std::chrono::milliseconds Backoff(int attempt) const;
+};
+
+/**
+ * @brief State of a DdcHealth circuit breaker.
+ */
+enum class DdcCircuit
+{
+  Closed,  // Requests go through
+  Open,    // Too many failed requests in a row; refused until the cool-down ends
+  HalfOpen // Cool-down over; one single-attempt trial decides whether to close or reopen
+};
+
+/**
+ * @brief Learned retry policy and circuit breaker for one DDC/CI endpoint.
+ *
+ * Keeps the outcome and latency of the last WINDOW commands and derives the
+ * retry parameters from them:
+ *   - attempts: enough that, at the observed failure rate, a request fails
+ *     for good less than 1% of the time (2 to 5);
+ *   - retryDelay: the 90th percentile latency of commands the monitor
+ *     answered, so a fast monitor is retried quickly and a slow one is given
+ *     room;
+ *   - timeout: four times the 95th percentile. Answers that came after the
+ *     timeout count as failures but still feed the percentiles, so a
+ *     monitor that slows down raises its timeout instead of tripping.
+ * Until MIN_SAMPLES commands have been recorded, Options::defaults apply.
+ *
+ * After Options::tripAfter failed requests in a row the breaker opens and
+ * Allow refuses requests for a cool-down that doubles with every trip that
+ * follows a failed trial. Once it has passed, one trial request is let
+ * through; success closes the breaker again.
+ *
+ * Pure logic and thread-safe: used from DDC workers and probe threads alike.
+ */
+class DdcHealth
+{
+public:
+  using Clock = std::chrono::steady_clock;
+
+  static constexpr size_t WINDOW = 64;          // Commands the model remembers
+  static constexpr size_t MIN_SAMPLES = 8;      // Commands needed before the model overrides the defaults
+  static constexpr size_t LATENCY_BUCKETS = 12; // Bucket 0: under 1 ms; bucket i: [2^(i-1), 2^i) ms; last open-ended
+
+  struct Options
+  {
+    DdcRetryParams defaults;                       // Policy while the model has too few samples
+    std::chrono::milliseconds minDelay{10};        // Bounds for the learned retryDelay
+    std::chrono::milliseconds maxDelay{250};
+    std::chrono::milliseconds minTimeout{100};     // Bounds for the learned timeout
+    std::chrono::milliseconds maxTimeout{2000};
+    int tripAfter = 3;                             // Failed requests in a row that open the breaker; 0 = never
+    std::chrono::milliseconds coolDown{2000};      // First cool-down
+    std::chrono::milliseconds maxCoolDown{60000};  // Upper bound as failed trials double it
+  };
+
+  /**
+   * @brief What the model has learned, for diagnostics.
+   */
+  struct Snapshot
+  {
+    DdcRetryParams params;
+    DdcCircuit circuit = DdcCircuit::Closed;
+    uint32_t successes[LATENCY_BUCKETS] = {}; // Commands in the window that succeeded, by latency
+    uint32_t failures[LATENCY_BUCKETS] = {};  // ...that failed or timed out, by latency
+    uint32_t samples = 0;                     // Commands in the window
+    double failureRate = 0.0;                 // Failed share of the window
+    uint32_t p50Us = 0;                       // Latency percentiles of answered commands
+    uint32_t p90Us = 0;
+    uint32_t p95Us = 0;
+    int consecutiveFailures = 0;            // Failed requests in a row
+    uint64_t trips = 0;                     // Times the breaker has opened
+    uint64_t rejected = 0;                  // Requests refused while open
+    std::chrono::milliseconds coolDown{0};  // Left before the next trial, while open
+  };
+
+  DdcHealth();
+  explicit DdcHealth(const Options &options);
+
+  DdcHealth(const DdcHealth &) = delete;
+  DdcHealth &operator=(const DdcHealth &) = delete;
+
+  /**
+   * @brief Records one command. A command slower than the current timeout
+   *        is recorded as failed even if the monitor accepted it.
+   * @return false if the command counts as failed.
+   */
+  bool RecordCommand(bool ok, std::chrono::microseconds latency);
+
+  /**
+   * @brief Records the outcome of a whole request, retries included. Feeds
+   *        the circuit breaker; a request that was abandoned (superseded,
+   *        cancelled) should not be recorded.
+   */
+  void RecordRequest(bool ok, Clock::time_point now = Clock::now());
+
+  /**
+   * @brief Whether a request may be issued now. Counts a refusal; while
+   *        half-open, grants the single trial and refuses everything else
+   *        until it has been recorded.
+   */
+  bool Allow(Clock::time_point now = Clock::now());
+
+  /**
+   * @brief When a refused request should ask Allow again: the end of the
+   *        cool-down while open. While another caller holds the half-open
+   *        trial, one retry delay from @p now, by which time its single
+   *        command has usually been recorded. In the past once Allow would
+   *        let a request through.
+   */
+  Clock::time_point RetryAt(Clock::time_point now = Clock::now()) const;
+
+  /**
+   * @brief The parameters for the next request; a single attempt for the
+   *        half-open trial.
+   */
+  DdcRetryParams Params() const;
+
+  Snapshot GetSnapshot(Clock::time_point now = Clock::now()) const;
+
+private:
+  struct Sample
+  {
+    uint32_t latencyUs = 0;
+    bool ok = false;       // Answered within the timeout
+    bool answered = false; // The monitor accepted it, however late
+  };
+
+  DdcRetryParams ParamsLocked() const; // Called with m_mutex held
+
+  Options m_options;
+  mutable std::mutex m_mutex;
+  Sample m_window[WINDOW];
+  size_t m_next = 0;    // Slot the next sample goes into
+  size_t m_samples = 0; // Filled slots, up to WINDOW
+
+  DdcCircuit m_circuit = DdcCircuit::Closed;
+  bool m_trialOutstanding = false;
+  int m_consecutiveFailures = 0;
+  std::chrono::milliseconds m_coolDown;
+  Clock::time_point m_retryAt;
+  uint64_t m_trips = 0;
+  uint64_t m_rejected = 0;
+};
+
+namespace DdcHealthUtils
+{
+  /**
+   * @brief One-line summary of a snapshot for logs, e.g. "3 tries, 20 ms
+   *        apart, timeout 180 ms; p50 9 ms, 2% failed; closed".
+   */
+  std::string Format(const DdcHealth::Snapshot &snapshot);
+}
@@ -0,0 +1,109 @@
+#include "ddcsim.h"
+#include <algorithm>
+#include <thread>
+
+SimulatedDdcMonitor::SimulatedDdcMonitor(uint32_t nativeMin, uint32_t nativeMax, std::chrono::milliseconds latency)
+    : m_min(nativeMin),
+      m_max(std::max(nativeMin, nativeMax)),
+      m_current(nativeMin + (std::max(nativeMin, nativeMax) - nativeMin) / 2),
+      m_latency(latency)
+{
+}
+
+void SimulatedDdcMonitor::SetFailEvery(int n)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_failEvery = std::max(0, n);
+  m_sinceFailure = 0;
+}
+
+void SimulatedDdcMonitor::FailNext(int n)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_failNext = std::max(0, n);
+}
+
+void SimulatedDdcMonitor::SetLatency(std::chrono::milliseconds latency)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_latency = latency;
+}
+
+bool SimulatedDdcMonitor::ShouldFail()
+{
+  m_commands++;
+  if (m_failNext > 0)
+  {
+    m_failNext--;
+    return true;
+  }
+  if (m_failEvery > 0 && ++m_sinceFailure >= static_cast<uint64_t>(m_failEvery))
+  {
+    m_sinceFailure = 0;
+    return true;
+  }
+  return false;
+}
+
+bool SimulatedDdcMonitor::SetBrightness(uint32_t nativeValue)
+{
+  std::chrono::milliseconds latency;
+  bool fail;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    latency = m_latency;
+    fail = ShouldFail();
+  }
+
+  // Sleep outside the lock: a real bus transaction does not stop the caller
+  // from querying counters on another thread.
+  std::this_thread::sleep_for(latency);
+
+  if (fail)
+    return false;
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_current = std::max(m_min, std::min(nativeValue, m_max));
+  m_acceptedWrites++;
+  return true;
+}
+
+bool SimulatedDdcMonitor::GetBrightness(uint32_t &minValue, uint32_t &currentValue, uint32_t &maxValue)
+{
+  std::chrono::milliseconds latency;
+  bool fail;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    latency = m_latency;
+    fail = ShouldFail();
+  }
+
+  std::this_thread::sleep_for(latency);
+
+  if (fail)
+    return false;
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  minValue = m_min;
+  currentValue = m_current;
+  maxValue = m_max;
+  return true;
+}
+
+uint32_t SimulatedDdcMonitor::GetCurrent() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_current;
+}
+
+uint64_t SimulatedDdcMonitor::GetAcceptedWrites() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_acceptedWrites;
+}
+
+uint64_t SimulatedDdcMonitor::GetCommandCount() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_commands;
+}
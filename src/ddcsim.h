@@ -0,0 +1,84 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+/**
+ * @brief In-memory stand-in for a DDC/CI capable monitor.
+ *
+ * Models the two properties of real DDC/CI hardware that matter to the
+ * brightness code: every command takes a noticeable amount of time, and some
+ * commands are rejected and have to be retried. Used to exercise DdcWorker
+ * (and anything built on it) on machines without a DDC bus, e.g. Linux CI.
+ *
+ * All methods are thread-safe.
+ */
+class SimulatedDdcMonitor
+{
+public:
+  /**
+   * @param nativeMin Minimum value reported by the VCP brightness feature.
+   * @param nativeMax Maximum value reported by the VCP brightness feature.
+   * @param latency Time each command blocks the caller.
+   */
+  explicit SimulatedDdcMonitor(uint32_t nativeMin = 0,
+                               uint32_t nativeMax = 100,
+                               std::chrono::milliseconds latency = std::chrono::milliseconds(40));
+
+  /**
+   * @brief Rejects every Nth command (1 = all, 0 = none). Counting restarts
+   *        each time the pattern is changed.
+   */
+  void SetFailEvery(int n);
+
+  /**
+   * @brief Rejects the next @p n commands, then behaves normally.
+   */
+  void FailNext(int n);
+
+  /**
+   * @brief Changes the per-command latency.
+   */
+  void SetLatency(std::chrono::milliseconds latency);
+
+  /**
+   * @brief Equivalent of SetMonitorBrightness.
+   * @return true if the simulated monitor accepted the value.
+   */
+  bool SetBrightness(uint32_t nativeValue);
+
+  /**
+   * @brief Equivalent of GetMonitorBrightness.
+   * @return true if the simulated monitor answered.
+   */
+  bool GetBrightness(uint32_t &minValue, uint32_t &currentValue, uint32_t &maxValue);
+
+  /**
+   * @brief Value most recently accepted by SetBrightness.
+   */
+  uint32_t GetCurrent() const;
+
+  /**
+   * @brief Number of SetBrightness calls that were accepted.
+   */
+  uint64_t GetAcceptedWrites() const;
+
+  /**
+   * @brief Total number of commands issued, accepted or not.
+   */
+  uint64_t GetCommandCount() const;
+
+private:
+  bool ShouldFail(); // Called with m_mutex held
+
+  mutable std::mutex m_mutex;
+  uint32_t m_min;
+  uint32_t m_max;
+  uint32_t m_current;
+  std::chrono::milliseconds m_latency;
+  int m_failEvery = 0;
+  int m_failNext = 0;
+  uint64_t m_sinceFailure = 0;
+  uint64_t m_acceptedWrites = 0;
+  uint64_t m_commands = 0;
+};
@@ -0,0 +1,219 @@
+#include "ddcworker.h"
+#include "ddchealth.h"
+#include "trace.h"
+#include <utility>
+
+DdcWorker::DdcWorker(WriteFn write, int maxAttempts, std::chrono::milliseconds retryDelay)
+    : m_write(std::move(write)),
+      m_maxAttempts(maxAttempts < 1 ? 1 : maxAttempts),
+      m_retryDelay(retryDelay)
+{
+  m_thread = std::thread(&DdcWorker::Run, this);
+}
+
+DdcWorker::DdcWorker(WriteFn write, std::shared_ptr<DdcHealth> health)
+    : m_write(std::move(write)),
+      m_maxAttempts(1),
+      m_health(std::move(health))
+{
+  m_thread = std::thread(&DdcWorker::Run, this);
+}
+
+DdcWorker::~DdcWorker()
+{
+  Stop();
+}
+
+void DdcWorker::Post(int brightness, uint32_t nativeValue, CompletionFn onComplete)
+{
+  Request dropped;
+  DdcResult droppedResult = DdcResult::Superseded;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_stopping)
+    {
+      // Posted after Stop(): nothing will ever write it.
+      dropped.brightness = brightness;
+      dropped.onComplete = std::move(onComplete);
+      droppedResult = DdcResult::Cancelled;
+    }
+    else
+    {
+      if (m_hasPending)
+      {
+        dropped = std::move(m_pending);
+        m_stats.superseded++;
+      }
+      m_pending.brightness = brightness;
+      m_pending.nativeValue = nativeValue;
+      m_pending.onComplete = std::move(onComplete);
+      m_hasPending = true;
+      m_stats.posted++;
+    }
+  }
+  m_cv.notify_all();
+
+  // Callbacks run outside the lock so they may post again without deadlocking.
+  if (dropped.onComplete)
+    dropped.onComplete(dropped.brightness, droppedResult);
+}
+
+void DdcWorker::Flush()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_cv.wait(lock, [this]
+            { return m_stopping || (!m_hasPending && !m_busy); });
+}
+
+void DdcWorker::Stop()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stopping = true;
+  }
+  m_cv.notify_all();
+  if (m_thread.joinable())
+    m_thread.join();
+}
+
+DdcWorker::Stats DdcWorker::GetStats() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_stats;
+}
+
+void DdcWorker::Run()
+{
+  Trace::SetThreadName("ddc worker");
+  std::unique_lock<std::mutex> lock(m_mutex);
+  for (;;)
+  {
+    if (m_hasDeferred)
+    {
+      // Hold the refused value until the breaker lets a trial through; a
+      // newer value makes it moot. Another thread may hold the trial, in
+      // which case RetryAt keeps moving until its outcome is recorded.
+      for (;;)
+      {
+        DdcHealth::Clock::time_point retryAt = m_health->RetryAt();
+        if (m_stopping || m_hasPending || DdcHealth::Clock::now() >= retryAt)
+          break;
+        m_cv.wait_until(lock, retryAt, [this]
+                        { return m_stopping || m_hasPending; });
+      }
+      if (!m_stopping && !m_hasPending)
+      {
+        m_pending = std::move(m_deferred);
+        m_hasPending = true;
+      }
+      m_hasDeferred = false;
+    }
+
+    m_cv.wait(lock, [this]
+              { return m_stopping || m_hasPending; });
+
+    if (m_stopping)
+    {
+      if (m_hasPending)
+      {
+        Request cancelled = std::move(m_pending);
+        m_hasPending = false;
+        lock.unlock();
+        if (cancelled.onComplete)
+          cancelled.onComplete(cancelled.brightness, DdcResult::Cancelled);
+        lock.lock();
+      }
+      m_cv.notify_all();
+      return;
+    }
+
+    Request request = std::move(m_pending);
+    m_hasPending = false;
+    m_busy = true;
+
+    DdcResult result = DdcResult::Failed;
+    if (m_health && !m_health->Allow())
+    {
+      // The monitor keeps failing: answer at once instead of stalling the
+      // caller on retries, and keep the value for the breaker's trial.
+      m_stats.rejected++;
+      m_deferred.brightness = request.brightness;
+      m_deferred.nativeValue = request.nativeValue;
+      m_hasDeferred = true;
+    }
+    else
+    {
+      result = Write(lock, request);
+      if (result == DdcResult::Applied)
+        m_stats.applied++;
+      else if (result == DdcResult::Failed)
+        m_stats.failed++;
+      else if (result == DdcResult::Superseded)
+        m_stats.superseded++;
+    }
+
+    lock.unlock();
+    if (request.onComplete)
+      request.onComplete(request.brightness, result);
+    lock.lock();
+
+    m_busy = false;
+    m_cv.notify_all();
+  }
+}
+
+DdcResult DdcWorker::Write(std::unique_lock<std::mutex> &lock, const Request &request)
+{
+  DdcRetryParams params;
+  if (m_health)
+    params = m_health->Params();
+  else
+  {
+    params.attempts = m_maxAttempts;
+    params.retryDelay = m_retryDelay;
+  }
+
+  DdcResult result = DdcResult::Failed;
+  for (int attempt = 1; attempt <= params.attempts; ++attempt)
+  {
+    m_stats.attempts++;
+    lock.unlock();
+    auto start = std::chrono::steady_clock::now();
+    bool ok = m_write(request.nativeValue);
+    // A write slower than the learned timeout counts as failed even if it
+    // landed: the monitor is struggling, and repeating the value is harmless.
+    if (m_health)
+      ok = m_health->RecordCommand(ok, std::chrono::duration_cast<std::chrono::microseconds>(
+                                           std::chrono::steady_clock::now() - start));
+    lock.lock();
+
+    if (ok)
+    {
+      result = DdcResult::Applied;
+      break;
+    }
+    if (attempt == params.attempts)
+      break;
+
+    // Sleep between attempts, but give up on this value as soon as a newer
+    // one arrives: retrying a stale target only delays the one that matters.
+    std::chrono::milliseconds delay = m_health ? params.Backoff(attempt + 1) : params.retryDelay;
+    m_cv.wait_for(lock, delay, [this]
+                  { return m_stopping || m_hasPending; });
+    if (m_stopping)
+    {
+      result = DdcResult::Cancelled;
+      break;
+    }
+    if (m_hasPending)
+    {
+      result = DdcResult::Superseded;
+      break;
+    }
+  }
+
+  // Only finished requests say anything about the monitor.
+  if (m_health && (result == DdcResult::Applied || result == DdcResult::Failed))
+    m_health->RecordRequest(result == DdcResult::Applied);
+  return result;
+}
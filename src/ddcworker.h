@@ -0,0 +1,150 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+class DdcHealth;
+
+/**
+ * @brief Outcome of a queued DDC/CI brightness request.
+ */
+enum class DdcResult
+{
+  Applied,    // The value reached the monitor
+  Failed,     // Every attempt was rejected by the monitor / driver
+  Superseded, // A newer value was posted before this one reached the bus
+  Cancelled   // The worker was stopped before the value was written
+};
+
+/**
+ * @brief Background DDC/CI writer for a single physical monitor.
+ *
+ * Owns one thread and a single-slot "latest value wins" mailbox. Posting a
+ * new target replaces any target that has not reached the bus yet, so a
+ * slider drag produces at most one in-flight write plus one pending write no
+ * matter how many WM_HSCROLL ticks arrive. The retry loop that used to run on
+ * the UI thread lives here, and is abandoned early if a newer value arrives.
+ *
+ * The worker only knows about native (monitor-range) values and a write
+ * callback, so it has no OS dependencies and can be driven by a simulated
+ * device (see ddcsim.h).
+ *
+ * Given a DdcHealth, the retry policy is the one it has learned for the
+ * monitor, and every attempt is fed back into it; an attempt slower than its
+ * timeout counts as failed. While its circuit breaker is open, requests fail
+ * at once without touching the bus; the last refused value is kept and
+ * written as the breaker's trial once the cool-down ends, unless a newer
+ * value is posted first.
+ */
+class DdcWorker
+{
+public:
+  /**
+   * @brief Performs a single write attempt of a native brightness value.
+   * @return true if the monitor accepted the value.
+   */
+  using WriteFn = std::function<bool(uint32_t nativeValue)>;
+
+  /**
+   * @brief Reports the fate of a posted request. Runs on the worker thread,
+   *        or on the posting thread for requests superseded inside Post().
+   * @param brightness The normalised (0-100) value that was posted.
+   * @param result What happened to it.
+   */
+  using CompletionFn = std::function<void(int brightness, DdcResult result)>;
+
+  /**
+   * @brief Counters describing how much traffic the mailbox absorbed.
+   */
+  struct Stats
+  {
+    uint64_t posted = 0;     // Requests handed to Post()
+    uint64_t superseded = 0; // Requests replaced before reaching the bus
+    uint64_t applied = 0;    // Requests the monitor accepted
+    uint64_t failed = 0;     // Requests that exhausted every attempt
+    uint64_t rejected = 0;   // Requests refused while the circuit breaker was open
+    uint64_t attempts = 0;   // Individual write calls issued
+  };
+
+  /**
+   * @brief Starts the worker thread.
+   * @param write Callback that performs one write attempt.
+   * @param maxAttempts Number of attempts before a request is reported failed.
+   * @param retryDelay Pause between attempts.
+   */
+  explicit DdcWorker(WriteFn write,
+                     int maxAttempts = 5,
+                     std::chrono::milliseconds retryDelay = std::chrono::milliseconds(50));
+
+  /**
+   * @brief Starts the worker thread with a learned retry policy.
+   * @param write Callback that performs one write attempt.
+   * @param health The monitor's latency/failure model and circuit breaker,
+   *        possibly shared with readers of the same monitor.
+   */
+  DdcWorker(WriteFn write, std::shared_ptr<DdcHealth> health);
+
+  /**
+   * @brief Stops the worker; any pending request is reported as Cancelled.
+   */
+  ~DdcWorker();
+
+  DdcWorker(const DdcWorker &) = delete;
+  DdcWorker &operator=(const DdcWorker &) = delete;
+
+  /**
+   * @brief Queues a new target, replacing any target not yet written.
+   * @param brightness Normalised brightness (0-100), echoed to the callback.
+   * @param nativeValue Value in the monitor's native DDC/CI range.
+   * @param onComplete Optional completion callback.
+   */
+  void Post(int brightness, uint32_t nativeValue, CompletionFn onComplete = nullptr);
+
+  /**
+   * @brief Blocks until the mailbox is empty and no write is in progress.
+   *        A value held back by an open circuit breaker is not waited for.
+   */
+  void Flush();
+
+  /**
+   * @brief Stops and joins the worker thread. Safe to call more than once.
+   *        Must be called before the underlying monitor handle is released.
+   */
+  void Stop();
+
+  /**
+   * @brief Returns a snapshot of the worker's counters.
+   */
+  Stats GetStats() const;
+
+private:
+  struct Request
+  {
+    int brightness = 0;
+    uint32_t nativeValue = 0;
+    CompletionFn onComplete;
+  };
+
+  void Run();
+  DdcResult Write(std::unique_lock<std::mutex> &lock, const Request &request);
+
+  WriteFn m_write;
+  int m_maxAttempts;
+  std::chrono::milliseconds m_retryDelay;
+  std::shared_ptr<DdcHealth> m_health;
+
+  mutable std::mutex m_mutex;
+  std::condition_variable m_cv;
+  Request m_pending;
+  bool m_hasPending = false;
+  Request m_deferred; // Refused by the open breaker; written as its trial
+  bool m_hasDeferred = false;
+  bool m_busy = false;
+  bool m_stopping = false;
+  Stats m_stats;
+  std::thread m_thread;
+};
@@ -0,0 +1,61 @@
+#include "devicename.h"
+
+namespace DeviceNameUtils
+{
+
+  std::wstring Escape(const std::wstring &deviceName)
+  {
+    std::wstring sanitized;
+    sanitized.reserve(deviceName.length() + 8);
+    for (wchar_t c : deviceName)
+    {
+      if (c == L'\\')
+      {
+        sanitized += L"##";
+      }
+      else if (c == L'#')
+      {
+        sanitized += L"#0";
+      }
+      else
+      {
+        sanitized += c;
+      }
+    }
+    return sanitized;
+  }
+
+  std::wstring Unescape(const std::wstring &escaped)
+  {
+    std::wstring realName;
+    realName.reserve(escaped.length());
+
+    for (size_t i = 0; i < escaped.length(); ++i)
+    {
+      if (escaped[i] != L'#')
+      {
+        realName += escaped[i];
+        continue;
+      }
+
+      wchar_t next = i + 1 < escaped.length() ? escaped[i + 1] : L'\0';
+      if (next == L'#')
+      {
+        realName += L'\\';
+        i++;
+      }
+      else if (next == L'0')
+      {
+        realName += L'#';
+        i++;
+      }
+      else
+      {
+        // Legacy: a single (or trailing) # stood for a backslash
+        realName += L'\\';
+      }
+    }
+    return realName;
+  }
+
+} // namespace DeviceNameUtils
@@ -0,0 +1,15 @@
+#pragma once
+#include <string>
+
+/**
+ * @brief Escaping of display device names (e.g. "\\.\DISPLAY1") for use as
+ *        registry key names, which cannot contain backslashes.
+ *
+ * A backslash becomes "##" and a literal '#' becomes "#0". Unescape also
+ * accepts the older scheme, where a single '#' stood for a backslash.
+ */
+namespace DeviceNameUtils
+{
+  std::wstring Escape(const std::wstring &deviceName);
+  std::wstring Unescape(const std::wstring &escaped);
+}
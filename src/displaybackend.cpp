@@ -0,0 +1,21 @@
+#include "displaybackend.h"
+#include <mutex>
+#include <utility>
+
+namespace
+{
+  std::mutex g_backendMutex;
+  std::shared_ptr<DisplayBackend> g_backend;
+}
+
+void SetDisplayBackend(std::shared_ptr<DisplayBackend> backend)
+{
+  std::lock_guard<std::mutex> lock(g_backendMutex);
+  g_backend = std::move(backend);
+}
+
+std::shared_ptr<DisplayBackend> GetDisplayBackend()
+{
+  std::lock_guard<std::mutex> lock(g_backendMutex);
+  return g_backend;
+}
@@ -0,0 +1,186 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Backend-defined identifier for a logical display (an HMONITOR on
+ *        Windows). Only meaningful to the backend that returned it.
+ */
+using OutputHandle = uintptr_t;
+
+/**
+ * @brief Backend-defined identifier for a DDC/CI endpoint (a physical monitor
+ *        handle on Windows). 0 means "no endpoint".
+ */
+using DdcHandle = uintptr_t;
+
+/**
+ * @brief One entry from the fast enumeration pass.
+ */
+struct DisplayOutput
+{
+  OutputHandle handle = 0;
+  std::wstring deviceName; // Stable name, used as the key for persisted settings
+};
+
+/**
+ * @brief 5x5 colour transform in the Magnification API layout: row i holds
+ *        the contribution of input channel i (R, G, B, A, constant) to each
+ *        output channel.
+ */
+struct ColorMatrix
+{
+  float m[5][5];
+};
+
+/**
+ * @brief Everything Candela needs from the platform's display stack.
+ *
+ * BrightnessController and BWFilter talk to displays exclusively through this
+ * interface, so the brightness logic has no OS dependencies and can run
+ * against FakeDisplayBackend on any host. Implementations own every OS
+ * resource behind the handles they return.
+ *
+ * Threading: OpenOutput, GetEdid, GetGammaSize, GetGammaRamp and the DDC
+ * calls may be invoked concurrently for *different* outputs / endpoints
+ * (monitor probing and DDC workers run on their own threads). The DDC calls
+ * may also overlap gamma writes to the same output, since hardware probing
+ * continues in the background after gamma has been restored.
+ *
+ * SetGammaRamp and FlushGamma are always called with BrightnessController's
+ * state lock held, so they never overlap each other, but they come from
+ * several threads: the UI thread, the transition thread, control endpoint
+ * clients, and the hardware probe when it publishes its results.
+ * EnumerateOutputs is called under the same lock. The colour effect calls
+ * come from the UI thread only.
+ */
+class DisplayBackend
+{
+public:
+  virtual ~DisplayBackend() = default;
+
+  // ---- Enumeration ------------------------------------------------------------------
+
+  /**
+   * @brief Lists the connected displays. Must be cheap: no DDC traffic, no
+   *        device contexts. Resources are acquired later by OpenOutput.
+   */
+  virtual std::vector<DisplayOutput> EnumerateOutputs() = 0;
+
+  /**
+   * @brief Acquires whatever the output needs for gamma access.
+   * @return true if gamma ramps can be read and written for this output.
+   */
+  virtual bool OpenOutput(OutputHandle output) = 0;
+
+  /**
+   * @brief Releases everything acquired by OpenOutput.
+   */
+  virtual void CloseOutput(OutputHandle output) = 0;
+
+  /**
+   * @brief Copies the output's base EDID block (128 bytes), used to identify
+   *        the monitor behind it.
+   * @return false if the platform does not expose it for this output.
+   */
+  virtual bool GetEdid(OutputHandle output, uint8_t *edid) = 0;
+
+  /**
+   * @brief The output's current refresh rate in Hz, used to pace transitions.
+   * @return 0 if the platform does not report it.
+   */
+  virtual int GetRefreshRate(OutputHandle output) = 0;
+
+  // ---- Gamma ------------------------------------------------------------------------
+
+  /**
+   * @brief Entries per channel in the output's ramp, as the hardware reports
+   *        it. Only valid after a successful OpenOutput.
+   */
+  virtual int GetGammaSize(OutputHandle output) = 0;
+
+  /**
+   * @brief Reads the output's current ramp (GetGammaSize words per channel,
+   *        R then G then B).
+   */
+  virtual bool GetGammaRamp(OutputHandle output, uint16_t *ramp) = 0;
+
+  /**
+   * @brief Writes a ramp in the same layout as GetGammaRamp. Backends may
+   *        queue the write until FlushGamma, so several outputs can be
+   *        updated in one round trip.
+   * @return false if the write was rejected up front.
+   */
+  virtual bool SetGammaRamp(OutputHandle output, const uint16_t *ramp) = 0;
+
+  /**
+   * @brief Pushes every queued SetGammaRamp to the display and waits for it
+   *        to be accepted.
+   * @return false if any queued write failed.
+   */
+  virtual bool FlushGamma() = 0;
+
+  // ---- DDC/CI -----------------------------------------------------------------------
+
+  /**
+   * @brief Number of DDC/CI endpoints (physical monitors) behind the output.
+   *        More than one for cloned or daisy-chained displays. 0 means the
+   *        output has no DDC/CI path at all and OpenDdc need not be retried.
+   */
+  virtual int CountDdcEndpoints(OutputHandle output) = 0;
+
+  /**
+   * @brief Opens every DDC/CI endpoint behind the output, in the order the
+   *        platform lists them. A single attempt; callers own the retry
+   *        policy. Endpoints the platform has not handed out yet (a null
+   *        physical monitor handle right after a mode change) are left out.
+   * @return The endpoints; empty if none is available (yet).
+   */
+  virtual std::vector<DdcHandle> OpenDdc(OutputHandle output) = 0;
+
+  /**
+   * @brief Releases an endpoint returned by OpenDdc.
+   */
+  virtual void CloseDdc(DdcHandle ddc) = 0;
+
+  /**
+   * @brief Reads the VCP brightness feature in the monitor's native range.
+   */
+  virtual bool GetDdcBrightness(DdcHandle ddc, uint32_t &minValue, uint32_t &currentValue, uint32_t &maxValue) = 0;
+
+  /**
+   * @brief Writes the VCP brightness feature (native range).
+   */
+  virtual bool SetDdcBrightness(DdcHandle ddc, uint32_t value) = 0;
+
+  // ---- Colour matrix ----------------------------------------------------------------
+
+  /**
+   * @brief Prepares the system-wide colour matrix facility. Safe to call more
+   *        than once.
+   */
+  virtual bool InitColorEffects() = 0;
+
+  /**
+   * @brief Restores the identity matrix and releases the facility.
+   */
+  virtual void ShutdownColorEffects() = 0;
+
+  /**
+   * @brief Applies a colour matrix to the whole desktop.
+   */
+  virtual bool SetColorMatrix(const ColorMatrix &matrix) = 0;
+};
+
+/**
+ * @brief Installs the backend used by BrightnessController and BWFilter.
+ *        Call once at startup, before either is initialised.
+ */
+void SetDisplayBackend(std::shared_ptr<DisplayBackend> backend);
+
+/**
+ * @brief Returns the installed backend, or nullptr if none has been set.
+ */
+std::shared_ptr<DisplayBackend> GetDisplayBackend();
@@ -0,0 +1,383 @@
+#include "drmbackend.h"
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace
+{
+  // Kernel connector type names (drm_connector.c), so device names match
+  // what /sys/class/drm and compositors show.
+  const char *const kConnectorNames[] = {
+      "Unknown", "VGA", "DVI-I", "DVI-D", "DVI-A", "Composite", "SVIDEO",
+      "LVDS", "Component", "DIN", "DP", "HDMI-A", "HDMI-B", "TV", "eDP",
+      "Virtual", "DSI", "DPI", "Writeback", "SPI", "USB"};
+
+  std::wstring ConnectorName(uint32_t type, uint32_t typeId)
+  {
+    const size_t known = sizeof(kConnectorNames) / sizeof(kConnectorNames[0]);
+    std::string name = type < known ? kConnectorNames[type] : kConnectorNames[0];
+    name += "-" + std::to_string(typeId);
+    return std::wstring(name.begin(), name.end());
+  }
+
+  // drm_color_lut is four 16-bit words: red, green, blue, reserved.
+  const size_t LUT_WORDS = sizeof(struct drm_color_lut) / sizeof(uint16_t);
+  static_assert(sizeof(struct drm_color_lut) == 4 * sizeof(uint16_t), "unexpected drm_color_lut layout");
+}
+
+DrmDisplayBackend::DrmDisplayBackend(const std::string &devicePath)
+{
+  m_fd = open(devicePath.c_str(), O_RDWR | O_CLOEXEC);
+  if (m_fd < 0)
+    return;
+  // GAMMA_LUT is only reachable as an atomic CRTC property.
+  m_atomic = drmSetClientCap(m_fd, DRM_CLIENT_CAP_UNIVERSAL_PLANES, 1) == 0 &&
+             drmSetClientCap(m_fd, DRM_CLIENT_CAP_ATOMIC, 1) == 0;
+}
+
+DrmDisplayBackend::~DrmDisplayBackend()
+{
+  if (m_fd >= 0)
+    close(m_fd);
+}
+
+bool DrmDisplayBackend::IsConnected() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_fd >= 0 && m_atomic;
+}
+
+DrmDisplayBackend::DrmCrtc *DrmDisplayBackend::FindCrtc(OutputHandle output)
+{
+  auto it = m_outputs.find(output);
+  if (it == m_outputs.end() || !it->second.open)
+    return nullptr;
+  auto crtc = m_crtcs.find(it->second.crtc);
+  return crtc == m_crtcs.end() ? nullptr : &crtc->second;
+}
+
+// Looks up the CRTC's GAMMA_LUT / GAMMA_LUT_SIZE properties and, optionally,
+// the blob id currently bound to GAMMA_LUT (0 = no LUT, i.e. linear).
+bool DrmDisplayBackend::ReadCrtcProperties(uint32_t crtc, DrmCrtc &state, uint64_t *currentLut)
+{
+  drmModeObjectPropertiesPtr props = drmModeObjectGetProperties(m_fd, crtc, DRM_MODE_OBJECT_CRTC);
+  if (!props)
+    return false;
+
+  for (uint32_t i = 0; i < props->count_props; ++i)
+  {
+    drmModePropertyPtr prop = drmModeGetProperty(m_fd, props->props[i]);
+    if (!prop)
+      continue;
+    if (std::strcmp(prop->name, "GAMMA_LUT") == 0)
+    {
+      state.gammaLutProp = prop->prop_id;
+      if (currentLut)
+        *currentLut = props->prop_values[i];
+    }
+    else if (std::strcmp(prop->name, "GAMMA_LUT_SIZE") == 0)
+    {
+      state.lutSize = static_cast<int>(props->prop_values[i]);
+    }
+    drmModeFreeProperty(prop);
+  }
+  drmModeFreeObjectProperties(props);
+  return state.gammaLutProp != 0 && state.lutSize > 0;
+}
+
+// -----------------------------------------------------------------------------------------------
+// Enumeration
+// -----------------------------------------------------------------------------------------------
+
+std::vector<DisplayOutput> DrmDisplayBackend::EnumerateOutputs()
+{
+  std::vector<DisplayOutput> outputs;
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (m_fd < 0 || !m_atomic)
+    return outputs;
+
+  drmModeResPtr resources = drmModeGetResources(m_fd);
+  if (!resources)
+    return outputs;
+
+  for (int i = 0; i < resources->count_connectors; ++i)
+  {
+    drmModeConnectorPtr connector = drmModeGetConnector(m_fd, resources->connectors[i]);
+    if (!connector)
+      continue;
+
+    // Only lit connectors have a CRTC, and only a CRTC has a gamma LUT.
+    uint32_t crtc = 0;
+    if (connector->connection == DRM_MODE_CONNECTED && connector->encoder_id &&
+        connector->connector_type != DRM_MODE_CONNECTOR_WRITEBACK)
+    {
+      drmModeEncoderPtr encoder = drmModeGetEncoder(m_fd, connector->encoder_id);
+      if (encoder)
+      {
+        crtc = encoder->crtc_id;
+        drmModeFreeEncoder(encoder);
+      }
+    }
+
+    if (crtc)
+    {
+      DisplayOutput output;
+      output.handle = static_cast<OutputHandle>(connector->connector_id);
+      output.deviceName = ConnectorName(connector->connector_type, connector->connector_type_id);
+      outputs.push_back(output);
+
+      DrmOutput &state = m_outputs[output.handle];
+      if (state.crtc != crtc)
+        state.open = false; // Rerouted since it was opened; force a reopen
+      state.crtc = crtc;
+    }
+    drmModeFreeConnector(connector);
+  }
+  drmModeFreeResources(resources);
+  return outputs;
+}
+
+bool DrmDisplayBackend::OpenOutput(OutputHandle output)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto it = m_outputs.find(output);
+  if (m_fd < 0 || it == m_outputs.end() || !it->second.crtc)
+    return false;
+
+  DrmCrtc &crtc = m_crtcs[it->second.crtc];
+  if (!ReadCrtcProperties(it->second.crtc, crtc, nullptr))
+  {
+    m_crtcs.erase(it->second.crtc);
+    return false;
+  }
+  // Staging buffer sized once here; writes only copy into it.
+  crtc.lut.assign(static_cast<size_t>(crtc.lutSize) * LUT_WORDS, 0);
+  crtc.staged = false;
+  it->second.open = true;
+  return true;
+}
+
+void DrmDisplayBackend::CloseOutput(OutputHandle output)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto it = m_outputs.find(output);
+  if (it != m_outputs.end())
+    it->second.open = false;
+}
+
+bool DrmDisplayBackend::GetEdid(OutputHandle output, uint8_t *edid)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (m_fd < 0)
+    return false;
+
+  // The kernel exposes the connector's EDID as the "EDID" blob property.
+  drmModeObjectPropertiesPtr props =
+      drmModeObjectGetProperties(m_fd, static_cast<uint32_t>(output), DRM_MODE_OBJECT_CONNECTOR);
+  if (!props)
+    return false;
+
+  uint64_t blobId = 0;
+  for (uint32_t i = 0; i < props->count_props && !blobId; ++i)
+  {
+    drmModePropertyPtr prop = drmModeGetProperty(m_fd, props->props[i]);
+    if (!prop)
+      continue;
+    if (std::strcmp(prop->name, "EDID") == 0)
+      blobId = props->prop_values[i];
+    drmModeFreeProperty(prop);
+  }
+  drmModeFreeObjectProperties(props);
+  if (!blobId)
+    return false;
+
+  drmModePropertyBlobPtr blob = drmModeGetPropertyBlob(m_fd, static_cast<uint32_t>(blobId));
+  if (!blob)
+    return false;
+  bool ok = blob->length >= 128;
+  if (ok)
+  {
+    const uint8_t *data = static_cast<const uint8_t *>(blob->data);
+    std::copy(data, data + 128, edid);
+  }
+  drmModeFreePropertyBlob(blob);
+  return ok;
+}
+
+int DrmDisplayBackend::GetRefreshRate(OutputHandle output)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto it = m_outputs.find(output);
+  if (m_fd < 0 || it == m_outputs.end() || !it->second.crtc)
+    return 0;
+
+  drmModeCrtcPtr crtc = drmModeGetCrtc(m_fd, it->second.crtc);
+  if (!crtc)
+    return 0;
+  int hz = crtc->mode_valid ? static_cast<int>(crtc->mode.vrefresh) : 0;
+  drmModeFreeCrtc(crtc);
+  return hz;
+}
+
+// -----------------------------------------------------------------------------------------------
+// Gamma
+// -----------------------------------------------------------------------------------------------
+
+int DrmDisplayBackend::GetGammaSize(OutputHandle output)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  DrmCrtc *crtc = FindCrtc(output);
+  return crtc ? crtc->lutSize : 0;
+}
+
+bool DrmDisplayBackend::GetGammaRamp(OutputHandle output, uint16_t *ramp)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  DrmCrtc *crtc = FindCrtc(output);
+  if (!crtc)
+    return false;
+
+  DrmCrtc current;
+  uint64_t blobId = 0;
+  if (!ReadCrtcProperties(m_outputs[output].crtc, current, &blobId) || current.lutSize != crtc->lutSize)
+    return false;
+
+  const int size = crtc->lutSize;
+  if (blobId == 0)
+  {
+    // No LUT bound: the pipe passes colours through unchanged.
+    for (int i = 0; i < size; ++i)
+    {
+      uint16_t value = static_cast<uint16_t>(static_cast<uint32_t>(i) * 65535 / (size - 1));
+      ramp[i] = ramp[i + size] = ramp[i + size * 2] = value;
+    }
+    return true;
+  }
+
+  drmModePropertyBlobPtr blob = drmModeGetPropertyBlob(m_fd, static_cast<uint32_t>(blobId));
+  if (!blob)
+    return false;
+  bool ok = blob->length == static_cast<uint32_t>(size) * sizeof(struct drm_color_lut);
+  if (ok)
+  {
+    const struct drm_color_lut *lut = static_cast<const struct drm_color_lut *>(blob->data);
+    for (int i = 0; i < size; ++i)
+    {
+      ramp[i] = lut[i].red;
+      ramp[i + size] = lut[i].green;
+      ramp[i + size * 2] = lut[i].blue;
+    }
+  }
+  drmModeFreePropertyBlob(blob);
+  return ok;
+}
+
+bool DrmDisplayBackend::SetGammaRamp(OutputHandle output, const uint16_t *ramp)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  DrmCrtc *crtc = FindCrtc(output);
+  if (!crtc)
+    return false;
+
+  // Interleave into drm_color_lut order; the upload happens in FlushGamma.
+  const int size = crtc->lutSize;
+  uint16_t *lut = crtc->lut.data();
+  for (int i = 0; i < size; ++i)
+  {
+    lut[i * LUT_WORDS + 0] = ramp[i];
+    lut[i * LUT_WORDS + 1] = ramp[i + size];
+    lut[i * LUT_WORDS + 2] = ramp[i + size * 2];
+  }
+  crtc->staged = true;
+  return true;
+}
+
+bool DrmDisplayBackend::FlushGamma()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (m_fd < 0)
+    return false;
+
+  drmModeAtomicReqPtr request = nullptr;
+  std::vector<uint32_t> blobs;
+  bool ok = true;
+  for (auto &entry : m_crtcs)
+  {
+    DrmCrtc &crtc = entry.second;
+    if (!crtc.staged)
+      continue;
+    crtc.staged = false;
+
+    uint32_t blobId = 0;
+    if (drmModeCreatePropertyBlob(m_fd, crtc.lut.data(), crtc.lut.size() * sizeof(uint16_t), &blobId) != 0)
+    {
+      ok = false;
+      continue;
+    }
+    blobs.push_back(blobId);
+
+    if (!request)
+      request = drmModeAtomicAlloc();
+    if (!request || drmModeAtomicAddProperty(request, entry.first, crtc.gammaLutProp, blobId) < 0)
+      ok = false;
+  }
+
+  // Every CRTC goes into one commit, so multi-head changes land in the same
+  // frame. GAMMA_LUT never needs a modeset, so no ALLOW_MODESET flag.
+  if (request)
+  {
+    if (drmModeAtomicCommit(m_fd, request, 0, nullptr) != 0)
+      ok = false;
+    drmModeAtomicFree(request);
+  }
+
+  // The committed CRTC state holds its own reference to each blob.
+  for (uint32_t blobId : blobs)
+    drmModeDestroyPropertyBlob(m_fd, blobId);
+  return ok;
+}
+
+// -----------------------------------------------------------------------------------------------
+// DDC/CI & Colour matrix (not available through KMS)
+// -----------------------------------------------------------------------------------------------
+
+int DrmDisplayBackend::CountDdcEndpoints(OutputHandle)
+{
+  return 0;
+}
+
+std::vector<DdcHandle> DrmDisplayBackend::OpenDdc(OutputHandle)
+{
+  return {};
+}
+
+void DrmDisplayBackend::CloseDdc(DdcHandle)
+{
+}
+
+bool DrmDisplayBackend::GetDdcBrightness(DdcHandle, uint32_t &, uint32_t &, uint32_t &)
+{
+  return false;
+}
+
+bool DrmDisplayBackend::SetDdcBrightness(DdcHandle, uint32_t)
+{
+  return false;
+}
+
+bool DrmDisplayBackend::InitColorEffects()
+{
+  return false;
+}
+
+void DrmDisplayBackend::ShutdownColorEffects()
+{
+}
+
+bool DrmDisplayBackend::SetColorMatrix(const ColorMatrix &)
+{
+  return false;
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include "displaybackend.h"
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * @brief DisplayBackend for Linux machines without a display server (kiosks),
+ *        talking to the kernel's KMS interface directly.
+ *
+ * - Enumeration:   connected DRM connectors driven by a CRTC
+ *                  (OutputHandle = connector id, deviceName = kernel
+ *                  connector name, e.g. "HDMI-A-1")
+ * - Gamma:         the CRTC's GAMMA_LUT property at the size its
+ *                  GAMMA_LUT_SIZE advertises (often 1024 or 4096).
+ *                  SetGammaRamp only stages the LUT; FlushGamma uploads every
+ *                  staged LUT and commits them in a single atomic request, so
+ *                  all heads change in the same frame.
+ * - DDC/CI:        not provided
+ * - Colour matrix: not provided
+ *
+ * Needs DRM master (no compositor holding the card). Runs without a GPU on
+ * the vkms virtual KMS driver.
+ */
+class DrmDisplayBackend : public DisplayBackend
+{
+public:
+  /**
+   * @param devicePath DRM card node to open.
+   */
+  explicit DrmDisplayBackend(const std::string &devicePath = "/dev/dri/card0");
+  ~DrmDisplayBackend() override;
+
+  DrmDisplayBackend(const DrmDisplayBackend &) = delete;
+  DrmDisplayBackend &operator=(const DrmDisplayBackend &) = delete;
+
+  /**
+   * @brief true if the card opened and accepted the atomic client cap.
+   */
+  bool IsConnected() const;
+
+  std::vector<DisplayOutput> EnumerateOutputs() override;
+  bool OpenOutput(OutputHandle output) override;
+  void CloseOutput(OutputHandle output) override;
+  bool GetEdid(OutputHandle output, uint8_t *edid) override;
+  int GetRefreshRate(OutputHandle output) override;
+
+  int GetGammaSize(OutputHandle output) override;
+  bool GetGammaRamp(OutputHandle output, uint16_t *ramp) override;
+  bool SetGammaRamp(OutputHandle output, const uint16_t *ramp) override;
+  bool FlushGamma() override;
+
+  int CountDdcEndpoints(OutputHandle output) override;
+  std::vector<DdcHandle> OpenDdc(OutputHandle output) override;
+  void CloseDdc(DdcHandle ddc) override;
+  bool GetDdcBrightness(DdcHandle ddc, uint32_t &minValue, uint32_t &currentValue, uint32_t &maxValue) override;
+  bool SetDdcBrightness(DdcHandle ddc, uint32_t value) override;
+
+  bool InitColorEffects() override;
+  void ShutdownColorEffects() override;
+  bool SetColorMatrix(const ColorMatrix &matrix) override;
+
+private:
+  struct DrmCrtc
+  {
+    uint32_t gammaLutProp = 0;        // GAMMA_LUT property id
+    int lutSize = 0;                  // GAMMA_LUT_SIZE
+    std::vector<uint16_t> lut;        // Staged struct drm_color_lut entries, 4 words each
+    bool staged = false;              // lut holds a write FlushGamma has not committed
+  };
+
+  struct DrmOutput
+  {
+    uint32_t crtc = 0; // CRTC driving the connector, from the last enumeration
+    bool open = false;
+  };
+
+  DrmCrtc *FindCrtc(OutputHandle output); // Called with m_mutex held; null unless open
+  bool ReadCrtcProperties(uint32_t crtc, DrmCrtc &state, uint64_t *currentLut);
+
+  mutable std::mutex m_mutex;
+  int m_fd = -1;
+  bool m_atomic = false;
+  std::map<OutputHandle, DrmOutput> m_outputs;
+  std::map<uint32_t, DrmCrtc> m_crtcs; // Keyed by CRTC id; shared by cloned connectors
+};
@@ -0,0 +1,312 @@
+#include "fakebackend.h"
+#include "colortemp.h"
+#include <algorithm>
+#include <thread>
+#include <utility>
+
+namespace
+{
+  std::vector<uint16_t> IdentityRamp(int entries)
+  {
+    std::vector<uint16_t> ramp(static_cast<size_t>(entries) * 3);
+    for (int i = 0; i < entries; ++i)
+    {
+      uint16_t value = static_cast<uint16_t>(static_cast<uint32_t>(i) * 65535 / (entries - 1));
+      ramp[i] = value;
+      ramp[i + entries] = value;
+      ramp[i + entries * 2] = value;
+    }
+    return ramp;
+  }
+
+  ColorMatrix IdentityMatrix()
+  {
+    ColorMatrix matrix{};
+    for (int i = 0; i < 5; ++i)
+      matrix.m[i][i] = 1.0f;
+    return matrix;
+  }
+}
+
+FakeDisplayBackend::FakeDisplayBackend()
+    : m_matrix(IdentityMatrix())
+{
+}
+
+// -----------------------------------------------------------------------------------------------
+// Test Controls
+// -----------------------------------------------------------------------------------------------
+
+OutputHandle FakeDisplayBackend::AddOutput(const std::wstring &deviceName, std::shared_ptr<SimulatedDdcMonitor> ddc,
+                                           int gammaSize)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  OutputHandle handle = m_nextOutput++;
+  FakeOutput &output = m_outputs[handle];
+  output.deviceName = deviceName;
+  output.gammaSize = std::max(ColorTempUtils::GAMMA_RAMP_ENTRIES_MIN,
+                              std::min(gammaSize, ColorTempUtils::GAMMA_RAMP_ENTRIES_MAX));
+  output.ramp = IdentityRamp(output.gammaSize);
+  if (ddc)
+    output.ddc.push_back(std::move(ddc));
+  return handle;
+}
+
+void FakeDisplayBackend::AddDdcEndpoint(OutputHandle output, std::shared_ptr<SimulatedDdcMonitor> ddc)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (FakeOutput *fake = Find(output))
+    fake->ddc.push_back(std::move(ddc));
+}
+
+void FakeDisplayBackend::RemoveOutput(OutputHandle output)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_outputs.erase(output);
+}
+
+void FakeDisplayBackend::SetRefreshRate(OutputHandle output, int hz)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (FakeOutput *fake = Find(output))
+    fake->refreshRate = hz;
+}
+
+void FakeDisplayBackend::SetEdid(OutputHandle output, const uint8_t *edid)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (FakeOutput *fake = Find(output))
+    fake->edid.assign(edid, edid + 128);
+}
+
+void FakeDisplayBackend::SetOpenLatency(std::chrono::milliseconds latency)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_openLatency = latency;
+}
+
+void FakeDisplayBackend::SetDdcOpenFailures(OutputHandle output, int failures)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (FakeOutput *fake = Find(output))
+    fake->ddcOpenFailures = std::max(0, failures);
+}
+
+void FakeDisplayBackend::SetGammaUnsupported(OutputHandle output)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (FakeOutput *fake = Find(output))
+    fake->gammaUnsupported = true;
+}
+
+void FakeDisplayBackend::OverwriteGammaRamp(OutputHandle output, const uint16_t *ramp)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (FakeOutput *fake = Find(output))
+    fake->ramp.assign(ramp, ramp + fake->ramp.size());
+}
+
+bool FakeDisplayBackend::PeekGammaRamp(OutputHandle output, uint16_t *ramp) const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto it = m_outputs.find(output);
+  if (it == m_outputs.end())
+    return false;
+  std::copy(it->second.ramp.begin(), it->second.ramp.end(), ramp);
+  return true;
+}
+
+ColorMatrix FakeDisplayBackend::GetColorMatrix() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_matrix;
+}
+
+FakeDisplayBackend::Counters FakeDisplayBackend::GetCounters() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_counters;
+}
+
+FakeDisplayBackend::FakeOutput *FakeDisplayBackend::Find(OutputHandle output)
+{
+  auto it = m_outputs.find(output);
+  return it == m_outputs.end() ? nullptr : &it->second;
+}
+
+std::shared_ptr<SimulatedDdcMonitor> FakeDisplayBackend::FindDdc(DdcHandle ddc)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto it = m_openDdc.find(ddc);
+  return it == m_openDdc.end() ? nullptr : it->second;
+}
+
+// -----------------------------------------------------------------------------------------------
+// DisplayBackend
+// -----------------------------------------------------------------------------------------------
+
+std::vector<DisplayOutput> FakeDisplayBackend::EnumerateOutputs()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_counters.enumerations++;
+  std::vector<DisplayOutput> outputs;
+  for (const auto &entry : m_outputs)
+  {
+    DisplayOutput output;
+    output.handle = entry.first;
+    output.deviceName = entry.second.deviceName;
+    outputs.push_back(output);
+  }
+  return outputs;
+}
+
+bool FakeDisplayBackend::OpenOutput(OutputHandle output)
+{
+  std::chrono::milliseconds latency;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    latency = m_openLatency;
+  }
+  std::this_thread::sleep_for(latency);
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  FakeOutput *fake = Find(output);
+  if (!fake || fake->gammaUnsupported)
+    return false;
+  m_counters.outputOpens++;
+  fake->open = true;
+  return true;
+}
+
+void FakeDisplayBackend::CloseOutput(OutputHandle output)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (FakeOutput *fake = Find(output))
+    fake->open = false;
+}
+
+int FakeDisplayBackend::GetGammaSize(OutputHandle output)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  FakeOutput *fake = Find(output);
+  return fake ? fake->gammaSize : 0;
+}
+
+bool FakeDisplayBackend::GetEdid(OutputHandle output, uint8_t *edid)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  FakeOutput *fake = Find(output);
+  if (!fake || fake->edid.empty())
+    return false;
+  std::copy(fake->edid.begin(), fake->edid.end(), edid);
+  return true;
+}
+
+int FakeDisplayBackend::GetRefreshRate(OutputHandle output)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  FakeOutput *fake = Find(output);
+  return fake ? fake->refreshRate : 0;
+}
+
+bool FakeDisplayBackend::GetGammaRamp(OutputHandle output, uint16_t *ramp)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  FakeOutput *fake = Find(output);
+  if (!fake || !fake->open)
+    return false;
+  m_counters.gammaReads++;
+  std::copy(fake->ramp.begin(), fake->ramp.end(), ramp);
+  return true;
+}
+
+bool FakeDisplayBackend::SetGammaRamp(OutputHandle output, const uint16_t *ramp)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  FakeOutput *fake = Find(output);
+  if (!fake || !fake->open)
+    return false;
+  m_counters.gammaWrites++;
+  fake->ramp.assign(ramp, ramp + fake->ramp.size());
+  return true;
+}
+
+bool FakeDisplayBackend::FlushGamma()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_counters.gammaFlushes++;
+  return true;
+}
+
+int FakeDisplayBackend::CountDdcEndpoints(OutputHandle output)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  FakeOutput *fake = Find(output);
+  return fake ? static_cast<int>(fake->ddc.size()) : 0;
+}
+
+std::vector<DdcHandle> FakeDisplayBackend::OpenDdc(OutputHandle output)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  FakeOutput *fake = Find(output);
+  if (!fake || fake->ddc.empty())
+    return {};
+  if (fake->ddcOpenFailures > 0)
+  {
+    fake->ddcOpenFailures--;
+    return {};
+  }
+  m_counters.ddcOpens++;
+  std::vector<DdcHandle> endpoints;
+  for (const auto &ddc : fake->ddc)
+  {
+    DdcHandle handle = m_nextDdc++;
+    m_openDdc[handle] = ddc;
+    endpoints.push_back(handle);
+  }
+  return endpoints;
+}
+
+void FakeDisplayBackend::CloseDdc(DdcHandle ddc)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_openDdc.erase(ddc);
+}
+
+bool FakeDisplayBackend::GetDdcBrightness(DdcHandle ddc, uint32_t &minValue, uint32_t &currentValue, uint32_t &maxValue)
+{
+  // The simulated monitor sleeps for its latency; do that without m_mutex held
+  // so concurrent probes of different monitors overlap like real buses do.
+  std::shared_ptr<SimulatedDdcMonitor> monitor = FindDdc(ddc);
+  return monitor && monitor->GetBrightness(minValue, currentValue, maxValue);
+}
+
+bool FakeDisplayBackend::SetDdcBrightness(DdcHandle ddc, uint32_t value)
+{
+  std::shared_ptr<SimulatedDdcMonitor> monitor = FindDdc(ddc);
+  return monitor && monitor->SetBrightness(value);
+}
+
+bool FakeDisplayBackend::InitColorEffects()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_colorEffects = true;
+  return true;
+}
+
+void FakeDisplayBackend::ShutdownColorEffects()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_matrix = IdentityMatrix();
+  m_colorEffects = false;
+}
+
+bool FakeDisplayBackend::SetColorMatrix(const ColorMatrix &matrix)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (!m_colorEffects)
+    return false;
+  m_counters.colorMatrixWrites++;
+  m_matrix = matrix;
+  return true;
+}
@@ -0,0 +1,155 @@
+#pragma once
+#include "displaybackend.h"
+#include "ddcsim.h"
+#include "colortemp.h"
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/**
+ * @brief In-memory DisplayBackend for running the brightness core without a
+ *        real display stack (Linux CI, benchmarks).
+ *
+ * Each output keeps its own gamma ramp in memory and may carry a
+ * SimulatedDdcMonitor as its DDC/CI endpoint, so DDC latency and failures
+ * can be dialled in per display. Every call is counted.
+ */
+class FakeDisplayBackend : public DisplayBackend
+{
+public:
+  /**
+   * @brief Per-call counters.
+   */
+  struct Counters
+  {
+    uint64_t enumerations = 0;
+    uint64_t gammaReads = 0;
+    uint64_t gammaWrites = 0;
+    uint64_t gammaFlushes = 0;
+    uint64_t colorMatrixWrites = 0;
+    uint64_t outputOpens = 0;
+    uint64_t ddcOpens = 0; // OpenDdc calls that found an endpoint
+  };
+
+  FakeDisplayBackend();
+
+  /**
+   * @brief Adds a display. The ramp starts as identity.
+   * @param deviceName Name reported by EnumerateOutputs.
+   * @param ddc DDC/CI endpoint for the display, or nullptr for none.
+   * @param gammaSize Ramp entries per channel reported by GetGammaSize.
+   * @return The handle EnumerateOutputs will report for it.
+   */
+  OutputHandle AddOutput(const std::wstring &deviceName, std::shared_ptr<SimulatedDdcMonitor> ddc = nullptr,
+                         int gammaSize = ColorTempUtils::GAMMA_RAMP_ENTRIES);
+
+  /**
+   * @brief Puts another physical monitor behind an output, as for a cloned
+   *        or daisy-chained display. OpenDdc hands the endpoints out in the
+   *        order they were added.
+   */
+  void AddDdcEndpoint(OutputHandle output, std::shared_ptr<SimulatedDdcMonitor> ddc);
+
+  /**
+   * @brief Removes a display, as if it had been unplugged.
+   */
+  void RemoveOutput(OutputHandle output);
+
+  /**
+   * @brief Gives an output an EDID block (128 bytes) for GetEdid to report.
+   */
+  void SetEdid(OutputHandle output, const uint8_t *edid);
+
+  /**
+   * @brief Refresh rate GetRefreshRate reports for an output (60 Hz unless set).
+   */
+  void SetRefreshRate(OutputHandle output, int hz);
+
+  /**
+   * @brief Delay added to OpenOutput, modelling device-context creation.
+   */
+  void SetOpenLatency(std::chrono::milliseconds latency);
+
+  /**
+   * @brief Number of OpenDdc calls that hand out no endpoint before they
+   *        succeed (models GetPhysicalMonitorsFromHMONITOR returning null
+   *        handles).
+   */
+  void SetDdcOpenFailures(OutputHandle output, int failures);
+
+  /**
+   * @brief Makes OpenOutput fail for an output, as for a display that takes
+   *        no gamma ramp.
+   */
+  void SetGammaUnsupported(OutputHandle output);
+
+  /**
+   * @brief Overwrites an output's ramp behind Candela's back (e.g. a game or
+   *        driver reset).
+   */
+  void OverwriteGammaRamp(OutputHandle output, const uint16_t *ramp);
+
+  /**
+   * @brief Copies an output's current ramp (its GetGammaSize words per
+   *        channel); false if the output is unknown.
+   */
+  bool PeekGammaRamp(OutputHandle output, uint16_t *ramp) const;
+
+  /**
+   * @brief Returns the matrix most recently passed to SetColorMatrix.
+   */
+  ColorMatrix GetColorMatrix() const;
+
+  Counters GetCounters() const;
+
+  std::vector<DisplayOutput> EnumerateOutputs() override;
+  bool OpenOutput(OutputHandle output) override;
+  void CloseOutput(OutputHandle output) override;
+  bool GetEdid(OutputHandle output, uint8_t *edid) override;
+  int GetRefreshRate(OutputHandle output) override;
+
+  int GetGammaSize(OutputHandle output) override;
+  bool GetGammaRamp(OutputHandle output, uint16_t *ramp) override;
+  bool SetGammaRamp(OutputHandle output, const uint16_t *ramp) override;
+  bool FlushGamma() override;
+
+  int CountDdcEndpoints(OutputHandle output) override;
+  std::vector<DdcHandle> OpenDdc(OutputHandle output) override;
+  void CloseDdc(DdcHandle ddc) override;
+  bool GetDdcBrightness(DdcHandle ddc, uint32_t &minValue, uint32_t &currentValue, uint32_t &maxValue) override;
+  bool SetDdcBrightness(DdcHandle ddc, uint32_t value) override;
+
+  bool InitColorEffects() override;
+  void ShutdownColorEffects() override;
+  bool SetColorMatrix(const ColorMatrix &matrix) override;
+
+private:
+  struct FakeOutput
+  {
+    std::wstring deviceName;
+    int gammaSize = ColorTempUtils::GAMMA_RAMP_ENTRIES;
+    std::vector<uint16_t> ramp; // gammaSize * 3 words
+    bool open = false;
+    std::vector<std::shared_ptr<SimulatedDdcMonitor>> ddc; // One per physical monitor
+    int ddcOpenFailures = 0;
+    bool gammaUnsupported = false;
+    std::vector<uint8_t> edid; // Empty = no EDID
+    int refreshRate = 60;
+  };
+
+  FakeOutput *Find(OutputHandle output); // Called with m_mutex held
+  std::shared_ptr<SimulatedDdcMonitor> FindDdc(DdcHandle ddc);
+
+  mutable std::mutex m_mutex;
+  std::map<OutputHandle, FakeOutput> m_outputs;
+  std::map<DdcHandle, std::shared_ptr<SimulatedDdcMonitor>> m_openDdc;
+  OutputHandle m_nextOutput = 1;
+  DdcHandle m_nextDdc = 1;
+  std::chrono::milliseconds m_openLatency{0};
+  ColorMatrix m_matrix;
+  bool m_colorEffects = false;
+  Counters m_counters;
+};
@@ -0,0 +1,42 @@
+#include "gammawatch.h"
+#include "brightness.h"
+#include <algorithm>
+
+GammaWatchdog::GammaWatchdog() : GammaWatchdog(Options()) {}
+
+GammaWatchdog::GammaWatchdog(const Options &options)
+    : m_options(options),
+      m_interval(options.minInterval)
+{
+  m_options.maxInterval = std::max(m_options.maxInterval, m_options.minInterval);
+}
+
+std::chrono::milliseconds GammaWatchdog::Check()
+{
+  GammaVerifyResult result = BrightnessController::VerifyGammaRamps();
+  m_stats.checks++;
+  m_stats.rampsRead += result.checked;
+  m_stats.drifts += result.drifted;
+  m_stats.busy += result.busy;
+
+  bool drifted = result.drifted > 0;
+  if (drifted && !m_drifted)
+  {
+    m_interval = m_options.minInterval;
+  }
+  else
+  {
+    if (drifted)
+      m_stats.contested++;
+    m_interval = std::min(m_interval * 2, m_options.maxInterval);
+  }
+  m_drifted = drifted;
+  return m_interval;
+}
+
+std::chrono::milliseconds GammaWatchdog::Reset()
+{
+  m_interval = m_options.minInterval;
+  m_drifted = false;
+  return m_interval;
+}
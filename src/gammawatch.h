@@ -0,0 +1,64 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+
+/**
+ * @brief Puts back gamma ramps that something else overwrote: games, screen
+ *        recorders, driver resets after a mode change or resume.
+ *
+ * Check() runs BrightnessController::VerifyGammaRamps and returns how long
+ * to wait before the next one. The interval doubles after every check that
+ * finds the ramps intact, from Options::minInterval up to maxInterval, so a
+ * stable desktop costs one ramp read per monitor every maxInterval and
+ * nothing in between. Drift found after a quiet check drops the interval
+ * back to minInterval, since more tends to follow. Drift found by two checks
+ * in a row means a program is setting its own ramp continuously; the
+ * interval then keeps doubling, so Candela restores the user's levels now
+ * and then instead of fighting it at full rate.
+ *
+ * Not thread-safe; call from the thread that drives BrightnessController.
+ */
+class GammaWatchdog
+{
+public:
+  struct Options
+  {
+    std::chrono::milliseconds minInterval{2000};
+    std::chrono::milliseconds maxInterval{60000};
+  };
+
+  struct Stats
+  {
+    uint64_t checks = 0;    // Check calls
+    uint64_t rampsRead = 0; // Ramps read back
+    uint64_t drifts = 0;    // Ramps found overwritten and written again
+    uint64_t contested = 0; // Checks finding drift right after another one did
+    uint64_t busy = 0;      // Ramps skipped while a transition was writing them
+  };
+
+  GammaWatchdog();
+  explicit GammaWatchdog(const Options &options);
+
+  /**
+   * @brief Verifies every monitor's ramp now.
+   * @return Delay until the next check.
+   */
+  std::chrono::milliseconds Check();
+
+  /**
+   * @brief Starts over at minInterval. Call after the monitors were
+   *        refreshed or the system resumed, when drivers are most likely to
+   *        reset the ramps.
+   * @return Delay until the next check.
+   */
+  std::chrono::milliseconds Reset();
+
+  std::chrono::milliseconds GetInterval() const { return m_interval; }
+  Stats GetStats() const { return m_stats; }
+
+private:
+  Options m_options;
+  std::chrono::milliseconds m_interval;
+  bool m_drifted = false; // The last check found drift
+  Stats m_stats;
+};
@@ -4,6 +4,7 @@
 #include "bwfilter.h"
 #include "settings.h"
 #include "resource.h"
+#include "trace.h"
 #include <commctrl.h>
 #include <windowsx.h>
 #include <vector>
@@ -32,10 +33,21 @@ namespace GuiConstants
 
   // Fixed (non-strided) IDs for global controls
   const int ID_BW_TOGGLE = 1900; // popup: global "B&W" checkbox
+  const std::chrono::milliseconds BW_FADE{250}; // B&W toggle fades rather than snaps
+
+  // Posted to the popup by a monitor's DDC worker when a hardware brightness
+  // write finishes. wParam = monitor index, lParam = MAKELPARAM(brightness, DdcResult).
+  const UINT WM_DDC_COMPLETE = WM_APP + 2;
+
+  // Popup timers that commit a unified slider once it has been left alone;
+  // wheel and some keyboard steps end without TB_ENDTRACK. One per monitor.
+  const UINT_PTR ID_UNIFIED_COMMIT_TIMER_BASE = 100;
+  const UINT UNIFIED_COMMIT_DELAY_MS = 400;
 
   // ID Constants for Settings Window
   const int ID_SETTINGS_STARTUP = 201;
   const int ID_SETTINGS_SHOW_BW = 202; // "Show B&W toggle in tray popup" checkbox
+  const int ID_SETTINGS_AUTO_BRIGHTNESS = 203; // "Automatic brightness" checkbox
   const int ID_SETTINGS_MONITOR_BASE = 3000;
   const int ID_SETTINGS_STRIDE = 10;
   const int OFFSET_SETTINGS_SW_CHECK = 1;
@@ -43,6 +55,7 @@ namespace GuiConstants
   const int OFFSET_SETTINGS_CT_SLIDER = 3; // per-monitor horizontal color temp slider
   const int OFFSET_SETTINGS_CT_VALUE = 4;  // per-monitor "6500K" value label
   const int OFFSET_SETTINGS_CT_LABEL = 5;  // per-monitor "Color Temp:" static label
+  const int OFFSET_SETTINGS_UNIFIED_CHECK = 6;
   const int ID_INFO_TEXT = 301;
 
   // Layout Constants
@@ -87,6 +100,76 @@ static LRESULT CALLBACK SliderKeyboardProc(HWND hwnd, UINT msg, WPARAM wParam, L
   return DefSubclassProc(hwnd, msg, wParam, lParam);
 }
 
+// Shows a hardware slider's current value, or why it has none yet: DDC/CI
+// may still be probing in the background after startup.
+static void UpdateHardwareSlider(HWND hSlider, HWND hValue, int monitorIndex)
+{
+  using namespace GuiConstants;
+
+  int val = BrightnessController::GetHardwareBrightness(monitorIndex);
+  if (val < 0)
+    val = 50; // Defensive fallback
+  SendMessage(hSlider, TBM_SETPOS, TRUE, SLIDER_MAX - val); // Invert: top = 100%, bottom = 0%
+
+  wchar_t buffer[20];
+  swprintf_s(buffer, L"%d%%", val);
+
+  switch (BrightnessController::GetHardwareProbeState(monitorIndex))
+  {
+  case HardwareProbeState::Available:
+    EnableWindow(hSlider, TRUE);
+    SetWindowText(hValue, buffer);
+    break;
+  case HardwareProbeState::Pending:
+    EnableWindow(hSlider, FALSE);
+    SetWindowText(hValue, L"Probing");
+    break;
+  case HardwareProbeState::Unavailable:
+    EnableWindow(hSlider, FALSE);
+    SetWindowText(hValue, L"N/A");
+    break;
+  }
+}
+
+// Completion callback for a popup hardware slider; reports back via WM_DDC_COMPLETE.
+static BrightnessController::HardwareCompletionFn ReportToPopup(HWND hwnd, int monitorIndex)
+{
+  return [hwnd, monitorIndex](const HardwareWriteReport &report)
+  {
+    PostMessage(hwnd, GuiConstants::WM_DDC_COMPLETE, (WPARAM)monitorIndex,
+                MAKELONG(report.brightness, static_cast<int>(report.Overall())));
+  };
+}
+
+// Writes a unified slider's level to the monitor, ending the gesture.
+static void CommitUnifiedSlider(HWND hwnd, int monitorIndex)
+{
+  using namespace GuiConstants;
+  KillTimer(hwnd, ID_UNIFIED_COMMIT_TIMER_BASE + monitorIndex);
+  HWND trackbar = GetDlgItem(hwnd, ID_SLIDER_BASE + (monitorIndex * ID_SLIDER_STRIDE) + OFFSET_HW_SLIDER);
+  if (!trackbar)
+    return;
+  int brightness = SLIDER_MAX - (int)SendMessage(trackbar, TBM_GETPOS, 0, 0);
+  BrightnessController::CommitUnifiedBrightness(monitorIndex, brightness, ReportToPopup(hwnd, monitorIndex));
+}
+
+void RefreshHardwareSliders()
+{
+  using namespace GuiConstants;
+  if (!g_hwnd_brightness || !IsWindow(g_hwnd_brightness))
+    return;
+
+  int monitorCount = (int)BrightnessController::GetMonitors().size();
+  for (int i = 0; i < monitorCount; i++)
+  {
+    int baseID = ID_SLIDER_BASE + (i * ID_SLIDER_STRIDE);
+    HWND hSlider = GetDlgItem(g_hwnd_brightness, baseID + OFFSET_HW_SLIDER);
+    HWND hValue = GetDlgItem(g_hwnd_brightness, baseID + OFFSET_HW_VALUE);
+    if (hSlider && hValue)
+      UpdateHardwareSlider(hSlider, hValue, i);
+  }
+}
+
 void ShowBrightnessSlider(HWND parent)
 {
   const auto &monitors = BrightnessController::GetMonitors();
@@ -264,7 +347,7 @@ void ShowBrightnessSlider(HWND parent)
           g_hwnd_brightness, (HMENU)(intptr_t)(baseID + OFFSET_HW_SLIDER), g_hInstance, nullptr);
 
       CreateWindowEx(
-          0, WC_STATIC, L"Hardware",
+          0, WC_STATIC, settings.unifiedBrightness ? L"Unified" : L"Hardware",
           WS_CHILD | WS_VISIBLE | SS_CENTER,
           sliderX, baseY + SLIDER_HEIGHT, SLIDER_GROUP_WIDTH, 20,
           g_hwnd_brightness, (HMENU)(intptr_t)(baseID + OFFSET_HW_LABEL), g_hInstance, nullptr);
@@ -275,23 +358,10 @@ void ShowBrightnessSlider(HWND parent)
           sliderX, baseY + SLIDER_HEIGHT + 20, SLIDER_GROUP_WIDTH, 20,
           g_hwnd_brightness, (HMENU)(intptr_t)(baseID + OFFSET_HW_VALUE), g_hInstance, nullptr);
 
-      int val = BrightnessController::GetHardwareBrightness(i);
-      if (val < 0)
-        val = 50; // Defensive fallback
       SendMessage(hSlider, TBM_SETRANGE, TRUE, MAKELONG(HW_SLIDER_MIN, SLIDER_MAX));
-      SendMessage(hSlider, TBM_SETPOS, TRUE, SLIDER_MAX - val); // Invert: top = 100%, bottom = 0%
       SendMessage(hSlider, TBM_SETTICFREQ, 10, 0);
       SetWindowSubclass(hSlider, SliderKeyboardProc, 0, 0);
-
-      wchar_t buffer[20];
-      swprintf_s(buffer, L"%d%%", val);
-      SetWindowText(hValue, buffer);
-
-      if (!monitors[i].supportsHardwareBrightness)
-      {
-        EnableWindow(hSlider, FALSE);
-        SetWindowText(hValue, L"N/A");
-      }
+      UpdateHardwareSlider(hSlider, hValue, i);
     }
 
     currentX += groupWidth + PADDING;
@@ -328,7 +398,7 @@ LRESULT CALLBACK BrightnessSliderProc(HWND hwnd, UINT message, WPARAM wParam, LP
     if (HIWORD(wParam) == BN_CLICKED && LOWORD(wParam) == ID_BW_TOGGLE)
     {
       bool state = (SendMessage((HWND)lParam, BM_GETCHECK, 0, 0) == BST_CHECKED);
-      BWFilter::SetEnabled(state);
+      BWFilter::SetEnabled(state, BW_FADE);
       g_settings.setBWEnabled(state);
       g_settings.save();
     }
@@ -337,6 +407,7 @@ LRESULT CALLBACK BrightnessSliderProc(HWND hwnd, UINT message, WPARAM wParam, LP
   case WM_HSCROLL:
   case WM_VSCROLL:
   {
+    TRACE_SCOPE("Brightness slider");
     HWND trackbar = (HWND)lParam;
     int controlID = GetDlgCtrlID(trackbar);
     int relativeID = controlID - ID_SLIDER_BASE;
@@ -371,7 +442,22 @@ LRESULT CALLBACK BrightnessSliderProc(HWND hwnd, UINT message, WPARAM wParam, LP
         }
         else if (type == OFFSET_HW_SLIDER)
         {
-          BrightnessController::SetHardwareBrightness(monitorIndex, brightness);
+          if (!settings.unifiedBrightness)
+          {
+            // Returns immediately; the worker reports back via WM_DDC_COMPLETE.
+            BrightnessController::SetHardwareBrightness(monitorIndex, brightness, ReportToPopup(hwnd, monitorIndex));
+          }
+          else if (LOWORD(wParam) == TB_ENDTRACK)
+          {
+            CommitUnifiedSlider(hwnd, monitorIndex);
+          }
+          else
+          {
+            // Unified: the gamma ramp follows the drag, DDC/CI is written
+            // once when it ends.
+            BrightnessController::PreviewUnifiedBrightness(monitorIndex, brightness);
+            SetTimer(hwnd, ID_UNIFIED_COMMIT_TIMER_BASE + monitorIndex, UNIFIED_COMMIT_DELAY_MS, nullptr);
+          }
           settings.lastHardwareBrightness = brightness;
           g_settings.setMonitorSettings(monitors[monitorIndex].deviceName, settings);
 
@@ -386,8 +472,41 @@ LRESULT CALLBACK BrightnessSliderProc(HWND hwnd, UINT message, WPARAM wParam, LP
     }
     break;
   }
+  case WM_DDC_COMPLETE:
+  {
+    // Superseded/cancelled writes are expected while dragging; only a value
+    // the monitor actually rejected is worth surfacing.
+    if (static_cast<DdcResult>(HIWORD(lParam)) == DdcResult::Failed)
+    {
+      int monitorIndex = (int)wParam;
+      int valueID = ID_SLIDER_BASE + (monitorIndex * ID_SLIDER_STRIDE) + OFFSET_HW_VALUE;
+      HWND hValue = GetDlgItem(hwnd, valueID);
+      if (hValue)
+        SetWindowText(hValue, L"Failed");
+    }
+    break;
+  }
+  case WM_TIMER:
+  {
+    if (wParam >= ID_UNIFIED_COMMIT_TIMER_BASE)
+    {
+      // Still held by the mouse: not the end of the drag yet.
+      int monitorIndex = (int)(wParam - ID_UNIFIED_COMMIT_TIMER_BASE);
+      HWND trackbar = GetDlgItem(hwnd, ID_SLIDER_BASE + (monitorIndex * ID_SLIDER_STRIDE) + OFFSET_HW_SLIDER);
+      if (trackbar && GetCapture() == trackbar)
+        break;
+      CommitUnifiedSlider(hwnd, monitorIndex);
+    }
+    break;
+  }
   case WM_DESTROY:
   {
+    // A unified slider left mid-gesture would keep its gamma preview forever.
+    int monitorCount = (int)BrightnessController::GetMonitors().size();
+    for (int i = 0; i < monitorCount; i++)
+      if (KillTimer(hwnd, ID_UNIFIED_COMMIT_TIMER_BASE + i))
+        CommitUnifiedSlider(hwnd, i);
+
     g_hwnd_brightness = nullptr;
     // Persist settings immediately upon window closure
     g_settings.save();
@@ -431,7 +550,9 @@ void ShowSettingsDialog(HWND parent)
     g_settings_hwnd = nullptr;
   }
 
-  BrightnessController::RefreshMonitors();
+  // The display-change handler keeps the list current through UpdateOutputs.
+  // A full refresh here would re-probe every monitor behind the back of the
+  // hardware restore, the profile baseline and the gamma watchdog.
   const auto &monitors = BrightnessController::GetMonitors();
   int monitorCount = (int)monitors.size();
 
@@ -456,8 +577,8 @@ void ShowSettingsDialog(HWND parent)
     g_settings_class_registered = true;
   }
 
-  int baseHeight = 90;
-  int perMonitorHeight = 140;
+  int baseHeight = 125;
+  int perMonitorHeight = 165;
   int width = 380;
   int height = baseHeight + (monitorCount * perMonitorHeight) + 40;
 
@@ -502,7 +623,17 @@ void ShowSettingsDialog(HWND parent)
   SendMessage(hShowBW, BM_SETCHECK,
               g_settings.getShowBWToggle() ? BST_CHECKED : BST_UNCHECKED, 0);
 
-  int currentY = 80;
+  // Automatic brightness follows one ambient light sensor for every monitor,
+  // each along its own curve.
+  HWND hAuto = CreateWindowEx(
+      0, L"BUTTON", L"Automatic brightness (ambient light sensor)",
+      BS_AUTOCHECKBOX | WS_CHILD | WS_VISIBLE,
+      10, 80, 340, 25,
+      g_settings_hwnd, (HMENU)(intptr_t)ID_SETTINGS_AUTO_BRIGHTNESS, g_hInstance, nullptr);
+  SendMessage(hAuto, BM_SETCHECK,
+              g_settings.getAutoBrightness() ? BST_CHECKED : BST_UNCHECKED, 0);
+
+  int currentY = 115;
   for (int i = 0; i < monitorCount; i++)
   {
     MonitorSettings settings = g_settings.getMonitorSettings(monitors[i].deviceName);
@@ -512,7 +643,7 @@ void ShowSettingsDialog(HWND parent)
     wchar_t buffer[64];
     swprintf_s(buffer, L"Display %d", i + 1);
     CreateWindowEx(0, L"BUTTON", buffer, BS_GROUPBOX | WS_CHILD | WS_VISIBLE,
-                   10, currentY, 340, 130, g_settings_hwnd, (HMENU)-1, g_hInstance, nullptr);
+                   10, currentY, 340, 155, g_settings_hwnd, (HMENU)-1, g_hInstance, nullptr);
 
     // Software Checkbox
     HWND swCheck = CreateWindowEx(
@@ -532,11 +663,21 @@ void ShowSettingsDialog(HWND parent)
 
     SendMessage(hwCheck, BM_SETCHECK, settings.showHardware ? BST_CHECKED : BST_UNCHECKED, 0);
 
+    // Unified Slider Checkbox: the hardware slider previews through gamma
+    // and writes DDC/CI once per drag
+    HWND unifiedCheck = CreateWindowEx(
+        0, L"BUTTON", L"Instant hardware slider (gamma preview)",
+        BS_AUTOCHECKBOX | WS_CHILD | WS_VISIBLE,
+        20, currentY + 70, 300, 20,
+        g_settings_hwnd, (HMENU)(intptr_t)(baseID + OFFSET_SETTINGS_UNIFIED_CHECK), g_hInstance, nullptr);
+
+    SendMessage(unifiedCheck, BM_SETCHECK, settings.unifiedBrightness ? BST_CHECKED : BST_UNCHECKED, 0);
+
     // Color Temperature Label
     CreateWindowEx(
         0, WC_STATIC, L"Color Temp:",
         WS_CHILD | WS_VISIBLE | SS_LEFT,
-        20, currentY + 72, 80, 16,
+        20, currentY + 97, 80, 16,
         g_settings_hwnd, (HMENU)(intptr_t)(baseID + OFFSET_SETTINGS_CT_LABEL), g_hInstance, nullptr);
 
     // Color Temperature Value Label
@@ -545,7 +686,7 @@ void ShowSettingsDialog(HWND parent)
     HWND hCTValue = CreateWindowEx(
         0, WC_STATIC, ctBuf,
         WS_CHILD | WS_VISIBLE | SS_LEFT,
-        110, currentY + 72, 80, 16,
+        110, currentY + 97, 80, 16,
         g_settings_hwnd, (HMENU)(intptr_t)(baseID + OFFSET_SETTINGS_CT_VALUE), g_hInstance, nullptr);
     (void)hCTValue;
 
@@ -553,7 +694,7 @@ void ShowSettingsDialog(HWND parent)
     HWND hCTSlider = CreateWindowEx(
         0, TRACKBAR_CLASS, L"",
         WS_CHILD | WS_VISIBLE | TBS_HORZ | TBS_AUTOTICKS | TBS_BOTH,
-        20, currentY + 90, 300, 26,
+        20, currentY + 115, 300, 26,
         g_settings_hwnd, (HMENU)(intptr_t)(baseID + OFFSET_SETTINGS_CT_SLIDER), g_hInstance, nullptr);
 
     SendMessage(hCTSlider, TBM_SETRANGE, TRUE,
@@ -591,6 +732,13 @@ LRESULT CALLBACK SettingsProc(HWND hwnd, UINT message, WPARAM wParam, LPARAM lPa
         // Hiding the toggle does not clear the filter — that's the popup's job.
         g_settings.save();
       }
+      else if (controlId == ID_SETTINGS_AUTO_BRIGHTNESS)
+      {
+        g_settings.setAutoBrightness(SendMessage((HWND)lParam, BM_GETCHECK, 0, 0) == BST_CHECKED);
+        g_settings.save();
+        // The main window starts or stops the ambient light sensor
+        PostMessage(GetWindow(hwnd, GW_OWNER), WM_AUTO_BRIGHTNESS_CHANGED, 0, 0);
+      }
       else if (controlId >= ID_SETTINGS_MONITOR_BASE)
       {
         int relative = controlId - ID_SETTINGS_MONITOR_BASE;
@@ -611,6 +759,10 @@ LRESULT CALLBACK SettingsProc(HWND hwnd, UINT message, WPARAM wParam, LPARAM lPa
           {
             settings.showHardware = (SendMessage((HWND)lParam, BM_GETCHECK, 0, 0) == BST_CHECKED);
           }
+          else if (type == OFFSET_SETTINGS_UNIFIED_CHECK)
+          {
+            settings.unifiedBrightness = (SendMessage((HWND)lParam, BM_GETCHECK, 0, 0) == BST_CHECKED);
+          }
 
           // Validate: Ensure at least one control remains enabled to prevent lockout
           if (!settings.showSoftware && !settings.showHardware)
@@ -634,6 +786,7 @@ LRESULT CALLBACK SettingsProc(HWND hwnd, UINT message, WPARAM wParam, LPARAM lPa
   }
   case WM_HSCROLL:
   {
+    TRACE_SCOPE("Colour temperature slider");
     int id = GetDlgCtrlID((HWND)lParam);
     int kelvin = (int)SendMessage((HWND)lParam, TBM_GETPOS, 0, 0);
     // Snap to nearest 100K step
@@ -10,12 +10,24 @@ class Settings;
  */
 void ShowBrightnessSlider(HWND parent);
 
+/**
+ * @brief Updates the hardware sliders of an open brightness popup, e.g. once
+ *        DDC/CI probing has finished. Does nothing if the popup is closed.
+ */
+void RefreshHardwareSliders();
+
 /**
  * @brief Displays the settings configuration dialog.
  * @param parent Handle to the parent window.
  */
 void ShowSettingsDialog(HWND parent);
 
+/**
+ * @brief Posted to the settings dialog's parent when the automatic
+ *        brightness setting has been switched on or off.
+ */
+const UINT WM_AUTO_BRIGHTNESS_CHANGED = WM_APP + 5;
+
 /**
  * @brief Displays the application information dialog.
  * @param parent Handle to the parent window.
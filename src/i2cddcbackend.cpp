@@ -0,0 +1,198 @@
+#include "i2cddcbackend.h"
+#include <cstring>
+#include <utility>
+
+I2cDdcBackend::I2cDdcBackend(std::shared_ptr<DisplayBackend> inner,
+                             std::vector<std::shared_ptr<DdcCi::I2cBus>> buses,
+                             DdcCi::Timing timing)
+    : m_inner(std::move(inner))
+{
+  m_buses.resize(buses.size());
+  for (size_t i = 0; i < buses.size(); ++i)
+  {
+    m_buses[i].bus = std::move(buses[i]);
+    m_buses[i].engine.reset(new DdcCiEngine(*m_buses[i].bus, timing));
+  }
+}
+
+DdcCiEngine::Stats I2cDdcBackend::GetEngineStats(DdcHandle ddc) const
+{
+  DdcCiEngine *engine = FindEngine(ddc);
+  return engine ? engine->GetStats() : DdcCiEngine::Stats();
+}
+
+DdcCiEngine *I2cDdcBackend::FindEngine(DdcHandle ddc) const
+{
+  if (ddc == 0 || ddc > m_buses.size())
+    return nullptr;
+  return m_buses[ddc - 1].engine.get();
+}
+
+// -----------------------------------------------------------------------------------------------
+// Matching
+// -----------------------------------------------------------------------------------------------
+
+void I2cDdcBackend::ScanBuses()
+{
+  if (m_scanned)
+    return;
+  for (auto &slot : m_buses)
+    slot.hasMonitor = slot.engine->ReadEdid(slot.edid);
+  m_matches.clear();
+  m_scanned = true;
+}
+
+int I2cDdcBackend::MatchBus(OutputHandle output)
+{
+  ScanBuses();
+  auto known = m_matches.find(output);
+  if (known != m_matches.end())
+    return known->second;
+
+  int match = -1;
+  uint8_t edid[DdcCi::EDID_LENGTH];
+  if (m_inner->GetEdid(output, edid))
+  {
+    for (size_t i = 0; i < m_buses.size() && match < 0; ++i)
+    {
+      if (m_buses[i].hasMonitor && std::memcmp(m_buses[i].edid, edid, sizeof(edid)) == 0)
+        match = static_cast<int>(i);
+    }
+  }
+  else if (m_outputCount == 1)
+  {
+    // No EDID to compare: only an unambiguous one-to-one pairing is safe.
+    int monitors = 0;
+    for (size_t i = 0; i < m_buses.size(); ++i)
+    {
+      if (m_buses[i].hasMonitor)
+      {
+        ++monitors;
+        match = static_cast<int>(i);
+      }
+    }
+    if (monitors != 1)
+      match = -1;
+  }
+  m_matches[output] = match;
+  return match;
+}
+
+// -----------------------------------------------------------------------------------------------
+// Forwarded to the wrapped backend
+// -----------------------------------------------------------------------------------------------
+
+std::vector<DisplayOutput> I2cDdcBackend::EnumerateOutputs()
+{
+  std::vector<DisplayOutput> outputs = m_inner->EnumerateOutputs();
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_outputCount = outputs.size();
+  m_scanned = false; // Monitors may have moved between connectors
+  return outputs;
+}
+
+bool I2cDdcBackend::OpenOutput(OutputHandle output)
+{
+  return m_inner->OpenOutput(output);
+}
+
+void I2cDdcBackend::CloseOutput(OutputHandle output)
+{
+  m_inner->CloseOutput(output);
+}
+
+bool I2cDdcBackend::GetEdid(OutputHandle output, uint8_t *edid)
+{
+  if (m_inner->GetEdid(output, edid))
+    return true;
+  std::lock_guard<std::mutex> lock(m_mutex);
+  int bus = MatchBus(output);
+  if (bus < 0)
+    return false;
+  std::memcpy(edid, m_buses[bus].edid, DdcCi::EDID_LENGTH);
+  return true;
+}
+
+int I2cDdcBackend::GetRefreshRate(OutputHandle output)
+{
+  return m_inner->GetRefreshRate(output);
+}
+
+int I2cDdcBackend::GetGammaSize(OutputHandle output)
+{
+  return m_inner->GetGammaSize(output);
+}
+
+bool I2cDdcBackend::GetGammaRamp(OutputHandle output, uint16_t *ramp)
+{
+  return m_inner->GetGammaRamp(output, ramp);
+}
+
+bool I2cDdcBackend::SetGammaRamp(OutputHandle output, const uint16_t *ramp)
+{
+  return m_inner->SetGammaRamp(output, ramp);
+}
+
+bool I2cDdcBackend::FlushGamma()
+{
+  return m_inner->FlushGamma();
+}
+
+bool I2cDdcBackend::InitColorEffects()
+{
+  return m_inner->InitColorEffects();
+}
+
+void I2cDdcBackend::ShutdownColorEffects()
+{
+  m_inner->ShutdownColorEffects();
+}
+
+bool I2cDdcBackend::SetColorMatrix(const ColorMatrix &matrix)
+{
+  return m_inner->SetColorMatrix(matrix);
+}
+
+// -----------------------------------------------------------------------------------------------
+// DDC/CI
+// -----------------------------------------------------------------------------------------------
+
+int I2cDdcBackend::CountDdcEndpoints(OutputHandle output)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return MatchBus(output) >= 0 ? 1 : 0;
+}
+
+std::vector<DdcHandle> I2cDdcBackend::OpenDdc(OutputHandle output)
+{
+  // A connector's EDID names a single sink, so one bus per output at most.
+  std::lock_guard<std::mutex> lock(m_mutex);
+  int bus = MatchBus(output);
+  if (bus < 0)
+    return {};
+  return {static_cast<DdcHandle>(bus + 1)};
+}
+
+void I2cDdcBackend::CloseDdc(DdcHandle)
+{
+  // Buses stay open for the backend's lifetime.
+}
+
+bool I2cDdcBackend::GetDdcBrightness(DdcHandle ddc, uint32_t &minValue, uint32_t &currentValue, uint32_t &maxValue)
+{
+  DdcCiEngine *engine = FindEngine(ddc);
+  uint16_t current = 0, maximum = 0;
+  if (!engine || !engine->GetVcp(DdcCi::VCP_BRIGHTNESS, current, maximum))
+    return false;
+  // Continuous VCP features always start at 0.
+  minValue = 0;
+  currentValue = current;
+  maxValue = maximum;
+  return true;
+}
+
+bool I2cDdcBackend::SetDdcBrightness(DdcHandle ddc, uint32_t value)
+{
+  DdcCiEngine *engine = FindEngine(ddc);
+  return engine && engine->SetVcp(DdcCi::VCP_BRIGHTNESS, static_cast<uint16_t>(value > 0xFFFF ? 0xFFFF : value));
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include "ddcci.h"
+#include "displaybackend.h"
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/**
+ * @brief Adds native DDC/CI over raw I2C buses to another DisplayBackend.
+ *
+ * Enumeration, gamma and colour effects are forwarded to the wrapped backend
+ * (X11 or DRM on Linux). DDC/CI endpoints come from the given buses: every
+ * bus with a valid EDID at 0x50 is a monitor, and it is matched to the output
+ * whose own EDID is identical. If the wrapped backend cannot report EDIDs, a
+ * single output is still paired with a single monitor bus.
+ *
+ * Buses are scanned lazily, on the first CountDdcEndpoints after each
+ * enumeration, so EnumerateOutputs stays free of bus traffic. DdcHandle is
+ * the bus index plus one.
+ */
+class I2cDdcBackend : public DisplayBackend
+{
+public:
+  /**
+   * @param inner Backend that provides everything except DDC/CI.
+   * @param buses Candidate buses, e.g. LinuxI2cBus::OpenAll().
+   * @param timing DDC/CI delays handed to each bus's DdcCiEngine.
+   */
+  I2cDdcBackend(std::shared_ptr<DisplayBackend> inner,
+                std::vector<std::shared_ptr<DdcCi::I2cBus>> buses,
+                DdcCi::Timing timing = DdcCi::Timing());
+
+  /**
+   * @brief Protocol counters of one endpoint's engine.
+   */
+  DdcCiEngine::Stats GetEngineStats(DdcHandle ddc) const;
+
+  std::vector<DisplayOutput> EnumerateOutputs() override;
+  bool OpenOutput(OutputHandle output) override;
+  void CloseOutput(OutputHandle output) override;
+  bool GetEdid(OutputHandle output, uint8_t *edid) override;
+  int GetRefreshRate(OutputHandle output) override;
+
+  int GetGammaSize(OutputHandle output) override;
+  bool GetGammaRamp(OutputHandle output, uint16_t *ramp) override;
+  bool SetGammaRamp(OutputHandle output, const uint16_t *ramp) override;
+  bool FlushGamma() override;
+
+  int CountDdcEndpoints(OutputHandle output) override;
+  std::vector<DdcHandle> OpenDdc(OutputHandle output) override;
+  void CloseDdc(DdcHandle ddc) override;
+  bool GetDdcBrightness(DdcHandle ddc, uint32_t &minValue, uint32_t &currentValue, uint32_t &maxValue) override;
+  bool SetDdcBrightness(DdcHandle ddc, uint32_t value) override;
+
+  bool InitColorEffects() override;
+  void ShutdownColorEffects() override;
+  bool SetColorMatrix(const ColorMatrix &matrix) override;
+
+private:
+  struct BusSlot
+  {
+    std::shared_ptr<DdcCi::I2cBus> bus;
+    std::unique_ptr<DdcCiEngine> engine;
+    bool hasMonitor = false; // A valid EDID answered at 0x50 on the last scan
+    uint8_t edid[DdcCi::EDID_LENGTH] = {};
+  };
+
+  void ScanBuses();                         // Called with m_mutex held
+  int MatchBus(OutputHandle output);        // Called with m_mutex held; -1 if none
+  DdcCiEngine *FindEngine(DdcHandle ddc) const;
+
+  std::shared_ptr<DisplayBackend> m_inner;
+  std::vector<BusSlot> m_buses; // Fixed after construction, so engines can be used without m_mutex
+  std::mutex m_mutex;           // Guards scanning and matching
+  bool m_scanned = false;
+  size_t m_outputCount = 0;
+  std::map<OutputHandle, int> m_matches; // Output -> bus index, from the current scan
+};
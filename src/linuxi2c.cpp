@@ -0,0 +1,91 @@
+#include "linuxi2c.h"
+#include <algorithm>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fstream>
+#include <linux/i2c-dev.h>
+#include <linux/i2c.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+LinuxI2cBus::LinuxI2cBus(const std::string &path)
+    : m_path(path)
+{
+  m_fd = open(path.c_str(), O_RDWR | O_CLOEXEC);
+}
+
+LinuxI2cBus::~LinuxI2cBus()
+{
+  if (m_fd >= 0)
+    close(m_fd);
+}
+
+bool LinuxI2cBus::IsOpen() const
+{
+  return m_fd >= 0;
+}
+
+const std::string &LinuxI2cBus::GetPath() const
+{
+  return m_path;
+}
+
+bool LinuxI2cBus::Transfer(uint8_t address, uint16_t flags, uint8_t *data, size_t length)
+{
+  if (m_fd < 0)
+    return false;
+
+  struct i2c_msg message;
+  message.addr = address;
+  message.flags = flags;
+  message.len = static_cast<uint16_t>(length);
+  message.buf = data;
+
+  struct i2c_rdwr_ioctl_data transfer;
+  transfer.msgs = &message;
+  transfer.nmsgs = 1;
+  return ioctl(m_fd, I2C_RDWR, &transfer) == 1;
+}
+
+bool LinuxI2cBus::Write(uint8_t address, const uint8_t *data, size_t length)
+{
+  // i2c_msg::buf is not const, but the kernel only reads it for writes.
+  return Transfer(address, 0, const_cast<uint8_t *>(data), length);
+}
+
+bool LinuxI2cBus::Read(uint8_t address, uint8_t *data, size_t length)
+{
+  return Transfer(address, I2C_M_RD, data, length);
+}
+
+std::vector<std::shared_ptr<DdcCi::I2cBus>> LinuxI2cBus::OpenAll()
+{
+  std::vector<int> numbers;
+  if (DIR *dev = opendir("/dev"))
+  {
+    while (struct dirent *entry = readdir(dev))
+    {
+      std::string name = entry->d_name;
+      if (name.compare(0, 4, "i2c-") == 0 && name.size() > 4 &&
+          name.find_first_not_of("0123456789", 4) == std::string::npos)
+        numbers.push_back(std::stoi(name.substr(4)));
+    }
+    closedir(dev);
+  }
+  std::sort(numbers.begin(), numbers.end());
+
+  std::vector<std::shared_ptr<DdcCi::I2cBus>> buses;
+  for (int number : numbers)
+  {
+    std::string adapter;
+    std::ifstream nameFile("/sys/bus/i2c/devices/i2c-" + std::to_string(number) + "/name");
+    std::getline(nameFile, adapter);
+    if (adapter.compare(0, 5, "SMBus") == 0)
+      continue;
+
+    auto bus = std::make_shared<LinuxI2cBus>("/dev/i2c-" + std::to_string(number));
+    if (bus->IsOpen())
+      buses.push_back(bus);
+  }
+  return buses;
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include "ddcci.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * @brief DdcCi::I2cBus on a Linux /dev/i2c-N character device.
+ *
+ * Each transaction is a single I2C_RDWR message, which also works while a
+ * kernel driver has claimed the address (as eeprom drivers do for 0x50).
+ * Requires the i2c-dev module and read/write access to the node (usually
+ * membership of the i2c group).
+ */
+class LinuxI2cBus : public DdcCi::I2cBus
+{
+public:
+  explicit LinuxI2cBus(const std::string &path);
+  ~LinuxI2cBus() override;
+
+  LinuxI2cBus(const LinuxI2cBus &) = delete;
+  LinuxI2cBus &operator=(const LinuxI2cBus &) = delete;
+
+  bool IsOpen() const;
+  const std::string &GetPath() const;
+
+  bool Write(uint8_t address, const uint8_t *data, size_t length) override;
+  bool Read(uint8_t address, uint8_t *data, size_t length) override;
+
+  /**
+   * @brief Opens every /dev/i2c-N in numeric order, skipping SMBus host
+   *        controllers (they never carry a display, and 0x50 on them is
+   *        usually a memory SPD EEPROM).
+   */
+  static std::vector<std::shared_ptr<DdcCi::I2cBus>> OpenAll();
+
+private:
+  bool Transfer(uint8_t address, uint16_t flags, uint8_t *data, size_t length);
+
+  std::string m_path;
+  int m_fd = -1;
+};
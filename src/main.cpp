@@ -2,12 +2,28 @@
 #include <shellapi.h>
 #include <commctrl.h>
 #include <iostream>
+#include <fstream>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
 
 #include "tray.h"
 #include "settings.h"
 #include "brightness.h"
+#include "ambient.h"
 #include "colortemp.h"
 #include "bwfilter.h"
+#include "profiles.h"
+#include "control.h"
+#include "cli.h"
+#include "gammawatch.h"
+#include "winfocus.h"
+#include "winbackend.h"
+#include "ddccache.h"
+#include "phaselog.h"
+#include "trace.h"
+#include "gui.h"
 #include "resource.h"
 
 // Global application instance
@@ -15,8 +31,60 @@ HINSTANCE g_hInstance = nullptr;
 HWND g_hwnd = nullptr;
 Settings g_settings;
 
+// Posted to g_hwnd by the background DDC/CI probe once hardware brightness
+// can be restored.
+const UINT WM_HARDWARE_PROBED = WM_APP + 3;
+
+// Posted by the control server with a heap-allocated std::function<void()>
+// in lParam, for the commands that must run on this thread.
+const UINT WM_CONTROL_INVOKE = WM_APP + 4;
+
+// Timings of the startup phases, measured from process start. Reset for each
+// later restore (display change, resume).
+PhaseLog g_startupLog;
+static const char *g_restoreReason = "startup";
+static bool g_startupLogStarted = false;
+
+// Automatic brightness: the ambient light sensor is opened and polled on a
+// timer only while the setting is on. Null while it is off, or if there is
+// no sensor to read.
+const UINT_PTR ID_AMBIENT_TIMER = 1;
+const UINT AMBIENT_POLL_MS = 1000;
+static std::unique_ptr<AutoBrightness> g_autoBrightness;
+
+// Colour effect fades (BWFilter) advance on this timer, about once a frame
+const UINT_PTR ID_COLOR_EFFECT_TIMER = 2;
+const UINT COLOR_EFFECT_FRAME_MS = 16;
+
+// Gamma drift watchdog: a one-shot timer, re-armed after every check with
+// the watchdog's next interval
+const UINT_PTR ID_GAMMA_WATCH_TIMER = 3;
+static GammaWatchdog g_gammaWatchdog;
+
+// Per-application profiles from profiles.ini in the data directory, switched
+// by foreground window events. Null if there is no profile file.
+static std::unique_ptr<ProfileEngine> g_profiles;
+static WinFocusSource g_focusSource;
+static std::string g_profilesStatus = "none";
+
+// Local control endpoint for scripts and the command line
+static ControlServer g_control;
+
+// Monitors whose hardware brightness has been restored since the last
+// refresh. Cached monitors are restored with the gamma, the rest once probed.
+static std::set<std::wstring> g_hardwareRestored;
+
 // Function to restore brightness settings on startup
-void RestoreBrightnessOnStartup();
+void RestoreBrightnessOnStartup(const char *reason = "startup");
+void ApplyDisplayChange();
+void RestoreHardwareBrightness();
+bool StartHardwareRestore();
+void UpdateAutoBrightness();
+void LoadProfiles(const std::filesystem::path &dataDirectory);
+void WriteStartupLog();
+void RestartGammaWatchdog();
+int RunCommand(const std::vector<std::string> &args);
+void StoreMonitorLevels(int monitorIndex);
 
 // Forward declarations
 LRESULT CALLBACK WndProc(HWND, UINT, WPARAM, LPARAM);
@@ -24,6 +92,26 @@ LRESULT CALLBACK WndProc(HWND, UINT, WPARAM, LPARAM);
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE, LPSTR, int)
 {
   g_hInstance = hInstance;
+  Trace::SetThreadName("ui");
+
+  // candela --get / --set / --bw: apply or report, then exit, without any
+  // of the window, tray or Magnification setup below
+  std::vector<std::string> args;
+  int argc = 0;
+  if (wchar_t **argv = CommandLineToArgvW(GetCommandLineW(), &argc))
+  {
+    for (int i = 1; i < argc; ++i)
+    {
+      int length = WideCharToMultiByte(CP_UTF8, 0, argv[i], -1, nullptr, 0, nullptr, nullptr);
+      std::string arg(length > 1 ? length - 1 : 0, '\0');
+      if (length > 1)
+        WideCharToMultiByte(CP_UTF8, 0, argv[i], -1, &arg[0], length, nullptr, nullptr);
+      args.push_back(arg);
+    }
+    LocalFree(argv);
+  }
+  if (CliUtils::IsCommand(args))
+    return RunCommand(args);
 
   // Initialize common controls
   INITCOMMONCONTROLSEX icc;
@@ -31,14 +119,31 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE, LPSTR, int)
   icc.dwICC = ICC_BAR_CLASSES;
   InitCommonControlsEx(&icc);
 
+  // All display access (gamma, DDC/CI, colour effects) goes through the Win32 backend
+  SetDisplayBackend(std::make_shared<WinDisplayBackend>());
+
   // Load settings
+  PhaseLog::Clock::time_point phase = PhaseLog::Clock::now();
   g_settings.load();
+  g_startupLog.End("load settings", phase);
+
+  // Known monitors' DDC/CI capabilities, so they can skip probing
+  phase = PhaseLog::Clock::now();
+  std::filesystem::path dataDirectory = g_settings.getDataDirectory();
+  auto ddcCache = std::make_shared<DdcCapabilityCache>(
+      dataDirectory.empty() ? std::filesystem::path() : dataDirectory / L"ddccaps.bin");
+  ddcCache->Load();
+  BrightnessController::SetCapabilityCache(ddcCache);
+  g_startupLog.End("load DDC/CI cache", phase);
 
   // Initialise the Magnification runtime once for the lifetime of the process
   // (used by BWFilter to apply the system-wide grayscale colour effect).
   BWFilter::Initialize();
+  BWFilter::SetScheduler([]
+                         { SetTimer(g_hwnd, ID_COLOR_EFFECT_TIMER, COLOR_EFFECT_FRAME_MS, nullptr); });
 
   // Register window class
+  phase = PhaseLog::Clock::now();
   const wchar_t CLASS_NAME[] = L"CandelaTrayWindowClass";
   WNDCLASSEXW wc = {};
   wc.cbSize = sizeof(WNDCLASSEXW);
@@ -77,10 +182,30 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE, LPSTR, int)
   // Ensure window is hidden as we run in the tray
   ShowWindow(g_hwnd, SW_HIDE);
   UpdateWindow(g_hwnd);
+  g_startupLog.End("create tray", phase);
+
+  // Ambient light sensor, if automatic brightness is on
+  UpdateAutoBrightness();
 
-  // Apply saved brightness settings (moved after window creation)
+  // Apply saved brightness settings (moved after window creation). Only the
+  // gamma half runs here; DDC/CI finishes in the background.
   RestoreBrightnessOnStartup();
 
+  // Profiles go on top of the restored levels, starting with whatever
+  // window has the focus now
+  LoadProfiles(dataDirectory);
+
+  // Scripts can drive the same state from here on
+  g_control.SetUiInvoker([](std::function<void()> task)
+                         {
+    auto *posted = new std::function<void()>(std::move(task));
+    if (PostMessage(g_hwnd, WM_CONTROL_INVOKE, 0, reinterpret_cast<LPARAM>(posted)))
+      return true;
+    delete posted;
+    return false; });
+  g_control.SetStoreHandler(StoreMonitorLevels);
+  g_control.Start();
+
   // Main message loop
   MSG msg;
   while (GetMessage(&msg, nullptr, 0, 0))
@@ -92,12 +217,18 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE, LPSTR, int)
   // Clean up tray icon
   Tray::removeTray(g_hwnd);
 
+  g_focusSource.Stop();
+  g_control.Stop();
+
   // Restore brightness/gamma settings
   BrightnessController::Cleanup();
 
   // Clear the grayscale colour effect and release Magnification resources.
   BWFilter::Cleanup();
 
+  // Write out any settings still waiting for their quiet period.
+  g_settings.shutdown();
+
   return (int)msg.wParam;
 }
 
@@ -111,16 +242,54 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT message, WPARAM wParam, LPARAM lParam)
   }
   case WM_DISPLAYCHANGE:
   {
-    BrightnessController::RefreshMonitors();
-    RestoreBrightnessOnStartup();
+    ApplyDisplayChange();
+    break;
+  }
+  case WM_TIMER:
+  {
+    if (wParam == ID_AMBIENT_TIMER && g_autoBrightness)
+      g_autoBrightness->Step();
+    else if (wParam == ID_COLOR_EFFECT_TIMER && !BWFilter::Tick())
+      KillTimer(hwnd, ID_COLOR_EFFECT_TIMER);
+    else if (wParam == ID_GAMMA_WATCH_TIMER)
+      SetTimer(hwnd, ID_GAMMA_WATCH_TIMER, static_cast<UINT>(g_gammaWatchdog.Check().count()), nullptr);
+    break;
+  }
+  case WM_HARDWARE_PROBED:
+  {
+    PhaseLog::Clock::time_point phase = PhaseLog::Clock::now();
+    RestoreHardwareBrightness();
+    g_startupLog.End("restore hardware", phase);
+
+    // An open popup still shows "Probing" on its hardware sliders.
+    RefreshHardwareSliders();
+    WriteStartupLog();
+    break;
+  }
+  case WM_AUTO_BRIGHTNESS_CHANGED:
+  {
+    UpdateAutoBrightness();
+    break;
+  }
+  case WM_CONTROL_INVOKE:
+  {
+    std::unique_ptr<std::function<void()>> task(reinterpret_cast<std::function<void()> *>(lParam));
+    (*task)();
+    break;
+  }
+  case WM_ENDSESSION:
+  {
+    // The session can end without the message loop ever returning, so this
+    // is the last chance to persist pending settings.
+    if (wParam)
+      g_settings.shutdown();
     break;
   }
   case WM_POWERBROADCAST:
   {
     if (wParam == PBT_APMRESUMEAUTOMATIC)
     {
-      BrightnessController::RefreshMonitors();
-      RestoreBrightnessOnStartup();
+      RestoreBrightnessOnStartup("resume");
     }
     break;
   }
@@ -151,28 +320,313 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT message, WPARAM wParam, LPARAM lParam)
   return 0;
 }
 
-// Function to restore brightness settings on startup
-void RestoreBrightnessOnStartup()
+// Function to restore brightness settings on startup. Runs in phases so the
+// tray is usable before the slow DDC/CI probing has finished:
+//   1. enumerate the outputs and open them for gamma (no DDC/CI traffic);
+//   2. restore software brightness and colour temp, which only need gamma,
+//      and hardware brightness on monitors the DDC/CI cache already knows;
+//   3. probe the other monitors (and revalidate the cached ones) on a
+//      background thread, then restore the rest of the hardware brightness
+//      when it reports back (WM_HARDWARE_PROBED).
+void RestoreBrightnessOnStartup(const char *reason)
 {
-  // Initialize brightness control
-  if (!BrightnessController::Initialize())
+  TRACE_SCOPE("RestoreBrightness");
+  // Also stops a DDC/CI probe still running for the previous monitor list,
+  // so nothing from an earlier restore lands in the log after the reset.
+  PhaseLog::Clock::time_point phase = PhaseLog::Clock::now();
+  bool found = BrightnessController::RefreshOutputs();
+  g_hardwareRestored.clear();
+
+  // Startup phases are timed from process start; later restores from here.
+  if (g_startupLogStarted)
+    g_startupLog.Reset(phase);
+  g_startupLogStarted = true;
+  g_restoreReason = reason;
+  g_startupLog.End("enumerate outputs", phase);
+  if (!found)
   {
+    WriteStartupLog();
     return;
   }
 
-  // Apply saved brightness settings per monitor, in the documented order:
-  // hardware brightness → software brightness → colour temp.
+  // Apply saved gamma settings per monitor: software brightness → colour
+  // temp. The gamma writes for every monitor are flushed together at EndUpdate.
+  phase = PhaseLog::Clock::now();
   const auto &monitors = BrightnessController::GetMonitors();
+  BrightnessController::BeginUpdate();
   for (size_t i = 0; i < monitors.size(); ++i)
   {
     MonitorSettings settings = g_settings.getMonitorSettings(monitors[i].deviceName);
 
-    BrightnessController::SetHardwareBrightness(static_cast<int>(i), settings.lastHardwareBrightness);
     BrightnessController::SetSoftwareBrightness(static_cast<int>(i), settings.lastSoftwareBrightness);
     BrightnessController::SetSoftwareColorTemp(static_cast<int>(i), settings.lastStandardColorTemp);
   }
+  BrightnessController::EndUpdate();
+  g_startupLog.End("restore gamma", phase);
+  RestartGammaWatchdog();
+
+  phase = PhaseLog::Clock::now();
+  RestoreHardwareBrightness();
+  g_startupLog.End("restore cached hardware", phase);
 
   // System-wide B&W filter (Magnification API). Independent of the gamma
   // pipeline above; sits on top of the final composited desktop.
   BWFilter::SetEnabled(g_settings.getBWEnabled());
-}
\ No newline at end of file
+
+  // The saved levels are the new baseline for the active profile
+  if (g_profiles)
+    g_profiles->Reset();
+
+  if (!StartHardwareRestore())
+    WriteStartupLog();
+}
+
+// WM_DISPLAYCHANGE: a mode change on one screen leaves the others alone.
+// The new topology is diffed against the current monitors; only the ones
+// that appeared are restored and probed, and the controller itself rewrites
+// the ramps the driver reset. Monitors that are still there keep their
+// handles, levels and DDC/CI state.
+void ApplyDisplayChange()
+{
+  TRACE_SCOPE("ApplyDisplayChange");
+  PhaseLog::Clock::time_point phase = PhaseLog::Clock::now();
+  TopologyChange change;
+  bool found = BrightnessController::UpdateOutputs(change);
+
+  // A monitor that comes back later is restored again.
+  for (const std::wstring &name : change.removed)
+    g_hardwareRestored.erase(name);
+
+  g_startupLog.Reset(phase);
+  g_startupLogStarted = true;
+  g_restoreReason = "display change";
+  g_startupLog.End("diff outputs", phase);
+  if (!found)
+  {
+    WriteStartupLog();
+    return;
+  }
+
+  phase = PhaseLog::Clock::now();
+  const auto &monitors = BrightnessController::GetMonitors();
+  BrightnessController::BeginUpdate();
+  for (int i : change.added)
+  {
+    MonitorSettings settings = g_settings.getMonitorSettings(monitors[i].deviceName);
+    BrightnessController::SetSoftwareBrightness(i, settings.lastSoftwareBrightness);
+    BrightnessController::SetSoftwareColorTemp(i, settings.lastStandardColorTemp);
+  }
+  BrightnessController::EndUpdate();
+  g_startupLog.End("restore gamma", phase);
+  RestartGammaWatchdog();
+
+  // Kept monitors are already in g_hardwareRestored, so this only reaches
+  // new monitors the DDC/CI cache knows.
+  phase = PhaseLog::Clock::now();
+  RestoreHardwareBrightness();
+  g_startupLog.End("restore cached hardware", phase);
+
+  if (!StartHardwareRestore())
+    WriteStartupLog();
+}
+
+// Checks the ramps again soon: drivers tend to reset them shortly after a
+// mode change or resume, not only during it.
+void RestartGammaWatchdog()
+{
+  SetTimer(g_hwnd, ID_GAMMA_WATCH_TIMER, static_cast<UINT>(g_gammaWatchdog.Reset().count()), nullptr);
+}
+
+// Starts the background DDC/CI probe for the monitors still pending; their
+// hardware brightness is restored on WM_HARDWARE_PROBED. Returns false if
+// there was nothing to probe.
+bool StartHardwareRestore()
+{
+  PhaseLog::Clock::time_point phase = PhaseLog::Clock::now();
+  return BrightnessController::StartHardwareProbe(
+      [phase]()
+      {
+        g_startupLog.End("probe DDC/CI", phase);
+        PostMessage(g_hwnd, WM_HARDWARE_PROBED, 0, 0);
+      });
+}
+
+// Hardware half of RestoreBrightnessOnStartup: runs for the monitors known
+// to the DDC/CI cache straight away, and for the rest once probed. Each
+// monitor is restored once per refresh, so a slider moved in between stays put.
+void RestoreHardwareBrightness()
+{
+  const auto &monitors = BrightnessController::GetMonitors();
+  for (size_t i = 0; i < monitors.size(); ++i)
+  {
+    if (BrightnessController::GetHardwareProbeState(static_cast<int>(i)) != HardwareProbeState::Available ||
+        !g_hardwareRestored.insert(monitors[i].deviceName).second)
+      continue;
+    MonitorSettings settings = g_settings.getMonitorSettings(monitors[i].deviceName);
+    BrightnessController::SetHardwareBrightness(static_cast<int>(i), settings.lastHardwareBrightness);
+  }
+
+  // Restored levels are the saved ones; let the sensor have its say again
+  if (g_autoBrightness)
+    g_autoBrightness->Reset();
+
+  // New monitors, and hardware levels just probed, get the active profile
+  if (g_profiles)
+    g_profiles->Refresh();
+}
+
+// Opens the ambient light sensor and starts polling it when automatic
+// brightness is switched on, and closes it and stops the timer when it is
+// switched off. A fresh AutoBrightness applies the current light level at
+// its first poll.
+void UpdateAutoBrightness()
+{
+  if (!g_settings.getAutoBrightness())
+  {
+    KillTimer(g_hwnd, ID_AMBIENT_TIMER);
+    g_autoBrightness.reset();
+    return;
+  }
+  if (g_autoBrightness)
+    return;
+  std::unique_ptr<AmbientSource> source = AmbientUtils::CreateDefaultSource(g_settings.getDataDirectory());
+  if (!source)
+    return;
+  g_autoBrightness = std::make_unique<AutoBrightness>(std::move(source));
+  SetTimer(g_hwnd, ID_AMBIENT_TIMER, AMBIENT_POLL_MS, nullptr);
+}
+
+// Reads profiles.ini from the data directory and, if it has any rules,
+// starts following the foreground window. A file that does not parse is
+// reported in startup.log and leaves profiles off.
+void LoadProfiles(const std::filesystem::path &dataDirectory)
+{
+  std::vector<AppProfile> profiles;
+  std::vector<ProfileRule> rules;
+  std::string error;
+  std::filesystem::path path = dataDirectory / L"profiles.ini";
+  if (dataDirectory.empty() || !std::filesystem::exists(path))
+    return;
+  if (!ProfileUtils::Load(path, profiles, rules, &error))
+  {
+    g_profilesStatus = "profiles.ini " + error;
+    return;
+  }
+  if (rules.empty())
+    return;
+
+  g_profilesStatus = std::to_string(profiles.size()) + " profile(s), " + std::to_string(rules.size()) + " rule(s)";
+  g_profiles = std::make_unique<ProfileEngine>(std::move(profiles), rules);
+  if (!g_focusSource.Start([](const FocusEvent &event)
+                           { g_profiles->OnFocus(event); }))
+    g_profilesStatus += ", no focus events";
+  else
+    g_profilesStatus += ", " + g_focusSource.Describe();
+}
+
+// Saves a monitor's levels as a command left them: in-process, or through
+// the control endpoint for a command forwarded to this instance
+void StoreMonitorLevels(int monitorIndex)
+{
+  std::wstring deviceName = BrightnessController::GetDeviceName(monitorIndex);
+  MonitorSettings settings = g_settings.getMonitorSettings(deviceName);
+  settings.lastSoftwareBrightness = BrightnessController::GetSoftwareBrightness(monitorIndex);
+  settings.lastStandardColorTemp = BrightnessController::GetSoftwareColorTemp(monitorIndex);
+  if (BrightnessController::GetHardwareProbeState(monitorIndex) == HardwareProbeState::Available)
+    settings.lastHardwareBrightness = BrightnessController::GetHardwareBrightness(monitorIndex);
+  g_settings.setMonitorSettings(deviceName, settings);
+}
+
+// Writes a one-shot command's output. Candela is a GUI program, so there is
+// a standard output only if the caller redirected it; otherwise the text
+// goes to the console the command was typed in, if any.
+static void WriteOutput(const std::string &text)
+{
+  HANDLE out = GetStdHandle(STD_OUTPUT_HANDLE);
+  if ((!out || out == INVALID_HANDLE_VALUE) && AttachConsole(ATTACH_PARENT_PROCESS))
+    out = CreateFileW(L"CONOUT$", GENERIC_WRITE, FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, 0, nullptr);
+  if (!out || out == INVALID_HANDLE_VALUE)
+    return;
+  DWORD written = 0;
+  WriteFile(out, text.data(), static_cast<DWORD>(text.size()), &written, nullptr);
+}
+
+// Runs a one-shot command line. A running instance is handed the request;
+// otherwise it is applied here to the monitors it names, on top of their
+// saved levels, and the new levels are saved so the next start keeps them.
+int RunCommand(const std::vector<std::string> &args)
+{
+  CliUtils::Command command;
+  std::string error;
+  if (!CliUtils::Parse(args, command, error))
+  {
+    WriteOutput(error + "\n" + CliUtils::Usage());
+    return 2;
+  }
+
+  std::string reply;
+  PhaseLog::Clock::time_point phase = PhaseLog::Clock::now();
+  if (CliUtils::Forward(command, ControlUtils::DefaultEndpoint(), reply))
+  {
+    g_startupLog.End("forward", phase);
+  }
+  else
+  {
+    SetDisplayBackend(std::make_shared<WinDisplayBackend>());
+    g_settings.load();
+    std::filesystem::path dataDirectory = g_settings.getDataDirectory();
+    auto ddcCache = std::make_shared<DdcCapabilityCache>(
+        dataDirectory.empty() ? std::filesystem::path() : dataDirectory / L"ddccaps.bin");
+    ddcCache->Load();
+    BrightnessController::SetCapabilityCache(ddcCache);
+    g_startupLog.End("load settings", phase);
+
+    reply = CliUtils::Apply(
+        command,
+        [](int index)
+        {
+          MonitorSettings saved = g_settings.getMonitorSettings(BrightnessController::GetDeviceName(index));
+          BrightnessController::SetSoftwareLevels(index, saved.lastSoftwareBrightness, saved.lastStandardColorTemp);
+        },
+        StoreMonitorLevels, &g_startupLog);
+    g_settings.shutdown();
+  }
+
+  int exitCode = CliUtils::ExitCode(reply);
+  if (command.timing)
+    reply += g_startupLog.Format();
+  WriteOutput(reply);
+  return exitCode;
+}
+
+// Sends the phase timings, and the DDC/CI retry policy learned for each
+// monitor so far, to the debugger and to startup.log in the data directory.
+// The file starts afresh with each launch; restores after a display change
+// or resume are appended.
+void WriteStartupLog()
+{
+  std::string text = std::string("Candela ") + g_restoreReason + ":\n" + g_startupLog.Format();
+  size_t monitorCount = BrightnessController::GetMonitors().size();
+  for (size_t i = 0; i < monitorCount; ++i)
+  {
+    std::vector<DdcHealth::Snapshot> health = BrightnessController::GetDdcHealth(static_cast<int>(i));
+    for (size_t e = 0; e < health.size(); ++e)
+      text += "DDC/CI monitor " + std::to_string(i + 1) + "." + std::to_string(e + 1) + ": " +
+              DdcHealthUtils::Format(health[e]) + "\n";
+    if (uint64_t drifts = BrightnessController::GetGammaDriftCount(static_cast<int>(i)))
+      text += "Gamma monitor " + std::to_string(i + 1) + ": overwritten " + std::to_string(drifts) + " time(s)\n";
+  }
+  if (g_autoBrightness)
+    text += "Ambient light: " + g_autoBrightness->GetSource().Describe() + "\n";
+  text += "Profiles: " + g_profilesStatus + "\n";
+  text += "Control: " + (g_control.IsRunning() ? g_control.GetEndpoint() : std::string("not running")) + "\n";
+  OutputDebugStringA(text.c_str());
+
+  std::filesystem::path directory = g_settings.getDataDirectory();
+  if (directory.empty())
+    return;
+  static bool truncated = false;
+  std::ofstream log(directory / L"startup.log", truncated ? std::ios::app : std::ios::trunc);
+  log << text;
+  truncated = true;
+}
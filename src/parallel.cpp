@@ -0,0 +1,35 @@
+#include "parallel.h"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+void ParallelFor(size_t count, size_t maxThreads, const std::function<void(size_t)> &fn)
+{
+  size_t threads = std::min(count, maxThreads);
+  if (threads < 2)
+  {
+    for (size_t i = 0; i < count; ++i)
+      fn(i);
+    return;
+  }
+
+  // Items are handed out one at a time so a slow monitor does not hold up a
+  // whole pre-assigned batch behind it.
+  std::atomic<size_t> next(0);
+  auto drain = [&]()
+  {
+    for (size_t i = next++; i < count; i = next++)
+      fn(i);
+  };
+
+  std::vector<std::thread> pool;
+  pool.reserve(threads - 1);
+  for (size_t t = 1; t < threads; ++t)
+    pool.emplace_back(drain);
+
+  drain();
+
+  for (auto &thread : pool)
+    thread.join();
+}
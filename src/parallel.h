@@ -0,0 +1,18 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+
+/**
+ * @brief Runs fn(0) .. fn(count - 1) on a small, short-lived pool of threads.
+ *
+ * Intended for I/O-bound fan-out such as probing several monitors over
+ * DDC/CI, where each item spends most of its time waiting on the bus. The
+ * calling thread takes part in the work and the call returns once every
+ * item has finished. Items must not depend on each other.
+ *
+ * @param count Number of items.
+ * @param maxThreads Upper bound on concurrently running items (including the
+ *        calling thread). Values below 2 run everything inline.
+ * @param fn Work item; receives the item index.
+ */
+void ParallelFor(size_t count, size_t maxThreads, const std::function<void(size_t)> &fn);
@@ -0,0 +1,56 @@
+#include "phaselog.h"
+#include <cstdio>
+
+namespace
+{
+  double Millis(PhaseLog::Clock::duration d)
+  {
+    return std::chrono::duration<double, std::milli>(d).count();
+  }
+}
+
+PhaseLog::PhaseLog(Clock::time_point origin)
+    : m_origin(origin)
+{
+}
+
+void PhaseLog::Reset(Clock::time_point origin)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_origin = origin;
+  m_phases.clear();
+}
+
+double PhaseLog::End(const std::string &name, Clock::time_point start)
+{
+  Clock::time_point end = Clock::now();
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  PhaseRecord record;
+  record.name = name;
+  record.startMs = Millis(start - m_origin);
+  record.durationMs = Millis(end - start);
+  m_phases.push_back(record);
+  return record.durationMs;
+}
+
+std::vector<PhaseRecord> PhaseLog::GetPhases() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_phases;
+}
+
+std::string PhaseLog::Format() const
+{
+  std::vector<PhaseRecord> phases = GetPhases();
+
+  std::string text;
+  char line[160];
+  for (const PhaseRecord &phase : phases)
+  {
+    std::snprintf(line, sizeof(line), "%-24s at %9.1f ms  took %9.1f ms\n", phase.name.c_str(), phase.startMs,
+                  phase.durationMs);
+    text += line;
+  }
+  return text;
+}
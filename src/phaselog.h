@@ -0,0 +1,59 @@
+#pragma once
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * @brief One timed phase, relative to the origin of the PhaseLog it was
+ *        recorded in.
+ */
+struct PhaseRecord
+{
+  std::string name;
+  double startMs = 0.0;    // When the phase began, measured from the origin
+  double durationMs = 0.0; // How long it ran
+};
+
+/**
+ * @brief Collects named, timed phases (e.g. the stages of startup) so they
+ *        can be logged together once the last one has finished.
+ *
+ * Phases may overlap and may be recorded from any thread.
+ */
+class PhaseLog
+{
+public:
+  using Clock = std::chrono::steady_clock;
+
+  /**
+   * @param origin Time every phase start is measured from.
+   */
+  explicit PhaseLog(Clock::time_point origin = Clock::now());
+
+  /**
+   * @brief Drops every recorded phase and starts measuring from @p origin.
+   */
+  void Reset(Clock::time_point origin = Clock::now());
+
+  /**
+   * @brief Records a phase that ran from @p start until now.
+   * @return The phase's duration in milliseconds.
+   */
+  double End(const std::string &name, Clock::time_point start);
+
+  /**
+   * @brief Returns the phases in the order they were recorded.
+   */
+  std::vector<PhaseRecord> GetPhases() const;
+
+  /**
+   * @brief Formats the log, one "name  start  duration" line per phase.
+   */
+  std::string Format() const;
+
+private:
+  mutable std::mutex m_mutex;
+  Clock::time_point m_origin;
+  std::vector<PhaseRecord> m_phases;
+};
@@ -0,0 +1,530 @@
+#include "profiles.h"
+#include "brightness.h"
+#include "bwfilter.h"
+#include "colortemp.h"
+#include <algorithm>
+#include <cctype>
+#include <cwctype>
+#include <deque>
+#include <fstream>
+#include <locale>
+#include <sstream>
+
+namespace
+{
+  std::wstring ToLower(const std::wstring &text)
+  {
+    std::wstring lower(text);
+    for (wchar_t &c : lower)
+      c = static_cast<wchar_t>(std::towlower(c));
+    return lower;
+  }
+
+  std::string Trim(const std::string &text)
+  {
+    size_t start = text.find_first_not_of(" \t\r");
+    if (start == std::string::npos)
+      return std::string();
+    size_t end = text.find_last_not_of(" \t\r");
+    return text.substr(start, end - start + 1);
+  }
+
+  // Decodes UTF-8 into the platform's wide encoding (UTF-16 on Windows, where
+  // window titles are compared as UTF-16). Malformed bytes become U+FFFD.
+  std::wstring FromUtf8(const std::string &text)
+  {
+    std::wstring wide;
+    for (size_t i = 0; i < text.size();)
+    {
+      unsigned char lead = static_cast<unsigned char>(text[i]);
+      size_t length = lead < 0x80 ? 1 : (lead >> 5) == 0x6 ? 2 : (lead >> 4) == 0xE ? 3 : (lead >> 3) == 0x1E ? 4 : 0;
+      uint32_t code = length == 1 ? lead : length == 2 ? lead & 0x1F : length == 3 ? lead & 0x0F : lead & 0x07;
+      bool valid = length > 0 && i + length <= text.size();
+      for (size_t k = 1; valid && k < length; ++k)
+      {
+        unsigned char next = static_cast<unsigned char>(text[i + k]);
+        valid = (next & 0xC0) == 0x80;
+        code = (code << 6) | (next & 0x3F);
+      }
+      if (!valid)
+      {
+        wide.push_back(static_cast<wchar_t>(0xFFFD));
+        ++i;
+        continue;
+      }
+      i += length;
+      if (sizeof(wchar_t) == 2 && code >= 0x10000)
+      {
+        code -= 0x10000;
+        wide.push_back(static_cast<wchar_t>(0xD800 + (code >> 10)));
+        wide.push_back(static_cast<wchar_t>(0xDC00 + (code & 0x3FF)));
+      }
+      else
+      {
+        wide.push_back(static_cast<wchar_t>(code));
+      }
+    }
+    return wide;
+  }
+
+  template <typename T>
+  bool ParseNumber(const std::string &text, T minValue, T maxValue, T &value)
+  {
+    std::istringstream stream(text);
+    stream.imbue(std::locale::classic());
+    char extra = 0;
+    return (stream >> value) && !(stream >> extra) && value >= minValue && value <= maxValue;
+  }
+
+  // Reads a level a profile may leave unset: -1 if no profile sets it, the
+  // new profile's level if it sets it, otherwise back to the baseline
+  int Pick(const AppProfile *from, const AppProfile *to, int AppProfile::*field, int baseline)
+  {
+    if (to && to->*field >= 0)
+      return to->*field;
+    if (from && from->*field >= 0)
+      return baseline;
+    return -1;
+  }
+
+  const char *const EFFECT_NAMES[] = {"correct-protanopia",  "correct-deuteranopia",  "correct-tritanopia",
+                                      "saturation",          "sepia",                 "grayscale",
+                                      "simulate-protanopia", "simulate-deuteranopia", "simulate-tritanopia",
+                                      "invert"};
+  static_assert(sizeof(EFFECT_NAMES) / sizeof(EFFECT_NAMES[0]) == ColorEffectStack::EFFECT_COUNT,
+                "one name per ColorEffect");
+}
+
+// -----------------------------------------------------------------------------------------------
+// SimulatedFocusSource
+// -----------------------------------------------------------------------------------------------
+
+bool SimulatedFocusSource::Start(Callback callback)
+{
+  m_callback = std::move(callback);
+  return true;
+}
+
+void SimulatedFocusSource::Stop()
+{
+  m_callback = nullptr;
+}
+
+std::string SimulatedFocusSource::Describe() const
+{
+  return "simulated";
+}
+
+bool SimulatedFocusSource::Focus(const std::wstring &process, const std::wstring &title)
+{
+  if (!m_callback)
+    return false;
+  m_callback(FocusEvent{process, title});
+  return true;
+}
+
+// -----------------------------------------------------------------------------------------------
+// ProfileMatcher
+// -----------------------------------------------------------------------------------------------
+
+ProfileMatcher::TitleIndex::TitleIndex() : m_nodes(1) {}
+
+void ProfileMatcher::TitleIndex::Add(const std::wstring &pattern, size_t rule)
+{
+  uint32_t node = 0;
+  for (wchar_t c : pattern)
+  {
+    auto found = m_nodes[node].next.find(c);
+    if (found != m_nodes[node].next.end())
+    {
+      node = found->second;
+      continue;
+    }
+    uint32_t child = static_cast<uint32_t>(m_nodes.size());
+    m_nodes.emplace_back();
+    m_nodes[node].next.emplace(c, child);
+    node = child;
+  }
+  m_nodes[node].rule = std::min(m_nodes[node].rule, rule);
+}
+
+void ProfileMatcher::TitleIndex::Build()
+{
+  // Breadth first, so a node's failure link (the longest proper suffix that
+  // is also in the trie) is complete before its children need it
+  std::deque<uint32_t> queue;
+  for (const auto &edge : m_nodes[0].next)
+    queue.push_back(edge.second);
+  while (!queue.empty())
+  {
+    uint32_t node = queue.front();
+    queue.pop_front();
+    for (const auto &edge : m_nodes[node].next)
+    {
+      uint32_t child = edge.second;
+      uint32_t fail = m_nodes[node].fail;
+      for (;;)
+      {
+        auto found = m_nodes[fail].next.find(edge.first);
+        if (found != m_nodes[fail].next.end() && found->second != child)
+        {
+          fail = found->second;
+          break;
+        }
+        if (fail == 0)
+          break;
+        fail = m_nodes[fail].fail;
+      }
+      m_nodes[child].fail = fail;
+      m_nodes[child].rule = std::min(m_nodes[child].rule, m_nodes[fail].rule);
+      queue.push_back(child);
+    }
+  }
+}
+
+size_t ProfileMatcher::TitleIndex::Match(const std::wstring &title, size_t best) const
+{
+  uint32_t node = 0;
+  for (wchar_t raw : title)
+  {
+    wchar_t c = static_cast<wchar_t>(std::towlower(raw));
+    for (;;)
+    {
+      auto found = m_nodes[node].next.find(c);
+      if (found != m_nodes[node].next.end())
+      {
+        node = found->second;
+        break;
+      }
+      if (node == 0)
+        break;
+      node = m_nodes[node].fail;
+    }
+    best = std::min(best, m_nodes[node].rule);
+  }
+  return best;
+}
+
+ProfileMatcher::ProfileMatcher(const std::vector<ProfileRule> &rules)
+{
+  for (size_t i = 0; i < rules.size(); ++i)
+  {
+    const ProfileRule &rule = rules[i];
+    Group &group = rule.process.empty() ? m_anyProcess : m_byProcess[ToLower(rule.process)];
+    if (rule.title.empty())
+      group.anyTitle = std::min(group.anyTitle, i);
+    else
+      group.titles.Add(ToLower(rule.title), i);
+  }
+  m_anyProcess.titles.Build();
+  for (auto &entry : m_byProcess)
+    entry.second.titles.Build();
+}
+
+size_t ProfileMatcher::MatchGroup(const Group &group, const std::wstring &title, size_t best)
+{
+  best = std::min(best, group.anyTitle);
+  if (group.titles.Empty())
+    return best;
+  return group.titles.Match(title, best);
+}
+
+size_t ProfileMatcher::Match(const std::wstring &process, const std::wstring &title) const
+{
+  size_t best = MatchGroup(m_anyProcess, title, NO_MATCH);
+  if (!m_byProcess.empty())
+  {
+    auto found = m_byProcess.find(ToLower(process));
+    if (found != m_byProcess.end())
+      best = MatchGroup(found->second, title, best);
+  }
+  return best;
+}
+
+size_t ProfileMatcher::MatchLinear(const std::vector<ProfileRule> &rules, const std::wstring &process,
+                                   const std::wstring &title)
+{
+  std::wstring lowerProcess = ToLower(process);
+  std::wstring lowerTitle = ToLower(title);
+  for (size_t i = 0; i < rules.size(); ++i)
+  {
+    if (!rules[i].process.empty() && ToLower(rules[i].process) != lowerProcess)
+      continue;
+    if (!rules[i].title.empty() && lowerTitle.find(ToLower(rules[i].title)) == std::wstring::npos)
+      continue;
+    return i;
+  }
+  return NO_MATCH;
+}
+
+// -----------------------------------------------------------------------------------------------
+// ProfileEngine
+// -----------------------------------------------------------------------------------------------
+
+ProfileEngine::ProfileEngine(std::vector<AppProfile> profiles, const std::vector<ProfileRule> &rules)
+    : ProfileEngine(std::move(profiles), rules, Options())
+{
+}
+
+ProfileEngine::ProfileEngine(std::vector<AppProfile> profiles, const std::vector<ProfileRule> &rules,
+                             const Options &options)
+    : m_profiles(std::move(profiles)), m_options(options)
+{
+  // A rule naming a profile that does not exist would never apply anything
+  std::vector<ProfileRule> valid;
+  for (const ProfileRule &rule : rules)
+  {
+    if (rule.profile >= m_profiles.size())
+      continue;
+    valid.push_back(rule);
+    m_ruleProfile.push_back(rule.profile);
+  }
+  m_matcher = ProfileMatcher(valid);
+}
+
+const AppProfile *ProfileEngine::Profile(size_t index) const
+{
+  return index < m_profiles.size() ? &m_profiles[index] : nullptr;
+}
+
+bool ProfileEngine::OnFocus(const FocusEvent &event)
+{
+  m_stats.events++;
+  size_t rule = m_matcher.Match(event.process, event.title);
+  size_t profile = rule == ProfileMatcher::NO_MATCH ? NO_PROFILE : m_ruleProfile[rule];
+  if (profile == m_active)
+    return false;
+
+  size_t previous = m_active;
+  m_active = profile;
+  m_stats.switches++;
+  Apply(previous, false);
+  ApplyEffects(previous);
+  return true;
+}
+
+void ProfileEngine::Reset()
+{
+  m_baseline.clear();
+  m_effectsCaptured = false;
+  if (m_active == NO_PROFILE)
+    return;
+  Apply(NO_PROFILE, false);
+  ApplyEffects(NO_PROFILE);
+}
+
+void ProfileEngine::Refresh()
+{
+  if (m_active == NO_PROFILE)
+    return;
+
+  // A monitor that comes back is restored to the user's levels, so its old
+  // baseline is no use
+  const std::vector<Monitor> &monitors = BrightnessController::GetMonitors();
+  for (auto it = m_baseline.begin(); it != m_baseline.end();)
+  {
+    bool present = std::any_of(monitors.begin(), monitors.end(),
+                               [&](const Monitor &monitor)
+                               { return monitor.deviceName == it->first; });
+    it = present ? std::next(it) : m_baseline.erase(it);
+  }
+  Apply(NO_PROFILE, true);
+}
+
+void ProfileEngine::Apply(size_t previous, bool onlyNew)
+{
+  const AppProfile *from = Profile(previous);
+  const AppProfile *to = Profile(m_active);
+
+  // Every monitor's ramp goes out in one flush
+  const std::vector<Monitor> &monitors = BrightnessController::GetMonitors();
+  BrightnessController::BeginUpdate();
+  for (size_t i = 0; i < monitors.size(); ++i)
+  {
+    int index = static_cast<int>(i);
+    bool hardware = BrightnessController::GetHardwareProbeState(index) == HardwareProbeState::Available;
+    auto found = m_baseline.find(monitors[i].deviceName);
+    bool known = found != m_baseline.end();
+    if (onlyNew && known && (found->second.hardwareBrightness >= 0 || !hardware))
+      continue;
+
+    Baseline &baseline = m_baseline[monitors[i].deviceName];
+    if (!known)
+    {
+      baseline.softwareBrightness = BrightnessController::GetSoftwareBrightness(index);
+      baseline.softwareColorTemp = BrightnessController::GetSoftwareColorTemp(index);
+    }
+    bool newHardware = hardware && baseline.hardwareBrightness < 0;
+    if (newHardware)
+      baseline.hardwareBrightness = BrightnessController::GetHardwareBrightness(index);
+
+    if (!onlyNew || !known)
+    {
+      int brightness = Pick(from, to, &AppProfile::softwareBrightness, baseline.softwareBrightness);
+      int kelvin = Pick(from, to, &AppProfile::softwareColorTemp, baseline.softwareColorTemp);
+      if (((brightness >= 0 && brightness != BrightnessController::GetSoftwareBrightness(index)) ||
+           (kelvin >= 0 && kelvin != BrightnessController::GetSoftwareColorTemp(index))) &&
+          BrightnessController::SetSoftwareLevels(index, brightness, kelvin))
+        m_stats.monitorWrites++;
+    }
+    if (hardware && (!onlyNew || newHardware))
+    {
+      int level = Pick(from, to, &AppProfile::hardwareBrightness, baseline.hardwareBrightness);
+      if (level >= 0 && level != BrightnessController::GetHardwareBrightness(index) &&
+          BrightnessController::SetHardwareBrightness(index, level))
+        m_stats.hardwareWrites++;
+    }
+  }
+  BrightnessController::EndUpdate();
+
+  // Back on the user's levels; the next profile takes a fresh baseline
+  if (!to)
+    m_baseline.clear();
+}
+
+void ProfileEngine::ApplyEffects(size_t previous)
+{
+  const AppProfile *from = Profile(previous);
+  const AppProfile *to = Profile(m_active);
+  if (!m_effectsCaptured)
+  {
+    for (size_t i = 0; i < ColorEffectStack::EFFECT_COUNT; ++i)
+      m_effectBaseline[i] = BWFilter::GetEffect(static_cast<ColorEffect>(i));
+    m_effectsCaptured = true;
+  }
+
+  // As Pick: the new profile's strength, else the baseline for effects the
+  // old profile had set
+  double target[ColorEffectStack::EFFECT_COUNT];
+  std::fill(std::begin(target), std::end(target), -1.0);
+  if (from)
+    for (const auto &effect : from->effects)
+      target[static_cast<size_t>(effect.first)] = m_effectBaseline[static_cast<size_t>(effect.first)];
+  if (to)
+    for (const auto &effect : to->effects)
+      target[static_cast<size_t>(effect.first)] = std::max(0.0, std::min(effect.second, 1.0));
+
+  for (size_t i = 0; i < ColorEffectStack::EFFECT_COUNT; ++i)
+  {
+    ColorEffect effect = static_cast<ColorEffect>(i);
+    if (target[i] < 0.0 || target[i] == BWFilter::GetEffect(effect))
+      continue;
+    if (BWFilter::SetEffect(effect, target[i], m_options.effectFade))
+      m_stats.effectChanges++;
+  }
+
+  if (!to)
+    m_effectsCaptured = false;
+}
+
+// -----------------------------------------------------------------------------------------------
+// ProfileUtils
+// -----------------------------------------------------------------------------------------------
+
+namespace ProfileUtils
+{
+  const char *EffectName(ColorEffect effect)
+  {
+    size_t index = static_cast<size_t>(effect);
+    return index < ColorEffectStack::EFFECT_COUNT ? EFFECT_NAMES[index] : "";
+  }
+
+  bool Load(const std::filesystem::path &path, std::vector<AppProfile> &profiles, std::vector<ProfileRule> &rules,
+            std::string *error)
+  {
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+      if (error)
+        *error = "cannot open " + path.string();
+      return false;
+    }
+
+    std::vector<AppProfile> loadedProfiles;
+    std::vector<ProfileRule> loadedRules;
+    std::string raw;
+    int number = 0;
+    auto fail = [&](const std::string &what)
+    {
+      if (error)
+        *error = "line " + std::to_string(number) + ": " + what;
+      return false;
+    };
+    while (std::getline(file, raw))
+    {
+      ++number;
+      if (number == 1 && raw.compare(0, 3, "\xEF\xBB\xBF") == 0)
+        raw.erase(0, 3);
+      std::string line = Trim(raw);
+      if (line.empty() || line[0] == '#' || line[0] == ';')
+        continue;
+
+      if (line[0] == '[')
+      {
+        std::string name = line.back() == ']' ? Trim(line.substr(1, line.size() - 2)) : std::string();
+        if (name.empty())
+          return fail("expected [profile name]");
+        loadedProfiles.push_back(AppProfile());
+        loadedProfiles.back().name = name;
+        continue;
+      }
+
+      size_t equals = line.find('=');
+      if (equals == std::string::npos)
+        return fail("expected key = value");
+      if (loadedProfiles.empty())
+        return fail("setting before the first [profile]");
+      std::string key = Trim(line.substr(0, equals));
+      std::string value = Trim(line.substr(equals + 1));
+      std::transform(key.begin(), key.end(), key.begin(),
+                     [](unsigned char c)
+                     { return static_cast<char>(std::tolower(c)); });
+      AppProfile &profile = loadedProfiles.back();
+
+      if (key == "match")
+      {
+        size_t bar = value.find('|');
+        std::string process = Trim(value.substr(0, bar));
+        std::string title = bar == std::string::npos ? std::string() : Trim(value.substr(bar + 1));
+        if (process == "*")
+          process.clear();
+        if (process.empty() && title.empty())
+          return fail("match needs a process or a title");
+        loadedRules.push_back({FromUtf8(process), FromUtf8(title), loadedProfiles.size() - 1});
+      }
+      else if (key == "brightness")
+      {
+        if (!ParseNumber(value, 1, 100, profile.softwareBrightness))
+          return fail("brightness must be 1-100");
+      }
+      else if (key == "temperature")
+      {
+        if (!ParseNumber(value, ColorTempUtils::KELVIN_MIN, ColorTempUtils::KELVIN_MAX, profile.softwareColorTemp))
+          return fail("temperature must be " + std::to_string(ColorTempUtils::KELVIN_MIN) + "-" +
+                      std::to_string(ColorTempUtils::KELVIN_MAX));
+      }
+      else if (key == "hardware")
+      {
+        if (!ParseNumber(value, 0, 100, profile.hardwareBrightness))
+          return fail("hardware must be 0-100");
+      }
+      else
+      {
+        // Saturation's strength only blends in SetSaturation's amount, which
+        // profiles do not set, so it is not offered
+        const char *const *name = std::find(std::begin(EFFECT_NAMES), std::end(EFFECT_NAMES), key);
+        ColorEffect effect = static_cast<ColorEffect>(name - std::begin(EFFECT_NAMES));
+        if (name == std::end(EFFECT_NAMES) || effect == ColorEffect::Saturation)
+          return fail("unknown key '" + key + "'");
+        double strength = 0.0;
+        if (!ParseNumber(value, 0.0, 1.0, strength))
+          return fail(key + " must be 0-1");
+        profile.effects.emplace_back(effect, strength);
+      }
+    }
+
+    profiles = std::move(loadedProfiles);
+    rules = std::move(loadedRules);
+    return true;
+  }
+}
@@ -0,0 +1,284 @@
+#pragma once
+#include "coloreffects.h"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief The window that has just come to the foreground, or whose title
+ *        has just changed.
+ */
+struct FocusEvent
+{
+  std::wstring process; // Executable file name, e.g. L"WindowsTerminal.exe"
+  std::wstring title;
+};
+
+/**
+ * @brief Where focus changes come from. Event-driven: the source calls back
+ *        when the foreground window or its title changes, and costs nothing
+ *        in between.
+ *
+ * The callback runs on the thread that called Start (on Windows, from its
+ * message loop), so it may drive BrightnessController and BWFilter directly.
+ */
+class FocusSource
+{
+public:
+  using Callback = std::function<void(const FocusEvent &event)>;
+
+  virtual ~FocusSource() = default;
+
+  /**
+   * @brief Starts delivering events to @p callback. The window focused right
+   *        now is reported straight away where the platform can tell.
+   * @return false if the platform offers no focus notifications.
+   */
+  virtual bool Start(Callback callback) = 0;
+
+  virtual void Stop() = 0;
+
+  /**
+   * @brief Short description for logs.
+   */
+  virtual std::string Describe() const = 0;
+};
+
+/**
+ * @brief FocusSource driven by hand, for tests and benchmarks: Focus()
+ *        delivers an event synchronously.
+ */
+class SimulatedFocusSource : public FocusSource
+{
+public:
+  bool Start(Callback callback) override;
+  void Stop() override;
+  std::string Describe() const override;
+
+  /**
+   * @brief Reports @p process / @p title as the foreground window.
+   * @return false if the source is not started.
+   */
+  bool Focus(const std::wstring &process, const std::wstring &title);
+
+private:
+  Callback m_callback;
+};
+
+/**
+ * @brief Levels to switch to while a matching application is focused.
+ *        Fields left at -1 keep the user's own level.
+ */
+struct AppProfile
+{
+  std::string name;
+  int softwareBrightness = -1; // 1-100
+  int softwareColorTemp = -1;  // Kelvin, 1200-6500
+  int hardwareBrightness = -1; // 0-100
+  std::vector<std::pair<ColorEffect, double>> effects; // Strengths (0-1) of the effects the profile sets
+};
+
+/**
+ * @brief Selects a profile by foreground application. Both conditions are
+ *        case-insensitive; an empty one matches anything.
+ */
+struct ProfileRule
+{
+  std::wstring process; // Executable file name, matched whole
+  std::wstring title;   // Matched anywhere in the window title
+  size_t profile = 0;   // Index into the profile list
+};
+
+/**
+ * @brief Finds the first rule that matches a focus event.
+ *
+ * The rules are compiled into an index when the matcher is built: a hash
+ * table from process name to the rules naming that process, and for each
+ * such group (and for the rules that name no process) an Aho-Corasick trie
+ * over their title patterns, whose nodes already know the earliest rule
+ * matching there. A lookup is one hash probe and one pass over the title,
+ * whatever the number of rules. Immutable once built, so const lookups are
+ * thread-safe.
+ */
+class ProfileMatcher
+{
+public:
+  static constexpr size_t NO_MATCH = static_cast<size_t>(-1);
+
+  explicit ProfileMatcher(const std::vector<ProfileRule> &rules = {});
+
+  /**
+   * @return Index of the first matching rule, or NO_MATCH.
+   */
+  size_t Match(const std::wstring &process, const std::wstring &title) const;
+
+  /**
+   * @brief The obvious implementation, testing every rule in turn. Kept as
+   *        the reference the index is checked against.
+   */
+  static size_t MatchLinear(const std::vector<ProfileRule> &rules, const std::wstring &process,
+                            const std::wstring &title);
+
+private:
+  // Aho-Corasick automaton over lowercased title patterns
+  class TitleIndex
+  {
+  public:
+    TitleIndex();
+    void Add(const std::wstring &pattern, size_t rule);
+    void Build();
+
+    // Earliest rule whose pattern occurs in @p title, or @p best if earlier
+    size_t Match(const std::wstring &title, size_t best) const;
+    bool Empty() const { return m_nodes.size() == 1; }
+
+  private:
+    struct Node
+    {
+      std::unordered_map<wchar_t, uint32_t> next;
+      uint32_t fail = 0;
+      size_t rule = NO_MATCH; // Earliest rule ending here or at any suffix
+    };
+    std::vector<Node> m_nodes; // m_nodes[0] is the root
+  };
+
+  // The rules that name one process (or none)
+  struct Group
+  {
+    size_t anyTitle = NO_MATCH; // Earliest rule with no title condition
+    TitleIndex titles;
+  };
+
+  static size_t MatchGroup(const Group &group, const std::wstring &title, size_t best);
+
+  std::unordered_map<std::wstring, Group> m_byProcess; // Keyed by lowercased process name
+  Group m_anyProcess;
+};
+
+/**
+ * @brief Switches the monitors between profiles as the focus moves.
+ *
+ * The levels the user had when the first profile took over are kept as a
+ * baseline per monitor; a profile is applied on top of that baseline, and
+ * focusing an application no rule matches restores it. Only the levels a
+ * profile sets are touched, on the way in and on the way out.
+ *
+ * A switch costs one gamma write per monitor whose ramp actually changes
+ * (served from the ramp cache, flushed together), a DDC/CI write only where
+ * the hardware level differs, and a colour effect fade only for effects that
+ * change. Focus events that leave the profile as it is cost a match and
+ * nothing else.
+ *
+ * A level the user changes while a profile that sets it is active is
+ * overwritten when the profile ends. Not thread-safe; call from the thread
+ * that drives BrightnessController and BWFilter.
+ */
+class ProfileEngine
+{
+public:
+  static constexpr size_t NO_PROFILE = ProfileMatcher::NO_MATCH;
+
+  struct Options
+  {
+    std::chrono::milliseconds effectFade{250}; // For colour effects; gamma switches at once
+  };
+
+  struct Stats
+  {
+    uint64_t events = 0;        // Focus events seen
+    uint64_t switches = 0;      // ...that changed the active profile
+    uint64_t monitorWrites = 0; // Monitors whose software levels were set
+    uint64_t hardwareWrites = 0;
+    uint64_t effectChanges = 0;
+  };
+
+  ProfileEngine(std::vector<AppProfile> profiles, const std::vector<ProfileRule> &rules);
+  ProfileEngine(std::vector<AppProfile> profiles, const std::vector<ProfileRule> &rules, const Options &options);
+
+  /**
+   * @brief Matches @p event and switches profile if it changed.
+   * @return true if the active profile changed.
+   */
+  bool OnFocus(const FocusEvent &event);
+
+  /**
+   * @brief The monitors were just restored to the user's levels (startup,
+   *        resume): forget the baseline, take it afresh, and reapply the
+   *        active profile.
+   */
+  void Reset();
+
+  /**
+   * @brief The monitor list changed or hardware brightness became available:
+   *        take a baseline for whatever has none yet and apply the active
+   *        profile to it. Monitors already covered are left alone.
+   */
+  void Refresh();
+
+  /**
+   * @return Index of the active profile, or NO_PROFILE.
+   */
+  size_t GetActiveProfile() const { return m_active; }
+
+  const std::vector<AppProfile> &GetProfiles() const { return m_profiles; }
+  Stats GetStats() const { return m_stats; }
+
+private:
+  struct Baseline
+  {
+    int softwareBrightness = -1;
+    int softwareColorTemp = -1;
+    int hardwareBrightness = -1; // -1 until DDC/CI has been probed
+  };
+
+  const AppProfile *Profile(size_t index) const;
+  void Apply(size_t previous, bool onlyNew);
+  void ApplyEffects(size_t previous);
+
+  std::vector<AppProfile> m_profiles;
+  ProfileMatcher m_matcher;
+  std::vector<size_t> m_ruleProfile; // Profile of each rule the matcher was built from
+  Options m_options;
+  size_t m_active = NO_PROFILE;
+  std::map<std::wstring, Baseline> m_baseline; // Per monitor device name; empty while no profile is active
+  bool m_effectsCaptured = false;
+  double m_effectBaseline[ColorEffectStack::EFFECT_COUNT] = {};
+  Stats m_stats;
+};
+
+namespace ProfileUtils
+{
+  /**
+   * @brief Reads profiles and rules from an INI-style UTF-8 file:
+   *
+   *     # Warmer and dimmer while the terminal is focused
+   *     [Terminal]
+   *     brightness = 60
+   *     temperature = 3400
+   *     match = WindowsTerminal.exe
+   *     match = * | vim
+   *
+   * Each [section] is a profile. Its keys are brightness, temperature,
+   * hardware and the colour effects by name (grayscale = 1, sepia = 0.5...);
+   * each "match = <process> [| <title>]" line adds a rule, "*" meaning any
+   * process. Rules keep file order, which is their priority. Blank lines and
+   * lines starting with '#' or ';' are skipped.
+   *
+   * @param error Receives "line N: ..." when the file does not parse.
+   * @return false if the file cannot be read or does not parse.
+   */
+  bool Load(const std::filesystem::path &path, std::vector<AppProfile> &profiles, std::vector<ProfileRule> &rules,
+            std::string *error = nullptr);
+
+  /**
+   * @brief The name Load accepts for @p effect, e.g. "correct-deuteranopia".
+   */
+  const char *EffectName(ColorEffect effect);
+}
@@ -0,0 +1,84 @@
+#include "rampcache.h"
+#include <algorithm>
+
+uint64_t HashGammaRamp(const uint16_t *ramp, size_t count)
+{
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < count; ++i)
+  {
+    hash ^= static_cast<uint64_t>(ramp[i]);
+    hash *= 1099511628211ULL;
+  }
+  return hash ? hash : 1;
+}
+
+GammaRampCache::GammaRampCache(size_t capacity)
+    : m_capacity(capacity ? capacity : 1)
+{
+}
+
+GammaRampCache::Key GammaRampCache::KeyOf(const ColorTempUtils::GammaRampOptions &opts)
+{
+  // brightness <= 100 and kelvin <= 6500 fit in 8 and 16 bits; entries takes the top.
+  return (static_cast<uint64_t>(static_cast<uint32_t>(opts.entries)) << 40) |
+         (static_cast<uint64_t>(static_cast<uint8_t>(opts.brightness)) << 32) |
+         static_cast<uint32_t>(opts.kelvin);
+}
+
+std::shared_ptr<const CachedGammaRamp> GammaRampCache::Get(const ColorTempUtils::GammaRampOptions &opts)
+{
+  Key key = KeyOf(opts);
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_index.find(key);
+    if (it != m_index.end())
+    {
+      m_lru.splice(m_lru.begin(), m_lru, it->second);
+      m_stats.hits++;
+      return it->second->second;
+    }
+    m_stats.misses++;
+  }
+
+  // Build outside the lock; a concurrent miss on the same key just builds twice.
+  auto ramp = std::make_shared<CachedGammaRamp>();
+  ramp->values.resize(static_cast<size_t>(std::max(ColorTempUtils::GAMMA_RAMP_ENTRIES_MIN,
+                                                   std::min(opts.entries, ColorTempUtils::GAMMA_RAMP_ENTRIES_MAX))) *
+                      3);
+  ColorTempUtils::BuildGammaRamp(opts, ramp->values.data());
+  ramp->hash = HashGammaRamp(ramp->values.data(), ramp->values.size());
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto it = m_index.find(key);
+  if (it != m_index.end())
+    return it->second->second;
+
+  m_lru.emplace_front(key, ramp);
+  m_index[key] = m_lru.begin();
+  while (m_lru.size() > m_capacity)
+  {
+    m_index.erase(m_lru.back().first);
+    m_lru.pop_back();
+    m_stats.evictions++;
+  }
+  return ramp;
+}
+
+void GammaRampCache::Clear()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_lru.clear();
+  m_index.clear();
+}
+
+GammaRampCache::Stats GammaRampCache::GetStats() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_stats;
+}
+
+size_t GammaRampCache::Size() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_lru.size();
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include "colortemp.h"
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief A fully built gamma ramp together with its content hash.
+ */
+struct CachedGammaRamp
+{
+  std::vector<uint16_t> values; // opts.entries * 3 words, R then G then B
+  uint64_t hash; // HashGammaRamp(values), computed once when the ramp is built
+};
+
+/**
+ * @brief 64-bit FNV-1a hash of a gamma ramp.
+ *
+ * Cheap enough to run on every ramp read back from a device, and used to
+ * decide whether a device already shows a given ramp. Never returns 0, so 0
+ * can mean "unknown" to callers.
+ */
+uint64_t HashGammaRamp(const uint16_t *ramp, size_t count);
+
+/**
+ * @brief Bounded LRU cache of built gamma ramps, keyed by GammaRampOptions.
+ *
+ * Building a ramp means evaluating the Kelvin curve and 3 * entries scaled
+ * words; most updates revisit a handful of (brightness, kelvin) pairs, so the
+ * cache is shared by every monitor. Outputs with different ramp sizes get
+ * separate entries. Entries are handed out as shared pointers and
+ * stay valid after eviction. Thread-safe.
+ */
+class GammaRampCache
+{
+public:
+  struct Stats
+  {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+  };
+
+  explicit GammaRampCache(size_t capacity = 64);
+
+  /**
+   * @brief Returns the ramp for @p opts, building and inserting it on a miss.
+   */
+  std::shared_ptr<const CachedGammaRamp> Get(const ColorTempUtils::GammaRampOptions &opts);
+
+  /**
+   * @brief Drops every entry. Counters are kept.
+   */
+  void Clear();
+
+  Stats GetStats() const;
+  size_t Size() const;
+
+private:
+  using Key = uint64_t;
+  using Entry = std::pair<Key, std::shared_ptr<const CachedGammaRamp>>;
+
+  // Folds every GammaRampOptions field into one key; extend when fields are added.
+  static Key KeyOf(const ColorTempUtils::GammaRampOptions &opts);
+
+  size_t m_capacity;
+  mutable std::mutex m_mutex;
+  std::list<Entry> m_lru; // Most recently used at the front
+  std::unordered_map<Key, std::list<Entry>::iterator> m_index;
+  Stats m_stats;
+};
@@ -1,46 +1,120 @@
 #include "settings.h"
+#include "devicename.h"
+#include "trace.h"
 #include <shlobj.h>
 #include <string>
 #include <algorithm>
+#include <filesystem>
+#include <utility>
+#include <vector>
 
 const wchar_t *const Settings::REGISTRY_KEY = L"Software\\Candela";
 const wchar_t *const Settings::MONITORS_SUBKEY = L"Monitors";
 const wchar_t *const Settings::START_ON_BOOT_VALUE = L"StartOnBoot";
 
+namespace
+{
+  // Values written per monitor, and at the top level including the Run key,
+  // by a full rewrite of every setting
+  const uint64_t VALUES_PER_MONITOR = 5;
+  const uint64_t TOP_LEVEL_VALUES = 4;
+
+  uint64_t CountBits(uint32_t bits)
+  {
+    uint64_t count = 0;
+    for (; bits; bits &= bits - 1)
+      ++count;
+    return count;
+  }
+
+  // %LOCALAPPDATA%\\Candela, or empty if the folder cannot be resolved
+  std::filesystem::path StoreDirectory()
+  {
+    wchar_t path[MAX_PATH];
+    if (!SUCCEEDED(SHGetFolderPathW(nullptr, CSIDL_LOCAL_APPDATA, nullptr, SHGFP_TYPE_CURRENT, path)))
+      return std::filesystem::path();
+    return std::filesystem::path(path) / L"Candela";
+  }
+
+  bool WriteDword(HKEY key, const wchar_t *name, DWORD value)
+  {
+    return RegSetValueEx(key, name, 0, REG_DWORD, reinterpret_cast<const BYTE *>(&value), sizeof(value)) ==
+           ERROR_SUCCESS;
+  }
+}
+
 Settings::Settings()
-    : m_startOnBoot(false)
+    : m_startOnBoot(false),
+      m_writer([this]()
+               { writeDirty(); },
+               SAVE_QUIET_PERIOD)
 {
 }
 
 Settings::~Settings()
 {
-  save();
+  shutdown();
 }
 
-std::wstring Settings::sanitizeDeviceName(const std::wstring &deviceName)
+bool Settings::getStartOnBoot() const
 {
-  std::wstring sanitized;
-  sanitized.reserve(deviceName.length());
-  for (wchar_t c : deviceName)
-  {
-    if (c == L'\\')
-    {
-      sanitized += L"##";
-    }
-    else if (c == L'#')
-    {
-      sanitized += L"#0";
-    }
-    else
-    {
-      sanitized += c;
-    }
-  }
-  return sanitized;
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_startOnBoot;
+}
+
+bool Settings::getShowBWToggle() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_showBWToggle;
+}
+
+bool Settings::getBWEnabled() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_bwEnabled;
+}
+
+bool Settings::getAutoBrightness() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_autoBrightness;
+}
+
+void Settings::setStartOnBoot(bool startOnBoot)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (m_startOnBoot != startOnBoot)
+    m_dirty |= DIRTY_START_ON_BOOT;
+  m_startOnBoot = startOnBoot;
+}
+
+void Settings::setShowBWToggle(bool v)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (m_showBWToggle != v)
+    m_dirty |= DIRTY_SHOW_BW_TOGGLE;
+  m_showBWToggle = v;
+}
+
+void Settings::setBWEnabled(bool v)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (m_bwEnabled != v)
+    m_dirty |= DIRTY_BW_ENABLED;
+  m_bwEnabled = v;
+}
+
+void Settings::setAutoBrightness(bool v)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (m_autoBrightness != v)
+    m_dirty |= DIRTY_AUTO_BRIGHTNESS;
+  m_autoBrightness = v;
 }
 
 MonitorSettings Settings::getMonitorSettings(const std::wstring &deviceName) const
 {
+  std::lock_guard<std::mutex> lock(m_mutex);
   auto it = m_monitorSettings.find(deviceName);
   if (it != m_monitorSettings.end())
   {
@@ -51,11 +125,73 @@ MonitorSettings Settings::getMonitorSettings(const std::wstring &deviceName) con
 
 void Settings::setMonitorSettings(const std::wstring &deviceName, const MonitorSettings &settings)
 {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto it = m_monitorSettings.find(deviceName);
+
+  // A monitor seen for the first time has nothing in the registry yet.
+  uint32_t dirty = DIRTY_SHOW_SOFTWARE | DIRTY_SHOW_HARDWARE | DIRTY_LAST_SOFTWARE | DIRTY_LAST_HARDWARE |
+                   DIRTY_LAST_COLOR_TEMP | DIRTY_UNIFIED_BRIGHTNESS;
+  if (it != m_monitorSettings.end())
+  {
+    const MonitorSettings &old = it->second;
+    dirty = 0;
+    if (old.showSoftware != settings.showSoftware)
+      dirty |= DIRTY_SHOW_SOFTWARE;
+    if (old.showHardware != settings.showHardware)
+      dirty |= DIRTY_SHOW_HARDWARE;
+    if (old.lastSoftwareBrightness != settings.lastSoftwareBrightness)
+      dirty |= DIRTY_LAST_SOFTWARE;
+    if (old.lastHardwareBrightness != settings.lastHardwareBrightness)
+      dirty |= DIRTY_LAST_HARDWARE;
+    if (old.lastStandardColorTemp != settings.lastStandardColorTemp)
+      dirty |= DIRTY_LAST_COLOR_TEMP;
+    if (old.unifiedBrightness != settings.unifiedBrightness)
+      dirty |= DIRTY_UNIFIED_BRIGHTNESS;
+  }
+
   m_monitorSettings[deviceName] = settings;
+  if (dirty)
+    m_dirtyMonitors[deviceName] |= dirty;
 }
 
 bool Settings::load()
 {
+  std::filesystem::path directory = StoreDirectory();
+  if (!directory.empty())
+    m_store = std::make_unique<SettingsStore>(directory);
+
+  StoredSettings stored;
+  if (m_store && m_store->Load(stored))
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_startOnBoot = stored.startOnBoot;
+    m_showBWToggle = stored.showBWToggle;
+    m_bwEnabled = stored.bwEnabled;
+    m_autoBrightness = stored.autoBrightness;
+    m_monitorSettings = std::move(stored.monitors);
+  }
+  else
+  {
+    // First run with the file store (or its snapshot is unreadable): take
+    // over the registry layout and write it out as the initial snapshot.
+    // The registry values are left in place for older versions.
+    loadFromRegistry();
+    if (m_store)
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_store->Compact(snapshotLocked());
+    }
+  }
+
+  // Update startup registry based on loaded setting
+  updateStartupRegistry();
+
+  return true;
+}
+
+void Settings::loadFromRegistry()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
   HKEY hKey;
   LONG result = RegOpenKeyEx(HKEY_CURRENT_USER, REGISTRY_KEY, 0, KEY_READ, &hKey);
 
@@ -87,6 +223,13 @@ bool Settings::load()
       m_bwEnabled = (value != 0);
     }
 
+    size = sizeof(DWORD);
+    if (RegQueryValueEx(hKey, L"AutoBrightness", nullptr, nullptr,
+                        reinterpret_cast<LPBYTE>(&value), &size) == ERROR_SUCCESS)
+    {
+      m_autoBrightness = (value != 0);
+    }
+
     // Load Monitors
     HKEY hMonitorsKey;
     result = RegOpenKeyEx(hKey, MONITORS_SUBKEY, 0, KEY_READ, &hMonitorsKey);
@@ -97,43 +240,7 @@ bool Settings::load()
       DWORD subKeyLen = 256;
       while (RegEnumKeyEx(hMonitorsKey, index, subKeyName, &subKeyLen, nullptr, nullptr, nullptr, nullptr) == ERROR_SUCCESS)
       {
-        std::wstring sanitizedName = subKeyName;
-        std::wstring realName;
-        realName.reserve(sanitizedName.length());
-
-        for (size_t i = 0; i < sanitizedName.length(); ++i)
-        {
-          if (sanitizedName[i] == L'#')
-          {
-            if (i + 1 < sanitizedName.length())
-            {
-              if (sanitizedName[i + 1] == L'#')
-              {
-                realName += L'\\';
-                i++;
-              }
-              else if (sanitizedName[i + 1] == L'0')
-              {
-                realName += L'#';
-                i++;
-              }
-              else
-              {
-                // Legacy fallback: single # treated as backslash
-                realName += L'\\';
-              }
-            }
-            else
-            {
-              // Trailing # (legacy)
-              realName += L'\\';
-            }
-          }
-          else
-          {
-            realName += sanitizedName[i];
-          }
-        }
+        std::wstring realName = DeviceNameUtils::Unescape(subKeyName);
 
         MonitorSettings settings;
         HKEY hMonitorKey;
@@ -161,6 +268,10 @@ bool Settings::load()
           if (RegQueryValueEx(hMonitorKey, L"LastStandardColorTemp", nullptr, nullptr, (LPBYTE)&dwVal, &dwSize) == ERROR_SUCCESS)
             settings.lastStandardColorTemp = (int)dwVal;
 
+          dwSize = sizeof(DWORD);
+          if (RegQueryValueEx(hMonitorKey, L"UnifiedBrightness", nullptr, nullptr, (LPBYTE)&dwVal, &dwSize) == ERROR_SUCCESS)
+            settings.unifiedBrightness = (dwVal != 0);
+
           RegCloseKey(hMonitorKey);
           m_monitorSettings[realName] = settings;
         }
@@ -173,14 +284,143 @@ bool Settings::load()
 
     RegCloseKey(hKey);
   }
+}
 
-  // Update startup registry based on loaded setting
-  updateStartupRegistry();
-
+bool Settings::save()
+{
+  TRACE_SCOPE("Settings::save");
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stats.saveRequests++;
+    // What the rewrite-everything save this replaced would have written
+    m_stats.writesAvoided += TOP_LEVEL_VALUES + VALUES_PER_MONITOR * m_monitorSettings.size();
+  }
+  m_writer.Request();
   return true;
 }
 
-bool Settings::save() const
+void Settings::flush()
+{
+  m_writer.FlushNow();
+}
+
+void Settings::shutdown()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_shuttingDown = true;
+  }
+  m_writer.Stop();
+
+  // Whatever a failed write left dirty gets one last attempt.
+  bool dirty;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    dirty = m_dirty || !m_dirtyMonitors.empty();
+  }
+  if (dirty)
+    writeDirty();
+
+  // Fold the session's journal into the snapshot so the next start only
+  // has to map one file.
+  if (m_store && m_store->GetStats().journalRecords > 0)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_store->Compact(snapshotLocked());
+  }
+}
+
+SettingsWriteStats Settings::getWriteStats() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_stats;
+}
+
+std::filesystem::path Settings::getDataDirectory() const
+{
+  return m_store ? m_store->GetSnapshotPath().parent_path() : std::filesystem::path();
+}
+
+void Settings::writeDirty()
+{
+  TRACE_SCOPE("Settings::writeDirty");
+  // Snapshot and clear the dirty set under the lock, then write without it
+  // so the UI thread never waits on the disk or the registry.
+  DirtySet changes;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    changes.dirty = m_dirty;
+    changes.globals.startOnBoot = m_startOnBoot;
+    changes.globals.showBWToggle = m_showBWToggle;
+    changes.globals.bwEnabled = m_bwEnabled;
+    changes.globals.autoBrightness = m_autoBrightness;
+    for (const auto &pair : m_dirtyMonitors)
+      changes.monitors.push_back({pair.first, m_monitorSettings[pair.first], pair.second});
+    m_dirty = 0;
+    m_dirtyMonitors.clear();
+  }
+  if (!changes.dirty && changes.monitors.empty())
+    return;
+
+  uint64_t written = 0;
+  bool ok = m_store ? writeToStore(changes, written) : writeToRegistry(changes, written);
+  if (!ok)
+  {
+    // Keep everything dirty and try again a quiet period from now. The
+    // request is made under the lock so it cannot race shutdown() into a
+    // stopped writer, which would flush on this very thread.
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_dirty |= changes.dirty;
+    for (const DirtyMonitor &monitor : changes.monitors)
+      m_dirtyMonitors[monitor.deviceName] |= monitor.dirty;
+    if (!m_shuttingDown)
+      m_writer.Request();
+    return;
+  }
+
+  // The Run key only needs touching when the setting itself changed.
+  if (changes.dirty & DIRTY_START_ON_BOOT)
+  {
+    updateStartupRegistry();
+    written++;
+  }
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_stats.flushes++;
+  m_stats.valuesWritten += written;
+  m_stats.writesAvoided -= std::min(m_stats.writesAvoided, written);
+}
+
+bool Settings::writeToStore(const DirtySet &changes, uint64_t &written)
+{
+  // A journal record carries all of a monitor's values; the count is of the
+  // values that changed, to stay comparable with the registry path.
+  bool ok = true;
+  if (changes.dirty)
+  {
+    ok = m_store->AppendGlobals(changes.globals) && ok;
+    written += CountBits(changes.dirty);
+  }
+  for (const DirtyMonitor &monitor : changes.monitors)
+  {
+    ok = m_store->AppendMonitor(monitor.deviceName, monitor.settings) && ok;
+    written += CountBits(monitor.dirty);
+  }
+  ok = m_store->Sync() && ok;
+
+  if (ok && m_store->NeedsCompaction())
+  {
+    StoredSettings all;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      all = snapshotLocked();
+    }
+    m_store->Compact(all);
+  }
+  return ok;
+}
+
+bool Settings::writeToRegistry(const DirtySet &changes, uint64_t &written)
 {
   HKEY hKey;
   LONG result = RegCreateKeyEx(HKEY_CURRENT_USER, REGISTRY_KEY, 0, nullptr,
@@ -191,52 +431,43 @@ bool Settings::save() const
     return false;
   }
 
-  DWORD value;
-
-  // Save start on boot
-  value = m_startOnBoot ? 1 : 0;
-  RegSetValueEx(hKey, START_ON_BOOT_VALUE, 0, REG_DWORD,
-                reinterpret_cast<const BYTE *>(&value), sizeof(value));
-
-  // Save B&W filter visibility + state
-  value = m_showBWToggle ? 1 : 0;
-  RegSetValueEx(hKey, L"ShowBWToggle", 0, REG_DWORD,
-                reinterpret_cast<const BYTE *>(&value), sizeof(value));
-
-  value = m_bwEnabled ? 1 : 0;
-  RegSetValueEx(hKey, L"BWEnabled", 0, REG_DWORD,
-                reinterpret_cast<const BYTE *>(&value), sizeof(value));
+  const StoredSettings &globals = changes.globals;
+  if (changes.dirty & DIRTY_START_ON_BOOT)
+    written += WriteDword(hKey, START_ON_BOOT_VALUE, globals.startOnBoot ? 1 : 0);
+  if (changes.dirty & DIRTY_SHOW_BW_TOGGLE)
+    written += WriteDword(hKey, L"ShowBWToggle", globals.showBWToggle ? 1 : 0);
+  if (changes.dirty & DIRTY_BW_ENABLED)
+    written += WriteDword(hKey, L"BWEnabled", globals.bwEnabled ? 1 : 0);
+  if (changes.dirty & DIRTY_AUTO_BRIGHTNESS)
+    written += WriteDword(hKey, L"AutoBrightness", globals.autoBrightness ? 1 : 0);
 
   // Save Monitors
   HKEY hMonitorsKey;
-  result = RegCreateKeyEx(hKey, MONITORS_SUBKEY, 0, nullptr,
-                          REG_OPTION_NON_VOLATILE, KEY_WRITE, nullptr, &hMonitorsKey, nullptr);
-
-  if (result == ERROR_SUCCESS)
+  if (!changes.monitors.empty() &&
+      RegCreateKeyEx(hKey, MONITORS_SUBKEY, 0, nullptr,
+                     REG_OPTION_NON_VOLATILE, KEY_WRITE, nullptr, &hMonitorsKey, nullptr) == ERROR_SUCCESS)
   {
-    for (const auto &pair : m_monitorSettings)
+    for (const DirtyMonitor &monitor : changes.monitors)
     {
-      std::wstring sanitizedName = sanitizeDeviceName(pair.first);
-      const MonitorSettings &settings = pair.second;
+      std::wstring sanitizedName = DeviceNameUtils::Escape(monitor.deviceName);
+      const MonitorSettings &settings = monitor.settings;
 
       HKEY hMonitorKey;
       if (RegCreateKeyEx(hMonitorsKey, sanitizedName.c_str(), 0, nullptr,
                          REG_OPTION_NON_VOLATILE, KEY_WRITE, nullptr, &hMonitorKey, nullptr) == ERROR_SUCCESS)
       {
-        value = settings.showSoftware ? 1 : 0;
-        RegSetValueEx(hMonitorKey, L"ShowSoftware", 0, REG_DWORD, (const BYTE *)&value, sizeof(value));
-
-        value = settings.showHardware ? 1 : 0;
-        RegSetValueEx(hMonitorKey, L"ShowHardware", 0, REG_DWORD, (const BYTE *)&value, sizeof(value));
-
-        value = (DWORD)settings.lastSoftwareBrightness;
-        RegSetValueEx(hMonitorKey, L"LastSoftware", 0, REG_DWORD, (const BYTE *)&value, sizeof(value));
-
-        value = (DWORD)settings.lastHardwareBrightness;
-        RegSetValueEx(hMonitorKey, L"LastHardware", 0, REG_DWORD, (const BYTE *)&value, sizeof(value));
-
-        value = (DWORD)settings.lastStandardColorTemp;
-        RegSetValueEx(hMonitorKey, L"LastStandardColorTemp", 0, REG_DWORD, (const BYTE *)&value, sizeof(value));
+        if (monitor.dirty & DIRTY_SHOW_SOFTWARE)
+          written += WriteDword(hMonitorKey, L"ShowSoftware", settings.showSoftware ? 1 : 0);
+        if (monitor.dirty & DIRTY_SHOW_HARDWARE)
+          written += WriteDword(hMonitorKey, L"ShowHardware", settings.showHardware ? 1 : 0);
+        if (monitor.dirty & DIRTY_LAST_SOFTWARE)
+          written += WriteDword(hMonitorKey, L"LastSoftware", (DWORD)settings.lastSoftwareBrightness);
+        if (monitor.dirty & DIRTY_LAST_HARDWARE)
+          written += WriteDword(hMonitorKey, L"LastHardware", (DWORD)settings.lastHardwareBrightness);
+        if (monitor.dirty & DIRTY_LAST_COLOR_TEMP)
+          written += WriteDword(hMonitorKey, L"LastStandardColorTemp", (DWORD)settings.lastStandardColorTemp);
+        if (monitor.dirty & DIRTY_UNIFIED_BRIGHTNESS)
+          written += WriteDword(hMonitorKey, L"UnifiedBrightness", settings.unifiedBrightness ? 1 : 0);
 
         RegCloseKey(hMonitorKey);
       }
@@ -245,22 +476,30 @@ bool Settings::save() const
   }
 
   RegCloseKey(hKey);
-
-  // Update startup registry based on setting
-  updateStartupRegistry();
-
   return true;
 }
 
+StoredSettings Settings::snapshotLocked() const
+{
+  StoredSettings settings;
+  settings.startOnBoot = m_startOnBoot;
+  settings.showBWToggle = m_showBWToggle;
+  settings.bwEnabled = m_bwEnabled;
+  settings.autoBrightness = m_autoBrightness;
+  settings.monitors = m_monitorSettings;
+  return settings;
+}
+
 bool Settings::updateStartupRegistry() const
 {
   HKEY hRunKey;
   LONG result = RegOpenKeyEx(HKEY_CURRENT_USER, L"Software\\Microsoft\\Windows\\CurrentVersion\\Run",
                              0, KEY_WRITE, &hRunKey);
+  bool startOnBoot = getStartOnBoot();
 
   if (result == ERROR_SUCCESS)
   {
-    if (m_startOnBoot)
+    if (startOnBoot)
     {
       // Get the current executable path
       wchar_t exePath[MAX_PATH];
@@ -285,7 +524,7 @@ bool Settings::updateStartupRegistry() const
       }
     }
     RegCloseKey(hRunKey);
-    return (result == ERROR_SUCCESS || (m_startOnBoot == false && result == ERROR_FILE_NOT_FOUND));
+    return (result == ERROR_SUCCESS || (startOnBoot == false && result == ERROR_FILE_NOT_FOUND));
   }
 
   return false;
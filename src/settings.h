@@ -1,15 +1,21 @@
 #pragma once
 #include <windows.h>
+#include <cstdint>
 #include <string>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "settingsstore.h"
+#include "writebehind.h"
 
-struct MonitorSettings
+// Writes generated by Settings, and how much the write-behind saved
+struct SettingsWriteStats
 {
-  bool showSoftware = true;
-  bool showHardware = true;
-  int lastSoftwareBrightness = 100; // Default to 100% for software (no dimming)
-  int lastHardwareBrightness = 50;  // Default to 50% for hardware
-  int lastStandardColorTemp = 6500; // Default to 6500K (neutral/daylight)
+  uint64_t saveRequests = 0;  // save() calls
+  uint64_t flushes = 0;       // Batches actually written
+  uint64_t valuesWritten = 0; // Registry values written
+  uint64_t writesAvoided = 0; // Values a full rewrite per save() would have written on top
 };
 
 class Settings
@@ -18,38 +24,117 @@ public:
   Settings();
   ~Settings();
 
-  // Load settings from registry
+  // Load settings from the file store, migrating the registry layout into
+  // it on first run
   bool load();
 
-  // Save settings to registry
-  bool save() const;
+  // Schedule the values changed since the last flush to be written once
+  // changes have been quiet for SAVE_QUIET_PERIOD (write-behind)
+  bool save();
+
+  // Write the changed values now, on the calling thread
+  void flush();
+
+  // Final flush and stop the writer thread; call before the process exits
+  void shutdown();
 
   // Update startup registry based on setting
   bool updateStartupRegistry() const;
 
+  SettingsWriteStats getWriteStats() const;
+
+  // Directory holding the settings files, also used for other per-user data
+  // such as the startup log. Empty until load() has found one.
+  std::filesystem::path getDataDirectory() const;
+
   // Getters
-  bool getStartOnBoot() const { return m_startOnBoot; }
-  bool getShowBWToggle() const { return m_showBWToggle; }
-  bool getBWEnabled() const { return m_bwEnabled; }
+  bool getStartOnBoot() const;
+  bool getShowBWToggle() const;
+  bool getBWEnabled() const;
+  bool getAutoBrightness() const;
   MonitorSettings getMonitorSettings(const std::wstring &deviceName) const;
 
-  // Setters
-  void setStartOnBoot(bool startOnBoot) { m_startOnBoot = startOnBoot; }
-  void setShowBWToggle(bool v) { m_showBWToggle = v; }
-  void setBWEnabled(bool v) { m_bwEnabled = v; }
+  // Setters. Only values that actually change are marked for the next flush.
+  void setStartOnBoot(bool startOnBoot);
+  void setShowBWToggle(bool v);
+  void setBWEnabled(bool v);
+  void setAutoBrightness(bool v);
   void setMonitorSettings(const std::wstring &deviceName, const MonitorSettings &settings);
 
+  static constexpr std::chrono::milliseconds SAVE_QUIET_PERIOD{500};
+
 private:
+  // Dirty bits for the top-level values
+  enum : uint32_t
+  {
+    DIRTY_START_ON_BOOT = 1 << 0,
+    DIRTY_SHOW_BW_TOGGLE = 1 << 1,
+    DIRTY_BW_ENABLED = 1 << 2,
+    DIRTY_AUTO_BRIGHTNESS = 1 << 3
+  };
+
+  // Dirty bits for a monitor's values
+  enum : uint32_t
+  {
+    DIRTY_SHOW_SOFTWARE = 1 << 0,
+    DIRTY_SHOW_HARDWARE = 1 << 1,
+    DIRTY_LAST_SOFTWARE = 1 << 2,
+    DIRTY_LAST_HARDWARE = 1 << 3,
+    DIRTY_LAST_COLOR_TEMP = 1 << 4,
+    DIRTY_UNIFIED_BRIGHTNESS = 1 << 5
+  };
+
+  struct DirtyMonitor
+  {
+    std::wstring deviceName;
+    MonitorSettings settings;
+    uint32_t dirty;
+  };
+
+  // Values changed since the last flush, captured under the lock
+  struct DirtySet
+  {
+    uint32_t dirty = 0;     // DIRTY_* top-level bits
+    StoredSettings globals; // Top-level values only; monitors is unused
+    std::vector<DirtyMonitor> monitors;
+  };
+
+  // Writes every dirty value; runs on the writer thread or in flush()
+  void writeDirty();
+
+  // Journal append to the file store; the registry is the fallback when
+  // %LOCALAPPDATA% is unavailable
+  bool writeToStore(const DirtySet &changes, uint64_t &written);
+  bool writeToRegistry(const DirtySet &changes, uint64_t &written);
+
+  // Legacy layout, read once to seed the file store
+  void loadFromRegistry();
+
+  // Full copy of the current values; called with m_mutex held
+  StoredSettings snapshotLocked() const;
+
+  // Guards every field below; the writer thread reads them too
+  mutable std::mutex m_mutex;
+
   bool m_startOnBoot;
-  bool m_showBWToggle = false; // Whether the tray popup shows the global B&W checkbox
-  bool m_bwEnabled = false;    // Persisted state of the global B&W filter
+  bool m_showBWToggle = false;   // Whether the tray popup shows the global B&W checkbox
+  bool m_bwEnabled = false;      // Persisted state of the global B&W filter
+  bool m_autoBrightness = false; // Brightness follows the ambient light sensor
   std::map<std::wstring, MonitorSettings> m_monitorSettings;
 
+  std::unique_ptr<SettingsStore> m_store; // Null if there is nowhere to put it
+
+  uint32_t m_dirty = 0;
+  std::map<std::wstring, uint32_t> m_dirtyMonitors;
+  SettingsWriteStats m_stats;
+  bool m_shuttingDown = false; // A failed write no longer schedules its own retry
+
+  // Declared last so it is destroyed (and its final flush runs) while the
+  // fields above are still alive
+  WriteBehind m_writer;
+
   // Registry key for settings
   static const wchar_t *const REGISTRY_KEY;
   static const wchar_t *const MONITORS_SUBKEY;
   static const wchar_t *const START_ON_BOOT_VALUE;
-
-  // Helper to sanitize device name for registry key
-  static std::wstring sanitizeDeviceName(const std::wstring &deviceName);
 };
\ No newline at end of file
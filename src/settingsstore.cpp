@@ -0,0 +1,540 @@
+#include "settingsstore.h"
+#include <algorithm>
+#include <cstring>
+#include <system_error>
+#include <utility>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+  // ---- File layout ------------------------------------------------------------------
+
+  const char SNAPSHOT_MAGIC[4] = {'C', 'D', 'L', 'S'};
+  const char JOURNAL_MAGIC[4] = {'C', 'D', 'L', 'J'};
+
+  // settings.bin: header, monitorCount records, then nameUnits UTF-16 code
+  // units holding every device name back to back.
+  struct SnapshotHeader
+  {
+    char magic[4];
+    uint16_t version;
+    uint16_t recordSize; // Lets a later version append fields to a record
+    uint32_t generation;
+    uint32_t flags;      // GLOBAL_*
+    uint32_t monitorCount;
+    uint32_t nameUnits;
+    uint32_t checksum;   // FNV-1a over everything after the header
+    uint32_t reserved;
+  };
+
+  struct SnapshotRecord
+  {
+    uint32_t nameOffset; // In code units, into the name pool
+    uint32_t nameLength; // In code units
+    uint32_t flags;      // MONITOR_*
+    int32_t softwareBrightness;
+    int32_t hardwareBrightness;
+    int32_t colorTemp;
+  };
+
+  // settings.journal: header, then records of [payload bytes][FNV-1a of
+  // payload][payload], each payload starting with its RECORD_* kind.
+  struct JournalHeader
+  {
+    char magic[4];
+    uint16_t version;
+    uint16_t reserved;
+    uint32_t generation; // Of the snapshot these changes apply to
+  };
+
+  static_assert(sizeof(SnapshotHeader) == 32, "snapshot header layout");
+  static_assert(sizeof(SnapshotRecord) == 24, "snapshot record layout");
+  static_assert(sizeof(JournalHeader) == 12, "journal header layout");
+
+  const uint32_t RECORD_GLOBALS = 1;
+  const uint32_t RECORD_MONITOR = 2;
+
+  const uint32_t GLOBAL_START_ON_BOOT = 1 << 0;
+  const uint32_t GLOBAL_SHOW_BW_TOGGLE = 1 << 1;
+  const uint32_t GLOBAL_BW_ENABLED = 1 << 2;
+  const uint32_t GLOBAL_AUTO_BRIGHTNESS = 1 << 3;
+
+  const uint32_t MONITOR_SHOW_SOFTWARE = 1 << 0;
+  const uint32_t MONITOR_SHOW_HARDWARE = 1 << 1;
+  const uint32_t MONITOR_UNIFIED_BRIGHTNESS = 1 << 2;
+
+  // Sanity bound on a journal payload; anything larger is a torn length
+  const uint32_t MAX_RECORD_BYTES = 4096;
+
+  // ---- Encoding helpers -------------------------------------------------------------
+
+  uint32_t Fnv1a(const uint8_t *data, size_t size)
+  {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; ++i)
+    {
+      hash ^= data[i];
+      hash *= 16777619u;
+    }
+    return hash;
+  }
+
+  template <typename T>
+  void Put(std::vector<uint8_t> &out, const T &value)
+  {
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&value);
+    out.insert(out.end(), bytes, bytes + sizeof(T));
+  }
+
+  // Bounds-checked read from an untrusted buffer; memcpy keeps it alignment-safe.
+  template <typename T>
+  bool Get(const uint8_t *data, size_t size, size_t &offset, T &value)
+  {
+    if (size < sizeof(T) || offset > size - sizeof(T))
+      return false;
+    std::memcpy(&value, data + offset, sizeof(T));
+    offset += sizeof(T);
+    return true;
+  }
+
+  // Names are stored as UTF-16 whatever the width of wchar_t.
+  void PutUtf16(std::vector<uint16_t> &out, const std::wstring &name)
+  {
+    for (wchar_t c : name)
+    {
+      uint32_t cp = static_cast<uint32_t>(c);
+      if (cp > 0xFFFF)
+      {
+        cp -= 0x10000;
+        out.push_back(static_cast<uint16_t>(0xD800 + (cp >> 10)));
+        out.push_back(static_cast<uint16_t>(0xDC00 + (cp & 0x3FF)));
+      }
+      else
+      {
+        out.push_back(static_cast<uint16_t>(cp));
+      }
+    }
+  }
+
+  std::wstring GetUtf16(const uint8_t *units, size_t count)
+  {
+    std::wstring name;
+    name.reserve(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+      uint16_t unit;
+      std::memcpy(&unit, units + i * 2, 2);
+      if (sizeof(wchar_t) > 2 && unit >= 0xD800 && unit < 0xDC00 && i + 1 < count)
+      {
+        uint16_t low;
+        std::memcpy(&low, units + (i + 1) * 2, 2);
+        name += static_cast<wchar_t>(0x10000 + ((unit - 0xD800) << 10) + (low - 0xDC00));
+        ++i;
+      }
+      else
+      {
+        name += static_cast<wchar_t>(unit);
+      }
+    }
+    return name;
+  }
+
+  uint32_t MonitorFlags(const MonitorSettings &settings)
+  {
+    return (settings.showSoftware ? MONITOR_SHOW_SOFTWARE : 0) | (settings.showHardware ? MONITOR_SHOW_HARDWARE : 0) |
+           (settings.unifiedBrightness ? MONITOR_UNIFIED_BRIGHTNESS : 0);
+  }
+
+  void ApplyMonitorFlags(MonitorSettings &settings, uint32_t flags)
+  {
+    settings.showSoftware = (flags & MONITOR_SHOW_SOFTWARE) != 0;
+    settings.showHardware = (flags & MONITOR_SHOW_HARDWARE) != 0;
+    settings.unifiedBrightness = (flags & MONITOR_UNIFIED_BRIGHTNESS) != 0;
+  }
+
+  uint32_t GlobalFlags(const StoredSettings &settings)
+  {
+    return (settings.startOnBoot ? GLOBAL_START_ON_BOOT : 0) | (settings.showBWToggle ? GLOBAL_SHOW_BW_TOGGLE : 0) |
+           (settings.bwEnabled ? GLOBAL_BW_ENABLED : 0) | (settings.autoBrightness ? GLOBAL_AUTO_BRIGHTNESS : 0);
+  }
+
+  void ApplyGlobalFlags(StoredSettings &settings, uint32_t flags)
+  {
+    settings.startOnBoot = (flags & GLOBAL_START_ON_BOOT) != 0;
+    settings.showBWToggle = (flags & GLOBAL_SHOW_BW_TOGGLE) != 0;
+    settings.bwEnabled = (flags & GLOBAL_BW_ENABLED) != 0;
+    settings.autoBrightness = (flags & GLOBAL_AUTO_BRIGHTNESS) != 0;
+  }
+
+  // ---- Platform ---------------------------------------------------------------------
+
+  // Read-only view of a whole file, released on destruction.
+  class MappedFile
+  {
+  public:
+    explicit MappedFile(const std::filesystem::path &path)
+    {
+#ifdef _WIN32
+      HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                FILE_ATTRIBUTE_NORMAL, nullptr);
+      if (file == INVALID_HANDLE_VALUE)
+        return;
+      LARGE_INTEGER size;
+      if (GetFileSizeEx(file, &size) && size.QuadPart > 0)
+      {
+        HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping)
+        {
+          m_data = static_cast<const uint8_t *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+          if (m_data)
+            m_size = static_cast<size_t>(size.QuadPart);
+          CloseHandle(mapping); // The view keeps the mapping alive
+        }
+      }
+      CloseHandle(file);
+#else
+      int fd = open(path.c_str(), O_RDONLY);
+      if (fd < 0)
+        return;
+      struct stat st;
+      if (fstat(fd, &st) == 0 && st.st_size > 0)
+      {
+        void *data = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED)
+        {
+          m_data = static_cast<const uint8_t *>(data);
+          m_size = static_cast<size_t>(st.st_size);
+        }
+      }
+      close(fd);
+#endif
+    }
+
+    ~MappedFile()
+    {
+      if (!m_data)
+        return;
+#ifdef _WIN32
+      UnmapViewOfFile(m_data);
+#else
+      munmap(const_cast<uint8_t *>(m_data), m_size);
+#endif
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    const uint8_t *Data() const { return m_data; }
+    size_t Size() const { return m_size; }
+
+  private:
+    const uint8_t *m_data = nullptr;
+    size_t m_size = 0;
+  };
+
+  // Atomically replaces @p to with @p from.
+  bool ReplaceWith(const std::filesystem::path &from, const std::filesystem::path &to)
+  {
+#ifdef _WIN32
+    // std::filesystem::rename is not guaranteed to replace on every MinGW runtime.
+    return MoveFileExW(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    std::error_code ec;
+    std::filesystem::rename(from, to, ec);
+    return !ec;
+#endif
+  }
+}
+
+SettingsStore::SettingsStore(std::filesystem::path directory)
+    : m_directory(std::move(directory)),
+      m_snapshotPath(m_directory / "settings.bin"),
+      m_journalPath(m_directory / "settings.journal")
+{
+}
+
+SettingsStore::~SettingsStore() = default;
+
+// -----------------------------------------------------------------------------------------------
+// Loading
+// -----------------------------------------------------------------------------------------------
+
+bool SettingsStore::Load(StoredSettings &settings)
+{
+  settings = StoredSettings();
+  m_stats = Stats();
+  bool ok = LoadSnapshot(settings);
+  if (!ok)
+    m_generation = 0;
+  ReplayJournal(settings);
+  return ok;
+}
+
+bool SettingsStore::LoadSnapshot(StoredSettings &settings)
+{
+  MappedFile file(m_snapshotPath);
+  const uint8_t *data = file.Data();
+  const size_t size = file.Size();
+
+  size_t offset = 0;
+  SnapshotHeader header;
+  if (!data || !Get(data, size, offset, header) || std::memcmp(header.magic, SNAPSHOT_MAGIC, 4) != 0 ||
+      header.version != FORMAT_VERSION || header.recordSize < sizeof(SnapshotRecord))
+    return false;
+
+  const uint64_t recordBytes = static_cast<uint64_t>(header.monitorCount) * header.recordSize;
+  const uint64_t nameBytes = static_cast<uint64_t>(header.nameUnits) * 2;
+  if (sizeof(SnapshotHeader) + recordBytes + nameBytes > size ||
+      Fnv1a(data + sizeof(SnapshotHeader), static_cast<size_t>(recordBytes + nameBytes)) != header.checksum)
+    return false;
+
+  // Records and names are read straight out of the mapping.
+  const uint8_t *names = data + sizeof(SnapshotHeader) + recordBytes;
+  for (uint32_t i = 0; i < header.monitorCount; ++i)
+  {
+    SnapshotRecord record;
+    std::memcpy(&record, data + sizeof(SnapshotHeader) + static_cast<size_t>(i) * header.recordSize, sizeof(record));
+    if (static_cast<uint64_t>(record.nameOffset) + record.nameLength > header.nameUnits)
+      return false;
+
+    // Compact writes records in map order, so each insert lands at the end.
+    MonitorSettings &monitor =
+        settings.monitors
+            .emplace_hint(settings.monitors.end(), GetUtf16(names + record.nameOffset * 2, record.nameLength),
+                          MonitorSettings())
+            ->second;
+    ApplyMonitorFlags(monitor, record.flags);
+    monitor.lastSoftwareBrightness = record.softwareBrightness;
+    monitor.lastHardwareBrightness = record.hardwareBrightness;
+    monitor.lastStandardColorTemp = record.colorTemp;
+  }
+  ApplyGlobalFlags(settings, header.flags);
+
+  m_generation = header.generation;
+  m_stats.snapshotMonitors = header.monitorCount;
+  return true;
+}
+
+void SettingsStore::ReplayJournal(StoredSettings &settings)
+{
+  std::vector<uint8_t> bytes;
+  {
+    std::ifstream in(m_journalPath, std::ios::binary);
+    if (in)
+      bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  }
+
+  size_t offset = 0;
+  JournalHeader header;
+  if (!Get(bytes.data(), bytes.size(), offset, header) || std::memcmp(header.magic, JOURNAL_MAGIC, 4) != 0 ||
+      header.version != FORMAT_VERSION || header.generation != m_generation)
+  {
+    // Missing, foreign, or left over from before the last compaction.
+    ResetJournal();
+    return;
+  }
+
+  // Replay up to the first record that does not check out; anything after
+  // it is the remains of an interrupted append.
+  size_t valid = offset;
+  for (;;)
+  {
+    uint32_t length, checksum;
+    size_t at = offset;
+    if (!Get(bytes.data(), bytes.size(), at, length) || !Get(bytes.data(), bytes.size(), at, checksum) ||
+        length == 0 || length > MAX_RECORD_BYTES || length > bytes.size() - at ||
+        Fnv1a(bytes.data() + at, length) != checksum)
+      break;
+
+    const uint8_t *payload = bytes.data() + at;
+    size_t p = 0;
+    uint32_t kind, flags;
+    if (!Get(payload, length, p, kind) || !Get(payload, length, p, flags))
+      break;
+    if (kind == RECORD_GLOBALS)
+    {
+      ApplyGlobalFlags(settings, flags);
+    }
+    else if (kind == RECORD_MONITOR)
+    {
+      int32_t software, hardware, colorTemp;
+      uint32_t nameUnits;
+      if (!Get(payload, length, p, software) || !Get(payload, length, p, hardware) ||
+          !Get(payload, length, p, colorTemp) || !Get(payload, length, p, nameUnits) ||
+          static_cast<uint64_t>(nameUnits) * 2 > length - p)
+        break;
+      MonitorSettings &monitor = settings.monitors[GetUtf16(payload + p, nameUnits)];
+      ApplyMonitorFlags(monitor, flags);
+      monitor.lastSoftwareBrightness = software;
+      monitor.lastHardwareBrightness = hardware;
+      monitor.lastStandardColorTemp = colorTemp;
+    }
+    // Unknown kinds from a later minor revision are skipped.
+
+    offset = at + length;
+    valid = offset;
+    m_stats.journalRecords++;
+  }
+
+  std::error_code ec;
+  if (valid < bytes.size())
+    std::filesystem::resize_file(m_journalPath, valid, ec);
+
+  m_journal.open(m_journalPath, std::ios::binary | std::ios::app);
+  m_stats.journalBytes = valid;
+}
+
+// -----------------------------------------------------------------------------------------------
+// Journal
+// -----------------------------------------------------------------------------------------------
+
+bool SettingsStore::ResetJournal()
+{
+  if (m_journal.is_open())
+    m_journal.close();
+
+  std::error_code ec;
+  std::filesystem::create_directories(m_directory, ec);
+  m_journal.open(m_journalPath, std::ios::binary | std::ios::trunc);
+  if (!m_journal)
+    return false;
+
+  JournalHeader header = {};
+  std::memcpy(header.magic, JOURNAL_MAGIC, 4);
+  header.version = FORMAT_VERSION;
+  header.generation = m_generation;
+  m_journal.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  m_journal.flush();
+  m_stats.journalRecords = 0;
+  m_stats.journalBytes = sizeof(header);
+  return static_cast<bool>(m_journal);
+}
+
+bool SettingsStore::AppendRecord(const std::vector<uint8_t> &payload)
+{
+  if (!m_journal.is_open() && !ResetJournal())
+    return false;
+
+  std::vector<uint8_t> record;
+  record.reserve(payload.size() + 8);
+  Put(record, static_cast<uint32_t>(payload.size()));
+  Put(record, Fnv1a(payload.data(), payload.size()));
+  record.insert(record.end(), payload.begin(), payload.end());
+
+  m_journal.write(reinterpret_cast<const char *>(record.data()), static_cast<std::streamsize>(record.size()));
+  if (!m_journal)
+    return false;
+  m_stats.journalRecords++;
+  m_stats.journalBytes += record.size();
+  return true;
+}
+
+bool SettingsStore::AppendGlobals(const StoredSettings &settings)
+{
+  std::vector<uint8_t> payload;
+  Put(payload, RECORD_GLOBALS);
+  Put(payload, GlobalFlags(settings));
+  return AppendRecord(payload);
+}
+
+bool SettingsStore::AppendMonitor(const std::wstring &deviceName, const MonitorSettings &settings)
+{
+  std::vector<uint16_t> name;
+  PutUtf16(name, deviceName);
+
+  std::vector<uint8_t> payload;
+  Put(payload, RECORD_MONITOR);
+  Put(payload, MonitorFlags(settings));
+  Put(payload, static_cast<int32_t>(settings.lastSoftwareBrightness));
+  Put(payload, static_cast<int32_t>(settings.lastHardwareBrightness));
+  Put(payload, static_cast<int32_t>(settings.lastStandardColorTemp));
+  Put(payload, static_cast<uint32_t>(name.size()));
+  for (uint16_t unit : name)
+    Put(payload, unit);
+  if (payload.size() > MAX_RECORD_BYTES)
+    return false;
+  return AppendRecord(payload);
+}
+
+bool SettingsStore::Sync()
+{
+  if (!m_journal.is_open())
+    return true;
+  m_journal.flush();
+  return static_cast<bool>(m_journal);
+}
+
+bool SettingsStore::NeedsCompaction() const
+{
+  return m_stats.journalRecords >= COMPACT_RECORDS || m_stats.journalBytes >= COMPACT_BYTES;
+}
+
+// -----------------------------------------------------------------------------------------------
+// Compaction
+// -----------------------------------------------------------------------------------------------
+
+bool SettingsStore::Compact(const StoredSettings &settings)
+{
+  std::vector<uint16_t> names;
+  std::vector<uint8_t> body;
+  body.reserve(settings.monitors.size() * sizeof(SnapshotRecord));
+  for (const auto &pair : settings.monitors)
+  {
+    SnapshotRecord record;
+    record.nameOffset = static_cast<uint32_t>(names.size());
+    PutUtf16(names, pair.first);
+    record.nameLength = static_cast<uint32_t>(names.size()) - record.nameOffset;
+    record.flags = MonitorFlags(pair.second);
+    record.softwareBrightness = pair.second.lastSoftwareBrightness;
+    record.hardwareBrightness = pair.second.lastHardwareBrightness;
+    record.colorTemp = pair.second.lastStandardColorTemp;
+    Put(body, record);
+  }
+  for (uint16_t unit : names)
+    Put(body, unit);
+
+  SnapshotHeader header = {};
+  std::memcpy(header.magic, SNAPSHOT_MAGIC, 4);
+  header.version = FORMAT_VERSION;
+  header.recordSize = sizeof(SnapshotRecord);
+  header.generation = m_generation + 1;
+  header.flags = GlobalFlags(settings);
+  header.monitorCount = static_cast<uint32_t>(settings.monitors.size());
+  header.nameUnits = static_cast<uint32_t>(names.size());
+  header.checksum = Fnv1a(body.data(), body.size());
+
+  // Write beside the live snapshot and swap it in, so a crash leaves either
+  // the old snapshot or the new one, never half of each.
+  std::error_code ec;
+  std::filesystem::create_directories(m_directory, ec);
+  std::filesystem::path temp = m_snapshotPath;
+  temp += ".tmp";
+  {
+    std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char *>(body.data()), static_cast<std::streamsize>(body.size()));
+    if (!out)
+      return false;
+  }
+  if (!ReplaceWith(temp, m_snapshotPath))
+    return false;
+
+  // The old journal is now stale by generation even if this reset fails.
+  m_generation = header.generation;
+  m_stats.snapshotMonitors = header.monitorCount;
+  m_stats.compactions++;
+  return ResetJournal();
+}
+
+SettingsStore::Stats SettingsStore::GetStats() const
+{
+  return m_stats;
+}
@@ -0,0 +1,127 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+struct MonitorSettings
+{
+  bool showSoftware = true;
+  bool showHardware = true;
+  bool unifiedBrightness = false;   // Hardware slider previews through gamma and writes DDC/CI once per drag
+  int lastSoftwareBrightness = 100; // Default to 100% for software (no dimming)
+  int lastHardwareBrightness = 50;  // Default to 50% for hardware
+  int lastStandardColorTemp = 6500; // Default to 6500K (neutral/daylight)
+};
+
+/**
+ * @brief Everything Settings persists.
+ */
+struct StoredSettings
+{
+  bool startOnBoot = false;
+  bool showBWToggle = false;
+  bool bwEnabled = false;
+  bool autoBrightness = false; // Follow the ambient light sensor
+  std::map<std::wstring, MonitorSettings> monitors;
+};
+
+/**
+ * @brief File-backed settings: a versioned binary snapshot plus an
+ *        append-only journal of changes made since it was written.
+ *
+ * The snapshot (settings.bin) is a fixed header, an array of fixed-size
+ * monitor records and a pool of UTF-16 names. Load() memory-maps it and
+ * reads the records in place, with no parsing or unescaping, then replays
+ * the journal (settings.journal) on top. Changes are appended to the
+ * journal as checksummed records; Compact() folds everything back into a
+ * fresh snapshot, written to a temporary file and renamed into place.
+ *
+ * Both files carry a generation number. A journal whose generation does not
+ * match the snapshot's predates the last compaction and is ignored, so a
+ * crash between writing the snapshot and resetting the journal is harmless.
+ * A torn record at the end of the journal (crash mid-append) is cut off.
+ *
+ * Files are little-endian. No OS dependencies beyond the memory mapping.
+ */
+class SettingsStore
+{
+public:
+  /**
+   * @brief Counters describing the files' current state.
+   */
+  struct Stats
+  {
+    uint64_t snapshotMonitors = 0; // Records in the snapshot read by Load
+    uint64_t journalRecords = 0;   // Records in the journal (replayed + appended)
+    uint64_t journalBytes = 0;     // Size of the journal file
+    uint64_t compactions = 0;      // Compact calls that succeeded
+  };
+
+  static constexpr uint16_t FORMAT_VERSION = 1;
+
+  // Compact once the journal holds this many records or bytes
+  static constexpr uint64_t COMPACT_RECORDS = 256;
+  static constexpr uint64_t COMPACT_BYTES = 64 * 1024;
+
+  explicit SettingsStore(std::filesystem::path directory);
+  ~SettingsStore();
+
+  SettingsStore(const SettingsStore &) = delete;
+  SettingsStore &operator=(const SettingsStore &) = delete;
+
+  /**
+   * @brief Reads the snapshot and replays the journal into @p settings, and
+   *        readies the journal for appending.
+   * @return false if there is no valid snapshot (first run, or the file is
+   *         damaged or from a newer major version); @p settings then holds
+   *         whatever a valid journal alone provided.
+   */
+  bool Load(StoredSettings &settings);
+
+  /**
+   * @brief Appends the top-level values to the journal.
+   */
+  bool AppendGlobals(const StoredSettings &settings);
+
+  /**
+   * @brief Appends one monitor's values to the journal.
+   */
+  bool AppendMonitor(const std::wstring &deviceName, const MonitorSettings &settings);
+
+  /**
+   * @brief Hands appended records to the OS.
+   */
+  bool Sync();
+
+  /**
+   * @brief True once the journal has grown past COMPACT_RECORDS or
+   *        COMPACT_BYTES.
+   */
+  bool NeedsCompaction() const;
+
+  /**
+   * @brief Writes @p settings as a new snapshot and empties the journal.
+   */
+  bool Compact(const StoredSettings &settings);
+
+  Stats GetStats() const;
+
+  const std::filesystem::path &GetSnapshotPath() const { return m_snapshotPath; }
+  const std::filesystem::path &GetJournalPath() const { return m_journalPath; }
+
+private:
+  bool LoadSnapshot(StoredSettings &settings);
+  void ReplayJournal(StoredSettings &settings);
+  bool ResetJournal();
+  bool AppendRecord(const std::vector<uint8_t> &payload);
+
+  std::filesystem::path m_directory;
+  std::filesystem::path m_snapshotPath;
+  std::filesystem::path m_journalPath;
+  uint32_t m_generation = 0; // Of the snapshot the journal applies to
+  std::ofstream m_journal;
+  Stats m_stats;
+};
@@ -0,0 +1,293 @@
+#include "trace.h"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+
+namespace
+{
+  static_assert((Trace::EVENTS_PER_THREAD & (Trace::EVENTS_PER_THREAD - 1)) == 0,
+                "EVENTS_PER_THREAD must be a power of two");
+
+  // A seqlock per slot: seq is 0 while the owning thread rewrites the slot
+  // and index + 1 once it is complete, so a Collect running alongside the
+  // owner can tell a finished event from one being overwritten.
+  struct Slot
+  {
+    std::atomic<uint64_t> seq{0};
+    std::atomic<const char *> name{nullptr};
+    std::atomic<const char *> argName{nullptr};
+    std::atomic<int64_t> arg{0};
+    std::atomic<uint64_t> startNs{0};
+    std::atomic<uint64_t> durationNs{0};
+  };
+
+  // One thread's ring. Only the owning thread writes; head counts every
+  // event recorded in the buffer's session, so head - EVENTS_PER_THREAD of
+  // them have been overwritten.
+  struct ThreadBuffer
+  {
+    uint32_t id = 0;
+    std::atomic<const char *> name{nullptr};
+    std::atomic<uint32_t> session{0};
+    std::atomic<uint64_t> head{0};
+    std::atomic<bool> retired{false};
+    Slot slots[Trace::EVENTS_PER_THREAD];
+  };
+
+  std::mutex g_registryMutex;
+  std::vector<std::shared_ptr<ThreadBuffer>> g_buffers;
+  uint32_t g_nextThreadId = 1;
+  uint32_t g_lastSession = 0; // Session Collect reads, guarded by the registry mutex
+  std::atomic<uint64_t> g_originNs{0};
+
+  thread_local const char *t_threadName = nullptr;
+
+  // Marks the buffer as retired when its thread exits; the next Start frees
+  // it. Until then it stays in the registry so its events can be collected.
+  struct BufferHolder
+  {
+    std::shared_ptr<ThreadBuffer> buffer;
+
+    ~BufferHolder()
+    {
+      if (buffer)
+        buffer->retired.store(true, std::memory_order_release);
+    }
+  };
+
+  thread_local BufferHolder t_holder;
+
+  ThreadBuffer *LocalBuffer()
+  {
+    if (!t_holder.buffer)
+    {
+      auto buffer = std::make_shared<ThreadBuffer>();
+      buffer->name.store(t_threadName, std::memory_order_relaxed);
+      std::lock_guard<std::mutex> lock(g_registryMutex);
+      buffer->id = g_nextThreadId++;
+      g_buffers.push_back(buffer);
+      t_holder.buffer = std::move(buffer);
+    }
+    return t_holder.buffer.get();
+  }
+
+  void CollectBuffer(const ThreadBuffer &buffer, uint32_t session, uint64_t originNs, Trace::Capture &capture)
+  {
+    if (buffer.session.load(std::memory_order_acquire) != session)
+      return;
+
+    const uint64_t size = Trace::EVENTS_PER_THREAD;
+    uint64_t head = buffer.head.load(std::memory_order_acquire);
+    uint64_t first = head > size ? head - size : 0;
+    capture.dropped += first;
+    for (uint64_t i = first; i < head; ++i)
+    {
+      const Slot &slot = buffer.slots[i & (size - 1)];
+      Trace::Event event;
+      uint64_t seq = slot.seq.load(std::memory_order_acquire);
+      event.name = slot.name.load(std::memory_order_relaxed);
+      event.argName = slot.argName.load(std::memory_order_relaxed);
+      event.arg = slot.arg.load(std::memory_order_relaxed);
+      event.startNs = slot.startNs.load(std::memory_order_relaxed);
+      event.durationNs = slot.durationNs.load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (seq != i + 1 || slot.seq.load(std::memory_order_relaxed) != seq)
+      {
+        // Overwritten by the owner since head was read.
+        capture.dropped++;
+        continue;
+      }
+      event.threadId = buffer.id;
+      event.startNs = event.startNs > originNs ? event.startNs - originNs : 0;
+      capture.events.push_back(event);
+    }
+  }
+
+  void AppendEscaped(std::string &out, const char *text)
+  {
+    for (const char *c = text; *c; ++c)
+    {
+      unsigned char ch = static_cast<unsigned char>(*c);
+      if (ch == '"' || ch == '\\')
+      {
+        out += '\\';
+        out += *c;
+      }
+      else if (ch < 0x20)
+      {
+        char buffer[8];
+        std::snprintf(buffer, sizeof(buffer), "\\u%04x", ch);
+        out += buffer;
+      }
+      else
+        out += *c;
+    }
+  }
+}
+
+namespace Trace
+{
+  namespace Detail
+  {
+    std::atomic<uint32_t> g_session{0};
+
+    uint64_t Now()
+    {
+      return static_cast<uint64_t>(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+              .count());
+    }
+
+    void Record(uint32_t session, const char *name, uint64_t startNs, const char *argName, int64_t arg)
+    {
+      uint64_t end = Now();
+
+      // A span that outlived its capture, or straddles a restart, is dropped.
+      if (g_session.load(std::memory_order_acquire) != session)
+        return;
+
+      ThreadBuffer *buffer = LocalBuffer();
+      if (buffer->session.load(std::memory_order_relaxed) != session)
+      {
+        // First event of a new capture on this thread: start the ring over.
+        buffer->head.store(0, std::memory_order_relaxed);
+        buffer->session.store(session, std::memory_order_release);
+      }
+
+      uint64_t head = buffer->head.load(std::memory_order_relaxed);
+      Slot &slot = buffer->slots[head & (EVENTS_PER_THREAD - 1)];
+      slot.seq.store(0, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+      slot.name.store(name, std::memory_order_relaxed);
+      slot.argName.store(argName, std::memory_order_relaxed);
+      slot.arg.store(arg, std::memory_order_relaxed);
+      slot.startNs.store(startNs, std::memory_order_relaxed);
+      slot.durationNs.store(end - startNs, std::memory_order_relaxed);
+      slot.seq.store(head + 1, std::memory_order_release);
+      buffer->head.store(head + 1, std::memory_order_release);
+    }
+  }
+
+  void Start()
+  {
+    std::lock_guard<std::mutex> lock(g_registryMutex);
+
+    // Buffers of threads that have exited are only kept for the capture
+    // they recorded into.
+    g_buffers.erase(std::remove_if(g_buffers.begin(), g_buffers.end(),
+                                   [](const std::shared_ptr<ThreadBuffer> &buffer)
+                                   { return buffer->retired.load(std::memory_order_acquire); }),
+                    g_buffers.end());
+
+    uint32_t session = g_lastSession + 1;
+    if (session == 0)
+      session = 1;
+    g_lastSession = session;
+    g_originNs.store(Detail::Now(), std::memory_order_relaxed);
+    Detail::g_session.store(session, std::memory_order_release);
+  }
+
+  void Stop()
+  {
+    Detail::g_session.store(0, std::memory_order_release);
+  }
+
+  bool IsCapturing()
+  {
+    return Detail::g_session.load(std::memory_order_relaxed) != 0;
+  }
+
+  void SetThreadName(const char *name)
+  {
+    t_threadName = name;
+    if (t_holder.buffer)
+      t_holder.buffer->name.store(name, std::memory_order_relaxed);
+  }
+
+  Capture Collect()
+  {
+    Capture capture;
+    std::lock_guard<std::mutex> lock(g_registryMutex);
+    if (g_lastSession == 0)
+      return capture;
+
+    uint64_t originNs = g_originNs.load(std::memory_order_relaxed);
+    for (const auto &buffer : g_buffers)
+    {
+      size_t before = capture.events.size();
+      uint64_t droppedBefore = capture.dropped;
+      CollectBuffer(*buffer, g_lastSession, originNs, capture);
+      if (capture.events.size() == before && capture.dropped == droppedBefore)
+        continue;
+
+      ThreadInfo thread;
+      thread.id = buffer->id;
+      const char *name = buffer->name.load(std::memory_order_relaxed);
+      thread.name = name ? name : "thread " + std::to_string(buffer->id);
+      capture.threads.push_back(thread);
+    }
+
+    std::stable_sort(capture.events.begin(), capture.events.end(), [](const Event &a, const Event &b)
+                     { return a.startNs < b.startNs; });
+    return capture;
+  }
+
+  std::string ToChromeJson(const Capture &capture)
+  {
+    std::string out;
+    out.reserve(128 + capture.events.size() * 128);
+    out += "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+    bool first = true;
+    char buffer[160];
+    for (const ThreadInfo &thread : capture.threads)
+    {
+      out += first ? "\n" : ",\n";
+      first = false;
+      std::snprintf(buffer, sizeof(buffer), "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"",
+                    thread.id);
+      out += buffer;
+      AppendEscaped(out, thread.name.c_str());
+      out += "\"}}";
+    }
+
+    // Chrome wants microseconds; keep the nanoseconds as decimals.
+    for (const Event &event : capture.events)
+    {
+      out += first ? "\n" : ",\n";
+      first = false;
+      out += "{\"name\":\"";
+      AppendEscaped(out, event.name);
+      std::snprintf(buffer, sizeof(buffer), "\",\"cat\":\"candela\",\"ph\":\"X\",\"ts\":%llu.%03u,\"dur\":%llu.%03u,\"pid\":1,\"tid\":%u",
+                    static_cast<unsigned long long>(event.startNs / 1000), static_cast<unsigned>(event.startNs % 1000),
+                    static_cast<unsigned long long>(event.durationNs / 1000),
+                    static_cast<unsigned>(event.durationNs % 1000), event.threadId);
+      out += buffer;
+      if (event.argName)
+      {
+        out += ",\"args\":{\"";
+        AppendEscaped(out, event.argName);
+        std::snprintf(buffer, sizeof(buffer), "\":%lld}", static_cast<long long>(event.arg));
+        out += buffer;
+      }
+      out += "}";
+    }
+
+    std::snprintf(buffer, sizeof(buffer), "\n],\"otherData\":{\"droppedEvents\":%llu}}\n",
+                  static_cast<unsigned long long>(capture.dropped));
+    out += buffer;
+    return out;
+  }
+
+  bool WriteChromeJson(const std::filesystem::path &path)
+  {
+    std::string json = ToChromeJson(Collect());
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file)
+      return false;
+    file.write(json.data(), static_cast<std::streamsize>(json.size()));
+    return static_cast<bool>(file);
+  }
+}
@@ -0,0 +1,147 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// Trace spans are compiled in unless the build sets CANDELA_TRACE=0
+// (make TRACE=0), in which case TRACE_SCOPE and TRACE_SCOPE_ARG expand to
+// nothing and the tray hides the capture entry.
+#ifndef CANDELA_TRACE
+#define CANDELA_TRACE 1
+#endif
+
+/**
+ * @brief Low-overhead timing spans for the hot paths (gamma writes, DDC/CI
+ *        commands, probing, settings flushes, slider handlers).
+ *
+ * Each thread records into its own fixed-size ring buffer; recording takes
+ * no lock and allocates nothing once the thread's buffer exists. Outside a
+ * capture a span costs one relaxed atomic load. When a buffer wraps, the
+ * oldest events are overwritten and counted as dropped.
+ *
+ * Names and argument names must be string literals (or otherwise outlive
+ * the capture): only the pointers are recorded.
+ */
+namespace Trace
+{
+  constexpr size_t EVENTS_PER_THREAD = 8192; // Ring size, a power of two
+
+  /**
+   * @brief One finished span, as collected from a thread's buffer.
+   */
+  struct Event
+  {
+    const char *name = nullptr;
+    const char *argName = nullptr; // nullptr = the span has no argument
+    int64_t arg = 0;
+    uint64_t startNs = 0; // Relative to the start of the capture
+    uint64_t durationNs = 0;
+    uint32_t threadId = 0;
+  };
+
+  struct ThreadInfo
+  {
+    uint32_t id = 0;
+    std::string name;
+  };
+
+  /**
+   * @brief Everything recorded by the last (or current) capture.
+   */
+  struct Capture
+  {
+    std::vector<ThreadInfo> threads;
+    std::vector<Event> events; // Sorted by start time
+    uint64_t dropped = 0;      // Events overwritten before they were collected
+  };
+
+  /**
+   * @brief Discards the previous capture and starts recording.
+   */
+  void Start();
+
+  /**
+   * @brief Stops recording. What was recorded stays available to Collect.
+   */
+  void Stop();
+
+  bool IsCapturing();
+
+  /**
+   * @brief Names the calling thread in exported traces. @p name must be a
+   *        string literal.
+   */
+  void SetThreadName(const char *name);
+
+  /**
+   * @brief Copies out the events of the last capture. May be called while
+   *        the capture is still running.
+   */
+  Capture Collect();
+
+  /**
+   * @brief Formats a capture as Chrome trace_event JSON (chrome://tracing,
+   *        Perfetto): one complete ("X") event per span, one metadata event
+   *        per thread name.
+   */
+  std::string ToChromeJson(const Capture &capture);
+
+  /**
+   * @brief Collects the last capture and writes it as Chrome JSON.
+   */
+  bool WriteChromeJson(const std::filesystem::path &path);
+
+  namespace Detail
+  {
+    extern std::atomic<uint32_t> g_session; // Running capture, 0 if none
+
+    uint64_t Now();
+    void Record(uint32_t session, const char *name, uint64_t startNs, const char *argName, int64_t arg);
+  }
+
+  /**
+   * @brief Records the time between its construction and destruction.
+   *        Use through TRACE_SCOPE / TRACE_SCOPE_ARG.
+   */
+  class Span
+  {
+  public:
+    explicit Span(const char *name, const char *argName = nullptr, int64_t arg = 0) noexcept
+        : m_name(name), m_argName(argName), m_arg(arg),
+          m_session(Detail::g_session.load(std::memory_order_relaxed))
+    {
+      if (m_session)
+        m_start = Detail::Now();
+    }
+
+    ~Span()
+    {
+      if (m_session)
+        Detail::Record(m_session, m_name, m_start, m_argName, m_arg);
+    }
+
+    Span(const Span &) = delete;
+    Span &operator=(const Span &) = delete;
+
+  private:
+    const char *m_name;
+    const char *m_argName;
+    int64_t m_arg;
+    uint32_t m_session;
+    uint64_t m_start = 0;
+  };
+}
+
+#if CANDELA_TRACE
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SCOPE(name) Trace::Span TRACE_CONCAT(traceSpan, __LINE__)(name)
+#define TRACE_SCOPE_ARG(name, argName, arg) \
+  Trace::Span TRACE_CONCAT(traceSpan, __LINE__)(name, argName, static_cast<int64_t>(arg))
+#else
+#define TRACE_SCOPE(name) ((void)0)
+#define TRACE_SCOPE_ARG(name, argName, arg) ((void)0)
+#endif
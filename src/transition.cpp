@@ -0,0 +1,143 @@
+#include "transition.h"
+#include "colortemp.h"
+#include <algorithm>
+#include <cmath>
+
+namespace TransitionUtils
+{
+  size_t FramesFor(std::chrono::milliseconds duration, int refreshHz)
+  {
+    if (duration.count() <= 0 || refreshHz <= 0)
+      return 1;
+    return std::max<size_t>(1, static_cast<size_t>(duration.count() * refreshHz / 1000));
+  }
+
+  double Ease(double t, TransitionEasing easing)
+  {
+    t = std::max(0.0, std::min(t, 1.0));
+    switch (easing)
+    {
+    case TransitionEasing::InOut:
+      return t * t * (3.0 - 2.0 * t);
+    case TransitionEasing::Out:
+      return 1.0 - (1.0 - t) * (1.0 - t);
+    case TransitionEasing::Linear:
+    default:
+      return t;
+    }
+  }
+}
+
+// -----------------------------------------------------------------------------------------------
+// SoftwareTransition
+// -----------------------------------------------------------------------------------------------
+
+void SoftwareTransition::Plan(double fromBrightness, double fromMired, int toBrightness, int toKelvin,
+                              size_t frames, TransitionEasing easing)
+{
+  using namespace ColorTempUtils;
+  toBrightness = std::max(BRIGHTNESS_MIN, std::min(toBrightness, BRIGHTNESS_MAX));
+  toKelvin = std::max(KELVIN_MIN, std::min(toKelvin, KELVIN_MAX));
+  const double toMired = TransitionUtils::KelvinToMired(toKelvin);
+  frames = std::max<size_t>(frames, 1);
+
+  m_keyframes.resize(frames);
+  for (size_t i = 0; i < frames; ++i)
+  {
+    // Frame i shows the state at the end of its interval, so the last frame
+    // is exactly the target and a one-frame plan is a plain step.
+    double p = TransitionUtils::Ease(static_cast<double>(i + 1) / frames, easing);
+    TransitionKeyframe &frame = m_keyframes[i];
+    frame.brightness = fromBrightness + (toBrightness - fromBrightness) * p;
+    frame.mired = fromMired + (toMired - fromMired) * p;
+    frame.rampBrightness = static_cast<int>(std::lround(frame.brightness));
+    frame.rampKelvin = static_cast<int>(std::lround(TransitionUtils::MiredToKelvin(frame.mired)));
+  }
+  m_keyframes.back().rampBrightness = toBrightness;
+  m_keyframes.back().rampKelvin = toKelvin;
+}
+
+void SoftwareTransition::Clear()
+{
+  m_keyframes.clear();
+}
+
+bool SoftwareTransition::IsActive() const
+{
+  return !m_keyframes.empty();
+}
+
+size_t SoftwareTransition::FrameCount() const
+{
+  return m_keyframes.size();
+}
+
+const TransitionKeyframe &SoftwareTransition::Frame(size_t index) const
+{
+  return m_keyframes[std::min(index, m_keyframes.size() - 1)];
+}
+
+// -----------------------------------------------------------------------------------------------
+// HardwareTransition
+// -----------------------------------------------------------------------------------------------
+
+void HardwareTransition::Plan(uint32_t fromNative, uint32_t toNative, std::chrono::milliseconds duration,
+                              std::chrono::milliseconds minInterval)
+{
+  m_from = fromNative;
+  m_to = toNative;
+  m_current = fromNative;
+  m_issued = 0;
+
+  // One native unit per step if time allows; otherwise as many steps as
+  // the write throttle fits into the duration, counting the immediate one.
+  size_t distance = fromNative > toNative ? fromNative - toNative : toNative - fromNative;
+  size_t slots = minInterval.count() > 0 ? static_cast<size_t>(duration / minInterval) + 1 : distance;
+  m_steps = std::max<size_t>(std::min(distance, slots), distance ? 1 : 0);
+  m_stepInterval = std::chrono::steady_clock::duration::zero();
+  if (m_steps > 1)
+  {
+    using Rep = std::chrono::steady_clock::rep;
+    m_stepInterval = std::chrono::steady_clock::duration(duration) / static_cast<Rep>(m_steps - 1);
+  }
+}
+
+void HardwareTransition::Clear()
+{
+  m_steps = 0;
+  m_issued = 0;
+}
+
+bool HardwareTransition::IsActive() const
+{
+  return m_issued < m_steps;
+}
+
+bool HardwareTransition::Due(std::chrono::steady_clock::duration elapsed, uint32_t &nativeValue)
+{
+  if (!IsActive())
+    return false;
+
+  // Step k (1-based) falls due at (k - 1) intervals, so the first one goes
+  // out immediately and the last one lands at the end of the duration.
+  size_t due = m_stepInterval.count() > 0 ? static_cast<size_t>(elapsed / m_stepInterval) + 1 : m_steps;
+  due = std::min(due, m_steps);
+  if (due <= m_issued)
+    return false;
+
+  m_issued = due;
+  double p = static_cast<double>(due) / m_steps;
+  m_current = static_cast<uint32_t>(std::lround(m_from + (static_cast<double>(m_to) - m_from) * p));
+  nativeValue = m_current;
+  return true;
+}
+
+std::chrono::steady_clock::duration HardwareTransition::NextDue() const
+{
+  return m_stepInterval * static_cast<std::chrono::steady_clock::rep>(m_issued);
+}
+
+uint32_t HardwareTransition::Current() const
+{
+  return m_current;
+}
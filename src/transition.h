@@ -0,0 +1,115 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Shape of a transition's progress curve.
+ */
+enum class TransitionEasing
+{
+  InOut, // Smoothstep; starts and ends at rest. Used for fresh transitions.
+  Out,   // Starts at speed and settles. Used when retargeting mid-flight.
+  Linear
+};
+
+/**
+ * @brief One display frame of a software (gamma) transition.
+ */
+struct TransitionKeyframe
+{
+  double brightness;  // Exact interpolated value, so a retarget can start from here
+  double mired;       // Exact interpolated colour temperature, 1e6 / kelvin
+  int rampBrightness; // Rounded values handed to the ramp builder
+  int rampKelvin;
+};
+
+/**
+ * @brief Precomputed gamma animation for one monitor.
+ *
+ * Plan() evaluates the whole animation up front, one keyframe per display
+ * frame: brightness is interpolated linearly, colour temperature linearly in
+ * mired space (where equal steps look equally large), both shaped by the
+ * easing curve. Playing a frame is a table lookup, and the ramp builder is
+ * table-driven too, so no transcendental maths runs per frame.
+ */
+class SoftwareTransition
+{
+public:
+  /**
+   * @param frames Number of keyframes; the last one is exactly the target.
+   */
+  void Plan(double fromBrightness, double fromMired, int toBrightness, int toKelvin, size_t frames,
+            TransitionEasing easing);
+
+  void Clear();
+  bool IsActive() const;
+  size_t FrameCount() const;
+
+  /**
+   * @brief Keyframe @p index, clamped to the last frame.
+   */
+  const TransitionKeyframe &Frame(size_t index) const;
+
+private:
+  std::vector<TransitionKeyframe> m_keyframes;
+};
+
+/**
+ * @brief Throttled stepping of a DDC/CI brightness value in native units.
+ *
+ * Monitors only take a DDC/CI write every few tens of milliseconds and many
+ * flash an OSD for each one, so the hardware side is not frame-paced. It
+ * walks from the current native value to the target in equal whole-unit
+ * steps, at most one write per minInterval, ending exactly on the target.
+ */
+class HardwareTransition
+{
+public:
+  void Plan(uint32_t fromNative, uint32_t toNative, std::chrono::milliseconds duration,
+            std::chrono::milliseconds minInterval);
+
+  void Clear();
+  bool IsActive() const;
+
+  /**
+   * @brief The newest step due @p elapsed after the start, if it has not been
+   *        handed out yet. Late callers skip straight to the current step.
+   */
+  bool Due(std::chrono::steady_clock::duration elapsed, uint32_t &nativeValue);
+
+  /**
+   * @brief Offset from the start at which the next step falls due.
+   */
+  std::chrono::steady_clock::duration NextDue() const;
+
+  /**
+   * @brief The value most recently handed out (the start value before any).
+   */
+  uint32_t Current() const;
+
+private:
+  uint32_t m_from = 0;
+  uint32_t m_to = 0;
+  uint32_t m_current = 0;
+  size_t m_steps = 0;  // Writes in the whole transition
+  size_t m_issued = 0; // Writes handed out so far
+  std::chrono::steady_clock::duration m_stepInterval{};
+};
+
+namespace TransitionUtils
+{
+  constexpr double KelvinToMired(double kelvin) { return 1000000.0 / kelvin; }
+  constexpr double MiredToKelvin(double mired) { return 1000000.0 / mired; }
+
+  /**
+   * @brief Keyframes needed to cover @p duration at @p refreshHz (at least 1).
+   */
+  size_t FramesFor(std::chrono::milliseconds duration, int refreshHz);
+
+  /**
+   * @brief Applies @p easing to progress @p t in [0, 1].
+   */
+  double Ease(double t, TransitionEasing easing);
+}
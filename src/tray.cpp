@@ -2,13 +2,46 @@
 #include "gui.h"
 #include "settings.h"
 #include "resource.h"
+#include "trace.h"
 #include <shellapi.h>
 #include <windowsx.h>
+#include <filesystem>
+#include <string>
 
 // Global external references
 extern HWND g_hwnd;
 extern Settings g_settings;
 
+#if CANDELA_TRACE
+// Starts a trace capture, or stops the running one and saves it as Chrome
+// trace JSON next to the settings.
+static void ToggleTraceCapture(HWND hwnd)
+{
+  if (!Trace::IsCapturing())
+  {
+    Trace::Start();
+    return;
+  }
+  Trace::Stop();
+
+  std::filesystem::path directory = g_settings.getDataDirectory();
+  if (directory.empty())
+  {
+    wchar_t tempPath[MAX_PATH];
+    if (GetTempPath(MAX_PATH, tempPath))
+      directory = tempPath;
+  }
+  std::filesystem::path path = directory / L"trace.json";
+
+  std::wstring message;
+  if (Trace::WriteChromeJson(path))
+    message = L"Trace saved to\n" + path.wstring() + L"\n\nOpen it in chrome://tracing or ui.perfetto.dev.";
+  else
+    message = L"Failed to write " + path.wstring();
+  MessageBox(hwnd, message.c_str(), L"Candela Trace", MB_OK | MB_ICONINFORMATION);
+}
+#endif
+
 bool Tray::createTray(HWND hwnd)
 {
   NOTIFYICONDATA nid = {};
@@ -56,6 +89,10 @@ void Tray::handleRightClick(HWND hwnd, int x, int y)
   if (hMenu)
   {
     InsertMenu(hMenu, -1, MF_BYPOSITION | MF_STRING, ID_INFO, L"Info");
+#if CANDELA_TRACE
+    InsertMenu(hMenu, -1, MF_BYPOSITION | MF_STRING, ID_TRACE,
+               Trace::IsCapturing() ? L"Stop Trace and Save" : L"Start Trace");
+#endif
     InsertMenu(hMenu, -1, MF_BYPOSITION | MF_SEPARATOR, 0, nullptr);
     InsertMenu(hMenu, -1, MF_BYPOSITION | MF_STRING, ID_SETTINGS, L"Settings");
     InsertMenu(hMenu, -1, MF_BYPOSITION | MF_STRING, ID_EXIT, L"Exit");
@@ -72,6 +109,12 @@ void Tray::handleRightClick(HWND hwnd, int x, int y)
       // Show info dialog
       ShowInfoDialog(hwnd);
     }
+#if CANDELA_TRACE
+    else if (cmd == ID_TRACE)
+    {
+      ToggleTraceCapture(hwnd);
+    }
+#endif
     else if (cmd == ID_SETTINGS)
     {
       // Show settings dialog
@@ -42,4 +42,5 @@ private:
   static const UINT ID_EXIT = 1;
   static const UINT ID_SETTINGS = 2;
   static const UINT ID_INFO = 3;
+  static const UINT ID_TRACE = 4;
 };
@@ -0,0 +1,333 @@
+#include "winbackend.h"
+#include "colortemp.h"
+#include "ddcci.h"
+#include "trace.h"
+#include <cstring>
+#include <setupapi.h>
+#include <highlevelmonitorconfigurationapi.h>
+#include <physicalmonitorenumerationapi.h>
+#include <magnification.h>
+
+// MinGW ships neither prototypes nor an import library for Magnification.dll,
+// so we resolve the three entry points dynamically. The DLL is present on
+// Windows 7 SP1 and later.
+namespace
+{
+  using MagInitializeFn = BOOL(WINAPI *)();
+  using MagUninitializeFn = BOOL(WINAPI *)();
+  using MagSetFullscreenColorEffectFn = BOOL(WINAPI *)(PMAGCOLOREFFECT);
+
+  HMODULE g_magModule = nullptr;
+  MagInitializeFn g_magInit = nullptr;
+  MagUninitializeFn g_magUninit = nullptr;
+  MagSetFullscreenColorEffectFn g_magSetEffect = nullptr;
+  bool g_magInitialized = false;
+
+  MAGCOLOREFFECT kIdentity = {{
+      {1.0f, 0.0f, 0.0f, 0.0f, 0.0f},
+      {0.0f, 1.0f, 0.0f, 0.0f, 0.0f},
+      {0.0f, 0.0f, 1.0f, 0.0f, 0.0f},
+      {0.0f, 0.0f, 0.0f, 1.0f, 0.0f},
+      {0.0f, 0.0f, 0.0f, 0.0f, 1.0f},
+  }};
+
+  void UnloadMagnification()
+  {
+    if (g_magModule)
+      FreeLibrary(g_magModule);
+    g_magModule = nullptr;
+    g_magInit = nullptr;
+    g_magUninit = nullptr;
+    g_magSetEffect = nullptr;
+  }
+
+  bool LoadMagnification()
+  {
+    if (g_magModule)
+      return true;
+    g_magModule = LoadLibraryW(L"Magnification.dll");
+    if (!g_magModule)
+      return false;
+
+    // Double-cast through void* keeps -Wcast-function-type quiet without
+    // hiding genuine type mismatches at the call sites below.
+    g_magInit = reinterpret_cast<MagInitializeFn>(
+        reinterpret_cast<void *>(GetProcAddress(g_magModule, "MagInitialize")));
+    g_magUninit = reinterpret_cast<MagUninitializeFn>(
+        reinterpret_cast<void *>(GetProcAddress(g_magModule, "MagUninitialize")));
+    g_magSetEffect = reinterpret_cast<MagSetFullscreenColorEffectFn>(
+        reinterpret_cast<void *>(GetProcAddress(g_magModule, "MagSetFullscreenColorEffect")));
+
+    if (!g_magInit || !g_magUninit || !g_magSetEffect)
+    {
+      UnloadMagnification();
+      return false;
+    }
+    return true;
+  }
+
+  BOOL CALLBACK CollectMonitorProc(HMONITOR hMonitor, HDC, LPRECT, LPARAM dwData)
+  {
+    auto *outputs = reinterpret_cast<std::vector<DisplayOutput> *>(dwData);
+    DisplayOutput output;
+    output.handle = reinterpret_cast<OutputHandle>(hMonitor);
+
+    MONITORINFOEX monitorInfoEx;
+    monitorInfoEx.cbSize = sizeof(MONITORINFOEX);
+    if (GetMonitorInfo(hMonitor, &monitorInfoEx))
+      output.deviceName = monitorInfoEx.szDevice;
+
+    outputs->push_back(output);
+    return TRUE;
+  }
+}
+
+WinDisplayBackend::~WinDisplayBackend()
+{
+  for (auto &entry : m_dcs)
+    DeleteDC(entry.second);
+  m_dcs.clear();
+}
+
+// -----------------------------------------------------------------------------------------------
+// Enumeration & Gamma
+// -----------------------------------------------------------------------------------------------
+
+std::vector<DisplayOutput> WinDisplayBackend::EnumerateOutputs()
+{
+  TRACE_SCOPE("EnumDisplayMonitors");
+  std::vector<DisplayOutput> outputs;
+  EnumDisplayMonitors(nullptr, nullptr, CollectMonitorProc, reinterpret_cast<LPARAM>(&outputs));
+  return outputs;
+}
+
+bool WinDisplayBackend::OpenOutput(OutputHandle output)
+{
+  HMONITOR hMonitor = reinterpret_cast<HMONITOR>(output);
+  MONITORINFOEX monitorInfoEx;
+  monitorInfoEx.cbSize = sizeof(MONITORINFOEX);
+  if (!GetMonitorInfo(hMonitor, &monitorInfoEx))
+    return false;
+
+  // Create a dedicated DC for this monitor for software brightness
+  HDC hdc = CreateDC(nullptr, monitorInfoEx.szDevice, nullptr, nullptr);
+  if (!hdc)
+    return false;
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  HDC &slot = m_dcs[output];
+  if (slot)
+    DeleteDC(slot);
+  slot = hdc;
+  return true;
+}
+
+void WinDisplayBackend::CloseOutput(OutputHandle output)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto it = m_dcs.find(output);
+  if (it == m_dcs.end())
+    return;
+  DeleteDC(it->second);
+  m_dcs.erase(it);
+}
+
+bool WinDisplayBackend::GetEdid(OutputHandle output, uint8_t *edid)
+{
+  TRACE_SCOPE("GetEdid");
+  MONITORINFOEX monitorInfoEx;
+  monitorInfoEx.cbSize = sizeof(MONITORINFOEX);
+  if (!GetMonitorInfo(reinterpret_cast<HMONITOR>(output), &monitorInfoEx))
+    return false;
+
+  // The monitor attached to the adapter output, as a device interface path.
+  // Only the first one is considered; that is the one dxva2 drives too.
+  DISPLAY_DEVICE device = {};
+  device.cb = sizeof(device);
+  if (!EnumDisplayDevices(monitorInfoEx.szDevice, 0, &device, EDD_GET_DEVICE_INTERFACE_NAME) ||
+      !device.DeviceID[0])
+    return false;
+
+  // The driver copies the EDID into the device's hardware registry key.
+  HDEVINFO devices = SetupDiCreateDeviceInfoList(nullptr, nullptr);
+  if (devices == INVALID_HANDLE_VALUE)
+    return false;
+
+  bool found = false;
+  SP_DEVICE_INTERFACE_DATA interfaceData = {};
+  interfaceData.cbSize = sizeof(interfaceData);
+  SP_DEVINFO_DATA deviceData = {};
+  deviceData.cbSize = sizeof(deviceData);
+  if (SetupDiOpenDeviceInterface(devices, device.DeviceID, 0, &interfaceData))
+  {
+    // Called for deviceData only; the detail buffer is not needed.
+    SetupDiGetDeviceInterfaceDetail(devices, &interfaceData, nullptr, 0, nullptr, &deviceData);
+    HKEY key = SetupDiOpenDevRegKey(devices, &deviceData, DICS_FLAG_GLOBAL, 0, DIREG_DEV, KEY_READ);
+    if (key != INVALID_HANDLE_VALUE)
+    {
+      BYTE block[256];
+      DWORD size = sizeof(block);
+      DWORD type = 0;
+      if (RegQueryValueEx(key, L"EDID", nullptr, &type, block, &size) == ERROR_SUCCESS && type == REG_BINARY &&
+          size >= DdcCi::EDID_LENGTH)
+      {
+        std::memcpy(edid, block, DdcCi::EDID_LENGTH);
+        found = true;
+      }
+      RegCloseKey(key);
+    }
+  }
+  SetupDiDestroyDeviceInfoList(devices);
+  return found;
+}
+
+int WinDisplayBackend::GetRefreshRate(OutputHandle output)
+{
+  MONITORINFOEX monitorInfoEx;
+  monitorInfoEx.cbSize = sizeof(MONITORINFOEX);
+  if (!GetMonitorInfo(reinterpret_cast<HMONITOR>(output), &monitorInfoEx))
+    return 0;
+
+  DEVMODE mode = {};
+  mode.dmSize = sizeof(DEVMODE);
+  if (!EnumDisplaySettings(monitorInfoEx.szDevice, ENUM_CURRENT_SETTINGS, &mode))
+    return 0;
+
+  // 0 and 1 both mean "hardware default" rather than a rate.
+  return mode.dmDisplayFrequency > 1 ? static_cast<int>(mode.dmDisplayFrequency) : 0;
+}
+
+HDC WinDisplayBackend::FindDC(OutputHandle output)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto it = m_dcs.find(output);
+  return it == m_dcs.end() ? nullptr : it->second;
+}
+
+int WinDisplayBackend::GetGammaSize(OutputHandle)
+{
+  // GDI ramps are always 256 entries per channel.
+  return ColorTempUtils::GAMMA_RAMP_ENTRIES;
+}
+
+bool WinDisplayBackend::GetGammaRamp(OutputHandle output, uint16_t *ramp)
+{
+  HDC hdc = FindDC(output);
+  return hdc && GetDeviceGammaRamp(hdc, ramp);
+}
+
+bool WinDisplayBackend::SetGammaRamp(OutputHandle output, const uint16_t *ramp)
+{
+  TRACE_SCOPE("SetDeviceGammaRamp");
+  HDC hdc = FindDC(output);
+  // SetDeviceGammaRamp takes a non-const pointer but does not modify the ramp.
+  return hdc && SetDeviceGammaRamp(hdc, const_cast<uint16_t *>(ramp));
+}
+
+bool WinDisplayBackend::FlushGamma()
+{
+  // SetDeviceGammaRamp is synchronous; nothing is ever queued.
+  return true;
+}
+
+// -----------------------------------------------------------------------------------------------
+// DDC/CI
+// -----------------------------------------------------------------------------------------------
+
+int WinDisplayBackend::CountDdcEndpoints(OutputHandle output)
+{
+  DWORD monitorCount = 0;
+  if (!GetNumberOfPhysicalMonitorsFromHMONITOR(reinterpret_cast<HMONITOR>(output), &monitorCount))
+    return 0;
+  return static_cast<int>(monitorCount);
+}
+
+std::vector<DdcHandle> WinDisplayBackend::OpenDdc(OutputHandle output)
+{
+  HMONITOR hMonitor = reinterpret_cast<HMONITOR>(output);
+  DWORD monitorCount = 0;
+  if (!GetNumberOfPhysicalMonitorsFromHMONITOR(hMonitor, &monitorCount) || monitorCount == 0)
+    return {};
+
+  std::vector<PHYSICAL_MONITOR> physicalMonitors(monitorCount);
+  {
+    TRACE_SCOPE_ARG("GetPhysicalMonitorsFromHMONITOR", "count", monitorCount);
+    if (!GetPhysicalMonitorsFromHMONITOR(hMonitor, monitorCount, physicalMonitors.data()))
+      return {};
+  }
+
+  // Cloned and daisy-chained displays list one physical monitor each. Null
+  // handles (common right after a mode change) are dropped; the caller
+  // decides whether to retry for them.
+  std::vector<DdcHandle> endpoints;
+  for (const PHYSICAL_MONITOR &physical : physicalMonitors)
+  {
+    if (physical.hPhysicalMonitor)
+      endpoints.push_back(reinterpret_cast<DdcHandle>(physical.hPhysicalMonitor));
+  }
+  return endpoints;
+}
+
+void WinDisplayBackend::CloseDdc(DdcHandle ddc)
+{
+  if (ddc)
+    DestroyPhysicalMonitor(reinterpret_cast<HANDLE>(ddc));
+}
+
+bool WinDisplayBackend::GetDdcBrightness(DdcHandle ddc, uint32_t &minValue, uint32_t &currentValue, uint32_t &maxValue)
+{
+  TRACE_SCOPE("GetMonitorBrightness");
+  DWORD minB, curB, maxB;
+  if (!GetMonitorBrightness(reinterpret_cast<HANDLE>(ddc), &minB, &curB, &maxB))
+    return false;
+  minValue = minB;
+  currentValue = curB;
+  maxValue = maxB;
+  return true;
+}
+
+bool WinDisplayBackend::SetDdcBrightness(DdcHandle ddc, uint32_t value)
+{
+  TRACE_SCOPE_ARG("SetMonitorBrightness", "value", value);
+  return SetMonitorBrightness(reinterpret_cast<HANDLE>(ddc), value) != FALSE;
+}
+
+// -----------------------------------------------------------------------------------------------
+// Colour Matrix
+// -----------------------------------------------------------------------------------------------
+
+bool WinDisplayBackend::InitColorEffects()
+{
+  if (g_magInitialized)
+    return true;
+  if (!LoadMagnification())
+    return false;
+  if (!g_magInit())
+    return false;
+  g_magInitialized = true;
+  return true;
+}
+
+void WinDisplayBackend::ShutdownColorEffects()
+{
+  if (!g_magInitialized)
+    return;
+  if (g_magSetEffect)
+    g_magSetEffect(&kIdentity);
+  if (g_magUninit)
+    g_magUninit();
+  g_magInitialized = false;
+  UnloadMagnification();
+}
+
+bool WinDisplayBackend::SetColorMatrix(const ColorMatrix &matrix)
+{
+  if (!g_magInitialized && !InitColorEffects())
+    return false;
+
+  MAGCOLOREFFECT effect;
+  for (int row = 0; row < 5; ++row)
+    for (int col = 0; col < 5; ++col)
+      effect.transform[row][col] = matrix.m[row][col];
+  return g_magSetEffect(&effect) != FALSE;
+}
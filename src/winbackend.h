@@ -0,0 +1,47 @@
+#pragma once
+#include "displaybackend.h"
+#include <windows.h>
+#include <map>
+#include <mutex>
+
+/**
+ * @brief DisplayBackend for Windows.
+ *
+ * - Enumeration:   EnumDisplayMonitors / GetMonitorInfo (OutputHandle = HMONITOR)
+ * - Gamma:         a per-monitor DC and Get/SetDeviceGammaRamp
+ * - DDC/CI:        dxva2 physical monitors (DdcHandle = physical monitor HANDLE)
+ * - Colour matrix: Magnification.dll, MagSetFullscreenColorEffect
+ */
+class WinDisplayBackend : public DisplayBackend
+{
+public:
+  WinDisplayBackend() = default;
+  ~WinDisplayBackend() override;
+
+  std::vector<DisplayOutput> EnumerateOutputs() override;
+  bool OpenOutput(OutputHandle output) override;
+  void CloseOutput(OutputHandle output) override;
+  bool GetEdid(OutputHandle output, uint8_t *edid) override;
+  int GetRefreshRate(OutputHandle output) override;
+
+  int GetGammaSize(OutputHandle output) override;
+  bool GetGammaRamp(OutputHandle output, uint16_t *ramp) override;
+  bool SetGammaRamp(OutputHandle output, const uint16_t *ramp) override;
+  bool FlushGamma() override;
+
+  int CountDdcEndpoints(OutputHandle output) override;
+  std::vector<DdcHandle> OpenDdc(OutputHandle output) override;
+  void CloseDdc(DdcHandle ddc) override;
+  bool GetDdcBrightness(DdcHandle ddc, uint32_t &minValue, uint32_t &currentValue, uint32_t &maxValue) override;
+  bool SetDdcBrightness(DdcHandle ddc, uint32_t value) override;
+
+  bool InitColorEffects() override;
+  void ShutdownColorEffects() override;
+  bool SetColorMatrix(const ColorMatrix &matrix) override;
+
+private:
+  HDC FindDC(OutputHandle output);
+
+  std::mutex m_mutex; // Guards m_dcs; outputs are opened from probe threads
+  std::map<OutputHandle, HDC> m_dcs;
+};
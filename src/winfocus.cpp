@@ -0,0 +1,102 @@
+#include "winfocus.h"
+
+namespace
+{
+  // WinEvent callbacks carry no context pointer
+  WinFocusSource *g_started = nullptr;
+
+  // Executable file name of the process owning @p hwnd, or empty if the
+  // process cannot be queried (an elevated one, from a normal-rights Candela)
+  std::wstring ProcessName(HWND hwnd)
+  {
+    DWORD processId = 0;
+    GetWindowThreadProcessId(hwnd, &processId);
+    HANDLE process = processId ? OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, processId) : nullptr;
+    if (!process)
+      return std::wstring();
+    wchar_t path[MAX_PATH];
+    DWORD length = MAX_PATH;
+    std::wstring name;
+    if (QueryFullProcessImageNameW(process, 0, path, &length))
+    {
+      name.assign(path, length);
+      size_t slash = name.find_last_of(L"\\/");
+      if (slash != std::wstring::npos)
+        name.erase(0, slash + 1);
+    }
+    CloseHandle(process);
+    return name;
+  }
+}
+
+WinFocusSource::~WinFocusSource()
+{
+  Stop();
+}
+
+bool WinFocusSource::Start(Callback callback)
+{
+  if (g_started && g_started != this)
+    return false;
+  Stop();
+
+  m_foregroundHook = SetWinEventHook(EVENT_SYSTEM_FOREGROUND, EVENT_SYSTEM_FOREGROUND, nullptr, OnWinEvent, 0, 0,
+                                     WINEVENT_OUTOFCONTEXT | WINEVENT_SKIPOWNPROCESS);
+  if (!m_foregroundHook)
+    return false;
+  // Title changes are reported for every window and control in the session;
+  // OnWinEvent drops all but the foreground window's own
+  m_titleHook = SetWinEventHook(EVENT_OBJECT_NAMECHANGE, EVENT_OBJECT_NAMECHANGE, nullptr, OnWinEvent, 0, 0,
+                                WINEVENT_OUTOFCONTEXT | WINEVENT_SKIPOWNPROCESS);
+  m_callback = std::move(callback);
+  g_started = this;
+
+  if (HWND foreground = GetForegroundWindow())
+    Report(foreground, false);
+  return true;
+}
+
+void WinFocusSource::Stop()
+{
+  if (m_foregroundHook)
+    UnhookWinEvent(m_foregroundHook);
+  if (m_titleHook)
+    UnhookWinEvent(m_titleHook);
+  m_foregroundHook = nullptr;
+  m_titleHook = nullptr;
+  m_callback = nullptr;
+  m_foreground = nullptr;
+  m_process.clear();
+  if (g_started == this)
+    g_started = nullptr;
+}
+
+std::string WinFocusSource::Describe() const
+{
+  return m_titleHook ? "WinEvent foreground and title hooks" : "WinEvent foreground hook";
+}
+
+void CALLBACK WinFocusSource::OnWinEvent(HWINEVENTHOOK, DWORD event, HWND hwnd, LONG idObject, LONG idChild, DWORD,
+                                         DWORD)
+{
+  if (!g_started || !hwnd || idObject != OBJID_WINDOW || idChild != CHILDID_SELF)
+    return;
+  if (event == EVENT_SYSTEM_FOREGROUND)
+    g_started->Report(hwnd, false);
+  else if (event == EVENT_OBJECT_NAMECHANGE && hwnd == g_started->m_foreground)
+    g_started->Report(hwnd, true);
+}
+
+void WinFocusSource::Report(HWND hwnd, bool titleOnly)
+{
+  if (!titleOnly)
+  {
+    m_foreground = hwnd;
+    m_process = ProcessName(hwnd);
+  }
+  wchar_t title[512];
+  int length = GetWindowTextW(hwnd, title, static_cast<int>(sizeof(title) / sizeof(title[0])));
+  FocusEvent focus{m_process, std::wstring(title, length > 0 ? length : 0)};
+  if (m_callback)
+    m_callback(focus);
+}
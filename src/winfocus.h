@@ -0,0 +1,34 @@
+#pragma once
+#include "profiles.h"
+#include <windows.h>
+
+/**
+ * @brief FocusSource for Windows, built on WinEvent hooks: the foreground
+ *        window changing (EVENT_SYSTEM_FOREGROUND) and the foreground
+ *        window's title changing (EVENT_OBJECT_NAMECHANGE).
+ *
+ * The hooks are out of context, so events arrive through the message loop
+ * of the thread that called Start; nothing polls. Only one instance can be
+ * started at a time.
+ */
+class WinFocusSource : public FocusSource
+{
+public:
+  WinFocusSource() = default;
+  ~WinFocusSource() override;
+
+  bool Start(Callback callback) override;
+  void Stop() override;
+  std::string Describe() const override;
+
+private:
+  static void CALLBACK OnWinEvent(HWINEVENTHOOK hook, DWORD event, HWND hwnd, LONG idObject, LONG idChild,
+                                  DWORD eventThread, DWORD eventTime);
+  void Report(HWND hwnd, bool titleOnly);
+
+  Callback m_callback;
+  HWINEVENTHOOK m_foregroundHook = nullptr;
+  HWINEVENTHOOK m_titleHook = nullptr;
+  HWND m_foreground = nullptr;
+  std::wstring m_process; // Of m_foreground, looked up once per foreground change
+};
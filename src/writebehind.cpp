@@ -0,0 +1,108 @@
+#include "writebehind.h"
+#include "trace.h"
+#include <utility>
+
+WriteBehind::WriteBehind(FlushFn flush, std::chrono::milliseconds quietPeriod)
+    : m_flush(std::move(flush)),
+      m_quietPeriod(quietPeriod)
+{
+}
+
+WriteBehind::~WriteBehind()
+{
+  Stop();
+}
+
+void WriteBehind::Request()
+{
+  bool stopped;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stats.requests++;
+    stopped = m_stopping;
+    if (!stopped)
+    {
+      m_pending = true;
+      m_lastRequest = std::chrono::steady_clock::now();
+      if (!m_thread.joinable())
+        m_thread = std::thread(&WriteBehind::Run, this);
+    }
+  }
+
+  // After Stop() there is no thread left to defer to.
+  if (stopped)
+    RunFlush();
+  else
+    m_cv.notify_all();
+}
+
+void WriteBehind::FlushNow()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_pending = false;
+  }
+  RunFlush();
+}
+
+void WriteBehind::Stop()
+{
+  bool pending;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stopping = true;
+    pending = m_pending;
+    m_pending = false;
+  }
+  m_cv.notify_all();
+  if (m_thread.joinable())
+    m_thread.join();
+  if (pending)
+    RunFlush();
+}
+
+WriteBehind::Stats WriteBehind::GetStats() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_stats;
+}
+
+void WriteBehind::RunFlush()
+{
+  std::lock_guard<std::mutex> flushLock(m_flushMutex);
+  m_flush();
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_stats.flushes++;
+}
+
+void WriteBehind::Run()
+{
+  Trace::SetThreadName("write-behind");
+  std::unique_lock<std::mutex> lock(m_mutex);
+  for (;;)
+  {
+    m_cv.wait(lock, [this]
+              { return m_stopping || m_pending; });
+    if (m_stopping)
+      return; // Stop() runs the pending flush itself
+
+    // Wait out the quiet period, restarting it whenever another request
+    // lands in the meantime.
+    while (m_pending && !m_stopping)
+    {
+      auto deadline = m_lastRequest + m_quietPeriod;
+      if (std::chrono::steady_clock::now() >= deadline)
+        break;
+      m_cv.wait_until(lock, deadline);
+    }
+    if (m_stopping)
+      return;
+    if (!m_pending)
+      continue; // FlushNow took it over
+
+    m_pending = false;
+    lock.unlock();
+    RunFlush();
+    lock.lock();
+  }
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+/**
+ * @brief Debounced background flusher for persisted state.
+ *
+ * Request() marks the owner's state as changed; the flush callback runs on
+ * a background thread once no further request has arrived for the quiet
+ * period, so a burst of changes (a slider drag) costs one flush. The owner
+ * keeps track of *what* changed; this class only decides *when* to write.
+ *
+ * The flush callback never runs concurrently with itself. The thread is
+ * started by the first Request(), so an owner that never changes anything
+ * never creates one.
+ */
+class WriteBehind
+{
+public:
+  using FlushFn = std::function<void()>;
+
+  /**
+   * @brief Counters describing how much the debounce absorbed.
+   */
+  struct Stats
+  {
+    uint64_t requests = 0; // Request() calls
+    uint64_t flushes = 0;  // Times the flush callback ran
+  };
+
+  explicit WriteBehind(FlushFn flush,
+                       std::chrono::milliseconds quietPeriod = std::chrono::milliseconds(500));
+
+  /**
+   * @brief Stops the thread, running any pending flush first.
+   */
+  ~WriteBehind();
+
+  WriteBehind(const WriteBehind &) = delete;
+  WriteBehind &operator=(const WriteBehind &) = delete;
+
+  /**
+   * @brief Schedules a flush one quiet period from now, pushing back any
+   *        flush already scheduled.
+   */
+  void Request();
+
+  /**
+   * @brief Runs the flush callback on the calling thread now, taking over
+   *        any scheduled flush.
+   */
+  void FlushNow();
+
+  /**
+   * @brief Stops and joins the thread, flushing first if a flush is pending.
+   *        Requests made afterwards flush synchronously. Safe to call more
+   *        than once.
+   */
+  void Stop();
+
+  Stats GetStats() const;
+
+private:
+  void Run();
+  void RunFlush();
+
+  FlushFn m_flush;
+  std::chrono::milliseconds m_quietPeriod;
+
+  mutable std::mutex m_mutex;
+  std::condition_variable m_cv;
+  std::chrono::steady_clock::time_point m_lastRequest;
+  bool m_pending = false;
+  bool m_stopping = false;
+  Stats m_stats;
+  std::thread m_thread;
+
+  std::mutex m_flushMutex; // Serialises the callback between the thread and FlushNow
+};
@@ -0,0 +1,303 @@
+#include "x11backend.h"
+#include <X11/Xlib.h>
+#include <X11/extensions/Xrandr.h>
+#include <algorithm>
+#include <atomic>
+
+// Xlib reports protocol errors through one process-wide handler. Count them,
+// so FlushGamma can tell whether anything it sent was rejected (BadValue for
+// a wrong ramp size, BadRRCrtc for a CRTC that went away).
+namespace
+{
+  std::atomic<unsigned long> g_xErrors(0);
+  XErrorHandler g_previousHandler = nullptr;
+
+  int CountXError(Display *, XErrorEvent *)
+  {
+    g_xErrors++;
+    return 0;
+  }
+}
+
+X11DisplayBackend::X11DisplayBackend(const char *displayName)
+{
+  m_display = XOpenDisplay(displayName);
+  if (!m_display)
+    return;
+  g_previousHandler = XSetErrorHandler(CountXError);
+
+  // Per-CRTC gamma arrived with RandR 1.2.
+  int eventBase = 0, errorBase = 0, major = 0, minor = 0;
+  m_randr = XRRQueryExtension(m_display, &eventBase, &errorBase) &&
+            XRRQueryVersion(m_display, &major, &minor) &&
+            (major > 1 || (major == 1 && minor >= 2));
+}
+
+X11DisplayBackend::~X11DisplayBackend()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  for (auto &entry : m_outputs)
+  {
+    if (entry.second.gamma)
+      XRRFreeGamma(entry.second.gamma);
+  }
+  m_outputs.clear();
+  if (m_display)
+  {
+    XCloseDisplay(m_display);
+    XSetErrorHandler(g_previousHandler);
+  }
+}
+
+bool X11DisplayBackend::IsConnected() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_display && m_randr;
+}
+
+X11DisplayBackend::X11Output *X11DisplayBackend::FindOpen(OutputHandle output)
+{
+  auto it = m_outputs.find(output);
+  return it == m_outputs.end() || !it->second.gamma ? nullptr : &it->second;
+}
+
+// -----------------------------------------------------------------------------------------------
+// Enumeration
+// -----------------------------------------------------------------------------------------------
+
+std::vector<DisplayOutput> X11DisplayBackend::EnumerateOutputs()
+{
+  std::vector<DisplayOutput> outputs;
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (!m_display || !m_randr)
+    return outputs;
+
+  // The "Current" variant returns the server's cached configuration instead
+  // of re-probing every connector, which keeps enumeration cheap.
+  XRRScreenResources *resources = XRRGetScreenResourcesCurrent(m_display, DefaultRootWindow(m_display));
+  if (!resources)
+    return outputs;
+
+  for (int i = 0; i < resources->noutput; ++i)
+  {
+    XRROutputInfo *info = XRRGetOutputInfo(m_display, resources, resources->outputs[i]);
+    if (!info)
+      continue;
+
+    // Disconnected or disabled outputs have no CRTC and therefore no gamma.
+    if (info->connection == RR_Connected && info->crtc)
+    {
+      DisplayOutput output;
+      output.handle = static_cast<OutputHandle>(resources->outputs[i]);
+      output.deviceName.assign(info->name, info->name + info->nameLen);
+      outputs.push_back(output);
+
+      X11Output &state = m_outputs[output.handle];
+      if (state.crtc != info->crtc && state.gamma)
+      {
+        // Moved to another CRTC since it was opened; force a reopen.
+        XRRFreeGamma(state.gamma);
+        state.gamma = nullptr;
+      }
+      state.crtc = info->crtc;
+    }
+    XRRFreeOutputInfo(info);
+  }
+  XRRFreeScreenResources(resources);
+  return outputs;
+}
+
+bool X11DisplayBackend::OpenOutput(OutputHandle output)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto it = m_outputs.find(output);
+  if (!m_display || it == m_outputs.end() || !it->second.crtc)
+    return false;
+
+  int size = XRRGetCrtcGammaSize(m_display, it->second.crtc);
+  if (size <= 0)
+    return false;
+
+  X11Output &state = it->second;
+  if (state.gamma && state.gamma->size != size)
+  {
+    XRRFreeGamma(state.gamma);
+    state.gamma = nullptr;
+  }
+  if (!state.gamma)
+    state.gamma = XRRAllocGamma(size);
+  return state.gamma != nullptr;
+}
+
+void X11DisplayBackend::CloseOutput(OutputHandle output)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (X11Output *state = FindOpen(output))
+  {
+    XRRFreeGamma(state->gamma);
+    state->gamma = nullptr;
+  }
+}
+
+bool X11DisplayBackend::GetEdid(OutputHandle output, uint8_t *edid)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (!m_display || !m_randr)
+    return false;
+
+  // Drivers publish the connector's EDID as the "EDID" output property.
+  Atom edidAtom = XInternAtom(m_display, "EDID", True);
+  if (edidAtom == None)
+    return false;
+
+  Atom actualType = None;
+  int actualFormat = 0;
+  unsigned long items = 0, bytesAfter = 0;
+  unsigned char *data = nullptr;
+  if (XRRGetOutputProperty(m_display, static_cast<RROutput>(output), edidAtom, 0, 128 / 4, False, False,
+                           AnyPropertyType, &actualType, &actualFormat, &items, &bytesAfter, &data) != Success)
+    return false;
+
+  bool ok = data && actualFormat == 8 && items >= 128;
+  if (ok)
+    std::copy(data, data + 128, edid);
+  if (data)
+    XFree(data);
+  return ok;
+}
+
+int X11DisplayBackend::GetRefreshRate(OutputHandle output)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto it = m_outputs.find(output);
+  if (!m_display || !m_randr || it == m_outputs.end() || !it->second.crtc)
+    return 0;
+
+  XRRScreenResources *resources = XRRGetScreenResourcesCurrent(m_display, DefaultRootWindow(m_display));
+  if (!resources)
+    return 0;
+
+  // RandR has no refresh field; derive it from the CRTC's mode timings.
+  int hz = 0;
+  if (XRRCrtcInfo *crtc = XRRGetCrtcInfo(m_display, resources, it->second.crtc))
+  {
+    for (int i = 0; i < resources->nmode; ++i)
+    {
+      const XRRModeInfo &mode = resources->modes[i];
+      if (mode.id == crtc->mode && mode.hTotal && mode.vTotal)
+        hz = static_cast<int>(static_cast<double>(mode.dotClock) / (static_cast<double>(mode.hTotal) * mode.vTotal) + 0.5);
+    }
+    XRRFreeCrtcInfo(crtc);
+  }
+  XRRFreeScreenResources(resources);
+  return hz;
+}
+
+// -----------------------------------------------------------------------------------------------
+// Gamma
+// -----------------------------------------------------------------------------------------------
+
+int X11DisplayBackend::GetGammaSize(OutputHandle output)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  X11Output *state = FindOpen(output);
+  return state ? state->gamma->size : 0;
+}
+
+bool X11DisplayBackend::GetGammaRamp(OutputHandle output, uint16_t *ramp)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  X11Output *state = FindOpen(output);
+  if (!state)
+    return false;
+
+  XRRCrtcGamma *current = XRRGetCrtcGamma(m_display, state->crtc);
+  if (!current)
+    return false;
+
+  // The size can only differ if the mode changed under us; the caller will
+  // re-enumerate, so report failure rather than a truncated ramp.
+  bool ok = current->size == state->gamma->size;
+  if (ok)
+  {
+    const int size = current->size;
+    std::copy(current->red, current->red + size, ramp);
+    std::copy(current->green, current->green + size, ramp + size);
+    std::copy(current->blue, current->blue + size, ramp + size * 2);
+  }
+  XRRFreeGamma(current);
+  return ok;
+}
+
+bool X11DisplayBackend::SetGammaRamp(OutputHandle output, const uint16_t *ramp)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  X11Output *state = FindOpen(output);
+  if (!state)
+    return false;
+
+  // Fill the buffer allocated at open time; no allocation per write.
+  const int size = state->gamma->size;
+  std::copy(ramp, ramp + size, state->gamma->red);
+  std::copy(ramp + size, ramp + size * 2, state->gamma->green);
+  std::copy(ramp + size * 2, ramp + size * 3, state->gamma->blue);
+
+  // Queued in Xlib's output buffer; nothing reaches the server until FlushGamma.
+  XRRSetCrtcGamma(m_display, state->crtc, state->gamma);
+  m_pending = true;
+  return true;
+}
+
+bool X11DisplayBackend::FlushGamma()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (!m_display || !m_pending)
+    return true;
+
+  unsigned long errorsBefore = g_xErrors;
+  XSync(m_display, False);
+  m_pending = false;
+  return g_xErrors == errorsBefore;
+}
+
+// -----------------------------------------------------------------------------------------------
+// DDC/CI & Colour matrix (not available through X11)
+// -----------------------------------------------------------------------------------------------
+
+int X11DisplayBackend::CountDdcEndpoints(OutputHandle)
+{
+  return 0;
+}
+
+std::vector<DdcHandle> X11DisplayBackend::OpenDdc(OutputHandle)
+{
+  return {};
+}
+
+void X11DisplayBackend::CloseDdc(DdcHandle)
+{
+}
+
+bool X11DisplayBackend::GetDdcBrightness(DdcHandle, uint32_t &, uint32_t &, uint32_t &)
+{
+  return false;
+}
+
+bool X11DisplayBackend::SetDdcBrightness(DdcHandle, uint32_t)
+{
+  return false;
+}
+
+bool X11DisplayBackend::InitColorEffects()
+{
+  return false;
+}
+
+void X11DisplayBackend::ShutdownColorEffects()
+{
+}
+
+bool X11DisplayBackend::SetColorMatrix(const ColorMatrix &)
+{
+  return false;
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include "displaybackend.h"
+#include <map>
+#include <mutex>
+
+// Xlib types, forward-declared so this header does not drag Xlib's macros
+// (Bool, Status, None, ...) into every file that includes it.
+struct _XDisplay;
+struct _XRRCrtcGamma;
+
+/**
+ * @brief DisplayBackend for Linux desktops running an X server.
+ *
+ * - Enumeration:   XRandR 1.2+ connected outputs driven by a CRTC
+ *                  (OutputHandle = RROutput, deviceName = output name, e.g. "DP-1")
+ * - Gamma:         the CRTC's gamma table at the size XRRGetCrtcGammaSize
+ *                  reports. SetGammaRamp only queues the request; FlushGamma
+ *                  sends every queued CRTC and waits once, so a multi-monitor
+ *                  update costs one round trip.
+ * - DDC/CI:        not provided
+ * - Colour matrix: not provided
+ *
+ * Works headless under Xvfb, whose RandR screen exposes a CRTC with gamma.
+ */
+class X11DisplayBackend : public DisplayBackend
+{
+public:
+  /**
+   * @param displayName X display to open, or nullptr for $DISPLAY.
+   */
+  explicit X11DisplayBackend(const char *displayName = nullptr);
+  ~X11DisplayBackend() override;
+
+  X11DisplayBackend(const X11DisplayBackend &) = delete;
+  X11DisplayBackend &operator=(const X11DisplayBackend &) = delete;
+
+  /**
+   * @brief true if the display opened and supports RandR 1.2 or later.
+   */
+  bool IsConnected() const;
+
+  std::vector<DisplayOutput> EnumerateOutputs() override;
+  bool OpenOutput(OutputHandle output) override;
+  void CloseOutput(OutputHandle output) override;
+  bool GetEdid(OutputHandle output, uint8_t *edid) override;
+  int GetRefreshRate(OutputHandle output) override;
+
+  int GetGammaSize(OutputHandle output) override;
+  bool GetGammaRamp(OutputHandle output, uint16_t *ramp) override;
+  bool SetGammaRamp(OutputHandle output, const uint16_t *ramp) override;
+  bool FlushGamma() override;
+
+  int CountDdcEndpoints(OutputHandle output) override;
+  std::vector<DdcHandle> OpenDdc(OutputHandle output) override;
+  void CloseDdc(DdcHandle ddc) override;
+  bool GetDdcBrightness(DdcHandle ddc, uint32_t &minValue, uint32_t &currentValue, uint32_t &maxValue) override;
+  bool SetDdcBrightness(DdcHandle ddc, uint32_t value) override;
+
+  bool InitColorEffects() override;
+  void ShutdownColorEffects() override;
+  bool SetColorMatrix(const ColorMatrix &matrix) override;
+
+private:
+  struct X11Output
+  {
+    unsigned long crtc = 0;         // RRCrtc driving the output, from the last enumeration
+    _XRRCrtcGamma *gamma = nullptr; // Allocated by OpenOutput and reused for every write
+  };
+
+  X11Output *FindOpen(OutputHandle output); // Called with m_mutex held
+
+  mutable std::mutex m_mutex; // Xlib is not thread-safe; every call on m_display holds it
+  _XDisplay *m_display = nullptr;
+  bool m_randr = false;
+  bool m_pending = false; // SetGammaRamp requests waiting for FlushGamma
+  std::map<OutputHandle, X11Output> m_outputs;
+};
@@ -0,0 +1,310 @@
+// Unit tests for BrightnessController against FakeDisplayBackend: monitor
+// enumeration, the ramps software brightness and colour temperature put on
+// each output, argument checking, batched flushing and the ramp cache, and
+// hardware brightness through the DDC/CI probe and workers.
+//
+// Usage: test_brightness
+
+#include "unittest.h"
+#include "brightness.h"
+#include "colortemp.h"
+#include "ddcsim.h"
+#include "fakebackend.h"
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+  // Installs a fake desk for one test and takes it down again afterwards, so
+  // every test starts from an empty controller.
+  struct Desk
+  {
+    std::shared_ptr<FakeDisplayBackend> backend = std::make_shared<FakeDisplayBackend>();
+    std::vector<OutputHandle> outputs;
+    std::vector<std::shared_ptr<SimulatedDdcMonitor>> ddc;
+
+    OutputHandle Add(int gammaSize = 256, std::shared_ptr<SimulatedDdcMonitor> monitor = nullptr)
+    {
+      std::wstring name = L"\\\\.\\DISPLAY" + std::to_wstring(outputs.size() + 1);
+      outputs.push_back(backend->AddOutput(name, monitor, gammaSize));
+      ddc.push_back(monitor);
+      return outputs.back();
+    }
+
+    bool Install()
+    {
+      SetDisplayBackend(backend);
+      return BrightnessController::RefreshMonitors();
+    }
+
+    ~Desk()
+    {
+      BrightnessController::Cleanup();
+      SetDisplayBackend(nullptr);
+    }
+
+    // True if the output shows exactly the ramp BuildGammaRamp makes for the
+    // given settings at the output's own size.
+    bool Shows(int index, int brightness, int kelvin) const
+    {
+      const Monitor &monitor = BrightnessController::GetMonitors()[index];
+      ColorTempUtils::GammaRampOptions opts;
+      opts.brightness = brightness;
+      opts.kelvin = kelvin;
+      opts.entries = monitor.gammaSize;
+      std::vector<uint16_t> expected(static_cast<size_t>(monitor.gammaSize) * 3);
+      std::vector<uint16_t> actual(expected.size());
+      ColorTempUtils::BuildGammaRamp(opts, expected.data());
+      return backend->PeekGammaRamp(outputs[index], actual.data()) && actual == expected;
+    }
+  };
+
+  std::shared_ptr<SimulatedDdcMonitor> FastDdc(uint32_t nativeMin = 0, uint32_t nativeMax = 100)
+  {
+    return std::make_shared<SimulatedDdcMonitor>(nativeMin, nativeMax, std::chrono::milliseconds(1));
+  }
+
+  // Sets a hardware brightness and blocks until every endpoint finished with it.
+  DdcResult SetHardwareAndWait(int index, int brightness)
+  {
+    std::mutex mutex;
+    std::condition_variable finished;
+    bool done = false;
+    DdcResult result = DdcResult::Cancelled;
+    bool queued = BrightnessController::SetHardwareBrightness(index, brightness, [&](const HardwareWriteReport &report) {
+      std::lock_guard<std::mutex> lock(mutex);
+      result = report.Overall();
+      done = true;
+      finished.notify_all();
+    });
+    if (!queued)
+      return DdcResult::Failed;
+    std::unique_lock<std::mutex> lock(mutex);
+    if (!finished.wait_for(lock, std::chrono::seconds(5), [&] { return done; }))
+      return DdcResult::Cancelled;
+    return result;
+  }
+}
+
+TEST(RefreshListsEveryOutput)
+{
+  Desk desk;
+  desk.Add();
+  desk.Add(1024);
+  EXPECT(desk.Install());
+
+  const auto &monitors = BrightnessController::GetMonitors();
+  EXPECT(monitors.size() == 2);
+  EXPECT(BrightnessController::GetMonitorCount() == 2);
+  EXPECT(monitors[0].hasGamma && monitors[1].hasGamma);
+  EXPECT(monitors[1].gammaSize == 1024);
+  EXPECT(BrightnessController::GetDeviceName(1) == L"\\\\.\\DISPLAY2");
+  EXPECT(BrightnessController::GetDeviceName(2).empty());
+}
+
+TEST(SoftwareBrightnessWritesTheRamp)
+{
+  Desk desk;
+  desk.Add();
+  desk.Add(4096);
+  EXPECT(desk.Install());
+
+  EXPECT(BrightnessController::SetSoftwareBrightness(0, 40));
+  EXPECT(BrightnessController::GetSoftwareBrightness(0) == 40);
+  EXPECT(desk.Shows(0, 40, ColorTempUtils::KELVIN_DEFAULT));
+
+  EXPECT(BrightnessController::SetSoftwareLevels(1, 70, 3400));
+  EXPECT(BrightnessController::GetSoftwareColorTemp(1) == 3400);
+  EXPECT(desk.Shows(1, 70, 3400));
+  EXPECT(desk.Shows(0, 40, ColorTempUtils::KELVIN_DEFAULT));
+}
+
+TEST(OutOfRangeValuesAreClamped)
+{
+  Desk desk;
+  desk.Add();
+  EXPECT(desk.Install());
+
+  EXPECT(BrightnessController::SetSoftwareBrightness(0, 0));
+  EXPECT(BrightnessController::GetSoftwareBrightness(0) == ColorTempUtils::BRIGHTNESS_MIN);
+  EXPECT(BrightnessController::SetSoftwareBrightness(0, 250));
+  EXPECT(BrightnessController::GetSoftwareBrightness(0) == ColorTempUtils::BRIGHTNESS_MAX);
+
+  EXPECT(BrightnessController::SetSoftwareColorTemp(0, 100));
+  EXPECT(BrightnessController::GetSoftwareColorTemp(0) == ColorTempUtils::KELVIN_MIN);
+  EXPECT(BrightnessController::SetSoftwareColorTemp(0, 20000));
+  EXPECT(BrightnessController::GetSoftwareColorTemp(0) == ColorTempUtils::KELVIN_MAX);
+  EXPECT(desk.Shows(0, ColorTempUtils::BRIGHTNESS_MAX, ColorTempUtils::KELVIN_MAX));
+}
+
+TEST(InvalidIndexIsRejected)
+{
+  Desk desk;
+  desk.Add();
+  EXPECT(desk.Install());
+  uint64_t writes = desk.backend->GetCounters().gammaWrites;
+
+  EXPECT(!BrightnessController::SetSoftwareBrightness(-1, 50));
+  EXPECT(!BrightnessController::SetSoftwareBrightness(1, 50));
+  EXPECT(!BrightnessController::SetSoftwareColorTemp(1, 4000));
+  EXPECT(!BrightnessController::SetHardwareBrightness(1, 50));
+  EXPECT(BrightnessController::GetSoftwareBrightness(1) == -1);
+  EXPECT(BrightnessController::GetHardwareBrightness(-1) == -1);
+  EXPECT(desk.backend->GetCounters().gammaWrites == writes);
+}
+
+TEST(OutputWithoutGammaIsRefused)
+{
+  Desk desk;
+  desk.Add();
+  desk.backend->SetGammaUnsupported(desk.Add());
+  EXPECT(desk.Install());
+
+  EXPECT(BrightnessController::GetMonitors().size() == 2);
+  EXPECT(!BrightnessController::GetMonitors()[1].hasGamma);
+  EXPECT(!BrightnessController::SetSoftwareBrightness(1, 50));
+  EXPECT(BrightnessController::SetSoftwareBrightness(0, 50));
+}
+
+TEST(BatchFlushesOnce)
+{
+  Desk desk;
+  for (int i = 0; i < 3; ++i)
+    desk.Add();
+  EXPECT(desk.Install());
+  GammaRampStats before = BrightnessController::GetGammaRampStats();
+  uint64_t flushes = desk.backend->GetCounters().gammaFlushes;
+
+  BrightnessController::BeginUpdate();
+  for (int i = 0; i < 3; ++i)
+    BrightnessController::SetSoftwareLevels(i, 30 + i, 4500);
+  EXPECT(BrightnessController::EndUpdate());
+
+  GammaRampStats after = BrightnessController::GetGammaRampStats();
+  EXPECT(after.writesIssued - before.writesIssued == 3);
+  EXPECT(after.flushes - before.flushes == 1);
+  EXPECT(desk.backend->GetCounters().gammaFlushes - flushes == 1);
+  for (int i = 0; i < 3; ++i)
+    EXPECT(desk.Shows(i, 30 + i, 4500));
+}
+
+TEST(RepeatedValueIsNotRewritten)
+{
+  Desk desk;
+  desk.Add();
+  EXPECT(desk.Install());
+
+  EXPECT(BrightnessController::SetSoftwareLevels(0, 55, 5000));
+  GammaRampStats before = BrightnessController::GetGammaRampStats();
+  uint64_t writes = desk.backend->GetCounters().gammaWrites;
+
+  EXPECT(BrightnessController::SetSoftwareLevels(0, 55, 5000));
+  GammaRampStats after = BrightnessController::GetGammaRampStats();
+  EXPECT(after.writesSkipped - before.writesSkipped == 1);
+  EXPECT(after.writesIssued == before.writesIssued);
+  EXPECT(desk.backend->GetCounters().gammaWrites == writes);
+}
+
+TEST(RampCacheServesRepeatedSettings)
+{
+  Desk desk;
+  desk.Add();
+  desk.Add();
+  EXPECT(desk.Install());
+
+  EXPECT(BrightnessController::SetSoftwareLevels(0, 35, 3800));
+  GammaRampStats before = BrightnessController::GetGammaRampStats();
+  EXPECT(BrightnessController::SetSoftwareLevels(1, 35, 3800));
+  GammaRampStats after = BrightnessController::GetGammaRampStats();
+  EXPECT(after.cacheHits - before.cacheHits == 1);
+  EXPECT(after.cacheMisses == before.cacheMisses);
+  EXPECT(desk.Shows(1, 35, 3800));
+}
+
+TEST(RefreshReadsTheShownRampBack)
+{
+  Desk desk;
+  desk.Add();
+  ColorTempUtils::GammaRampOptions opts;
+  opts.brightness = 60;
+  opts.kelvin = 4000;
+  std::vector<uint16_t> ramp(256 * 3);
+  ColorTempUtils::BuildGammaRamp(opts, ramp.data());
+  desk.backend->OverwriteGammaRamp(desk.outputs[0], ramp.data());
+  EXPECT(desk.Install());
+
+  EXPECT(BrightnessController::GetSoftwareBrightness(0) == 60);
+  EXPECT(BrightnessController::GetSoftwareColorTemp(0) == 4000);
+}
+
+TEST(RefreshProbesDdcBrightness)
+{
+  Desk desk;
+  auto monitor = FastDdc(0, 200);
+  monitor->SetBrightness(100);
+  desk.Add(256, monitor);
+  desk.Add();
+  EXPECT(desk.Install());
+
+  const auto &monitors = BrightnessController::GetMonitors();
+  EXPECT(monitors[0].supportsHardwareBrightness);
+  EXPECT(!monitors[1].supportsHardwareBrightness);
+  EXPECT(BrightnessController::GetHardwareProbeState(0) == HardwareProbeState::Available);
+  EXPECT(BrightnessController::GetHardwareProbeState(1) == HardwareProbeState::Unavailable);
+  EXPECT(BrightnessController::GetHardwareBrightness(0) == 50);
+}
+
+TEST(HardwareBrightnessReachesTheMonitor)
+{
+  Desk desk;
+  auto monitor = FastDdc(0, 200);
+  desk.Add(256, monitor);
+  EXPECT(desk.Install());
+
+  EXPECT(SetHardwareAndWait(0, 30) == DdcResult::Applied);
+  EXPECT(monitor->GetCurrent() == 60);
+  EXPECT(BrightnessController::GetHardwareBrightness(0) == 30);
+}
+
+TEST(RejectedHardwareWriteIsReported)
+{
+  Desk desk;
+  auto monitor = FastDdc();
+  desk.Add(256, monitor);
+  EXPECT(desk.Install());
+  uint32_t shown = monitor->GetCurrent();
+
+  monitor->SetFailEvery(1);
+  EXPECT(SetHardwareAndWait(0, 20) == DdcResult::Failed);
+  EXPECT(monitor->GetCurrent() == shown);
+  monitor->SetFailEvery(0);
+}
+
+TEST(BackgroundProbeStartsPending)
+{
+  Desk desk;
+  auto monitor = FastDdc();
+  monitor->SetBrightness(70);
+  desk.Add(256, monitor);
+  SetDisplayBackend(desk.backend);
+  EXPECT(BrightnessController::RefreshOutputs());
+
+  EXPECT(BrightnessController::GetHardwareProbeState(0) == HardwareProbeState::Pending);
+  EXPECT(BrightnessController::SetSoftwareBrightness(0, 45));
+  EXPECT(BrightnessController::StartHardwareProbe());
+  BrightnessController::WaitForHardwareProbe();
+
+  EXPECT(BrightnessController::GetHardwareProbeState(0) == HardwareProbeState::Available);
+  EXPECT(BrightnessController::GetHardwareBrightness(0) == 70);
+  EXPECT(BrightnessController::GetSoftwareBrightness(0) == 45);
+}
+
+int main()
+{
+  return UnitTest::RunAll();
+}
@@ -0,0 +1,64 @@
+// Minimal unit test harness for the tests under tests/: TEST registers a
+// case, EXPECT records a failed condition without stopping the case, and
+// RunAll runs every case in the order it was defined. Each test file is its
+// own executable; make test builds and runs them all.
+
+#pragma once
+#include <cstdio>
+#include <vector>
+
+namespace UnitTest
+{
+  struct Case
+  {
+    const char *name;
+    void (*run)();
+  };
+
+  inline std::vector<Case> &Cases()
+  {
+    static std::vector<Case> cases;
+    return cases;
+  }
+
+  inline int &CaseFailures()
+  {
+    static int failures = 0;
+    return failures;
+  }
+
+  struct Register
+  {
+    Register(const char *name, void (*run)()) { Cases().push_back({name, run}); }
+  };
+
+  inline void Expect(bool ok, const char *condition, const char *file, int line)
+  {
+    if (ok)
+      return;
+    std::printf("    %s:%d: expected %s\n", file, line, condition);
+    CaseFailures()++;
+  }
+
+  // Returns the process exit code: 0 if every case passed
+  inline int RunAll()
+  {
+    int failed = 0;
+    for (const Case &test : Cases())
+    {
+      CaseFailures() = 0;
+      test.run();
+      std::printf("  %-60s %s\n", test.name, CaseFailures() ? "FAIL" : "ok");
+      failed += CaseFailures() ? 1 : 0;
+    }
+    std::printf("%zu test(s), %d failed\n", Cases().size(), failed);
+    return failed ? 1 : 0;
+  }
+}
+
+#define TEST(name)                                          \
+  static void name();                                       \
+  static const UnitTest::Register name##Registration(#name, name); \
+  static void name()
+
+#define EXPECT(condition) UnitTest::Expect((condition), #condition, __FILE__, __LINE__)